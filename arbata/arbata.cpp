@@ -1,6 +1,7 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 
 #include <arbor/assert_macro.hpp>
 #include <arbor/common_types.hpp>
@@ -10,7 +11,6 @@
 #include <arbor/spike_source_cell.hpp>
 #include <arbor/profile/meter_manager.hpp>
 #include <arbor/profile/profiler.hpp>
-#include <arbor/simple_sampler.hpp>
 #include <arbor/simulation.hpp>
 #include <arbor/recipe.hpp>
 #include <arbor/version.hpp>
@@ -22,10 +22,16 @@
 #include <sonata/sonata_io.hpp>
 #include <sonata/sonata_recipe.hpp>
 #include <sonata/sonata_cell.hpp>
+#include <sonata/async_writer.hpp>
+#include <sonata/cell_cost.hpp>
+#include <sonata/h5_io_stats.hpp>
+#include <sonata/partition.hpp>
+#include <sonata/phase_profiler.hpp>
+#include <sonata/report_writer.hpp>
+#include <sonata/spike_writer.hpp>
 
 #ifdef ARB_MPI_ENABLED
 #include <mpi.h>
-#include <arborenv/with_mpi.hpp>
 #endif
 
 using arb::cell_gid_type;
@@ -35,6 +41,21 @@ using arb::cell_member_type;
 using arb::cell_kind;
 using arb::time_type;
 
+#ifdef ARB_MPI_ENABLED
+// MPI with MPI_THREAD_MULTIPLE, for MPI-IO reads of the inputs on the I/O thread and the output blocks gathered or
+// written on the writer thread while the simulation thread communicates
+struct with_mpi_multiple {
+    with_mpi_multiple(int& argc, char**& argv) {
+        int provided;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+        MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
+    }
+    ~with_mpi_multiple() {
+        MPI_Finalize();
+    }
+};
+#endif
+
 int main(int argc, char **argv)
 {
     try {
@@ -48,8 +69,10 @@ int main(int argc, char **argv)
             resources.num_threads = arbenv::thread_concurrency();
         }
 
+        auto opts = sonata::parse_options(argc, argv);
+
 #ifdef ARB_MPI_ENABLED
-        arbenv::with_mpi guard(argc, argv, false);
+        with_mpi_multiple guard(argc, argv);
         resources.gpu_id = arbenv::find_private_gpu(MPI_COMM_WORLD);
         auto context = arb::make_context(resources, MPI_COMM_WORLD);
         root = arb::rank(context) == 0;
@@ -68,42 +91,216 @@ int main(int argc, char **argv)
         std::cout << "mpi:      " << (has_mpi(context)? "yes": "no") << "\n";
         std::cout << "ranks:    " << num_ranks(context) << "\n" << std::endl;
 
-        auto params = sonata::read_options(argc, argv);
+        // The text input files are read once and broadcast: reading them is collective from here on
+#ifdef ARB_MPI_ENABLED
+        sonata::share_input_files(opts.read_inputs, MPI_COMM_WORLD);
+
+        // With MPI-IO, opening the hdf5 input files is collective from here on
+        if (sonata::set_h5_access(opts.hdf5_driver, MPI_COMM_WORLD) != opts.hdf5_driver && root) {
+            std::cout << "hdf5 driver mpio requires parallel hdf5 and MPI_THREAD_MULTIPLE, reading the inputs with sec2\n";
+        }
+#endif
+        // Small hdf5 inputs are read from memory
+        sonata::set_h5_core_threshold(opts.core_threshold);
+
+        // Wall time and memory use of the phases of the run, reported with --bench
+#ifdef ARB_MPI_ENABLED
+        sonata::phase_profiler phases(MPI_COMM_WORLD);
+#else
+        sonata::phase_profiler phases;
+#endif
+
+        // Reads of the hdf5 input files, when the library is built with SONATA_H5_INSTRUMENTATION
+        sonata::h5_instrumentation_enable(opts.bench);
+
+        phases.start("config");
+        auto params = sonata::read_options(opts.config_file);
 
         arb::profile::meter_manager meters;
         meters.start(context);
 
         // Create an instance of our recipe.
+        phases.start("recipe");
         sonata::sonata_recipe recipe(params);
 
-        auto decomp = arb::partition_load_balance(recipe, context);
+        phases.start("partition");
+        bool graph_partition = params.partition.method == "graph";
+        sonata::cost_model cost_model;
+        sonata::cell_graph graph;
+        if (graph_partition) {
+            graph = recipe.get_cell_graph(params.partition.use_positions, cost_model);
+        }
+        auto decomp = graph_partition?
+            sonata::partition_network(recipe, graph, context, params.partition):
+            arb::partition_load_balance(recipe, context);
+
+        // Predicted and measured cost of the cells of every rank
+        auto gather_load = [&](double local_time) {
+#ifdef ARB_MPI_ENABLED
+            return sonata::gather_load(graph.features, cost_model, decomp, local_time, MPI_COMM_WORLD);
+#else
+            return sonata::gather_load(graph.features, cost_model, decomp, local_time);
+#endif
+        };
+
+        if (graph_partition && params.partition.calibration_time > 0) {
+            // Fit the cost model to the time of a short pilot run, and partition again
+            recipe.build_local_maps(decomp);
+            {
+                arb::simulation pilot(recipe, context, decomp);
+                recipe.finish_loading();
+                // The I/O thread is stopped and there is no output, so only the simulation threads run
+                auto start = sonata::process_cpu_time();
+                pilot.run(params.partition.calibration_time, params.run.dt);
+                auto load = gather_load(sonata::process_cpu_time() - start);
+                if (root) {
+                    std::cout << "pilot run: predicted imbalance " << load.predicted_imbalance() << ", "
+                              << "measured imbalance " << load.measured_imbalance() << "\n";
+                }
+                cost_model = cost_model.calibrate(load.terms, load.measured);
+            }
+            graph.costs = cost_model.estimate(graph.features);
+            decomp = sonata::partition_network(recipe, graph, context, params.partition);
+        }
+
+        if (graph_partition) {
+            std::vector<unsigned> parts(graph.size());
+            for (cell_gid_type gid = 0; gid < graph.size(); gid++) {
+                parts[gid] = decomp.gid_domain(gid);
+            }
+            auto stats = sonata::evaluate_partition(graph, parts, num_ranks(context));
+            if (root) {
+                std::cout << "partition: cost imbalance " << stats.imbalance() << ", "
+                          << stats.cut_edges << " of " << stats.total_edges << " edges between ranks\n";
+            }
+        }
 
+        phases.start("local-maps");
         recipe.build_local_maps(decomp);
+        if (params.run.coalesce_synapses) {
+            unsigned long coalesced = recipe.get_num_coalesced_targets();
+#ifdef ARB_MPI_ENABLED
+            MPI_Allreduce(MPI_IN_PLACE, &coalesced, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+#endif
+            if (root) {
+                std::cout << "synapses: " << coalesced << " synapse instances saved by coalescing targets\n";
+            }
+        }
 
         // Construct the model.
+        phases.start("simulation-init");
         arb::simulation sim(recipe, context, decomp);
 
-        // Set up the probes that will measure voltages in the cells.
-        std::unordered_map<cell_member_type, sonata::trace_info> traces;
-        auto sched = arb::regular_schedule(0.1);
+        // Reads of the hdf5 inputs while building the cells, summed over the ranks
+        auto io = recipe.get_io_stats();
+        recipe.close_inputs();
+        unsigned long io_counts[] = {io.blocks, io.bytes, io.hits, io.misses};
+#ifdef ARB_MPI_ENABLED
+        MPI_Allreduce(MPI_IN_PLACE, io_counts, 4, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+#endif
+        if (root && params.run.prefetch_inputs) {
+            std::cout << "inputs: " << io_counts[0] << " blocks (" << io_counts[1]/(1024.*1024.) << " MiB) prefetched, "
+                      << io_counts[2] << " of " << io_counts[2] + io_counts[3] << " reads served from them\n";
+        }
+
+        // Density mechanisms of the cells; every one is instantiated once per cell group using it
+        auto mechanisms = recipe.get_mechanism_summary(decomp.groups());
+        if (root) {
+            std::cout << "mechanisms: " << mechanisms.mechanisms << " density mechanisms, "
+                      << mechanisms.derived << " derived from global parameters; "
+                      << mechanisms.total_instances() << " instances in " << mechanisms.group_instances.size()
+                      << " cell groups, at most " << mechanisms.max_instances() << " per group\n";
+            for (const auto& [base, n]: mechanisms.variants) {
+                std::cout << "  " << base << ": " << n << " derived mechanisms\n";
+            }
+        }
+
+        phases.start("output-init");
 
+        // arbor runs the simulation in epochs of half the shortest delay of the network, after which the
+        // reports are flushed: their buffers hold the samples of an epoch
+        double epoch = recipe.get_min_delay()/2;
+#ifdef ARB_MPI_ENABLED
+        MPI_Allreduce(MPI_IN_PLACE, &epoch, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+#endif
+
+        // Locations of the local probes.
+        std::unordered_map<cell_member_type, arb::mlocation> probe_locations;
+        for (const auto& group: decomp.groups()) {
+            for (auto gid: group.gids) {
+                for (auto p: recipe.get_probes_info(gid)) {
+                    probe_locations[{gid, p.idx}] = p.info.loc;
+                }
+            }
+        }
 
-        for (unsigned gid = 0; gid < recipe.num_cells(); gid++) {
-            auto pbs = recipe.get_probes_info(gid);
-            for (auto p:pbs) {
-                sonata::trace_info t(p.info.is_voltage, p.info.loc);
-                traces[{gid, p.idx}] = t;
+        // Output blocks are written on a background thread while the simulation continues;
+        // declared before the writers using it, so that it outlives them.
+        std::unique_ptr<sonata::async_writer> output_writer;
+        if (params.output.write_async) {
+            output_writer = std::make_unique<sonata::async_writer>(params.output.queue_depth);
+        }
+
+        // Set up the reports: every rank samples its local probes of each report file straight
+        // into the report's buffers, and appends the buffered samples to the file after each epoch.
+        auto probe_groups = recipe.get_probe_groups();
+        std::vector<std::unique_ptr<sonata::report_writer>> reports;
+
+        for (const auto& info: sonata::report_files(params.probes_info)) {
+#ifdef ARB_MPI_ENABLED
+            auto report = std::make_unique<sonata::report_writer>(info, recipe.get_pop_names(), recipe.get_pop_partitions(), MPI_COMM_WORLD);
+#else
+            auto report = std::make_unique<sonata::report_writer>(info, recipe.get_pop_names(), recipe.get_pop_partitions());
+#endif
+            std::vector<std::pair<cell_member_type, arb::mlocation>> probes;
+            for (auto probe: probe_groups[info.file_name]) {
+                probes.emplace_back(probe, probe_locations.at(probe));
+            }
+            report->open(probes, epoch);
+            report->set_async_writer(output_writer.get());
 
-                sim.add_sampler(arb::one_probe({gid, p.idx}), sched, arb::make_simple_sampler(traces[{gid, p.idx}].data));
+            for (auto p: probes) {
+                sim.add_sampler(arb::one_probe(p.first), report->schedule(), report->sampler(report->column(p.first)));
             }
+            reports.push_back(std::move(report));
         }
 
-        // Set up recording of spikes to a vector on the root process.
-        std::vector<arb::spike> recorded_spikes;
+        sim.set_epoch_callback(
+                [&reports](double t, double) {
+                    for (auto& report: reports) {
+                        report->flush(t);
+                    }
+                });
+
+        auto spike_order = sonata::spike_order_from_string(params.spike_output.sort_by);
+
+        // Set up streaming of spikes to the output file on the root process,
+        // or recording of the local spikes of every rank for parallel output.
+        std::unique_ptr<sonata::spike_writer> spike_output;
+#ifdef ARB_MPI_ENABLED
+        std::unique_ptr<sonata::parallel_spike_writer> parallel_spike_output;
+        if (params.spike_output.write_mode == "parallel") {
+            parallel_spike_output = std::make_unique<sonata::parallel_spike_writer>(params.spike_output.file_name,
+                                                                                    spike_order,
+                                                                                    recipe.get_pop_names(),
+                                                                                    recipe.get_pop_partitions(),
+                                                                                    MPI_COMM_WORLD);
+            sim.set_local_spike_callback(
+                    [&parallel_spike_output](const std::vector<arb::spike>& spikes) {
+                        parallel_spike_output->append(spikes);
+                    });
+        }
+        else
+#endif
         if (root) {
+            spike_output = std::make_unique<sonata::spike_writer>(params.spike_output.file_name,
+                                                                  spike_order,
+                                                                  recipe.get_pop_names(),
+                                                                  recipe.get_pop_partitions());
+            spike_output->set_async_writer(output_writer.get());
             sim.set_global_spike_callback(
-                    [&recorded_spikes](const std::vector<arb::spike>& spikes) {
-                        recorded_spikes.insert(recorded_spikes.end(), spikes.begin(), spikes.end());
+                    [&spike_output](const std::vector<arb::spike>& spikes) {
+                        spike_output->append(spikes);
                     });
         }
 
@@ -111,21 +308,143 @@ int main(int argc, char **argv)
 
         std::cout << "running simulation" << std::endl;
         // Run the simulation for 100 ms, with time steps of 0.025 ms.
+        phases.start("run");
+        // CPU time of the simulation threads: that of the process without the writer thread
+        auto simulation_cpu_time = [&output_writer] {
+            return sonata::process_cpu_time() - (output_writer? output_writer->get_stats().cpu_time: 0.);
+        };
+        auto run_start = simulation_cpu_time();
         sim.run(params.run.duration, params.run.dt);
 
+        phases.start("output");
+
+        // Finish the writes in flight before the files are closed on this thread
+        if (output_writer) {
+            output_writer->drain();
+            if (root) {
+                auto stats = output_writer->get_stats();
+                std::cout << "output writer: " << stats.num_tasks << " blocks written in " << stats.write_time << " s "
+                          << "(" << stats.cpu_time << " s CPU), "
+                          << "max queue depth " << stats.max_queue_depth << ", "
+                          << "simulation waited " << stats.wait_time << " s\n";
+            }
+        }
+        // The writes of the run still running when it ended are only counted once drained
+        auto run_time = simulation_cpu_time() - run_start;
+
         meters.checkpoint("model-run", context);
 
+        // CPU time of every rank in the run against the cost predicted for its cells
+        std::optional<sonata::load_report> load;
+        if (graph_partition) {
+            load = gather_load(run_time);
+            if (root) {
+                std::cout << "load: predicted imbalance " << load->predicted_imbalance() << ", "
+                          << "measured imbalance " << load->measured_imbalance() << "\n";
+            }
+        }
+
         auto ns = sim.num_spikes();
 
 
-        // Write spikes to file
+        // Finish writing spikes to file
         if (root) {
             std::cout << "\n" << ns << " spikes generated \n";
-            sonata::write_spikes(recorded_spikes, params.spike_output.sort_by == "time", params.spike_output.file_name, recipe.get_pop_names(), recipe.get_pop_partitions());
         }
+        if (spike_output) {
+            spike_output->close();
+        }
+#ifdef ARB_MPI_ENABLED
+        if (parallel_spike_output) {
+            parallel_spike_output->close();
+        }
+#endif
+
+        // Write the remaining samples to the report files.
+        for (auto& report: reports) {
+            report->close();
+        }
+        phases.stop();
+
+        if (opts.bench) {
+            // Size of the local part of the network
+            phases.record("local_cells", decomp.num_local_cells());
+            phases.record("cell_groups", decomp.num_groups());
+            phases.record("connections", recipe.get_num_connections(decomp.groups()));
+            phases.record("coalesced_targets", recipe.get_num_coalesced_targets());
+            auto templates = recipe.get_template_stats();
+            phases.record("cell_templates", templates.size);
+            phases.record("cell_template_hits", templates.hits);
+            phases.record("density_mechanisms", mechanisms.mechanisms);
+            phases.record("derived_mechanisms", mechanisms.derived);
+            phases.record("mechanism_instances", mechanisms.total_instances());
+            phases.record("prefetch_blocks", io.blocks);
+            phases.record("prefetch_hits", io.hits);
+            phases.record("prefetch_misses", io.misses);
+            auto input_files = sonata::input_file_statistics();
+            phases.record("input_files_read", input_files.read);
+            phases.record("input_files_received", input_files.received);
+            // Every rank records the same quantities: the probes of all report files, also those without local probes
+            for (const auto& info: sonata::report_files(params.probes_info)) {
+                auto it = probe_groups.find(info.file_name);
+                phases.record("probes " + info.file_name, it == probe_groups.end()? 0: it->second.size());
+            }
+            phases.record("io_desc_bytes", recipe.get_io_desc_bytes());
+
+            auto bench = phases.report();
+            bench["arbor_version"] = arb::version;
+            bench["threads"] = num_threads(context);
+            bench["cells"] = recipe.num_cells();
+            bench["spikes"] = ns;
+            bench["config"] = opts.config_file;
+            bench["hdf5_driver"] = sonata::h5_input_driver() == sonata::h5_driver::mpio? "mpio": "sec2";
+            bench["hdf5_core_threshold"] = sonata::h5_core_threshold();
+            if (load) {
+                bench["load"] = {{"predicted", load->predicted}, {"measured", load->measured},
+                                 {"weights", cost_model.weights()}};
+            }
 
-        // Write the samples to a json file.
-        if (root) write_trace(traces, recipe.get_probe_groups(), recipe.get_pop_names(), recipe.get_pop_partitions());
+            // Reads of the root rank, the datasets with most read time first
+            auto h5_reads = sonata::h5_read_summary();
+            if (sonata::h5_instrumentation_available()) {
+                bench["h5_reads"] = nlohmann::json::array();
+                for (const auto& r: h5_reads) {
+                    bench["h5_reads"].push_back({{"path", r.path},
+                                                 {"reads", r.reads},
+                                                 {"elements", r.elements},
+                                                 {"bytes", r.bytes},
+                                                 {"all", r.selections[(int)sonata::h5_selection::all]},
+                                                 {"hyperslab", r.selections[(int)sonata::h5_selection::hyperslab]},
+                                                 {"point", r.selections[(int)sonata::h5_selection::point]},
+                                                 {"time", r.time},
+                                                 {"chunk_hits", r.chunk_hits},
+                                                 {"chunk_misses", r.chunk_misses}});
+                }
+            }
+            auto h5_caches = sonata::h5_file_cache_summary();
+            if (sonata::h5_instrumentation_available()) {
+                bench["h5_metadata_cache"] = nlohmann::json::array();
+                for (const auto& c: h5_caches) {
+                    bench["h5_metadata_cache"].push_back({{"file", c.file}, {"hit_rate", c.metadata_hit_rate}});
+                }
+            }
+
+            if (root) {
+                std::cout << "\n";
+                sonata::phase_profiler::print(std::cout, bench);
+                if (sonata::h5_instrumentation_available()) {
+                    std::cout << "\nhdf5 reads:\n";
+                    sonata::print_h5_read_summary(std::cout, h5_reads);
+                    std::cout << "\nhdf5 metadata cache hit rates:\n";
+                    for (const auto& c: h5_caches) {
+                        std::cout << "  " << c.file << ": " << c.metadata_hit_rate << "\n";
+                    }
+                }
+                if (!opts.profile_json.empty()) {
+                    std::ofstream(opts.profile_json) << bench.dump(2) << "\n";
+                }
+            }
+        }
 
         auto report = arb::profile::make_meter_report(meters, context);
         std::cout << report;
@@ -133,6 +452,9 @@ int main(int argc, char **argv)
         auto summary = arb::profile::profiler_summary();
         std::cout << summary << "\n";
 
+        sonata::unshare_input_files();
+        sonata::reset_h5_access();
+        sonata::reset_h5_cache();
     }
     catch (arb::arbor_exception& e) {
         std::cerr << "Arbor exception caught in SONATA miniapp: " << e.what() << "\n";
@@ -0,0 +1,69 @@
+// Time of sorting random spikes with sort_spikes and with std::sort, for example/benchmark/spike_sort.py
+//
+//     spike-sort-bench <spikes> <gids> [threads] [repeat]
+//
+// Prints one json object per order with the fastest time (s) of `repeat` sorts of the same spikes.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <arbor/spike.hpp>
+
+#include <sonata/spike_sort.hpp>
+
+using sonata::spike_order;
+
+// Spikes of `num_gids` gids at uniform random times in [0, 1000) ms, in the order of epochs of 1 ms as the
+// simulation delivers them: sorted by time between the epochs, in any order within them
+static std::vector<arb::spike> make_spikes(std::size_t num_spikes, unsigned num_gids) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<unsigned> gid(0, num_gids - 1);
+    std::uniform_real_distribution<double> time(0., 1000.);
+
+    std::vector<arb::spike> spikes(num_spikes);
+    for (auto& s: spikes) {
+        s.source = {gid(rng), 0};
+        s.time = time(rng);
+    }
+    std::sort(spikes.begin(), spikes.end(), [](const auto& a, const auto& b) { return int(a.time) < int(b.time); });
+    return spikes;
+}
+
+// Fastest of `repeat` runs of `sort` on copies of `spikes`
+template <typename F>
+static double min_time(const std::vector<arb::spike>& spikes, unsigned repeat, F sort) {
+    double best = 0;
+    for (unsigned i = 0; i < repeat; i++) {
+        auto copy = spikes;
+        auto start = std::chrono::steady_clock::now();
+        sort(copy);
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        best = i? std::min(best, t.count()): t.count();
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <spikes> <gids> [threads] [repeat]\n";
+        return 1;
+    }
+    std::size_t num_spikes = std::stoul(argv[1]);
+    unsigned num_gids = std::stoul(argv[2]);
+    unsigned num_threads = argc > 3? std::stoul(argv[3]): 1;
+    unsigned repeat = argc > 4? std::stoul(argv[4]): 3;
+
+    auto spikes = make_spikes(num_spikes, std::max(num_gids, 1u));
+    for (auto order: {spike_order::by_id, spike_order::by_time}) {
+        auto radix = min_time(spikes, repeat, [&](auto& s) { sonata::sort_spikes(s, order, num_threads); });
+        auto baseline = min_time(spikes, repeat, [&](auto& s) { std::sort(s.begin(), s.end(), sonata::spike_less{order}); });
+        std::cout << "{\"order\": \"" << (order == spike_order::by_id? "id": "time") << "\", "
+                  << "\"spikes\": " << num_spikes << ", \"gids\": " << num_gids << ", \"threads\": " << num_threads << ", "
+                  << "\"radix\": " << radix << ", \"std_sort\": " << baseline << "}\n";
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+"""Running arbata and comparing its outputs, for the benchmarks of this directory."""
+
+import copy
+import json
+import os
+import subprocess
+
+import h5py
+import numpy as np
+
+
+def run(arbata, launcher, config, name, outdir, args=(), env=None):
+    """Run the simulation of `config` with outputs in a directory of `outdir` and the variables `env` added to the
+    environment; return the profile, the spikes file and the voltage report files."""
+    rundir = os.path.join(outdir, name.replace(" ", "_").replace("/", "-"))
+    os.makedirs(rundir, exist_ok=True)
+
+    config = copy.deepcopy(config)
+    config["outputs"]["spikes_file"] = os.path.join(rundir, "spikes.h5")
+    reports = {}
+    for report_name, report in config.get("reports", {}).items():
+        report["report_file"] = os.path.join(rundir, os.path.basename(report["report_file"]))
+        if report.get("variable_name") == "v":
+            reports[report_name] = report["report_file"]
+
+    config_file = os.path.join(rundir, "simulation_config.json")
+    profile_file = os.path.join(rundir, "profile.json")
+    with open(config_file, "w") as f:
+        json.dump(config, f, indent=2)
+
+    subprocess.run(launcher + [arbata, *args, "--profile-json", profile_file, config_file],
+                   check=True, stdout=subprocess.DEVNULL, env={**os.environ, **(env or {})})
+    with open(profile_file) as f:
+        profile = json.load(f)
+    return profile, config["outputs"]["spikes_file"], reports
+
+
+def read_spikes(file):
+    """Spike times per (population, node id)."""
+    trains = {}
+    with h5py.File(file, "r") as f:
+        for pop, group in f["spikes"].items():
+            ids = group["node_ids"][:]
+            times = group["timestamps"][:]
+            for i in np.unique(ids):
+                trains[(pop, i)] = np.sort(times[ids == i])
+    return trains
+
+
+def compare_spikes(trains, ref):
+    """Relative error of the spike count, and mean shift (ms) of the spikes present in both runs."""
+    count_error = 0
+    shifts = []
+    for key in set(trains) | set(ref):
+        a = trains.get(key, np.empty(0))
+        b = ref.get(key, np.empty(0))
+        count_error += abs(len(a) - len(b))
+        n = min(len(a), len(b))
+        shifts.extend(np.abs(a[:n] - b[:n]))
+    total = sum(len(t) for t in ref.values())
+    return count_error/max(total, 1), np.mean(shifts) if shifts else 0.
+
+
+def compare_reports(reports, ref):
+    """RMS difference (mV) of the voltage traces over all reports."""
+    sq, n = 0., 0
+    for name, file in reports.items():
+        with h5py.File(file, "r") as f, h5py.File(ref[name], "r") as g:
+            for pop in f["reports"]:
+                a = f["reports"][pop]["data"][:]
+                b = g["reports"][pop]["data"][:]
+                sq += np.sum((a - b)**2)
+                n += a.size
+    return np.sqrt(sq/n) if n else 0.
+
+
+def phase_wall(profile, name):
+    return next((p["wall_max"] for p in profile["phases"] if p["name"] == name), 0.)
@@ -0,0 +1,51 @@
+"""Wall time of building the cells of the example on 1, 2, 4, ... threads.
+
+Runs arbata with ARBENV_NUM_THREADS set to each thread count and prints the wall time of the simulation-init
+phase, where the cells are built, its speedup over one thread and the cell templates built. With --baseline, an
+older build (e.g. building the templates under the recipe lock) is run with the same settings for comparison.
+
+    python example/benchmark/cell_build.py build/bin/arbata example/simulation_config.json --baseline old/bin/arbata
+"""
+
+import argparse
+import json
+import os
+import shlex
+
+from bench_util import phase_wall, run
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("arbata", help="arbata executable")
+    parser.add_argument("config", help="simulation config")
+    parser.add_argument("--baseline", help="arbata executable to compare with")
+    parser.add_argument("--launcher", default="", help="command prefix, e.g. \"mpirun -n 4\"")
+    parser.add_argument("--outdir", default="cell_build_benchmark", help="directory of the outputs")
+    parser.add_argument("--max-threads", type=int, default=os.cpu_count(), help="largest thread count")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per setting, the fastest is reported")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+    launcher = shlex.split(args.launcher)
+    builds = [("current", args.arbata)] + ([("baseline", args.baseline)] if args.baseline else [])
+
+    print(f"{'build':<10}{'threads':>8}{'init (s)':>10}{'speedup':>9}{'templates':>11}")
+    threads = [1]
+    while threads[-1]*2 <= args.max_threads:
+        threads.append(threads[-1]*2)
+    for name, arbata in builds:
+        serial = None
+        for n in threads:
+            env = {"ARBENV_NUM_THREADS": str(n)}
+            runs = [run(arbata, launcher, config, f"{name}_{n}", args.outdir, env=env) for _ in range(args.repeat)]
+            profile = min((r[0] for r in runs), key=lambda p: phase_wall(p, "simulation-init"))
+            init = phase_wall(profile, "simulation-init")
+            serial = serial or init
+            templates = profile["statistics"].get("cell_templates", {}).get("sum", 0)
+            print(f"{name:<10}{n:>8}{init:>10.3f}{serial/init:>9.2f}{int(templates):>11}")
+
+
+if __name__ == "__main__":
+    main()
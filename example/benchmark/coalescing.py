@@ -0,0 +1,51 @@
+"""Wall time of the example with and without synapse coalescing.
+
+Runs arbata with run.coalesce_synapses off and on, and prints the synapse instances saved, the init
+and run wall time and the difference of the spikes and voltage traces of the two runs (rounding only).
+
+    python example/benchmark/coalescing.py build/bin/arbata example/simulation_config.json
+"""
+
+import argparse
+import copy
+import json
+import shlex
+
+from bench_util import compare_reports, compare_spikes, phase_wall, read_spikes, run
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("arbata", help="arbata executable")
+    parser.add_argument("config", help="simulation config")
+    parser.add_argument("--launcher", default="", help="command prefix, e.g. \"mpirun -n 4\"")
+    parser.add_argument("--outdir", default="coalescing_benchmark", help="directory of the outputs")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per setting, the fastest is reported")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+    launcher = shlex.split(args.launcher)
+
+    print(f"{'coalesce':<10}{'saved':>8}{'init (s)':>10}{'run (s)':>10}{'spikes':>8}{'count err':>11}{'V rms (mV)':>12}")
+    ref_spikes, ref_reports = None, None
+    for coalesce in [False, True]:
+        run_config = copy.deepcopy(config)
+        run_config["run"]["coalesce_synapses"] = coalesce
+        name = "coalesce" if coalesce else "separate"
+        runs = [run(args.arbata, launcher, run_config, name, args.outdir) for _ in range(args.repeat)]
+        profile, spikes_file, reports = min(runs, key=lambda r: phase_wall(r[0], "run"))
+
+        trains = read_spikes(spikes_file)
+        if ref_spikes is None:
+            ref_spikes, ref_reports = trains, reports
+        count_error, _ = compare_spikes(trains, ref_spikes)
+        v_rms = compare_reports(reports, ref_reports)
+        saved = profile["statistics"].get("coalesced_targets", {}).get("sum", 0)
+        print(f"{str(coalesce):<10}{int(saved):>8}{phase_wall(profile, 'simulation-init'):>10.3f}"
+              f"{phase_wall(profile, 'run'):>10.3f}{sum(len(t) for t in trains.values()):>8}"
+              f"{100*count_error:>10.1f}%{v_rms:>12.2e}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,60 @@
+"""Wall time against accuracy of the CV discretisation policies.
+
+Runs arbata once per policy in POLICIES, with the outputs of every run in its own directory, and
+compares the spikes and voltage traces of every run with those of the finest policy (the first one).
+
+    python example/benchmark/discretization.py build/bin/arbata example/simulation_config.json
+    python example/benchmark/discretization.py --launcher "mpirun -n 4" build/bin/arbata example/simulation_config.json
+"""
+
+import argparse
+import copy
+import json
+import shlex
+
+from bench_util import compare_reports, compare_spikes, phase_wall, read_spikes, run
+
+# Name and run.discretization section of every run; the first one is the reference
+POLICIES = [
+    ("max-extent 1um", {"policy": "max-extent", "max_extent": 1, "single_cv_soma": False}),
+    ("fixed 200/branch", {"policy": "fixed-per-branch", "cvs_per_branch": 200, "single_cv_soma": False}),
+    ("fixed 50/branch", {"policy": "fixed-per-branch", "cvs_per_branch": 50}),
+    ("fixed 10/branch", {"policy": "fixed-per-branch", "cvs_per_branch": 10}),
+    ("fixed 1/branch", {"policy": "fixed-per-branch", "cvs_per_branch": 1}),
+    ("max-extent 10um", {"policy": "max-extent", "max_extent": 10}),
+    ("max-extent 50um", {"policy": "max-extent", "max_extent": 50}),
+    ("max-extent 100um", {"policy": "max-extent", "max_extent": 100}),
+    ("explicit mid-branch", {"policy": "explicit", "locset": "(on-branches 0.5)"}),
+]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("arbata", help="arbata executable")
+    parser.add_argument("config", help="simulation config")
+    parser.add_argument("--launcher", default="", help="command prefix, e.g. \"mpirun -n 4\"")
+    parser.add_argument("--outdir", default="discretization_benchmark", help="directory of the outputs")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+    launcher = shlex.split(args.launcher)
+
+    print(f"{'policy':<22}{'init (s)':>10}{'run (s)':>10}{'spikes':>8}{'count err':>11}{'shift (ms)':>12}{'V rms (mV)':>12}")
+    ref_spikes, ref_reports = None, None
+    for name, discretization in POLICIES:
+        run_config = copy.deepcopy(config)
+        run_config["run"]["discretization"] = discretization
+        profile, spikes_file, reports = run(args.arbata, launcher, run_config, name, args.outdir)
+        trains = read_spikes(spikes_file)
+        if ref_spikes is None:
+            ref_spikes, ref_reports = trains, reports
+        count_error, shift = compare_spikes(trains, ref_spikes)
+        v_rms = compare_reports(reports, ref_reports)
+        num_spikes = sum(len(t) for t in trains.values())
+        print(f"{name:<22}{phase_wall(profile, 'simulation-init'):>10.3f}{phase_wall(profile, 'run'):>10.3f}"
+              f"{num_spikes:>8}{100*count_error:>10.1f}%{shift:>12.4f}{v_rms:>12.4f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+"""Read latency of the hdf5 inputs with the sec2 and core drivers.
+
+Runs arbata with the hdf5 node and spike input files read from disk (sec2, --h5-core-threshold 0) and loaded
+into memory (core; edge files are always read from disk), without reading ahead, and prints the mean time per read and per element of the most read datasets
+and the wall time of the phases reading them. Requires arbata built with -DSONATA_H5_INSTRUMENTATION=ON.
+
+    python example/benchmark/h5_driver.py build/bin/arbata example/simulation_config.json
+"""
+
+import argparse
+import copy
+import json
+import shlex
+
+from bench_util import phase_wall, run
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("arbata", help="arbata executable")
+    parser.add_argument("config", help="simulation config")
+    parser.add_argument("--launcher", default="", help="command prefix, e.g. \"mpirun -n 4\"")
+    parser.add_argument("--outdir", default="h5_driver_benchmark", help="directory of the outputs")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per driver, the fastest is reported")
+    parser.add_argument("--datasets", type=int, default=10, help="datasets shown, the most read first")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+    config["run"]["prefetch_inputs"] = False
+    launcher = shlex.split(args.launcher)
+
+    reads, walls = {}, {}
+    for driver, threshold in [("sec2", 0), ("core", 1 << 40)]:
+        runs = [run(args.arbata, launcher, copy.deepcopy(config), driver, args.outdir,
+                    ["--h5-core-threshold", str(threshold)]) for _ in range(args.repeat)]
+        profile = min(runs, key=lambda r: phase_wall(r[0], "simulation-init"))[0]
+        if "h5_reads" not in profile:
+            raise SystemExit("arbata is built without SONATA_H5_INSTRUMENTATION")
+        reads[driver] = {r["path"]: r for r in profile["h5_reads"]}
+        walls[driver] = [phase_wall(profile, p) for p in ["config", "local-maps", "simulation-init"]]
+
+    print(f"{'dataset':<50}{'reads':>9}{'sec2 (us/read)':>16}{'core (us/read)':>16}"
+          f"{'sec2 (ns/elem)':>16}{'core (ns/elem)':>16}")
+    paths = sorted((p for p in reads["sec2"] if p in reads["core"]), key=lambda p: -reads["sec2"][p]["reads"])
+    for path in paths[:args.datasets]:
+        sec2, core = reads["sec2"][path], reads["core"][path]
+        print(f"{path:<50}{sec2['reads']:>9}"
+              f"{1e6*sec2['time']/sec2['reads']:>16.2f}{1e6*core['time']/core['reads']:>16.2f}"
+              f"{1e9*sec2['time']/max(sec2['elements'], 1):>16.1f}{1e9*core['time']/max(core['elements'], 1):>16.1f}")
+
+    print()
+    print(f"{'driver':<8}{'config (s)':>12}{'local-maps (s)':>16}{'init (s)':>10}")
+    for driver, (config_time, maps_time, init_time) in walls.items():
+        print(f"{driver:<8}{config_time:>12.3f}{maps_time:>16.3f}{init_time:>10.3f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,41 @@
+"""Memory per rank of the spike, current clamp and probe maps as the number of ranks grows.
+
+Runs arbata on 1, 2, 4, ... ranks and prints, per rank count, the largest size of the local maps of the
+inputs (io_desc) over the ranks, the local cells of that rank count and the peak resident set size at
+the end of the local-maps phase. The maps only hold the local cells, so their size per rank falls as
+the ranks grow, instead of staying at the size of the network.
+
+    python example/benchmark/io_desc_memory.py build/bin/arbata example/simulation_config.json --ranks 1 2 4 8
+"""
+
+import argparse
+import json
+import shlex
+
+from bench_util import run
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("arbata", help="arbata executable")
+    parser.add_argument("config", help="simulation config")
+    parser.add_argument("--launcher", default="mpirun -n {ranks}", help="command prefix, {ranks} is the rank count")
+    parser.add_argument("--ranks", type=int, nargs="+", default=[1, 2, 4], help="rank counts")
+    parser.add_argument("--outdir", default="io_desc_memory_benchmark", help="directory of the outputs")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+
+    print(f"{'ranks':>6}{'cells/rank':>12}{'io_desc max (KiB)':>19}{'io_desc sum (KiB)':>19}{'peak rss (MiB)':>16}")
+    for ranks in args.ranks:
+        launcher = shlex.split(args.launcher.format(ranks=ranks))
+        profile = run(args.arbata, launcher, config, f"ranks_{ranks}", args.outdir)[0]
+        stats = profile["statistics"]
+        peak = next((p["peak_rss_max_mib"] for p in profile["phases"] if p["name"] == "local-maps"), 0.)
+        print(f"{ranks:>6}{int(stats['local_cells']['max']):>12}"
+              f"{stats['io_desc_bytes']['max']/1024:>19.1f}{stats['io_desc_bytes']['sum']/1024:>19.1f}{peak:>16.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,69 @@
+"""Cost of sampling the reports, per probe and time step.
+
+Runs arbata without reports, then with the reports of the config sampled at each of the given report dt
+(by default that of the config and the simulation dt), and prints the run wall time and its increase per
+sample over the run without reports, per rank. The samples are written straight into the report buffers;
+the increase includes packing and writing the blocks unless the output is written on the writer thread.
+
+    python example/benchmark/sampling.py build/bin/arbata example/simulation_config.json
+"""
+
+import argparse
+import copy
+import json
+import os
+import shlex
+
+from bench_util import phase_wall, run
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("arbata", help="arbata executable")
+    parser.add_argument("config", help="simulation config")
+    parser.add_argument("--launcher", default="", help="command prefix, e.g. \"mpirun -n 4\"")
+    parser.add_argument("--outdir", default="sampling_benchmark", help="directory of the outputs")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per setting, the fastest is reported")
+    parser.add_argument("--dt", type=float, nargs="*", help="report dt of the runs (ms)")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+    launcher = shlex.split(args.launcher)
+    tstop = config["run"]["tstop"]
+    report_dts = args.dt or sorted({r["dt"] for r in config.get("reports", {}).values()} | {config["run"]["dt"]},
+                                   reverse=True)
+
+    def fastest(name, run_config):
+        runs = [run(args.arbata, launcher, run_config, name, args.outdir) for _ in range(args.repeat)]
+        return min((r[0] for r in runs), key=lambda p: phase_wall(p, "run"))
+
+    no_reports = copy.deepcopy(config)
+    no_reports["reports"] = {}
+    base = phase_wall(fastest("no reports", no_reports), "run")
+
+    print(f"{'report dt':<12}{'samples/rank':>14}{'run (s)':>10}{'ns/sample':>11}")
+    print(f"{'none':<12}{0:>14}{base:>10.3f}{'':>11}")
+    for dt in report_dts:
+        run_config = copy.deepcopy(config)
+        for report in run_config["reports"].values():
+            report["dt"] = dt
+        profile = fastest(f"dt {dt}", run_config)
+
+        # Samples of every report: its probes times its time steps
+        samples = 0
+        for report in run_config["reports"].values():
+            steps = round((report.get("end_time", tstop) - report.get("start_time", 0.))/dt)
+            file = os.path.basename(report["report_file"])
+            probes = sum(q["sum"] for name, q in profile["statistics"].items()
+                         if name.startswith("probes ") and os.path.basename(name[len("probes "):]) == file)
+            samples += probes*steps
+        per_rank = samples/profile["ranks"]
+
+        wall = phase_wall(profile, "run")
+        cost = 1e9*(wall - base)/per_rank if per_rank else float("nan")
+        print(f"{dt:<12g}{int(per_rank):>14}{wall:>10.3f}{cost:>11.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,35 @@
+"""Time of sorting the output spikes with the radix sort against std::sort.
+
+Runs spike-sort-bench (built with arbata) on random spikes of a range of sizes, delivered epoch by epoch as by
+the simulation, and prints the time of sort_spikes and of the std::sort that it replaced, by id and by time.
+
+    python example/benchmark/spike_sort.py build/bin/spike-sort-bench --spikes 1e5 1e6 1e7 --threads 1 4
+"""
+
+import argparse
+import json
+import subprocess
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("bench", help="spike-sort-bench executable")
+    parser.add_argument("--spikes", type=float, nargs="*", default=[1e5, 1e6, 1e7], help="numbers of spikes")
+    parser.add_argument("--gids", type=int, default=100000, help="number of gids that spike")
+    parser.add_argument("--threads", type=int, nargs="*", default=[1], help="threads of the radix sort")
+    parser.add_argument("--repeat", type=int, default=3, help="sorts per setting, the fastest is reported")
+    args = parser.parse_args()
+
+    print(f"{'order':<7}{'spikes':>10}{'threads':>9}{'radix (s)':>11}{'std (s)':>10}{'speedup':>9}")
+    for n in args.spikes:
+        for threads in args.threads:
+            out = subprocess.run([args.bench, str(int(n)), str(args.gids), str(threads), str(args.repeat)],
+                                 check=True, capture_output=True, text=True).stdout
+            for line in out.splitlines():
+                r = json.loads(line)
+                print(f"{r['order']:<7}{r['spikes']:>10}{r['threads']:>9}{r['radix']:>11.4f}{r['std_sort']:>10.4f}"
+                      f"{r['std_sort']/r['radix']:>9.2f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,155 @@
+"""Step throughput of synapse-dense cells with synapses in edge order and sorted by location.
+
+Generates a network of `--cells` cells of the example morphology with `--synapses` expsyn synapses
+each, at random positions in random edge order, driven by `--sources` virtual cells, and runs it
+with run.sort_synapses off and on.
+
+    python example/benchmark/synapse_order.py build/bin/arbata
+"""
+
+import argparse
+import json
+import os
+import shlex
+
+import h5py
+import numpy as np
+
+from bench_util import compare_spikes, phase_wall, read_spikes, run
+
+COMPONENTS = "example/components"
+
+
+def write_nodes(path, cells, sources):
+    with h5py.File(path, "w") as f:
+        for pop, n, type_id in [("dense", cells, 300), ("src", sources, 301)]:
+            g = f.create_group("nodes/" + pop)
+            g.create_dataset("node_group_id", data=np.zeros(n, dtype="i4"))
+            g.create_dataset("node_group_index", data=np.arange(n, dtype="i4"))
+            g.create_dataset("node_type_id", data=np.full(n, type_id, dtype="i4"))
+            g.create_group("0")
+
+
+def write_edges(path, cells, sources, synapses, rng):
+    n = cells*synapses
+    target = np.repeat(np.arange(cells, dtype="i4"), synapses)
+    source = rng.integers(0, sources, n).astype("i4")
+
+    with h5py.File(path, "w") as f:
+        g = f.create_group("edges/src_dense")
+        g.create_dataset("edge_group_id", data=np.zeros(n, dtype="i4"))
+        g.create_dataset("edge_group_index", data=np.arange(n, dtype="i4"))
+        g.create_dataset("edge_type_id", data=np.full(n, 300, dtype="i4"))
+        g.create_dataset("source_node_id", data=source)
+        g.create_dataset("target_node_id", data=target)
+
+        # Edges are sorted by target: one range per target, and one range per edge of every source
+        t2s = g.create_group("indicies/target_to_source")
+        t2s.create_dataset("node_id_to_ranges", data=np.stack([np.arange(cells), np.arange(1, cells + 1)], 1).astype("i4"))
+        t2s.create_dataset("range_to_edge_id", data=np.stack([np.arange(cells), np.arange(1, cells + 1)], 1).astype("i4")*synapses)
+
+        by_source = np.argsort(source, kind="stable").astype("i4")
+        counts = np.bincount(source, minlength=sources)
+        ends = np.cumsum(counts)
+        s2t = g.create_group("indicies/source_to_target")
+        s2t.create_dataset("node_id_to_ranges", data=np.stack([ends - counts, ends], 1).astype("i4"))
+        s2t.create_dataset("range_to_edge_id", data=np.stack([by_source, by_source + 1], 1))
+
+        # Random positions on the soma and dendrite branch, in edge order
+        g0 = g.create_group("0")
+        g0.create_dataset("afferent_section_id", data=np.zeros(n, dtype="i4"))
+        g0.create_dataset("afferent_section_pos", data=rng.random(n).astype("f4"))
+        g0.create_dataset("efferent_section_id", data=np.zeros(n, dtype="i4"))
+        g0.create_dataset("efferent_section_pos", data=np.zeros(n, dtype="f4"))
+
+
+def write_spikes(path, sources, rate, tstop, rng):
+    """Poisson input spikes of `rate` (Hz) on every source."""
+    times = [np.sort(rng.uniform(0, tstop, rng.poisson(rate*tstop/1000))) for _ in range(sources)]
+    counts = np.array([len(t) for t in times])
+    ends = np.cumsum(counts)
+    with h5py.File(path, "w") as f:
+        g = f.create_group("spikes")
+        g.create_dataset("gids", data=np.repeat(np.arange(sources), counts).astype("i4"))
+        g.create_dataset("timestamps", data=np.concatenate(times).astype("f4"))
+        g.create_dataset("gid_to_range", data=np.stack([ends - counts, ends], 1).astype("i4"))
+
+
+def make_network(outdir, cells, synapses, sources, tstop, seed):
+    """Files of the network; returns the simulation config."""
+    rng = np.random.default_rng(seed)
+    net = os.path.join(outdir, "network")
+    os.makedirs(net, exist_ok=True)
+
+    write_nodes(os.path.join(net, "nodes.h5"), cells, sources)
+    write_edges(os.path.join(net, "edges.h5"), cells, sources, synapses, rng)
+    write_spikes(os.path.join(net, "input_spikes.h5"), sources, 20, tstop, rng)
+
+    with open(os.path.join(net, "node_types.csv"), "w") as f:
+        f.write("node_type_id,pop_name,model_type,model_template,morphology,dynamics_params\n")
+        f.write(f"300,dense,biophysical,{COMPONENTS}/density_params/set_pas.json,"
+                f"{COMPONENTS}/morphologies/soma_branch.swc,{COMPONENTS}/density_params/pas_hh.json\n")
+        f.write("301,src,virtual,NULL,NULL,NULL\n")
+    with open(os.path.join(net, "edge_types.csv"), "w") as f:
+        f.write("edge_type_id,pop_name,source_pop_name,target_pop_name,model_template,dynamics_params,delay,"
+                "syn_weight,afferent_section_id,afferent_section_pos,efferent_section_id,efferent_section_pos,threshold\n")
+        f.write(f"300,src_dense,src,dense,expsyn,{COMPONENTS}/point_params/expsyn.json,1,0.0002,0,0.5,0,0,10\n")
+
+    circuit = {"network": {
+        "nodes": [{"nodes_file": os.path.join(net, "nodes.h5"), "node_types_file": os.path.join(net, "node_types.csv")}],
+        "edges": [{"edges_file": os.path.join(net, "edges.h5"), "edge_types_file": os.path.join(net, "edge_types.csv")}],
+    }}
+    node_sets = {"sources": {"population": "src"}}
+    for name, content in [("circuit_config.json", circuit), ("node_sets.json", node_sets)]:
+        with open(os.path.join(net, name), "w") as f:
+            json.dump(content, f, indent=2)
+
+    return {
+        "network": os.path.join(net, "circuit_config.json"),
+        "node_sets_file": os.path.join(net, "node_sets.json"),
+        "conditions": {"celsius": 6.3, "v_init": -65},
+        "run": {"tstop": tstop, "dt": 0.025, "spike_threshold": 10},
+        "inputs": {"spikes": {"input_type": "spikes", "module": "h5",
+                              "input_file": os.path.join(net, "input_spikes.h5"), "node_set": "sources"}},
+        "outputs": {"spikes_file": "spikes.h5", "spikes_sort_order": "time"},
+        "reports": {},
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("arbata", help="arbata executable")
+    parser.add_argument("--launcher", default="", help="command prefix, e.g. \"mpirun -n 4\"")
+    parser.add_argument("--outdir", default="synapse_order_benchmark", help="directory of the network and outputs")
+    parser.add_argument("--cells", type=int, default=64)
+    parser.add_argument("--synapses", type=int, default=5000, help="synapses per cell")
+    parser.add_argument("--sources", type=int, default=1000)
+    parser.add_argument("--tstop", type=float, default=200)
+    parser.add_argument("--repeat", type=int, default=3, help="runs per setting, the fastest is reported")
+    parser.add_argument("--seed", type=int, default=42)
+    args = parser.parse_args()
+
+    config = make_network(args.outdir, args.cells, args.synapses, args.sources, args.tstop, args.seed)
+    launcher = shlex.split(args.launcher)
+    steps = args.tstop/config["run"]["dt"]
+
+    print(f"{args.cells} cells, {args.synapses} synapses per cell, {steps:.0f} steps")
+    print(f"{'order':<10}{'run (s)':>10}{'steps/s':>10}{'synapse updates/s':>20}{'spikes':>8}{'count err':>11}")
+    ref = None
+    for sort in [False, True]:
+        config["run"]["sort_synapses"] = sort
+        name = "location" if sort else "edge"
+        runs = [run(args.arbata, launcher, config, name, args.outdir) for _ in range(args.repeat)]
+        profile, spikes_file, _ = min(runs, key=lambda r: phase_wall(r[0], "run"))
+
+        trains = read_spikes(spikes_file)
+        if ref is None:
+            ref = trains
+        count_error, _ = compare_spikes(trains, ref)
+        wall = phase_wall(profile, "run")
+        print(f"{name:<10}{wall:>10.3f}{steps/wall:>10.0f}{steps*args.cells*args.synapses/wall:>20.3e}"
+              f"{sum(len(t) for t in trains.values()):>8}{100*count_error:>10.1f}%")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <utility>
+
+#include <sonata/async_writer.hpp>
+
+namespace sonata {
+using clock_type = std::chrono::steady_clock;
+
+static double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// CPU time (s) of the calling thread
+static double thread_cpu_time() {
+    timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+async_writer::async_writer(std::size_t max_queue_depth):
+    max_queue_depth_(std::max<std::size_t>(max_queue_depth, 1)),
+    thread_([this] { run(); })
+{}
+
+async_writer::~async_writer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    not_empty_.notify_one();
+    thread_.join();
+}
+
+std::future<void> async_writer::submit(std::function<void()> task) {
+    auto done = std::make_shared<std::promise<void>>();
+    auto result = done->get_future();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.size() >= max_queue_depth_) {
+        auto start = clock_type::now();
+        not_full_.wait(lock, [this] { return queue_.size() < max_queue_depth_; });
+        stats_.wait_time += seconds_since(start);
+    }
+    // The exception is also kept for `drain`
+    queue_.push_back([task = std::move(task), done] {
+        try {
+            task();
+        }
+        catch (...) {
+            done->set_exception(std::current_exception());
+            throw;
+        }
+        done->set_value();
+    });
+    stats_.max_queue_depth = std::max(stats_.max_queue_depth, queue_.size());
+    lock.unlock();
+    not_empty_.notify_one();
+    return result;
+}
+
+void async_writer::drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+async_writer::stats async_writer::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void async_writer::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        not_empty_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        auto task = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+        lock.unlock();
+        not_full_.notify_one();
+
+        auto start = clock_type::now();
+        auto cpu_start = thread_cpu_time();
+        std::exception_ptr error;
+        try {
+            task();
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        auto elapsed = seconds_since(start);
+        auto cpu = thread_cpu_time() - cpu_start;
+
+        lock.lock();
+        busy_ = false;
+        stats_.num_tasks++;
+        stats_.write_time += elapsed;
+        stats_.cpu_time += cpu;
+        if (error && !error_) {
+            error_ = error;
+        }
+        if (queue_.empty()) {
+            idle_.notify_all();
+        }
+    }
+}
+} // namespace sonata
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <arbor/morph/morphology.hpp>
+
+#include <sonata/cell_cost.hpp>
+#include <sonata/discretization.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+#include "mpi_helper.hpp"
+
+namespace sonata {
+void add_morphology_features(cell_features& f, const arb::morphology& morph, const discretization_info& d) {
+    f.branches = morph.num_branches();
+    f.cvs = count_cvs(d, morph);
+    f.length = 0;
+    for (unsigned b = 0; b < f.branches; b++) {
+        for (const auto& s: morph.branch_segments(b)) {
+            f.length += std::sqrt((s.dist.x - s.prox.x)*(s.dist.x - s.prox.x) +
+                                  (s.dist.y - s.prox.y)*(s.dist.y - s.prox.y) +
+                                  (s.dist.z - s.prox.z)*(s.dist.z - s.prox.z));
+        }
+    }
+}
+
+cost_model::cost_model(const terms_type& weights): weights_(weights) {}
+
+cost_model::terms_type cost_model::terms(const cell_features& f) {
+    if (f.kind != arb::cell_kind::cable) {
+        return {1, 0, 0, 0, double(f.synapses)};
+    }
+    return {0, 1, double(f.cvs), double(f.cvs)*f.density_mechs, double(f.synapses)};
+}
+
+double cost_model::estimate(const cell_features& f) const {
+    auto t = terms(f);
+    return std::inner_product(t.begin(), t.end(), weights_.begin(), 0.);
+}
+
+std::vector<double> cost_model::estimate(const std::vector<cell_features>& f) const {
+    std::vector<double> costs;
+    costs.reserve(f.size());
+    for (const auto& c: f) {
+        costs.push_back(estimate(c));
+    }
+    return costs;
+}
+
+cost_model cost_model::calibrate(const std::vector<terms_type>& part_terms, const std::vector<double>& part_times) const {
+    if (part_terms.size() != part_times.size() || part_terms.empty()) {
+        throw sonata_exception("Calibration of the cost model requires a measured time for every part");
+    }
+    constexpr unsigned n = num_terms;
+
+    // Scale the weights so that the model predicts the total measured time
+    double predicted = 0, measured = 0;
+    for (unsigned r = 0; r < part_terms.size(); r++) {
+        predicted += std::inner_product(part_terms[r].begin(), part_terms[r].end(), weights_.begin(), 0.);
+        measured += part_times[r];
+    }
+    if (predicted <= 0 || measured <= 0) {
+        return *this;
+    }
+    double scale = measured/predicted;
+
+    // Solve for factors u of the scaled weights: the contribution of term k to part r is a[r][k]*u[k].
+    // Minimise sum_r (t_r - a_r.u)^2 + lambda*sum_k |a_k|^2 (u_k - 1)^2, keeping the scaled weights
+    // where the parts do not tell the terms apart
+    constexpr double lambda = 0.1;
+    double m[n][n + 1] = {};
+    for (unsigned r = 0; r < part_terms.size(); r++) {
+        double a[n];
+        for (unsigned k = 0; k < n; k++) {
+            a[k] = part_terms[r][k]*weights_[k]*scale;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            for (unsigned j = 0; j < n; j++) {
+                m[i][j] += a[i]*a[j];
+            }
+            m[i][n] += a[i]*part_times[r];
+        }
+    }
+    for (unsigned k = 0; k < n; k++) {
+        double c = m[k][k] > 0? lambda*m[k][k]: 1;
+        m[k][k] += c;
+        m[k][n] += c;
+    }
+
+    // Gaussian elimination with partial pivoting
+    for (unsigned i = 0; i < n; i++) {
+        unsigned pivot = i;
+        for (unsigned j = i + 1; j < n; j++) {
+            if (std::abs(m[j][i]) > std::abs(m[pivot][i])) {
+                pivot = j;
+            }
+        }
+        std::swap(m[i], m[pivot]);
+        for (unsigned j = i + 1; j < n; j++) {
+            double f = m[j][i]/m[i][i];
+            for (unsigned k = i; k <= n; k++) {
+                m[j][k] -= f*m[i][k];
+            }
+        }
+    }
+    terms_type weights;
+    double u[n];
+    for (unsigned i = n; i-- > 0;) {
+        double v = m[i][n];
+        for (unsigned j = i + 1; j < n; j++) {
+            v -= m[i][j]*u[j];
+        }
+        u[i] = v/m[i][i];
+    }
+    for (unsigned k = 0; k < n; k++) {
+        weights[k] = std::max(u[k], 0.)*weights_[k]*scale;
+    }
+    return cost_model(weights);
+}
+
+static double imbalance(const std::vector<double>& loads) {
+    if (loads.empty()) {
+        return 1;
+    }
+    double mean = std::accumulate(loads.begin(), loads.end(), 0.)/loads.size();
+    return mean > 0? *std::max_element(loads.begin(), loads.end())/mean: 1;
+}
+
+double load_report::predicted_imbalance() const {
+    return imbalance(predicted);
+}
+
+double load_report::measured_imbalance() const {
+    return imbalance(measured);
+}
+
+// Summed terms of the local cells of `decomp`
+static cost_model::terms_type local_terms(const std::vector<cell_features>& features,
+                                          const arb::domain_decomposition& decomp) {
+    cost_model::terms_type sum = {};
+    for (const auto& group: decomp.groups()) {
+        for (auto gid: group.gids) {
+            auto t = cost_model::terms(features.at(gid));
+            for (unsigned k = 0; k < cost_model::num_terms; k++) {
+                sum[k] += t[k];
+            }
+        }
+    }
+    return sum;
+}
+
+load_report gather_load(const std::vector<cell_features>& features,
+                        const cost_model& model,
+                        const arb::domain_decomposition& decomp,
+                        double local_time) {
+    load_report report;
+    report.terms = {local_terms(features, decomp)};
+    report.measured = {local_time};
+    const auto& w = model.weights();
+    report.predicted = {std::inner_product(w.begin(), w.end(), report.terms[0].begin(), 0.)};
+    return report;
+}
+
+#ifdef ARB_MPI_ENABLED
+load_report gather_load(const std::vector<cell_features>& features,
+                        const cost_model& model,
+                        const arb::domain_decomposition& decomp,
+                        double local_time,
+                        MPI_Comm comm) {
+    load_report report;
+    report.terms = gather_all(std::vector<cost_model::terms_type>{local_terms(features, decomp)}, comm);
+    report.measured = gather_all(local_time, comm);
+    const auto& w = model.weights();
+    for (const auto& t: report.terms) {
+        report.predicted.push_back(std::inner_product(w.begin(), w.end(), t.begin(), 0.));
+    }
+    return report;
+}
+#endif
+
+double process_cpu_time() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 1e-6*(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+} // namespace sonata
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sonata/cell_template.hpp>
+
+namespace sonata {
+std::string cell_template_key(unsigned type_tag,
+                              const std::string& pop,
+                              const std::string& morph_file,
+                              const std::unordered_map<section_kind, std::vector<arb::mechanism_desc>>& mechs) {
+    std::ostringstream key;
+    key << std::hexfloat << pop << '\n' << type_tag << '\n' << morph_file << '\n';
+    for (auto section: {section_kind::soma, section_kind::dend, section_kind::axon, section_kind::none}) {
+        auto it = mechs.find(section);
+        if (it == mechs.end()) {
+            continue;
+        }
+        for (const auto& m: it->second) {
+            std::vector<std::pair<std::string, double>> values(m.values().begin(), m.values().end());
+            std::sort(values.begin(), values.end());
+
+            key << section << ':' << m.name();
+            for (const auto& [param, value]: values) {
+                key << ',' << param << '=' << value;
+            }
+            key << '\n';
+        }
+    }
+    return key.str();
+}
+
+std::shared_ptr<const cell_template> cell_template_cache::find(const std::string& key) {
+    auto it = templates_.find(key);
+    if (it == templates_.end()) {
+        stats_.misses++;
+        return nullptr;
+    }
+    stats_.hits++;
+    return it->second;
+}
+
+std::shared_ptr<const cell_template> cell_template_cache::insert(const std::string& key, cell_template t) {
+    auto it = templates_.find(key);
+    if (it != templates_.end()) {
+        return it->second;
+    }
+    auto p = std::make_shared<const cell_template>(std::move(t));
+    if (templates_.size() < capacity_) {
+        templates_.emplace(key, p);
+        stats_.size = templates_.size();
+    }
+    return p;
+}
+
+void cell_template_cache::clear() {
+    templates_.clear();
+    stats_ = {};
+}
+} // namespace sonata
@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <string>
 #include <fstream>
+#include <limits>
+#include <sstream>
 #include <unordered_set>
 
 #include <arbor/common_types.hpp>
@@ -8,15 +14,16 @@
 #include <sonata/sonata_exceptions.hpp>
 #include <sonata/density_mech_helper.hpp>
 #include <sonata/csv_lib.hpp>
+#include <sonata/input_files.hpp>
 
 namespace sonata {
 csv_file::csv_file(std::string name, char delm) :
         filename(name), delimeter(delm) {
-    std::ifstream file(name);
-
-    if (!file.good()) {
+    auto contents = read_input_file(name);
+    if (!contents) {
         throw std::runtime_error("Unable to open csv file: " + name);
     }
+    std::istringstream file(*contents);
 
     std::string line;
 
@@ -30,7 +37,6 @@ csv_file::csv_file(std::string name, char delm) :
         }
         data.push_back(vec);
     }
-    file.close();
 }
 
 std::vector<std::vector<std::string>> csv_file::get_data() {
@@ -41,6 +47,46 @@ std::string csv_file::name() {
     return filename;
 }
 
+int csv_file::column(const std::string& name) const {
+    if (data.empty()) {
+        return -1;
+    }
+    const auto& header = data.front();
+    auto it = std::find(header.begin(), header.end(), name);
+    if (it == header.end()) {
+        return -1;
+    }
+    return it - header.begin();
+}
+
+// True if only whitespace (e.g. a trailing '\r') follows the parsed number
+static bool csv_field_end(const char* end) {
+    while (std::isspace(static_cast<unsigned char>(*end))) ++end;
+    return *end == '\0';
+}
+
+unsigned csv_to_unsigned(const std::string& field) {
+    const char* begin = field.c_str();
+    char* end;
+    errno = 0;
+    auto value = std::strtoll(begin, &end, 10);
+    if (end == begin || !csv_field_end(end) || errno == ERANGE || value < 0 || value > std::numeric_limits<unsigned>::max()) {
+        throw sonata_exception("Invalid unsigned integer field in csv file: \"" + field + "\"");
+    }
+    return value;
+}
+
+double csv_to_double(const std::string& field) {
+    const char* begin = field.c_str();
+    char* end;
+    errno = 0;
+    auto value = std::strtod(begin, &end);
+    if (end == begin || !csv_field_end(end) || errno == ERANGE) {
+        throw sonata_exception("Invalid floating point field in csv file: \"" + field + "\"");
+    }
+    return value;
+}
+
 ////////////////////////////////////////////////////////
 
 csv_record::csv_record(std::vector<csv_file> files) {
@@ -96,8 +142,9 @@ csv_node_record::csv_node_record(std::vector<csv_file> files) : csv_record(files
                 if (type.second["morphology"] == "NULL") {
                     throw sonata_exception("Morphology of non-virtual cell can not be NULL");
                 }
-                std::ifstream f(type.second["morphology"]);
-                if (!f) throw sonata_exception("Unable to open SWC file");
+                auto swc = read_input_file(type.second["morphology"]);
+                if (!swc) throw sonata_exception("Unable to open SWC file");
+                std::istringstream f(*swc);
                 morphologies_[type.first] = arb::morphology(arborio::load_swc_neuron(arborio::parse_swc(f)));
             } else {
                 throw sonata_exception("Morphology not found in node csv description");
@@ -132,7 +179,9 @@ arb::morphology csv_node_record::morph(type_pop_id id) {
 }
 
 arb::cell_kind csv_node_record::cell_kind(type_pop_id id) {
-    if (fields_[id]["model_type"] == "virtual") {
+    auto it = fields_.find(id);
+    if (it != fields_.end() && it->second.find("model_type") != it->second.end() &&
+        it->second.at("model_type") == "virtual") {
         return arb::cell_kind::spike_source;
     }
     return arb::cell_kind::cable;
@@ -151,7 +200,10 @@ std::unordered_map<std::string, variable_map> csv_node_record::dynamic_params(ty
 std::unordered_map<section_kind, std::vector<arb::mechanism_desc>> csv_node_record::density_mech_desc(
         type_pop_id id, std::unordered_map<std::string, variable_map> overrides) {
 
-    std::unordered_map<std::string, mech_groups> density_mechs = density_params_[id];
+    std::unordered_map<std::string, mech_groups> density_mechs;
+    if (density_params_.find(id) != density_params_.end()) {
+        density_mechs = density_params_.at(id);
+    }
 
     for (auto seg_overrides: overrides) {
         if (density_mechs.find(seg_overrides.first) != density_mechs.end()) {
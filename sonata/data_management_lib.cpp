@@ -1,10 +1,17 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <set>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <arbor/version.hpp>
 #include <arbor/mechcat.hpp>
 
 #include <sonata/data_management_lib.hpp>
+#include <sonata/h5_access.hpp>
 
 #include "mpi_helper.hpp"
 
@@ -18,11 +25,160 @@ using arb::mlocation;
 
 namespace sonata {
 
+// Sorted ranges covering `ranges`, with overlapping and adjacent ranges merged
+static std::vector<std::pair<unsigned, unsigned>> merge_ranges(std::vector<std::pair<unsigned, unsigned>> ranges) {
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<std::pair<unsigned, unsigned>> merged;
+    for (auto r: ranges) {
+        if (!merged.empty() && r.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, r.second);
+        }
+        else if (r.first < r.second) {
+            merged.push_back(r);
+        }
+    }
+    return merged;
+}
+
+// Ranges of consecutive ids of `ids`
+static std::vector<std::pair<unsigned, unsigned>> id_ranges(const std::vector<unsigned>& ids) {
+    std::vector<std::pair<unsigned, unsigned>> ranges;
+    for (auto id: ids) {
+        ranges.emplace_back(id, id + 1);
+    }
+    return merge_ranges(std::move(ranges));
+}
+
+// Rows of a dataset, read in one hyperslab per run of overlapping or adjacent requested ranges
+template <typename T>
+class row_slices {
+public:
+    row_slices() = default;
+
+    // Read the rows of `ranges` with `read(first, last)`, which returns the rows [first, last)
+    template <typename F>
+    row_slices(std::vector<std::pair<unsigned, unsigned>> ranges, F&& read) {
+        for (auto [first, last]: merge_ranges(std::move(ranges))) {
+            auto rows = read(first, last);
+            firsts_.push_back(first);
+            offsets_.push_back(rows_.size());
+            rows_.insert(rows_.end(), rows.begin(), rows.end());
+        }
+    }
+
+    // Row `i`, which must be in one of the ranges read
+    const T& operator[](unsigned i) const {
+        auto run = std::upper_bound(firsts_.begin(), firsts_.end(), i) - firsts_.begin() - 1;
+        return rows_[offsets_[run] + i - firsts_[run]];
+    }
+
+private:
+    std::vector<unsigned> firsts_;
+    std::vector<std::size_t> offsets_;
+    std::vector<T> rows_;
+};
+
+// Edges of a set of nodes of an edge population, read through one of its indices (source_to_target or
+// target_to_source), with a value per edge
+template <typename T>
+struct indexed_edges {
+    row_slices<std::pair<int, int>> node_id_to_ranges;
+    row_slices<std::pair<int, int>> range_to_edge_id;
+    row_slices<T> values;
+
+    // Rows of range_to_edge_id and edge ranges of the nodes
+    std::vector<std::pair<unsigned, unsigned>> index_rows;
+    std::vector<std::pair<unsigned, unsigned>> edge_ranges;
+
+    // Call f(edge id, value) for the edges of node `id`, in index order
+    template <typename F>
+    void for_each(unsigned id, F&& f) const {
+        auto rows = node_id_to_ranges[id];
+        for (int j = rows.first; j < rows.second; j++) {
+            auto r2e = range_to_edge_id[j];
+            for (int e = r2e.first; e < r2e.second; e++) {
+                f(unsigned(e), values[e]);
+            }
+        }
+    }
+};
+
+// Edges of the nodes `ids` through `index`, with the values of edge ranges read by `read(first, last)`:
+// only the rows of the nodes are read, each dataset in one hyperslab per run of adjacent rows
+template <typename T, typename F>
+static indexed_edges<T> read_indexed_edges(const h5_wrapper& index, const std::vector<unsigned>& ids, F&& read) {
+    indexed_edges<T> edges;
+    edges.node_id_to_ranges = row_slices<std::pair<int, int>>(id_ranges(ids), [&](unsigned first, unsigned last) {
+        return index.get<std::vector<std::pair<int, int>>>("node_id_to_ranges", first, last);
+    });
+    for (auto id: ids) {
+        auto rows = edges.node_id_to_ranges[id];
+        edges.index_rows.emplace_back(rows.first, rows.second);
+    }
+
+    edges.range_to_edge_id = row_slices<std::pair<int, int>>(edges.index_rows, [&](unsigned first, unsigned last) {
+        return index.get<std::vector<std::pair<int, int>>>("range_to_edge_id", first, last);
+    });
+    for (auto [first, last]: merge_ranges(edges.index_rows)) {
+        for (auto j = first; j < last; j++) {
+            auto r2e = edges.range_to_edge_id[j];
+            edges.edge_ranges.emplace_back(r2e.first, r2e.second);
+        }
+    }
+
+    edges.values = row_slices<T>(edges.edge_ranges, read);
+    return edges;
+}
+
+// Interval [first, last) of the ids of the edges of a node in an edge index
+struct edge_interval {
+    std::uint64_t first;
+    std::uint64_t last;
+    cell_gid_type node;
+};
+
+// Edge intervals of share `rank` of `num_ranks` of the nodes of edge index `index` (source_to_target or
+// target_to_source), with the node ids offset by `offset`; only the index rows of the share are read
+static std::vector<edge_interval> read_edge_intervals(const h5_wrapper& index, cell_gid_type offset,
+                                                      std::size_t rank, std::size_t num_ranks) {
+    auto size = index.dataset_size("node_id_to_ranges");
+    if (size < 0) {
+        throw sonata_exception("Edge index " + index.name() + " has no node_id_to_ranges");
+    }
+    std::size_t num_nodes = size;
+    std::size_t first = num_nodes*rank/num_ranks, last = num_nodes*(rank + 1)/num_ranks;
+    std::vector<edge_interval> intervals;
+    if (first == last) {
+        return intervals;
+    }
+
+    auto node_rows = index.get<std::vector<std::pair<int, int>>>("node_id_to_ranges", first, last);
+    std::vector<std::pair<unsigned, unsigned>> rows;
+    for (auto r: node_rows) {
+        rows.emplace_back(r.first, r.second);
+    }
+    row_slices<std::pair<int, int>> ranges(rows, [&](unsigned i, unsigned j) {
+        return index.get<std::vector<std::pair<int, int>>>("range_to_edge_id", i, j);
+    });
+
+    for (std::size_t n = 0; n < node_rows.size(); n++) {
+        for (int j = node_rows[n].first; j < node_rows[n].second; j++) {
+            auto r = ranges[j];
+            if (r.first < r.second) {
+                intervals.push_back({std::uint64_t(r.first), std::uint64_t(r.second), cell_gid_type(offset + first + n)});
+            }
+        }
+    }
+    return intervals;
+}
+
 model_desc::model_desc(h5_record nodes,
                        h5_record edges,
                        csv_node_record node_types,
-                       csv_edge_record edge_types):
-nodes_(nodes), edges_(edges), node_types_(node_types), edge_types_(edge_types) {}
+                       csv_edge_record edge_types,
+                       discretization_params discretization):
+nodes_(nodes), edges_(edges), node_types_(node_types), edge_types_(edge_types),
+discretization_(std::move(discretization)) {}
 
 
 cell_size_type model_desc::num_cells() const {
@@ -37,6 +193,10 @@ cell_size_type model_desc::num_targets(cell_gid_type gid) const {
     return target_maps_.at(gid).size();
 }
 
+std::size_t model_desc::num_coalesced_targets() const {
+    return num_coalesced_;
+}
+
 std::vector<unsigned> model_desc::pop_partitions() const {
     return nodes_.partitions();
 }
@@ -63,80 +223,110 @@ unsigned model_desc::population_id_of(cell_gid_type gid) const {
     return {};
 }
 
-void model_desc::build_source_and_target_maps(const std::vector<arb::group_description>& groups) {
-    // Build loc_source_gids and loc_source_sizes
+void model_desc::build_source_and_target_maps(const std::vector<arb::group_description>& groups,
+                                              const std::function<bool(const arb::mechanism_desc&)>& coalesce,
+                                              bool sort_synapses_by_location) {
+    // Maps of a previous decomposition are replaced
+    source_maps_.clear();
+    target_maps_.clear();
+    synapse_maps_.clear();
+    num_coalesced_ = 0;
+    local_rows_ = {};
+
+    // Local cells, in group order
     std::vector<cell_gid_type> loc_source_gids;
-    std::vector<unsigned> loc_source_sizes;
-    std::vector<source_type> loc_sources;
-
-    for (auto group: groups) {
-        loc_source_gids.insert(loc_source_gids.end(), group.gids.begin(), group.gids.end());
+    std::vector<local_element> loc_nodes;
+    for (const auto& group: groups) {
         for (auto gid: group.gids) {
-            std::unordered_set<source_type> src_set;
-            std::vector<std::pair<target_type, unsigned>> tgt_vec;
-
-            auto loc_node = nodes_.localize(gid);
-            auto source_edge_pops = edge_types_.edges_of_source(loc_node.pop_name);
-            auto target_edge_pops = edge_types_.edges_of_target(loc_node.pop_name);
-
-            for (auto edge_pop_name: source_edge_pops) {
-                if (edges_.find_population(edge_pop_name)) {
-                    auto edge_pop = edges_.map()[edge_pop_name];
-                    auto ind_id = edges_[edge_pop].find_group("indicies");
-                    auto s2t_id = edges_[edge_pop][ind_id].find_group("source_to_target");
-                    auto n2r_range = edges_[edge_pop][ind_id][s2t_id].get<std::pair<int,int>>("node_id_to_ranges", loc_node.el_id);
-
-                    for (auto j = n2r_range.first; j < n2r_range.second; j++) {
-                        auto r2e = edges_[edge_pop][ind_id][s2t_id].get<std::pair<int,int>>("range_to_edge_id", j);
-                        auto src_rng = source_range(edge_pop, r2e);
-                        for (auto s: src_rng) {
-                            auto loc = src_set.find(s);
-                            if (loc == src_set.end()) {
-                                src_set.insert(s);
-                            }
-                        }
-                    }
-                }
+            loc_source_gids.push_back(gid);
+            loc_nodes.push_back(nodes_.localize(gid));
+            local_rows_.nodes[nodes_.map()[loc_nodes.back().pop_name]].push_back(loc_nodes.back().el_id);
+        }
+    }
+
+    // Node ids of the local cells in every edge population they are the source or target of
+    std::map<unsigned, std::vector<unsigned>> source_ids, target_ids;
+    for (const auto& loc_node: loc_nodes) {
+        for (const auto& edge_pop_name: edge_types_.edges_of_source(loc_node.pop_name)) {
+            if (edges_.find_population(edge_pop_name)) {
+                source_ids[edges_.map()[edge_pop_name]].push_back(loc_node.el_id);
             }
+        }
+        for (const auto& edge_pop_name: edge_types_.edges_of_target(loc_node.pop_name)) {
+            if (edges_.find_population(edge_pop_name)) {
+                target_ids[edges_.map()[edge_pop_name]].push_back(loc_node.el_id);
+            }
+        }
+    }
 
-            for (auto edge_pop_name: target_edge_pops) {
-                if (edges_.find_population(edge_pop_name)) {
-                    auto edge_pop = edges_.map()[edge_pop_name];
+    // Read the edges of the local cells in bulk: the index rows of their node ids, then their edges,
+    // so that a rank only reads the edges of its own cells
+    std::unordered_map<unsigned, indexed_edges<source_type>> out_edges;
+    for (const auto& [edge_pop, ids]: source_ids) {
+        out_edges[edge_pop] = read_indexed_edges<source_type>(
+            edges_[int(edge_pop)]["indicies"]["source_to_target"], ids,
+            [&, edge_pop = edge_pop](unsigned first, unsigned last) { return source_range(edge_pop, {first, last}); });
+    }
 
-                    auto ind_id = edges_[edge_pop].find_group("indicies");
-                    auto t2s_id = edges_[edge_pop][ind_id].find_group("target_to_source");
-                    auto n2r = edges_[edge_pop][ind_id][t2s_id].get<std::pair<int,int>>("node_id_to_ranges", loc_node.el_id);
-                    for (auto j = n2r.first; j < n2r.second; j++) {
-                        auto r2e = edges_[edge_pop][ind_id][t2s_id].get<std::pair<int,int>>("range_to_edge_id", j);
+    std::unordered_map<unsigned, indexed_edges<target_type>> in_edges;
+    for (const auto& [edge_pop, ids]: target_ids) {
+        auto& edges = in_edges[edge_pop] = read_indexed_edges<target_type>(
+            edges_[int(edge_pop)]["indicies"]["target_to_source"], ids,
+            [&, edge_pop = edge_pop](unsigned first, unsigned last) { return target_range(edge_pop, {first, last}); });
 
-                        auto tgt_rng = target_range(edge_pop, r2e);
+        local_rows_.targets[edge_pop] = ids;
+        local_rows_.ranges[edge_pop] = edges.index_rows;
+        local_rows_.edges[edge_pop] = edges.edge_ranges;
+    }
 
-                        std::vector<unsigned> edge_rng(r2e.second - r2e.first);
-                        std::iota(edge_rng.begin(), edge_rng.end(), r2e.first);
+    // Build loc_source_sizes, loc_sources and the target maps
+    std::vector<unsigned> loc_source_sizes;
+    std::vector<source_type> loc_sources;
 
-                        for (unsigned k = 0; k < tgt_rng.size(); k++) {
-                            tgt_vec.push_back(std::make_pair(tgt_rng[k], edges_.globalize({edge_pop_name, (cell_gid_type) edge_rng[k]})));
-                        }
-                    }
-                }
-            }
+    for (unsigned i = 0; i < loc_source_gids.size(); i++) {
+        auto gid = loc_source_gids[i];
+        const auto& loc_node = loc_nodes[i];
+
+        std::unordered_set<source_type> src_set;
+        std::vector<std::pair<target_type, unsigned>> tgt_vec;
 
-            // Build loc_sources
-            std::vector<source_type> src_vec(src_set.begin(), src_set.end());
-            std::sort(src_vec.begin(), src_vec.end(), [](const auto &a, const auto& b) -> bool
-            {
-                return std::tie(a.segment, a.position) < std::tie(b.segment, b.position);
-            });
+        for (const auto& edge_pop_name: edge_types_.edges_of_source(loc_node.pop_name)) {
+            if (edges_.find_population(edge_pop_name)) {
+                out_edges.at(edges_.map()[edge_pop_name]).for_each(loc_node.el_id,
+                    [&](unsigned, const source_type& s) { src_set.insert(s); });
+            }
+        }
 
-            loc_sources.insert(loc_sources.end(), src_vec.begin(), src_vec.end());
-            loc_source_sizes.push_back(src_vec.size());
+        for (const auto& edge_pop_name: edge_types_.edges_of_target(loc_node.pop_name)) {
+            if (edges_.find_population(edge_pop_name)) {
+                in_edges.at(edges_.map()[edge_pop_name]).for_each(loc_node.el_id,
+                    [&](unsigned e, const target_type& t) {
+                        tgt_vec.push_back(std::make_pair(t, edges_.globalize({edge_pop_name, (cell_gid_type) e})));
+                    });
+            }
+        }
 
-            // Build target_maps_
-            std::sort(tgt_vec.begin(), tgt_vec.end(), [](const auto &a, const auto& b) -> bool
-            {
-                return a.second < b.second;
-            });
-            target_maps_[gid].insert(target_maps_[gid].end(), tgt_vec.begin(), tgt_vec.end());
+        // Build loc_sources
+        std::vector<source_type> src_vec(src_set.begin(), src_set.end());
+        std::sort(src_vec.begin(), src_vec.end(), [](const auto &a, const auto& b) -> bool
+        {
+            return std::tie(a.segment, a.position) < std::tie(b.segment, b.position);
+        });
+
+        loc_sources.insert(loc_sources.end(), src_vec.begin(), src_vec.end());
+        loc_source_sizes.push_back(src_vec.size());
+
+        // Build target_maps_
+        std::sort(tgt_vec.begin(), tgt_vec.end(), [](const auto &a, const auto& b) -> bool
+        {
+            return a.second < b.second;
+        });
+        target_maps_[gid].insert(target_maps_[gid].end(), tgt_vec.begin(), tgt_vec.end());
+
+        auto& synapses = synapse_maps_[gid] = coalesce_targets(target_maps_[gid], coalesce);
+        num_coalesced_ += synapses.num_coalesced();
+        if (sort_synapses_by_location) {
+            sort_synapses(synapses, target_maps_[gid]);
         }
     }
 
@@ -173,36 +363,75 @@ void model_desc::get_sources_and_targets(cell_gid_type gid, std::vector<mlocatio
         src.push_back(mlocation{s.segment, s.position});
     }
 
-    tgt.reserve(target_maps_.at(gid).size());
-    for (auto t: target_maps_.at(gid)) {
-        tgt.push_back(std::make_pair(mlocation{t.first.segment, t.first.position}, t.first.synapse));
+    const auto& targets = target_maps_.at(gid);
+    const auto& synapses = synapse_maps_.at(gid).synapses;
+    tgt.reserve(synapses.size());
+    for (auto i: synapses) {
+        const auto& t = targets[i].first;
+        tgt.push_back(std::make_pair(mlocation{t.segment, t.position}, t.synapse));
     }
 }
 
-arb::morphology model_desc::get_cell_morphology(cell_gid_type gid) {
+std::string model_desc::get_morphology_file(cell_gid_type gid) {
     auto loc_node = nodes_.localize(gid);
-
-    auto node_pop_name = loc_node.pop_name;
-    auto node_pop_id = nodes_.map()[node_pop_name];
+    auto node_pop_id = nodes_.map()[loc_node.pop_name];
     auto node_id = loc_node.el_id;
 
     auto group_id = nodes_[node_pop_id].get<int>("node_group_id", node_id);
     auto group_idx = nodes_[node_pop_id].get<int>("node_group_index", node_id);
 
-    auto node_type_tag = nodes_[node_pop_id].get<int>("node_type_id", node_id);
-
     if (nodes_[node_pop_id].find_group(std::to_string(group_id)) != -1) {
         auto lgi = nodes_[node_pop_id].find_group(std::to_string(group_id));
         auto group = nodes_[node_pop_id][lgi];
         if (group.find_dataset("morphology") != -1) {
-            auto file = group.get<std::string>("morphology", group_idx);
+            return group.get<std::string>("morphology", group_idx);
+        }
+    }
+    return {};
+}
+
+arb::morphology model_desc::get_cell_morphology(cell_gid_type gid) {
+    auto file = get_morphology_file(gid);
+    if (!file.empty()) {
+        // Morphologies of single cells are read by the ranks building them, not through read_input_file
+        std::ifstream f(file);
+        if (!f) throw sonata_exception("Unable to open SWC file");
+        return arb::morphology(arborio::load_swc_neuron(arborio::parse_swc(f)));
+    }
 
-            std::ifstream f(file);
-            if (!f) throw sonata_exception("Unable to open SWC file");
-            return arb::morphology(arborio::load_swc_neuron(arborio::parse_swc(f)));
+    auto loc_node = nodes_.localize(gid);
+    auto node_pop_id = nodes_.map()[loc_node.pop_name];
+    auto node_type_tag = nodes_[node_pop_id].get<int>("node_type_id", loc_node.el_id);
+    return node_types_.morph(type_pop_id(node_type_tag, loc_node.pop_name));
+}
+
+std::string model_desc::get_template_key(cell_gid_type gid,
+        const std::unordered_map<section_kind, std::vector<arb::mechanism_desc>>& mechs) {
+    auto loc_node = nodes_.localize(gid);
+    auto node_pop_id = nodes_.map()[loc_node.pop_name];
+    auto node_type_tag = nodes_[node_pop_id].get<int>("node_type_id", loc_node.el_id);
+    return cell_template_key(node_type_tag, loc_node.pop_name, get_morphology_file(gid), mechs);
+}
+
+const discretization_info& model_desc::get_discretization(cell_gid_type gid) {
+    if (discretization_.populations.empty() && discretization_.node_types.empty()) {
+        return discretization_.defaults;
+    }
+    auto loc_node = nodes_.localize(gid);
+    auto node_pop_id = nodes_.map()[loc_node.pop_name];
+
+    if (!discretization_.node_types.empty()) {
+        auto node_type_tag = nodes_[node_pop_id].get<int>("node_type_id", loc_node.el_id);
+        auto it = discretization_.node_types.find(node_type_tag);
+        if (it != discretization_.node_types.end()) {
+            return it->second;
         }
     }
-    return node_types_.morph(type_pop_id(node_type_tag, node_pop_name));
+    auto it = discretization_.populations.find(loc_node.pop_name);
+    if (it != discretization_.populations.end()) {
+        return it->second;
+    }
+    return discretization_.defaults;
 }
 
 arb::cell_kind model_desc::get_cell_kind(cell_gid_type gid) {
@@ -252,16 +481,23 @@ void model_desc::get_connections(cell_gid_type gid, std::vector<arb::cell_connec
                 for (unsigned s = 0; s < src_rng.size(); s++) {
                     auto source_gid = nodes_.globalize({source_pop_name, (cell_gid_type) src_id[s]});
 
-                    auto loc = std::lower_bound(source_maps_[source_gid].begin(), source_maps_[source_gid].end(),
+                    // Cells are built concurrently: look up the maps without inserting
+                    auto src_it = source_maps_.find(source_gid);
+                    if (src_it == source_maps_.end()) {
+                        throw sonata_exception("source maps initialized incorrectly");
+                    }
+                    const auto& src_map = src_it->second;
+
+                    auto loc = std::lower_bound(src_map.begin(), src_map.end(),
                                                 src_rng[s],
                                                 [](const auto &lhs, const auto &rhs) -> bool {
                                                     return std::tie(lhs.segment, lhs.position) <
                                                            std::tie(rhs.segment, rhs.position);
                                                 });
 
-                    if (loc != source_maps_[source_gid].end()) {
+                    if (loc != src_map.end()) {
                         if (*loc == src_rng[s]) {
-                            unsigned index = loc - source_maps_[source_gid].begin();
+                            unsigned index = loc - src_map.begin();
                             sources.emplace_back(source_gid, std::string{"detector@"} + std::to_string(index));
                         } else {
                             throw sonata_exception("source maps initialized incorrectly");
@@ -271,18 +507,25 @@ void model_desc::get_connections(cell_gid_type gid, std::vector<arb::cell_connec
                     }
                 }
 
+                auto tgt_it = target_maps_.find(gid);
+                auto syn_it = synapse_maps_.find(gid);
+                if (tgt_it == target_maps_.end() || syn_it == synapse_maps_.end()) {
+                    throw sonata_exception("target maps initialized incorrectly");
+                }
+                const auto& tgt_map = tgt_it->second;
+
                 unsigned e = 0;
                 for (unsigned t = r2e.first; t < r2e.second; t++, e++) {
-                    auto loc = std::lower_bound(target_maps_[gid].begin(), target_maps_[gid].end(),
+                    auto loc = std::lower_bound(tgt_map.begin(), tgt_map.end(),
                                                 std::make_pair(tgt_rng[e],
                                                                edges_.globalize({edge_pop_name, (cell_gid_type) t})),
                                                 [](const auto &lhs, const auto &rhs) -> bool {
                                                     return lhs.second < rhs.second;
                                                 });
 
-                    if (loc != target_maps_[gid].end()) {
+                    if (loc != tgt_map.end()) {
                         if ((*loc).second == edges_.globalize({edge_pop_name, (cell_gid_type) t})) {
-                            unsigned index = loc - target_maps_[gid].begin();
+                            unsigned index = syn_it->second.index[loc - tgt_map.begin()];
                             targets.emplace_back(std::string{"synapse@"} + std::to_string(index));
                         } else {
                             throw sonata_exception("target maps initialized incorrectly");
@@ -340,6 +583,284 @@ std::unordered_map<section_kind, std::vector<arb::mechanism_desc>> model_desc::g
     return node_types_.density_mech_desc(node_unique_id, std::move(density_vars));
 }
 
+cell_graph model_desc::build_cell_graph(bool with_positions, const cost_model& model) {
+    cell_graph g;
+    std::size_t num_cells = nodes_.num_elements();
+    g.kinds.resize(num_cells);
+    g.mech_sets.resize(num_cells);
+
+    // Sets of density mechanism names per section, numbered in order of appearance
+    std::map<std::vector<std::pair<int, std::string>>, unsigned> mech_set_ids;
+    auto mech_set_of = [&](type_pop_id id) {
+        std::vector<std::pair<int, std::string>> names;
+        for (const auto& [section, mechs]: node_types_.density_mech_desc(id)) {
+            for (const auto& m: mechs) {
+                names.emplace_back(section, m.name());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        return mech_set_ids.emplace(names, mech_set_ids.size()).first->second;
+    };
+
+    bool have_positions = with_positions;
+    if (with_positions) {
+        g.positions.resize(num_cells);
+    }
+
+    for (const auto& pop_name: nodes_.pop_names()) {
+        const auto& pop = nodes_[pop_name];
+        auto offset = nodes_.globalize({pop_name, 0});
+        auto type_ids = pop.get<std::vector<int>>("node_type_id");
+
+        // Kind and mechanism set of every node type of the population
+        std::unordered_map<int, std::pair<arb::cell_kind, unsigned>> types;
+        for (unsigned i = 0; i < type_ids.size(); i++) {
+            auto it = types.find(type_ids[i]);
+            if (it == types.end()) {
+                type_pop_id id(type_ids[i], pop_name);
+                it = types.emplace(type_ids[i], std::make_pair(node_types_.cell_kind(id), mech_set_of(id))).first;
+            }
+            g.kinds[offset + i] = it->second.first;
+            g.mech_sets[offset + i] = it->second.second;
+        }
+
+        // Positions from the x/y/z datasets of the node groups
+        if (have_positions) {
+            auto group_ids = pop.get<std::vector<int>>("node_group_id");
+            auto group_idx = pop.get<std::vector<int>>("node_group_index");
+
+            std::unordered_map<int, std::array<std::vector<double>, 3>> group_positions;
+            for (unsigned i = 0; i < group_ids.size() && have_positions; i++) {
+                auto it = group_positions.find(group_ids[i]);
+                if (it == group_positions.end()) {
+                    auto lgi = pop.find_group(std::to_string(group_ids[i]));
+                    if (lgi == -1) {
+                        have_positions = false;
+                        break;
+                    }
+                    const auto& group = pop[lgi];
+                    std::array<std::vector<double>, 3> xyz;
+                    for (unsigned d = 0; d < 3; d++) {
+                        std::string name(1, "xyz"[d]);
+                        if (group.find_dataset(name) == -1) {
+                            have_positions = false;
+                            break;
+                        }
+                        xyz[d] = group.get<std::vector<double>>(name);
+                    }
+                    it = group_positions.emplace(group_ids[i], std::move(xyz)).first;
+                }
+                if (have_positions) {
+                    for (unsigned d = 0; d < 3; d++) {
+                        g.positions[offset + i][d] = it->second[d].at(group_idx[i]);
+                    }
+                }
+            }
+        }
+    }
+    if (!have_positions) {
+        g.positions.clear();
+    }
+
+    // The connectivity is built from the edge indices of every edge population, without reading the edges:
+    // every rank reads the index rows of a share of the sources and of the targets, and the edge intervals of
+    // all ranks are gathered. The edges between a source and a target are the overlaps of their intervals.
+    // Connections of a cell to itself are left out of the pairs, but count as synapses
+#ifdef ARB_MPI_ENABLED
+    std::size_t rank = sonata::rank(MPI_COMM_WORLD), num_ranks = sonata::size(MPI_COMM_WORLD);
+#else
+    std::size_t rank = 0, num_ranks = 1;
+#endif
+    std::vector<std::uint64_t> pairs;
+    std::vector<unsigned> counts;
+    std::vector<unsigned> synapses(num_cells, 0);
+    for (const auto& target_pop: nodes_.pop_names()) {
+        std::set<std::pair<std::string, std::string>> edge_pops;
+        for (const auto& e: edge_types_.edge_to_source_of_target(target_pop)) {
+            edge_pops.insert(e);
+        }
+        for (const auto& [edge_pop_name, source_pop]: edge_pops) {
+            if (!edges_.find_population(edge_pop_name)) {
+                continue;
+            }
+            if (!nodes_.find_population(source_pop)) {
+                throw sonata_exception("source population of edge population not available");
+            }
+            const auto& index = edges_[edge_pop_name]["indicies"];
+            auto sources = read_edge_intervals(index["source_to_target"], nodes_.globalize({source_pop, 0}),
+                                               rank, num_ranks);
+            auto targets = read_edge_intervals(index["target_to_source"], nodes_.globalize({target_pop, 0}),
+                                               rank, num_ranks);
+#ifdef ARB_MPI_ENABLED
+            sources = gather_all(sources, MPI_COMM_WORLD);
+            targets = gather_all(targets, MPI_COMM_WORLD);
+#endif
+            auto first_less = [](const edge_interval& a, const edge_interval& b) { return a.first < b.first; };
+            std::sort(sources.begin(), sources.end(), first_less);
+            std::sort(targets.begin(), targets.end(), first_less);
+
+            for (const auto& t: targets) {
+                synapses.at(t.node) += t.last - t.first;
+            }
+
+            // The intervals of an index are disjoint: sweep both in edge order
+            std::size_t i = 0, j = 0;
+            while (i < sources.size() && j < targets.size()) {
+                const auto& s = sources[i];
+                const auto& t = targets[j];
+                auto first = std::max(s.first, t.first), last = std::min(s.last, t.last);
+                if (first < last && s.node != t.node) {
+                    std::uint64_t a = s.node, b = t.node;
+                    pairs.push_back(std::min(a, b) << 32 | std::max(a, b));
+                    counts.push_back(last - first);
+                }
+                if (s.last < t.last) {
+                    i++;
+                }
+                else {
+                    j++;
+                }
+            }
+        }
+    }
+
+    // Merge the edges between the same cells
+    auto merge = [](std::vector<std::uint64_t>& keys, std::vector<unsigned>& counts) {
+        std::vector<std::size_t> order(keys.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](auto a, auto b) { return keys[a] < keys[b]; });
+
+        std::vector<std::uint64_t> merged_keys;
+        std::vector<unsigned> merged_counts;
+        for (auto i: order) {
+            if (!merged_keys.empty() && merged_keys.back() == keys[i]) {
+                merged_counts.back() += counts[i];
+            }
+            else {
+                merged_keys.push_back(keys[i]);
+                merged_counts.push_back(counts[i]);
+            }
+        }
+        keys = std::move(merged_keys);
+        counts = std::move(merged_counts);
+    };
+
+    merge(pairs, counts);
+
+    std::vector<cell_gid_type> sources, targets;
+    sources.reserve(pairs.size());
+    targets.reserve(pairs.size());
+    for (auto p: pairs) {
+        sources.push_back(p >> 32);
+        targets.push_back(p & 0xffffffff);
+    }
+    set_adjacency(g, sources, targets, counts);
+
+    // Every rank loads the morphologies and mechanisms of an equal share of the cells
+    std::vector<cell_features> features;
+    for (cell_gid_type gid = num_cells*rank/num_ranks; gid < num_cells*(rank + 1)/num_ranks; gid++) {
+        cell_features f;
+        f.kind = g.kinds[gid];
+        f.synapses = synapses[gid];
+        if (f.kind == arb::cell_kind::cable) {
+            add_morphology_features(f, get_cell_morphology(gid), get_discretization(gid));
+            for (const auto& section: get_density_mechs(gid)) {
+                f.density_mechs += section.second.size();
+            }
+        }
+        features.push_back(f);
+    }
+#ifdef ARB_MPI_ENABLED
+    g.features = gather_all(features, MPI_COMM_WORLD);
+#else
+    g.features = std::move(features);
+#endif
+    g.costs = model.estimate(g.features);
+
+    return g;
+}
+
+// Rows of a dataset at most this far apart are read in one block by the read plans
+static constexpr hsize_t read_plan_gap = 1024;
+
+h5_read_plan model_desc::local_read_plan() const {
+    h5_read_plan plan;
+    for (const auto& [pop_id, ids]: local_rows_.nodes) {
+        const auto& pop = nodes_[int(pop_id)];
+        for (auto [first, last]: id_ranges(ids)) {
+            for (auto name: {"node_type_id", "node_group_id", "node_group_index"}) {
+                plan.add(pop.dataset(name), first, last);
+            }
+        }
+    }
+    for (const auto& [pop_id, ids]: local_rows_.targets) {
+        const auto& t2s = edges_[int(pop_id)]["indicies"]["target_to_source"];
+        for (auto [first, last]: id_ranges(ids)) {
+            plan.add(t2s.dataset("node_id_to_ranges"), first, last);
+        }
+        for (auto [first, last]: merge_ranges(local_rows_.ranges.at(pop_id))) {
+            plan.add(t2s.dataset("range_to_edge_id"), first, last);
+        }
+    }
+    for (const auto& [pop_id, ranges]: local_rows_.edges) {
+        const auto& pop = edges_[int(pop_id)];
+        for (auto [first, last]: merge_ranges(ranges)) {
+            for (auto name: {"edge_group_id", "edge_group_index", "edge_type_id", "source_node_id"}) {
+                plan.add(pop.dataset(name), first, last);
+            }
+        }
+    }
+    plan.coalesce(read_plan_gap);
+    return plan;
+}
+
+h5_read_plan model_desc::group_read_plan() const {
+    h5_read_plan plan;
+
+    // Rows of the groups of rows [first, last) of population `pop`, from their group ids and indices
+    auto add_group_rows = [&](const h5_wrapper& pop, const std::string& id_name, const std::string& index_name,
+                              unsigned first, unsigned last) {
+        auto ids = pop.get<std::vector<int>>(id_name, first, last);
+        auto idx = pop.get<std::vector<int>>(index_name, first, last);
+
+        std::map<int, std::pair<unsigned, unsigned>> group_rows;
+        for (unsigned i = 0; i < ids.size(); i++) {
+            auto [it, inserted] = group_rows.emplace(ids[i], std::make_pair(idx[i], idx[i] + 1));
+            it->second.first = std::min<unsigned>(it->second.first, idx[i]);
+            it->second.second = std::max<unsigned>(it->second.second, idx[i] + 1);
+        }
+        for (const auto& [group_id, rows]: group_rows) {
+            auto lgi = pop.find_group(std::to_string(group_id));
+            if (lgi == -1) {
+                continue;
+            }
+            const auto& group = pop[lgi];
+            for (const auto& d: group.datasets()) {
+                plan.add(d, rows.first, rows.second);
+            }
+            auto dpi = group.find_group("dynamics_params");
+            if (dpi != -1) {
+                for (const auto& d: group[dpi].datasets()) {
+                    plan.add(d, rows.first, rows.second);
+                }
+            }
+        }
+    };
+
+    for (const auto& [pop_id, ids]: local_rows_.nodes) {
+        for (auto [first, last]: id_ranges(ids)) {
+            add_group_rows(nodes_[int(pop_id)], "node_group_id", "node_group_index", first, last);
+        }
+    }
+    for (const auto& [pop_id, ranges]: local_rows_.edges) {
+        for (auto [first, last]: merge_ranges(ranges)) {
+            add_group_rows(edges_[int(pop_id)], "edge_group_id", "edge_group_index", first, last);
+        }
+    }
+    plan.coalesce(read_plan_gap);
+    return plan;
+}
+
 // Private helper functions
 
 // Read from HDF5 file/ CSV file depending on where the information is available
@@ -582,23 +1103,59 @@ std::vector<double> model_desc::delay_range(unsigned edge_pop_id, std::pair<unsi
     return ret;
 }
 
+void model_desc::close_files() {
+    nodes_.close();
+    edges_.close();
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-io_desc::io_desc(h5_record nodes,
-                       std::vector<spike_in_info> spikes,
-                       std::vector<current_clamp_info> current_clamp,
-                       std::vector<probe_info> probes) : nodes_(nodes){
-    build_spike_map(spikes);
-    build_current_clamp_map(current_clamp);
-    build_probe_map(probes);
-};
+io_desc::io_desc(const h5_record& nodes,
+                 std::vector<spike_in_info> spikes,
+                 std::vector<current_clamp_info> current_clamp,
+                 std::vector<probe_info> probes):
+pop_names_(nodes.pop_names()),
+pop_parts_(nodes.partitions()),
+pop_map_(nodes.map()),
+spikes_(std::move(spikes)),
+current_clamps_(std::move(current_clamp)),
+probes_(std::move(probes)) {}
+
+void io_desc::build_local_maps(const std::vector<arb::group_description>& groups) {
+    // Maps of a previous decomposition are replaced
+    spike_map_.clear();
+    probe_map_.clear();
+    probe_groups_.clear();
+
+    std::unordered_set<cell_gid_type> local_gids;
+    for (const auto& group: groups) {
+        local_gids.insert(group.gids.begin(), group.gids.end());
+    }
+
+    build_spike_map(local_gids);
+    build_current_clamp_map(local_gids);
+    build_probe_map(local_gids);
+}
+
+local_element io_desc::localize(cell_gid_type gid) const {
+    for (unsigned i = 1; i < pop_parts_.size(); i++) {
+        if (gid < pop_parts_[i]) {
+            return {pop_names_[i-1], gid - pop_parts_[i-1]};
+        }
+    }
+    return local_element();
+}
+
+cell_gid_type io_desc::globalize(const local_element& n) const {
+    return n.el_id + pop_parts_[pop_map_.at(n.pop_name)];
+}
 
-void io_desc::build_spike_map(std::vector<spike_in_info> spikes) {
-    for (unsigned gid = 0; gid < nodes_.num_elements(); gid++) {
+void io_desc::build_spike_map(const std::unordered_set<cell_gid_type>& local_gids) {
+    for (auto gid: local_gids) {
         std::vector<double> spike_times;
 
-        auto loc_cell = nodes_.localize(gid);
+        auto loc_cell = localize(gid);
 
-        for (auto sp: spikes) {
+        for (const auto& sp: spikes_) {
             if (loc_cell.pop_name != sp.population) {
                 continue;
             }
@@ -614,97 +1171,247 @@ void io_desc::build_spike_map(std::vector<spike_in_info> spikes) {
             spike_times.insert(spike_times.end(), spk_times.begin(), spk_times.end());
         }
 
-        std::sort(spike_times.begin(), spike_times.end());
-        spike_map_.insert({gid, std::move(spike_times)});
+        if (!spike_times.empty()) {
+            std::sort(spike_times.begin(), spike_times.end());
+            spike_map_.insert({gid, std::move(spike_times)});
+        }
+    }
+}
+
+// True if `file` names an hdf5 file, judging by its extension
+static bool is_h5_file_name(const std::string& file) {
+    for (std::string ext: {".h5", ".hdf5"}) {
+        if (file.size() >= ext.size() && file.compare(file.size() - ext.size(), ext.size(), ext) == 0) {
+            return true;
+        }
     }
+    return false;
 }
 
-void io_desc::build_current_clamp_map(std::vector<current_clamp_info> current) {
+io_desc::clamp_electrode_table io_desc::read_clamp_electrodes(const std::string& file,
+                                                              const std::unordered_set<cell_gid_type>& local_gids) const {
+    clamp_electrode_table table;
 
-    struct param_info {
-        double dur;
-        double amp;
-        double delay;
+    auto add_electrode = [&](unsigned id, cell_gid_type gid, unsigned sec_id, double seg_x) {
+        if (local_gids.count(gid)) {
+            table.electrode_id.push_back(id);
+            table.gid.push_back(gid);
+            table.sec_id.push_back(sec_id);
+            table.seg_x.push_back(seg_x);
+        }
     };
 
-    struct loc_info {
-        cell_gid_type gid;
-        std::string population;
-        unsigned seg;
-        double pos;
+    auto check_population = [&](const std::string& pop_name) {
+        if (!pop_map_.count(pop_name)) {
+            throw sonata_exception("Electrode population \"" + pop_name + "\" not present in node populations");
+        }
     };
-    for (auto curr_clamp : current){
-        std::unordered_map<unsigned, param_info> param_map;
-        std::unordered_map<unsigned, loc_info> loc_map;
-
-        auto stim_param_data = curr_clamp.stim_params.get_data();
-        auto stim_param_cols = stim_param_data.front();
-
-        for(auto it = stim_param_data.begin()+1; it < stim_param_data.end(); it++) {
-            loc_info loc;
-            unsigned pos = 0, id;
-
-            for (auto field: *it) {
-                if(stim_param_cols[pos] == "electrode_id") {
-                    id = std::atoi(field.c_str());
-                } else if (stim_param_cols[pos] == "node_id") {
-                    loc.gid = std::atoi(field.c_str());
-                } else if (stim_param_cols[pos] == "population") {
-                    loc.population = field;
-                } else if (stim_param_cols[pos] == "sec_id") {
-                    loc.seg = std::atoi(field.c_str());
-                } else if (stim_param_cols[pos] == "seg_x") {
-                    loc.pos = std::atof(field.c_str());
-                }
-                pos++;
-            }
-            loc_map[id] = loc;
+
+    if (is_h5_file_name(file)) {
+        // Electrodes are grouped by population: /electrodes/<population>/{electrode_id, node_id, sec_id, seg_x}.
+        // All ranks read all of them
+        h5_collective_reads collective;
+        h5_file f(file);
+        h5_wrapper top(f.top_group_);
+
+        auto elec_idx = top.find_group("electrodes");
+        if (elec_idx == -1) {
+            throw sonata_file_exception("Electrode file {} doesn't have top level group \"electrodes\"", file);
         }
+        auto electrodes = top[elec_idx];
 
-        auto stim_loc_data = curr_clamp.stim_loc.get_data();
-        auto stim_loc_cols = stim_loc_data.front();
+        for (int p = 0; p < electrodes.size(); p++) {
+            const auto& pop = electrodes[p];
+            auto pop_name = pop.name();
+            check_population(pop_name);
 
-        for(auto it = stim_loc_data.begin()+1; it < stim_loc_data.end(); it++) {
-            param_info param;
-            unsigned pos = 0, id;
+            auto ids = pop.get<std::vector<int>>("electrode_id");
+            auto node_ids = pop.get<std::vector<int>>("node_id");
+            auto sec_ids = pop.get<std::vector<int>>("sec_id");
+            auto seg_x = pop.get<std::vector<double>>("seg_x");
 
-            for (auto field: *it) {
-                if(stim_loc_cols[pos] == "electrode_id") {
-                    id = std::atoi(field.c_str());
-                } else if (stim_loc_cols[pos] == "dur") {
-                    param.dur = std::atof(field.c_str());
-                } else if (stim_loc_cols[pos] == "amp") {
-                    param.amp = std::atof(field.c_str());
-                } else if (stim_loc_cols[pos] == "delay") {
-                    param.delay = std::atof(field.c_str());
-                }
-                pos++;
+            if (node_ids.size() != ids.size() || sec_ids.size() != ids.size() || seg_x.size() != ids.size()) {
+                throw sonata_file_exception("Electrode datasets of different sizes in file {}", file);
             }
-            param_map[id] = param;
+
+            for (unsigned i = 0; i < ids.size(); i++) {
+                add_electrode(ids[i], globalize({pop_name, (unsigned)node_ids[i]}), sec_ids[i], seg_x[i]);
+            }
+        }
+    }
+    else {
+        csv_file f(file);
+
+        // Resolve the columns once
+        auto id_col = f.column("electrode_id");
+        auto node_col = f.column("node_id");
+        auto pop_col = f.column("population");
+        auto sec_col = f.column("sec_id");
+        auto x_col = f.column("seg_x");
+
+        if (id_col == -1 || node_col == -1 || pop_col == -1 || sec_col == -1 || x_col == -1) {
+            throw sonata_file_exception("Electrode file {} requires columns electrode_id, node_id, population, sec_id and seg_x", file);
         }
+        unsigned num_cols = std::max({id_col, node_col, pop_col, sec_col, x_col}) + 1;
 
-        for (auto i: loc_map) {
-            if (param_map.find(i.first) != param_map.end()) {
-                auto params = param_map.at(i.first);
+        auto data = f.get_data();
+        for (auto it = data.begin()+1; it < data.end(); it++) {
+            const auto& row = *it;
+            if (row.empty()) {
+                continue;
+            }
+            if (row.size() < num_cols) {
+                throw sonata_file_exception("Missing fields in electrode file {}", file);
+            }
 
-                auto local_loc = i.second;
-                auto global_gid = nodes_.globalize({local_loc.population, local_loc.gid});
+            const auto& pop_name = row[pop_col];
+            check_population(pop_name);
 
-                current_clamp_map_[global_gid].emplace_back(params.dur, params.amp, params.delay, arb::mlocation{local_loc.seg, local_loc.pos});
+            auto gid = globalize({pop_name, csv_to_unsigned(row[node_col])});
+            add_electrode(csv_to_unsigned(row[id_col]), gid, csv_to_unsigned(row[sec_col]), csv_to_double(row[x_col]));
+        }
+    }
+    return table;
+}
+
+io_desc::clamp_input_table io_desc::read_clamp_inputs(const std::string& file) const {
+    clamp_input_table table;
+
+    if (is_h5_file_name(file)) {
+        // Inputs are stored in one table: /inputs/{electrode_id, dur, amp, delay}; all ranks read all of them
+        h5_collective_reads collective;
+        h5_file f(file);
+        h5_wrapper top(f.top_group_);
+
+        auto input_idx = top.find_group("inputs");
+        if (input_idx == -1) {
+            throw sonata_file_exception("Input file {} doesn't have top level group \"inputs\"", file);
+        }
+        const auto& inputs = top[input_idx];
+
+        auto ids = inputs.get<std::vector<int>>("electrode_id");
+        table.electrode_id.assign(ids.begin(), ids.end());
+        table.dur = inputs.get<std::vector<double>>("dur");
+        table.amp = inputs.get<std::vector<double>>("amp");
+        table.delay = inputs.get<std::vector<double>>("delay");
+
+        auto n = table.electrode_id.size();
+        if (table.dur.size() != n || table.amp.size() != n || table.delay.size() != n) {
+            throw sonata_file_exception("Input datasets of different sizes in file {}", file);
+        }
+    }
+    else {
+        csv_file f(file);
+
+        // Resolve the columns once
+        auto id_col = f.column("electrode_id");
+        auto dur_col = f.column("dur");
+        auto amp_col = f.column("amp");
+        auto delay_col = f.column("delay");
+
+        if (id_col == -1 || dur_col == -1 || amp_col == -1 || delay_col == -1) {
+            throw sonata_file_exception("Input file {} requires columns electrode_id, dur, amp and delay", file);
+        }
+        unsigned num_cols = std::max({id_col, dur_col, amp_col, delay_col}) + 1;
+
+        auto data = f.get_data();
+        auto num_rows = data.empty() ? 0 : data.size() - 1;
+        table.electrode_id.reserve(num_rows);
+        table.dur.reserve(num_rows);
+        table.amp.reserve(num_rows);
+        table.delay.reserve(num_rows);
+
+        for (auto it = data.begin()+1; it < data.end(); it++) {
+            const auto& row = *it;
+            if (row.empty()) {
+                continue;
             }
-            else {
+            if (row.size() < num_cols) {
+                throw sonata_file_exception("Missing fields in input file {}", file);
+            }
+            table.electrode_id.push_back(csv_to_unsigned(row[id_col]));
+            table.dur.push_back(csv_to_double(row[dur_col]));
+            table.amp.push_back(csv_to_double(row[amp_col]));
+            table.delay.push_back(csv_to_double(row[delay_col]));
+        }
+    }
+    return table;
+}
+
+void io_desc::build_current_clamp_map(const std::unordered_set<cell_gid_type>& local_gids) {
+    // Clamps on local gids, in order of appearance
+    std::vector<cell_gid_type> gids;
+    std::vector<current_clamp_desc> descs;
+
+    for (const auto& clamp: current_clamps_) {
+        auto electrodes = read_clamp_electrodes(clamp.electrode_file, local_gids);
+        auto inputs = read_clamp_inputs(clamp.input_file);
+
+        // Map from electrode id to row in the input table
+        std::unordered_map<unsigned, unsigned> input_row;
+        input_row.reserve(inputs.electrode_id.size());
+        for (unsigned i = 0; i < inputs.electrode_id.size(); i++) {
+            input_row[inputs.electrode_id[i]] = i;
+        }
+
+        gids.reserve(gids.size() + electrodes.gid.size());
+        descs.reserve(descs.size() + electrodes.gid.size());
+
+        for (unsigned i = 0; i < electrodes.electrode_id.size(); i++) {
+            auto it = input_row.find(electrodes.electrode_id[i]);
+            if (it == input_row.end()) {
                 throw sonata_exception("Electrode id has no corresponding input description");
             }
-        };
+            auto row = it->second;
+
+            gids.push_back(electrodes.gid[i]);
+            descs.emplace_back(inputs.dur[row], inputs.amp[row], inputs.delay[row],
+                               arb::mlocation{electrodes.sec_id[i], electrodes.seg_x[i]});
+        }
+    }
+
+    // Group the clamps by gid with a counting sort, keeping their order of appearance
+    std::unordered_map<cell_gid_type, unsigned> offset;
+    for (auto gid: gids) {
+        offset[gid]++;
+    }
+
+    clamp_gids_.clear();
+    clamp_gids_.reserve(offset.size());
+    for (const auto& g: offset) {
+        clamp_gids_.push_back(g.first);
+    }
+    std::sort(clamp_gids_.begin(), clamp_gids_.end());
+
+    clamp_divs_.assign(1, 0);
+    clamp_divs_.reserve(clamp_gids_.size() + 1);
+    for (auto gid: clamp_gids_) {
+        auto count = offset[gid];
+        offset[gid] = clamp_divs_.back();
+        clamp_divs_.push_back(clamp_divs_.back() + count);
+    }
+
+    std::vector<unsigned> order(gids.size());
+    for (unsigned i = 0; i < gids.size(); i++) {
+        order[offset[gids[i]]++] = i;
+    }
+
+    clamps_.clear();
+    clamps_.reserve(order.size());
+    for (auto i: order) {
+        clamps_.push_back(descs[i]);
     }
 }
 
-void io_desc::build_probe_map(std::vector<probe_info> probes) {
+void io_desc::build_probe_map(const std::unordered_set<cell_gid_type>& local_gids) {
     std::unordered_map<cell_gid_type, cell_size_type> probe_count;
 
-    for (auto probe: probes) {
+    for (const auto& probe: probes_) {
         for (auto i: probe.node_ids) {
-            auto gid = nodes_.globalize({probe.population, i});
+            auto gid = globalize({probe.population, i});
+            if (!local_gids.count(gid)) {
+                continue;
+            }
 
             if (probe_count.find(gid) == probe_count.end()) {
                 probe_count[gid] = 0;
@@ -722,9 +1429,11 @@ void io_desc::build_probe_map(std::vector<probe_info> probes) {
     }
 }
 
-std::vector<current_clamp_desc> io_desc::get_current_clamps(cell_gid_type gid) const {
-    if (current_clamp_map_.find(gid) != current_clamp_map_.end()) {
-        return current_clamp_map_.at(gid);
+span<const current_clamp_desc> io_desc::get_current_clamps(cell_gid_type gid) const {
+    auto it = std::lower_bound(clamp_gids_.begin(), clamp_gids_.end(), gid);
+    if (it != clamp_gids_.end() && *it == gid) {
+        auto i = it - clamp_gids_.begin();
+        return {clamps_.data() + clamp_divs_[i], clamp_divs_[i+1] - clamp_divs_[i]};
     }
     return {};
 };
@@ -746,4 +1455,34 @@ std::vector<trace_index_and_info> io_desc::get_probes(cell_gid_type gid) const {
 std::unordered_map<std::string, std::vector<cell_member_type>> io_desc::get_probe_groups() const {
     return probe_groups_;
 };
+
+std::size_t io_desc::memory_bytes() const {
+    // Buckets and nodes of a hash map, without the heap memory of its values
+    auto map_bytes = [](const auto& map) {
+        using value_type = typename std::decay_t<decltype(map)>::value_type;
+        return map.bucket_count()*sizeof(void*) + map.size()*(sizeof(value_type) + sizeof(void*));
+    };
+
+    std::size_t bytes = clamp_gids_.capacity()*sizeof(cell_gid_type) + clamp_divs_.capacity()*sizeof(unsigned) +
+                        clamps_.capacity()*sizeof(current_clamp_desc);
+    bytes += map_bytes(spike_map_);
+    for (const auto& [gid, times]: spike_map_) {
+        bytes += times.capacity()*sizeof(double);
+    }
+    bytes += map_bytes(probe_map_);
+    for (const auto& [gid, probes]: probe_map_) {
+        bytes += probes.capacity()*sizeof(trace_index_and_info);
+    }
+    bytes += map_bytes(probe_groups_);
+    for (const auto& [file, probes]: probe_groups_) {
+        bytes += file.capacity() + probes.capacity()*sizeof(cell_member_type);
+    }
+    return bytes;
+}
+
+void io_desc::close_files() {
+    for (auto& sp: spikes_) {
+        sp.data.close();
+    }
+}
 } // namespace sonata
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include <arbor/morph/mprovider.hpp>
+#include <arborio/label_parse.hpp>
+
+#include <sonata/discretization.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+namespace sonata {
+arb::locset parse_cv_locset(const std::string& expr) {
+    auto ls = arborio::parse_locset_expression(expr);
+    if (!ls) {
+        throw sonata_exception("Invalid locset of explicit discretization \"" + expr + "\": " + ls.error().what());
+    }
+    return *ls;
+}
+
+bool is_soma_only(const arb::morphology& morph) {
+    if (morph.empty()) {
+        return false;
+    }
+    for (unsigned b = 0; b < morph.num_branches(); b++) {
+        for (const auto& s: morph.branch_segments(b)) {
+            if (s.tag != 1) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static double branch_length(const arb::morphology& morph, unsigned b) {
+    double length = 0;
+    for (const auto& s: morph.branch_segments(b)) {
+        length += std::sqrt((s.dist.x - s.prox.x)*(s.dist.x - s.prox.x) +
+                            (s.dist.y - s.prox.y)*(s.dist.y - s.prox.y) +
+                            (s.dist.z - s.prox.z)*(s.dist.z - s.prox.z));
+    }
+    return length;
+}
+
+arb::cv_policy make_cv_policy(const discretization_info& d, const arb::morphology& morph) {
+    if (d.single_cv_soma && is_soma_only(morph)) {
+        return arb::cv_policy_single();
+    }
+    if (d.policy == "max-extent") {
+        return arb::cv_policy_max_extent(d.max_extent);
+    }
+    if (d.policy == "explicit") {
+        return arb::cv_policy_explicit(parse_cv_locset(d.locset));
+    }
+    return arb::cv_policy_fixed_per_branch(d.cvs_per_branch);
+}
+
+unsigned count_cvs(const discretization_info& d, const arb::morphology& morph) {
+    if (d.single_cv_soma && is_soma_only(morph)) {
+        return 1;
+    }
+    if (d.policy == "max-extent") {
+        unsigned cvs = 0;
+        for (unsigned b = 0; b < morph.num_branches(); b++) {
+            cvs += std::max(1u, (unsigned)std::ceil(branch_length(morph, b)/d.max_extent));
+        }
+        return cvs;
+    }
+    if (d.policy == "explicit") {
+        return arb::thingify(parse_cv_locset(d.locset), arb::mprovider(morph)).size() + 1;
+    }
+    return morph.num_branches()*d.cvs_per_branch;
+}
+} // namespace sonata
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+#include <sonata/h5_access.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+namespace sonata {
+namespace {
+h5_driver input_driver = h5_driver::sec2;
+
+// Property lists of the input files with mpio, H5P_DEFAULT with sec2
+hid_t input_fapl = H5P_DEFAULT;
+hid_t read_dapl = H5P_DEFAULT;
+hid_t collective_dxpl = H5P_DEFAULT;
+
+// Access property list of the input files loaded into memory, made on first use; requires cache_mutex
+hid_t core_fapl = H5P_DEFAULT;
+
+// Largest input file loaded into memory
+std::atomic<std::size_t> core_threshold{std::size_t(64) << 20};
+
+// Number of live h5_collective_reads scopes
+std::atomic<int> collective_scopes{0};
+
+// Cache settings by file and dataset name, and the access property lists of the files with a metadata cache
+// setting by file name and the property list they are made from
+std::mutex cache_mutex;
+std::map<std::pair<std::string, std::string>, h5_cache_params> cache_settings;
+std::map<std::pair<std::string, hid_t>, hid_t> file_fapls;
+
+void close_plist(hid_t& plist) {
+    if (plist != H5P_DEFAULT) {
+        H5Pclose(plist);
+        plist = H5P_DEFAULT;
+    }
+}
+
+void close_file_fapls() {
+    for (auto& f: file_fapls) {
+        H5Pclose(f.second);
+    }
+    file_fapls.clear();
+}
+
+// The values set in `from` over those of `to`
+void merge(h5_cache_params& to, const h5_cache_params& from) {
+    if (from.chunk_bytes) {
+        to.chunk_bytes = from.chunk_bytes;
+    }
+    if (from.chunk_slots) {
+        to.chunk_slots = from.chunk_slots;
+    }
+    if (from.chunk_w0 >= 0) {
+        to.chunk_w0 = from.chunk_w0;
+    }
+    if (from.metadata_bytes) {
+        to.metadata_bytes = from.metadata_bytes;
+    }
+}
+
+// Settings of `dataset` of `file`, the most specific last; requires cache_mutex
+h5_cache_params settings(const std::string& file, const std::string& dataset) {
+    h5_cache_params params;
+    for (const auto& key: {std::make_pair(std::string(), std::string()), std::make_pair(std::string(), dataset),
+                           std::make_pair(file, std::string()), std::make_pair(file, dataset)}) {
+        auto it = cache_settings.find(key);
+        if (it != cache_settings.end()) {
+            merge(params, it->second);
+        }
+    }
+    return params;
+}
+
+std::size_t next_prime(std::size_t n) {
+    auto is_prime = [](std::size_t n) {
+        for (std::size_t d = 2; d*d <= n; d++) {
+            if (n % d == 0) {
+                return false;
+            }
+        }
+        return n > 1;
+    };
+    while (!is_prime(n)) {
+        n++;
+    }
+    return n;
+}
+}
+
+h5_driver parse_h5_driver(const std::string& name) {
+    if (name == "sec2") {
+        return h5_driver::sec2;
+    }
+    if (name == "mpio") {
+        return h5_driver::mpio;
+    }
+    throw sonata_exception("Unknown hdf5 driver " + name + ", expected \"sec2\" or \"mpio\"");
+}
+
+#ifdef ARB_MPI_ENABLED
+h5_driver set_h5_access(h5_driver driver, MPI_Comm comm) {
+    reset_h5_access();
+    if (driver != h5_driver::mpio) {
+        return input_driver;
+    }
+#ifdef H5_HAVE_PARALLEL
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided < MPI_THREAD_MULTIPLE) {
+        return input_driver;
+    }
+
+    input_fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(input_fapl, comm, MPI_INFO_NULL);
+    H5Pset_all_coll_metadata_ops(input_fapl, true);
+    // A file is closed with its last object, as with sec2, rather than failing to close while groups are open
+    H5Pset_fclose_degree(input_fapl, H5F_CLOSE_WEAK);
+
+    read_dapl = H5Pcreate(H5P_DATASET_ACCESS);
+    H5Pset_all_coll_metadata_ops(read_dapl, false);
+
+    collective_dxpl = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(collective_dxpl, H5FD_MPIO_COLLECTIVE);
+
+    input_driver = h5_driver::mpio;
+#endif
+    return input_driver;
+}
+
+hid_t h5_mpio_fapl(MPI_Comm comm) {
+#ifdef H5_HAVE_PARALLEL
+    auto fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(fapl, comm, MPI_INFO_NULL);
+    H5Pset_coll_metadata_write(fapl, true);
+    return fapl;
+#else
+    throw sonata_exception("MPI-IO output requires hdf5 built with parallel support");
+#endif
+}
+#endif
+
+void reset_h5_access() {
+    close_plist(input_fapl);
+    close_plist(read_dapl);
+    close_plist(collective_dxpl);
+    input_driver = h5_driver::sec2;
+
+    // Made from the lists closed above
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    close_file_fapls();
+    close_plist(core_fapl);
+}
+
+h5_driver h5_input_driver() {
+    return input_driver;
+}
+
+void set_h5_core_threshold(std::size_t bytes) {
+    core_threshold = bytes;
+}
+
+std::size_t h5_core_threshold() {
+    return core_threshold;
+}
+
+hid_t h5_input_fapl(const std::string& file, bool in_memory) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    // Files that can't be sized are left to fail to open with the driver
+    std::error_code ec;
+    auto size = in_memory? std::filesystem::file_size(file, ec): 0;
+    auto base = input_fapl;
+    if (in_memory && !ec && core_threshold && size <= core_threshold) {
+        if (core_fapl == H5P_DEFAULT) {
+            // Read only: the image is never written back
+            core_fapl = H5Pcreate(H5P_FILE_ACCESS);
+            H5Pset_fapl_core(core_fapl, 1 << 20, false);
+        }
+        base = core_fapl;
+    }
+
+    auto metadata_bytes = settings(file, "").metadata_bytes;
+    if (!metadata_bytes) {
+        return base;
+    }
+    auto& fapl = file_fapls[{file, base}];
+    if (!fapl) {
+        fapl = base == H5P_DEFAULT? H5Pcreate(H5P_FILE_ACCESS): H5Pcopy(base);
+
+        // The cache starts at the size set, and may still grow or shrink from there
+        H5AC_cache_config_t config;
+        config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+        H5Pget_mdc_config(fapl, &config);
+        config.set_initial_size = true;
+        config.initial_size = metadata_bytes;
+        config.min_size = std::min<std::size_t>(config.min_size, metadata_bytes);
+        config.max_size = std::max<std::size_t>(config.max_size, metadata_bytes);
+        H5Pset_mdc_config(fapl, &config);
+    }
+    return fapl;
+}
+
+h5_cache_params parse_h5_cache(const std::string& text) {
+    h5_cache_params params;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        auto eq = item.find('=');
+        auto key = item.substr(0, eq);
+        auto value = eq == std::string::npos? std::string(): item.substr(eq + 1);
+        try {
+            if (key == "chunk_bytes") {
+                params.chunk_bytes = std::stoull(value);
+            }
+            else if (key == "chunk_slots") {
+                params.chunk_slots = std::stoull(value);
+            }
+            else if (key == "chunk_w0") {
+                params.chunk_w0 = std::stod(value);
+            }
+            else if (key == "metadata_bytes") {
+                params.metadata_bytes = std::stoull(value);
+            }
+            else {
+                throw sonata_exception("Unknown hdf5 cache setting \"" + key + "\", expected chunk_bytes, chunk_slots, "
+                                       "chunk_w0 or metadata_bytes");
+            }
+        }
+        catch (std::logic_error&) {
+            throw sonata_exception("Invalid value of hdf5 cache setting " + key + ": \"" + value + "\"");
+        }
+    }
+    if (params.chunk_w0 > 1) {
+        throw sonata_exception("hdf5 cache setting chunk_w0 must be between 0 and 1");
+    }
+    return params;
+}
+
+void set_h5_cache(const h5_cache_params& params, const std::string& file, const std::string& dataset) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    merge(cache_settings[{file, dataset}], params);
+}
+
+void reset_h5_cache() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_settings.clear();
+    close_file_fapls();
+}
+
+h5_cache_params h5_dataset_cache(const std::string& file, const std::string& dataset, std::size_t chunk_bytes) {
+    h5_cache_params params;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        params = settings(file, dataset);
+    }
+    if (chunk_bytes) {
+        if (!params.chunk_bytes) {
+            params.chunk_bytes = std::max<std::size_t>(4*chunk_bytes, 1 << 20);
+        }
+        if (!params.chunk_slots) {
+            params.chunk_slots = next_prime(std::max<std::size_t>(100*(params.chunk_bytes/chunk_bytes), 521));
+        }
+    }
+    if (params.chunk_w0 < 0) {
+        params.chunk_w0 = 0.75;
+    }
+    return params;
+}
+
+hid_t h5_read_dapl(const h5_cache_params& cache) {
+    auto dapl = read_dapl == H5P_DEFAULT? H5Pcreate(H5P_DATASET_ACCESS): H5Pcopy(read_dapl);
+    H5Pset_chunk_cache(dapl,
+                       cache.chunk_slots? cache.chunk_slots: H5D_CHUNK_CACHE_NSLOTS_DEFAULT,
+                       cache.chunk_bytes? cache.chunk_bytes: H5D_CHUNK_CACHE_NBYTES_DEFAULT,
+                       cache.chunk_w0 >= 0? cache.chunk_w0: H5D_CHUNK_CACHE_W0_DEFAULT);
+    return dapl;
+}
+
+hid_t h5_whole_read_dxpl([[maybe_unused]] hid_t dataset) {
+    if (collective_scopes == 0 || collective_dxpl == H5P_DEFAULT) {
+        return H5P_DEFAULT;
+    }
+#ifdef H5_HAVE_PARALLEL
+    // Collective transfers are only valid in files opened with MPI-IO, not in those loaded into memory
+    auto file = H5Iget_file_id(dataset);
+    auto fapl = H5Fget_access_plist(file);
+    bool mpio = H5Pget_driver(fapl) == H5FD_MPIO;
+    H5Pclose(fapl);
+    H5Fclose(file);
+    return mpio? collective_dxpl: H5P_DEFAULT;
+#else
+    return H5P_DEFAULT;
+#endif
+}
+
+h5_collective_reads::h5_collective_reads() {
+    collective_scopes++;
+}
+
+h5_collective_reads::~h5_collective_reads() {
+    collective_scopes--;
+}
+} // namespace sonata
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+
+#include <sonata/h5_io_service.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+namespace sonata {
+static std::atomic<h5_io_service*> active_service{nullptr};
+
+void h5_read_plan::add(const std::shared_ptr<h5_dataset>& dataset, hsize_t begin, hsize_t end) {
+    if (dataset && begin < end && (dataset->is_integer() || dataset->is_float())) {
+        requests_.push_back({dataset, begin, end});
+    }
+}
+
+void h5_read_plan::coalesce(hsize_t gap) {
+    auto key = [](const h5_read_request& r) {
+        return std::make_tuple(r.dataset->file_offset(), r.dataset.get(), r.begin);
+    };
+    std::sort(requests_.begin(), requests_.end(), [&](const auto& a, const auto& b) { return key(a) < key(b); });
+
+    std::vector<h5_read_request> merged;
+    for (auto& r: requests_) {
+        if (!merged.empty() && merged.back().dataset == r.dataset && r.begin <= merged.back().end + gap) {
+            merged.back().end = std::max(merged.back().end, r.end);
+        }
+        else {
+            merged.push_back(std::move(r));
+        }
+    }
+    requests_ = std::move(merged);
+}
+
+h5_io_service::h5_io_service() {
+    thread_ = std::thread([this]() { run(); });
+
+    h5_io_service* none = nullptr;
+    if (!active_service.compare_exchange_strong(none, this)) {
+        {
+            std::lock_guard<std::mutex> l(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+        throw sonata_exception("Another hdf5 I/O service is active");
+    }
+}
+
+h5_io_service::~h5_io_service() {
+    h5_io_service* self = this;
+    active_service.compare_exchange_strong(self, nullptr);
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+h5_io_service* h5_io_service::active() {
+    return active_service.load();
+}
+
+void h5_io_service::enqueue(std::function<void(bool)> job) {
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (!stop_) {
+            queue_.push_back(std::move(job));
+            cv_.notify_one();
+            return;
+        }
+    }
+    // Stopping: reads run on the calling thread, prefetching is cancelled
+    job(true);
+}
+
+void h5_io_service::run() {
+    while (true) {
+        std::function<void(bool)> job;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> l(mutex_);
+            cv_.wait(l, [this]() { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            job = std::move(queue_.front());
+            queue_.pop_front();
+            stopping = stop_;
+        }
+        job(stopping);
+    }
+}
+
+std::shared_future<void> h5_io_service::prefetch(const h5_read_plan& plan) {
+    for (const auto& r: plan.requests()) {
+        auto b = std::make_shared<block>();
+        b->begin = r.begin;
+        b->end = r.end;
+        auto loaded = std::make_shared<std::promise<void>>();
+        b->ready = loaded->get_future().share();
+        {
+            std::lock_guard<std::mutex> l(mutex_);
+            blocks_[r.dataset.get()][r.begin] = b;
+        }
+
+        enqueue([this, r, b, loaded](bool cancelled) {
+            if (!cancelled) {
+                try {
+                    if (r.dataset->is_integer()) {
+                        b->ints = r.dataset->read_rows<int>(r.begin, r.end);
+                    }
+                    else {
+                        b->doubles = r.dataset->read_rows<double>(r.begin, r.end);
+                    }
+                    b->loaded = true;
+                    blocks_loaded_++;
+                    bytes_loaded_ += b->ints.size()*sizeof(int) + b->doubles.size()*sizeof(double);
+                }
+                catch (std::exception&) {
+                    // Reads of the rows of the block go to the file instead
+                }
+            }
+            loaded->set_value();
+        });
+    }
+
+    auto done = std::make_shared<std::promise<void>>();
+    auto result = done->get_future().share();
+    enqueue([done](bool) { done->set_value(); });
+    return result;
+}
+
+template <typename T>
+bool h5_io_service::copy_rows(const h5_dataset* dataset, hsize_t begin, hsize_t end, hsize_t columns, T* out) {
+    std::shared_ptr<block> b;
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        auto d = blocks_.find(dataset);
+        if (d != blocks_.end()) {
+            auto it = d->second.upper_bound(begin);
+            if (it != d->second.begin() && std::prev(it)->second->end >= end) {
+                b = std::prev(it)->second;
+            }
+        }
+    }
+
+    // The I/O thread can not wait for blocks queued after its current job
+    if (b && on_io_thread() && b->ready.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        b = nullptr;
+    }
+    if (b) {
+        b->ready.wait();
+        const auto& rows = [&]() -> const std::vector<T>& {
+            if constexpr (std::is_same_v<T, int>) {
+                return b->ints;
+            }
+            else {
+                return b->doubles;
+            }
+        }();
+        if (b->loaded && rows.size() == (b->end - b->begin)*columns) {
+            std::copy(rows.begin() + (begin - b->begin)*columns, rows.begin() + (end - b->begin)*columns, out);
+            hits_++;
+            return true;
+        }
+    }
+    misses_++;
+    return false;
+}
+
+bool h5_io_service::read_cached(const h5_dataset* dataset, hsize_t begin, hsize_t end, hsize_t columns, int* out) {
+    return copy_rows(dataset, begin, end, columns, out);
+}
+
+bool h5_io_service::read_cached(const h5_dataset* dataset, hsize_t begin, hsize_t end, hsize_t columns, double* out) {
+    return copy_rows(dataset, begin, end, columns, out);
+}
+
+h5_io_service::stats h5_io_service::statistics() const {
+    stats s;
+    s.blocks = blocks_loaded_;
+    s.bytes = bytes_loaded_;
+    s.hits = hits_;
+    s.misses = misses_;
+    return s;
+}
+} // namespace sonata
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sonata/h5_io_stats.hpp>
+
+#include "h5_read_timer.hpp"
+
+namespace sonata {
+namespace {
+std::atomic<bool> recording{false};
+
+std::mutex stats_mutex;
+std::unordered_map<std::string, h5_read_stats> stats;
+
+// Modelled chunk cache of every dataset, the most recently used chunk first
+std::unordered_map<std::string, std::deque<std::size_t>> chunk_caches;
+
+// Names of the input files open, and metadata cache hit rates of the files closed, by name
+std::unordered_map<hid_t, std::string> open_files;
+std::map<std::string, double> metadata_hit_rates;
+}
+
+bool h5_instrumentation_available() {
+#ifdef SONATA_H5_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
+
+void h5_instrumentation_enable(bool enable) {
+    recording = enable && h5_instrumentation_available();
+}
+
+bool h5_instrumentation_enabled() {
+    return recording;
+}
+
+std::vector<h5_read_stats> h5_read_summary() {
+    std::vector<h5_read_stats> summary;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        for (const auto& s: stats) {
+            summary.push_back(s.second);
+        }
+    }
+    std::sort(summary.begin(), summary.end(), [](const auto& a, const auto& b) {
+        return a.time > b.time || (a.time == b.time && a.path < b.path);
+    });
+    return summary;
+}
+
+std::vector<h5_file_cache_stats> h5_file_cache_summary() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    auto rates = metadata_hit_rates;
+    for (const auto& f: open_files) {
+        H5Fget_mdc_hit_rate(f.first, &rates[f.second]);
+    }
+
+    std::vector<h5_file_cache_stats> summary;
+    for (const auto& r: rates) {
+        summary.push_back({r.first, r.second});
+    }
+    return summary;
+}
+
+void h5_instrumentation_reset() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.clear();
+    chunk_caches.clear();
+    metadata_hit_rates.clear();
+    for (const auto& f: open_files) {
+        H5Freset_mdc_hit_rate_stats(f.first);
+    }
+}
+
+void print_h5_read_summary(std::ostream& o, const std::vector<h5_read_stats>& summary, std::size_t max_rows) {
+    o << std::left << std::setw(50) << "dataset"
+      << std::right << std::setw(10) << "reads" << std::setw(12) << "elements" << std::setw(12) << "MiB"
+      << std::setw(8) << "all" << std::setw(10) << "slab" << std::setw(10) << "point"
+      << std::setw(10) << "time(s)" << std::setw(12) << "chunk hit%" << "\n";
+
+    auto flags = o.flags();
+    for (std::size_t i = 0; i < std::min(max_rows, summary.size()); i++) {
+        const auto& s = summary[i];
+        o << std::left << std::setw(50) << s.path
+          << std::right << std::setw(10) << s.reads << std::setw(12) << s.elements
+          << std::fixed << std::setprecision(2) << std::setw(12) << s.bytes/(1024.*1024.)
+          << std::setw(8) << s.selections[0] << std::setw(10) << s.selections[1] << std::setw(10) << s.selections[2]
+          << std::setprecision(4) << std::setw(10) << s.time;
+        if (auto chunks = s.chunk_hits + s.chunk_misses) {
+            o << std::setprecision(1) << std::setw(12) << 100.*s.chunk_hits/chunks;
+        }
+        else {
+            o << std::setw(12) << "-";
+        }
+        o << "\n";
+        o.flags(flags);
+    }
+    if (summary.size() > max_rows) {
+        o << "... " << summary.size() - max_rows << " more datasets\n";
+    }
+}
+
+#ifdef SONATA_H5_INSTRUMENTATION
+h5_read_timer::h5_read_timer(const std::string& path, h5_selection selection, std::size_t elements, std::size_t element_size) {
+    if (!recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+    path_ = &path;
+    selection_ = selection;
+    elements_ = elements;
+    element_size_ = element_size;
+    start_ = std::chrono::steady_clock::now();
+}
+
+h5_read_timer::~h5_read_timer() {
+    if (!path_) {
+        return;
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    auto& s = stats[*path_];
+    if (s.path.empty()) {
+        s.path = *path_;
+    }
+    s.reads++;
+    s.elements += elements_;
+    s.bytes += elements_*element_size_;
+    s.selections[(int)selection_]++;
+    s.time += time;
+
+    if (chunk_rows_ && end_ > begin_) {
+        // Chunks missing from the cache are read and put in front of it, evicting the least recently used ones
+        auto& cache = chunk_caches[*path_];
+        auto first = begin_/chunk_rows_;
+        auto last = (end_ - 1)/chunk_rows_;
+        if (last - first + 1 > cache_chunks_) {
+            // Larger than the cache: only its last chunks stay
+            auto hits = std::count_if(cache.begin(), cache.end(), [&](auto c) { return c >= first && c <= last; });
+            s.chunk_hits += hits;
+            s.chunk_misses += last - first + 1 - hits;
+            cache.clear();
+            for (std::size_t i = 0; i < cache_chunks_; i++) {
+                cache.push_back(last - i);
+            }
+        }
+        for (auto c = first; c <= last && last - first < cache_chunks_; c++) {
+            auto it = std::find(cache.begin(), cache.end(), c);
+            if (it != cache.end()) {
+                s.chunk_hits++;
+                cache.erase(it);
+            }
+            else {
+                s.chunk_misses++;
+            }
+            cache.push_front(c);
+            if (cache.size() > cache_chunks_) {
+                cache.pop_back();
+            }
+        }
+    }
+}
+
+void h5_read_timer::rows(std::size_t begin, std::size_t end, std::size_t chunk_rows, std::size_t cache_chunks) {
+    begin_ = begin;
+    end_ = end;
+    chunk_rows_ = chunk_rows;
+    cache_chunks_ = cache_chunks;
+}
+
+void h5_track_file(hid_t id, const std::string& name) {
+    if (!recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    H5Freset_mdc_hit_rate_stats(id);
+    open_files[id] = name;
+}
+
+void h5_untrack_file(hid_t id) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    auto it = open_files.find(id);
+    if (it != open_files.end()) {
+        H5Fget_mdc_hit_rate(id, &metadata_hit_rates[it->second]);
+        open_files.erase(it);
+    }
+}
+#endif
+} // namespace sonata
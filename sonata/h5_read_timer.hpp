@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include <hdf5.h>
+
+#include <sonata/h5_io_stats.hpp>
+
+namespace sonata {
+/// Class timing a read of a dataset, recorded when it goes out of scope
+/// Compiled out without SONATA_H5_INSTRUMENTATION; a flag check when recording is disabled
+class h5_read_timer {
+public:
+#ifdef SONATA_H5_INSTRUMENTATION
+    h5_read_timer(const std::string& path, h5_selection selection, std::size_t elements, std::size_t element_size);
+
+    ~h5_read_timer();
+
+    // The read covers rows [begin, end) of a dataset stored in chunks of `chunk_rows` rows (0: not chunked) with a
+    // chunk cache of `cache_chunks` chunks; the chunk cache hits and misses of the read are estimated from them
+    void rows(std::size_t begin, std::size_t end, std::size_t chunk_rows, std::size_t cache_chunks);
+
+private:
+    const std::string* path_ = nullptr;
+    h5_selection selection_;
+    std::size_t elements_;
+    std::size_t element_size_;
+    std::chrono::steady_clock::time_point start_;
+
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+    std::size_t chunk_rows_ = 0;
+    std::size_t cache_chunks_ = 0;
+#else
+    h5_read_timer(const std::string&, h5_selection, std::size_t, std::size_t) {}
+
+    void rows(std::size_t, std::size_t, std::size_t, std::size_t) {}
+#endif
+};
+
+// Record the metadata cache hit rate of input file `id`, named `name`, from now until it is closed with
+// h5_untrack_file; compiled out without SONATA_H5_INSTRUMENTATION
+#ifdef SONATA_H5_INSTRUMENTATION
+void h5_track_file(hid_t id, const std::string& name);
+
+void h5_untrack_file(hid_t id);
+#else
+inline void h5_track_file(hid_t, const std::string&) {}
+
+inline void h5_untrack_file(hid_t) {}
+#endif
+} // namespace sonata
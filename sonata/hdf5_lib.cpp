@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -7,81 +8,399 @@
 #include <hdf5.h>
 
 #include <sonata/sonata_exceptions.hpp>
+#include <sonata/h5_access.hpp>
+#include <sonata/h5_io_service.hpp>
 #include <sonata/hdf5_lib.hpp>
 
+#include "h5_read_timer.hpp"
+
 #define MAX_NAME 1024
 
 ///h5_dataset methods
 namespace sonata {
-h5_dataset::h5_dataset(hid_t parent, std::string name): parent_id_(parent), name_(name) {
+// Name of hdf5 object `id` returned by `get_name` (H5Iget_name, H5Fget_name)
+template <typename F>
+static std::string object_name(hid_t id, F get_name) {
+    auto len = get_name(id, NULL, 0);
+    if (len <= 0) {
+        return {};
+    }
+    std::string name(len + 1, '\0');
+    get_name(id, &name[0], name.size());
+    name.resize(len);
+    return name;
+}
+
+// Path in the file of dataset `name` of group `parent`
+static std::string full_path(hid_t parent, const std::string& name) {
+    auto path = object_name(parent, H5Iget_name);
+    if (path.empty()) {
+        return name;
+    }
+    if (path.back() != '/') {
+        path += '/';
+    }
+    return path + name;
+}
+
+// Path of dataset `name` of group `parent`; only needed to record reads
+static std::string dataset_path([[maybe_unused]] hid_t parent, const std::string& name) {
+#ifdef SONATA_H5_INSTRUMENTATION
+    return full_path(parent, name);
+#else
+    return name;
+#endif
+}
+
+// Copy of rows [i, j) of `d` from a block prefetched by `io`; false if it has none
+static bool read_cached(h5_io_service& io, const h5_dataset* d, hsize_t i, hsize_t j, int& out) {
+    return io.read_cached(d, i, j, 1, &out);
+}
+
+static bool read_cached(h5_io_service& io, const h5_dataset* d, hsize_t i, hsize_t j, double& out) {
+    return io.read_cached(d, i, j, 1, &out);
+}
+
+static bool read_cached(h5_io_service& io, const h5_dataset* d, hsize_t i, hsize_t j, std::pair<int, int>& out) {
+    int row[2];
+    if (!io.read_cached(d, i, j, 2, row)) {
+        return false;
+    }
+    out = {row[0], row[1]};
+    return true;
+}
+
+template <typename T>
+static bool read_cached(h5_io_service& io, const h5_dataset* d, hsize_t i, hsize_t j, std::vector<T>& out) {
+    out.resize(j - i);
+    return io.read_cached(d, i, j, 1, out.data());
+}
+
+static bool read_cached(h5_io_service& io, const h5_dataset* d, hsize_t i, hsize_t j, std::vector<std::pair<int, int>>& out) {
+    std::vector<int> rows(2*(j - i));
+    if (!io.read_cached(d, i, j, 2, rows.data())) {
+        return false;
+    }
+    out.resize(j - i);
+    for (unsigned k = 0; k < out.size(); k++) {
+        out[k] = {rows[2*k], rows[2*k + 1]};
+    }
+    return true;
+}
+
+// Strings are never prefetched
+static bool read_cached(h5_io_service&, const h5_dataset*, hsize_t, hsize_t, std::string&) {
+    return false;
+}
+
+// Rows [i, j) of `d` read by `read`: from a block prefetched by the active I/O service, or by `read` on
+// the thread of the service; on this thread if there is no service or this is its thread
+template <typename T, typename F>
+static T routed_read(const h5_dataset* d, hsize_t i, hsize_t j, F read) {
+    auto io = h5_io_service::active();
+    if (!io) {
+        return read();
+    }
+    T out;
+    if (read_cached(*io, d, i, j, out)) {
+        return out;
+    }
+    if (io->on_io_thread()) {
+        return read();
+    }
+    return io->submit(read).get();
+}
+
+h5_dataset::h5_dataset(hid_t parent, std::string name):
+        parent_id_(parent), name_(name), path_(dataset_path(parent, name)) {
     auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
     hid_t dspace = H5Dget_space(id);
 
-    const int ndims = H5Sget_simple_extent_ndims(dspace);
-
-    hsize_t dims[ndims];
-    H5Sget_simple_extent_dims(dspace, dims, NULL);
+    std::vector<hsize_t> dims(std::max(H5Sget_simple_extent_ndims(dspace), 1), 0);
+    H5Sget_simple_extent_dims(dspace, dims.data(), NULL);
 
     size_ = dims[0];
+    columns_ = dims.size() > 1? dims[1]: 1;
+
+    auto type = H5Dget_type(id);
+    type_class_ = H5Tget_class(type);
+    offset_ = H5Dget_offset(id);
+
+    // Chunks size the chunk cache of the reads
+    auto dcpl = H5Dget_create_plist(id);
+    if (H5Pget_layout(dcpl) == H5D_CHUNKED) {
+        std::vector<hsize_t> chunk(dims.size(), 1);
+        H5Pget_chunk(dcpl, chunk.size(), chunk.data());
+        chunk_rows_ = chunk[0];
+        chunk_bytes_ = H5Tget_size(type);
+        for (auto c: chunk) {
+            chunk_bytes_ *= c;
+        }
+    }
 
+    H5Pclose(dcpl);
+    H5Tclose(type);
     H5Sclose(dspace);
     H5Dclose(id);
 }
 
-h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<int> data): parent_id_(parent), name_(name) {
-    hsize_t size = data.size();
-    auto dspace = H5Screate_simple(1, &size, NULL);
+h5_dataset::~h5_dataset() {
+    if (read_id_ >= 0) {
+        H5Dclose(read_id_);
+    }
+}
+
+hid_t h5_dataset::read_handle() {
+    if (read_id_ < 0) {
+        auto cache = h5_dataset_cache(object_name(parent_id_, H5Fget_name), full_path(parent_id_, name_), chunk_bytes_);
+
+        auto dapl = h5_read_dapl(cache);
+        read_id_ = H5Dopen(parent_id_, name_.c_str(), dapl);
+        H5Pclose(dapl);
+        cache_chunks_ = chunk_bytes_? cache.chunk_bytes/chunk_bytes_: 0;
+    }
+    return read_id_;
+}
+
+void h5_dataset::close() {
+    if (read_id_ >= 0) {
+        H5Dclose(read_id_);
+        read_id_ = -1;
+    }
+}
+
+// Row-major copy of the rows of `data`, which must all have the same size
+template <typename T>
+static std::vector<T> row_major(const std::string& name, const std::vector<std::vector<T>>& data) {
+    std::vector<T> out;
+    if (data.empty()) {
+        return out;
+    }
+    auto num_cols = data.front().size();
+    out.reserve(data.size()*num_cols);
+    for (const auto& row: data) {
+        if (row.size() != num_cols) {
+            throw sonata_exception("Rows of dataset \"" + name + "\" have different sizes");
+        }
+        out.insert(out.end(), row.begin(), row.end());
+    }
+    return out;
+}
+
+h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<int> data):
+        h5_dataset(parent, name, data.data(), {data.size()}) {}
+
+h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<double> data):
+        h5_dataset(parent, name, data.data(), {data.size()}) {}
+
+h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<std::vector<int>> data):
+        h5_dataset(parent, name, row_major(name, data).data(),
+                   {data.size(), data.empty()? 0: data.front().size()}) {}
+
+h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<std::vector<double>> data):
+        h5_dataset(parent, name, row_major(name, data).data(),
+                   {data.size(), data.empty()? 0: data.front().size()}) {}
 
-    auto id = H5Dcreate(parent_id_, name.c_str(), H5T_NATIVE_INT, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    int arr[size];
-    std::copy(data.begin(), data.end(), arr);
-    H5Dwrite(id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, arr);
+template <typename T>
+h5_dataset::h5_dataset(hid_t parent, std::string name, const T* data, std::vector<hsize_t> dims,
+                       const h5_dataset_props& props):
+        h5_dataset(parent, name, h5_native_type<T>(), dims, props) {
+    // The whole dataset at once, straight from the buffer
+    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
+    auto status = H5Dwrite(id, h5_native_type<T>(), H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
+    H5Dclose(id);
+
+    if (status < 0) {
+        throw sonata_dataset_exception(name_);
+    }
+}
 
+h5_dataset::h5_dataset(hid_t parent, std::string name, hid_t type, std::vector<hsize_t> dims,
+                       const h5_dataset_props& props):
+        parent_id_(parent), name_(name), path_(dataset_path(parent, name)), size_(dims.at(0)) {
+    auto dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    auto max_dims = dims;
+
+    // Chunked datasets are extendible along their first dimension, and can be filtered
+    if (!props.chunk_dims.empty()) {
+        max_dims[0] = H5S_UNLIMITED;
+        H5Pset_chunk(dcpl, props.chunk_dims.size(), props.chunk_dims.data());
+        if (props.shuffle) {
+            H5Pset_shuffle(dcpl);
+        }
+        if (props.deflate) {
+            H5Pset_deflate(dcpl, props.deflate);
+        }
+    }
+    auto dspace = H5Screate_simple(dims.size(), dims.data(), max_dims.data());
+
+    auto id = H5Dcreate(parent_id_, name.c_str(), type, dspace, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+
+    H5Pclose(dcpl);
     H5Sclose(dspace);
+
+    if (id < 0) {
+        throw sonata_dataset_exception(name_);
+    }
     H5Dclose(id);
 }
 
-h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<double> data): parent_id_(parent), name_(name) {
-    hsize_t size = data.size();
-    auto dspace = H5Screate_simple(1, &size, NULL);
+h5_dataset::h5_dataset(hid_t parent, std::string name, hid_t type, hsize_t chunk_size):
+        h5_dataset(parent, name, type, {0}, h5_dataset_props{{chunk_size}}) {}
+
+h5_dataset::h5_dataset(hid_t parent, std::string name, hid_t type,
+                       std::vector<hsize_t> dims, std::vector<hsize_t> chunk_dims):
+        h5_dataset(parent, name, type, dims, h5_dataset_props{chunk_dims}) {}
+
+h5_dataset::h5_dataset(hid_t parent, std::string name, hid_t type, std::vector<hsize_t> dims):
+        h5_dataset(parent, name, type, dims, h5_dataset_props{}) {}
+
+template <typename T>
+void h5_dataset::append(const std::vector<T>& data) {
+    append(data.data(), data.size());
+}
+
+template <typename T>
+void h5_dataset::append(const T* data, hsize_t count) {
+    if (!count) {
+        return;
+    }
+    hsize_t offset = size_;
+    resize(offset + count);
+    write(offset, data, count);
+}
 
-    auto id = H5Dcreate(parent_id_, name.c_str(), H5T_NATIVE_DOUBLE, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    double arr[size];
-    std::copy(data.begin(), data.end(), arr);
-    H5Dwrite(id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, arr);
+void h5_dataset::resize(hsize_t size) {
+    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
 
+    // Only the first dimension changes
+    hid_t dspace = H5Dget_space(id);
+    std::vector<hsize_t> dims(H5Sget_simple_extent_ndims(dspace));
+    H5Sget_simple_extent_dims(dspace, dims.data(), NULL);
     H5Sclose(dspace);
+
+    dims[0] = size;
+    auto status = H5Dset_extent(id, dims.data());
     H5Dclose(id);
+
+    if (status < 0) {
+        throw sonata_dataset_exception(name_, (unsigned)size_, (unsigned)size);
+    }
+    size_ = size;
+}
+
+template <typename T>
+void h5_dataset::write(hsize_t offset, const std::vector<T>& data, bool collective) {
+    write(offset, data.data(), data.size(), collective);
 }
 
-h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<std::vector<int>> data): parent_id_(parent), name_(name) {
-    hsize_t dims_data[2] = {data.size(), data.front().size()};
-    auto dspace = H5Screate_simple(2, dims_data, NULL);
+template <typename T>
+void h5_dataset::write(hsize_t offset, const T* data, hsize_t count, bool collective) {
+    if (!count && !collective) {
+        return;
+    }
+
+    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
+    hid_t dspace = H5Dget_space(id);
+    hid_t in_mem;
+
+    // Ranks without data still take part in a collective write, with empty selections
+    if (count) {
+        // Whole rows of the dataset
+        std::vector<hsize_t> start(H5Sget_simple_extent_ndims(dspace), 0);
+        std::vector<hsize_t> counts(start.size());
+        H5Sget_simple_extent_dims(dspace, counts.data(), NULL);
+        start[0] = offset;
+        counts[0] = count;
+
+        in_mem = H5Screate_simple(counts.size(), counts.data(), NULL);
+        H5Sselect_hyperslab(dspace, H5S_SELECT_SET, start.data(), NULL, counts.data(), NULL);
+    }
+    else {
+        in_mem = H5Scopy(dspace);
+        H5Sselect_none(in_mem);
+        H5Sselect_none(dspace);
+    }
 
-    auto id = H5Dcreate(parent_id_, name.c_str(), H5T_NATIVE_INT, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    int arr[data.size()][data.front().size()];
-    for (unsigned i = 0; i < data.size(); i++) {
-        std::copy(data[i].begin(), data[i].end(), arr[i]);
+    auto dxpl = H5Pcreate(H5P_DATASET_XFER);
+#ifdef H5_HAVE_PARALLEL
+    if (collective) {
+        H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
     }
-    H5Dwrite(id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, arr);
+#endif
+    auto status = H5Dwrite(id, h5_native_type<T>(), in_mem, dspace, dxpl, data);
 
+    H5Pclose(dxpl);
     H5Sclose(dspace);
+    H5Sclose(in_mem);
     H5Dclose(id);
+
+    if (status < 0) {
+        throw sonata_dataset_exception(name_, (unsigned)offset, (unsigned)(offset + count));
+    }
 }
 
-h5_dataset::h5_dataset(hid_t parent, std::string name, std::vector<std::vector<double>> data): parent_id_(parent), name_(name) {
-    hsize_t dims_data[2] = {data.size(), data.front().size()};
-    auto dspace = H5Screate_simple(2, dims_data, NULL);
+template <typename T>
+void h5_dataset::write_columns(hsize_t row_offset,
+                               hsize_t num_rows,
+                               const std::vector<hsize_t>& columns,
+                               const std::vector<T>& data,
+                               bool collective) {
+    write_columns(row_offset, num_rows, columns, data.data(), collective);
+}
+
+template <typename T>
+void h5_dataset::write_columns(hsize_t row_offset,
+                               hsize_t num_rows,
+                               const std::vector<hsize_t>& columns,
+                               const T* data,
+                               bool collective) {
+    if ((columns.empty() || !num_rows) && !collective) {
+        return;
+    }
+
+    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
+    hid_t dspace = H5Dget_space(id);
+    hid_t in_mem;
+
+    if (!columns.empty() && num_rows) {
+        // Select runs of consecutive columns
+        H5Sselect_none(dspace);
+        for (unsigned i = 0; i < columns.size();) {
+            unsigned j = i + 1;
+            while (j < columns.size() && columns[j] == columns[j-1] + 1) j++;
+
+            hsize_t offset[2] = {row_offset, columns[i]};
+            hsize_t count[2] = {num_rows, j - i};
+            H5Sselect_hyperslab(dspace, H5S_SELECT_OR, offset, NULL, count, NULL);
+            i = j;
+        }
+        hsize_t mem_dims[2] = {num_rows, columns.size()};
+        in_mem = H5Screate_simple(2, mem_dims, NULL);
+    }
+    else {
+        // Ranks without data still take part in a collective write, with empty selections
+        in_mem = H5Scopy(dspace);
+        H5Sselect_none(in_mem);
+        H5Sselect_none(dspace);
+    }
 
-    auto id = H5Dcreate(parent_id_, name.c_str(), H5T_NATIVE_DOUBLE, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    double arr[data.size()][data.front().size()];
-    for (unsigned i = 0; i < data.size(); i++) {
-        std::copy(data[i].begin(), data[i].end(), arr[i]);
+    auto dxpl = H5Pcreate(H5P_DATASET_XFER);
+#ifdef H5_HAVE_PARALLEL
+    if (collective) {
+        H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
     }
-    H5Dwrite(id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, arr);
+#endif
+    auto status = H5Dwrite(id, h5_native_type<T>(), in_mem, dspace, dxpl, data);
 
+    H5Pclose(dxpl);
     H5Sclose(dspace);
+    H5Sclose(in_mem);
     H5Dclose(id);
+
+    if (status < 0) {
+        throw sonata_dataset_exception(name_, (unsigned)row_offset, (unsigned)(row_offset + num_rows));
+    }
 }
 
 std::string h5_dataset::name() {
@@ -94,265 +413,356 @@ int h5_dataset::size() {
 
 template<>
 auto h5_dataset::get<int>(const int i) {
-    const hsize_t idx = (hsize_t)i;
+    return routed_read<int>(this, i, i + 1, [&]() {
+        const hsize_t idx = (hsize_t)i;
 
-    // Output
-    int *out = new int[1];
+        // Output
+        int *out = new int[1];
 
-    // Output dimensions 1x1
-    hsize_t dims = 1;
-    hsize_t dim_sizes[] = {1};
+        // Output dimensions 1x1
+        hsize_t dims = 1;
+        hsize_t dim_sizes[] = {1};
 
-    // Output size
-    hsize_t num_elements = 1;
+        // Output size
+        hsize_t num_elements = 1;
 
-    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
-    hid_t dspace = H5Dget_space(id);
+        auto id = read_handle();
+        hid_t dspace = H5Dget_space(id);
 
-    H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, &idx);
+        H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, &idx);
 
-    hid_t out_mem = H5Screate_simple(dims, dim_sizes, NULL);
+        hid_t out_mem = H5Screate_simple(dims, dim_sizes, NULL);
 
-    auto status = H5Dread(id, H5T_NATIVE_INT, out_mem, dspace, H5P_DEFAULT, out);
+        h5_read_timer timer(path_, h5_selection::point, 1, sizeof(int));
+        timer.rows(idx, idx + 1, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(id, H5T_NATIVE_INT, out_mem, dspace, H5P_DEFAULT, out);
 
-    H5Sclose(dspace);
-    H5Sclose(out_mem);
-    H5Dclose(id);
+        H5Sclose(dspace);
+        H5Sclose(out_mem);
 
-    if (status < 0 ) {
-        throw sonata_dataset_exception(name_, (unsigned)i);
-    }
+        if (status < 0 ) {
+            throw sonata_dataset_exception(name_, (unsigned)i);
+        }
 
-    int r = out[0];
-    delete [] out;
+        int r = out[0];
+        delete [] out;
 
-    return r;
+        return r;
+    });
 }
 
 template<>
 auto h5_dataset::get<double>(const int i) {
-    const hsize_t idx = (hsize_t)i;
+    return routed_read<double>(this, i, i + 1, [&]() {
+        const hsize_t idx = (hsize_t)i;
 
-    // Output
-    double *out = new double[1];
+        // Output
+        double *out = new double[1];
 
-    // Output dimensions 1x1
-    hsize_t dims = 1;
-    hsize_t dim_sizes[] = {1};
+        // Output dimensions 1x1
+        hsize_t dims = 1;
+        hsize_t dim_sizes[] = {1};
 
-    // Output size
-    hsize_t num_elements = 1;
+        // Output size
+        hsize_t num_elements = 1;
 
-    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
-    hid_t dspace = H5Dget_space(id);
+        auto id = read_handle();
+        hid_t dspace = H5Dget_space(id);
 
-    H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, &idx);
-    hid_t out_mem = H5Screate_simple(dims, dim_sizes, NULL);
+        H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, &idx);
+        hid_t out_mem = H5Screate_simple(dims, dim_sizes, NULL);
 
-    auto status = H5Dread(id, H5T_NATIVE_DOUBLE, out_mem, dspace, H5P_DEFAULT, out);
+        h5_read_timer timer(path_, h5_selection::point, 1, sizeof(double));
+        timer.rows(idx, idx + 1, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(id, H5T_NATIVE_DOUBLE, out_mem, dspace, H5P_DEFAULT, out);
 
-    H5Sclose(dspace);
-    H5Sclose(out_mem);
-    H5Dclose(id);
+        H5Sclose(dspace);
+        H5Sclose(out_mem);
 
-    if (status < 0) {
-        throw sonata_dataset_exception(name_, (unsigned)i);
-    }
+        if (status < 0) {
+            throw sonata_dataset_exception(name_, (unsigned)i);
+        }
 
-    double r = out[0];
-    delete [] out;
+        double r = out[0];
+        delete [] out;
 
-    return r;
+        return r;
+    });
 }
 
 template<>
 auto h5_dataset::get<std::string>(const int i) {
-    const hsize_t idx = (hsize_t)i;
-    hsize_t dims = 1;
-    hsize_t dim_sizes[] = {1};
-    size_t  sdim;
+    return routed_read<std::string>(this, i, i + 1, [&]() {
+        const hsize_t idx = (hsize_t)i;
+        hsize_t dims = 1;
+        hsize_t dim_sizes[] = {1};
+        size_t  sdim;
 
-    char *out;
+        char *out;
 
-    auto dset =  H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
-    auto filetype = H5Dget_type(dset);
+        auto dset = read_handle();
+        auto filetype = H5Dget_type(dset);
 
-    // Initialize sdim with size of string + null terminator
-    sdim = H5Tget_size(filetype) + 1;
+        // Initialize sdim with size of string + null terminator
+        sdim = H5Tget_size(filetype) + 1;
 
-    // Initialize output buffer
-    out = (char *) malloc (sdim * sizeof (char));
+        // Initialize output buffer
+        out = (char *) malloc (sdim * sizeof (char));
 
-    H5Dclose(dset);
-    H5Tclose(filetype);
+        H5Tclose(filetype);
 
-    // Open dataset and dataspace
-    dset =  H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
-    auto dspace = H5Dget_space(dset);
+        auto dspace = H5Dget_space(dset);
 
-    // Select element to read
-    H5Sselect_elements(dspace, H5S_SELECT_SET, 1, &idx);
-    hid_t out_mem = H5Screate_simple(dims, dim_sizes, NULL);
+        // Select element to read
+        H5Sselect_elements(dspace, H5S_SELECT_SET, 1, &idx);
+        hid_t out_mem = H5Screate_simple(dims, dim_sizes, NULL);
 
-    // Select right datatype
-    auto memtype = H5Tcopy(H5T_C_S1);
-    H5Tset_size (memtype, sdim);
+        // Select right datatype
+        auto memtype = H5Tcopy(H5T_C_S1);
+        H5Tset_size (memtype, sdim);
 
-    auto status = H5Dread(dset, memtype, out_mem, dspace, H5P_DEFAULT, out);
+        h5_read_timer timer(path_, h5_selection::point, 1, sdim);
+        timer.rows(idx, idx + 1, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(dset, memtype, out_mem, dspace, H5P_DEFAULT, out);
 
-    if (status < 0) {
-        throw sonata_dataset_exception(name_, (unsigned)i);
-    }
+        if (status < 0) {
+            throw sonata_dataset_exception(name_, (unsigned)i);
+        }
 
-    std::string ret(out);
+        std::string ret(out);
 
-    free (out);
-    H5Dclose(dset);
-    H5Sclose(dspace);
-    H5Tclose(memtype);
+        free (out);
+        H5Sclose(dspace);
+        H5Tclose(memtype);
 
-    return ret;
+        return ret;
+    });
 }
 
 template<>
 auto h5_dataset::get<std::vector<int>>(const int i, const int j) {
-    hsize_t offset = i;
-    hsize_t count = j-i;
-    hsize_t stride = 1;
-    hsize_t  block = 1;
-    hsize_t dimsm = count;
-
-    int rdata[count];
-
-    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
-    hid_t dspace = H5Dget_space(id);
+    return routed_read<std::vector<int>>(this, i, j, [&]() {
+        hsize_t offset = i;
+        hsize_t count = j-i;
+        hsize_t stride = 1;
+        hsize_t  block = 1;
+        hsize_t dimsm = count;
+
+        std::vector<int> out(count);
+        if (!count) {
+            return out;
+        }
 
-    hid_t out_mem = H5Screate_simple(1, &dimsm, NULL);
+        auto id = read_handle();
+        hid_t dspace = H5Dget_space(id);
 
-    H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset, &stride, &count, &block);
-    auto status = H5Dread(id, H5T_NATIVE_INT, out_mem, dspace, H5P_DEFAULT, rdata);
+        hid_t out_mem = H5Screate_simple(1, &dimsm, NULL);
 
-    H5Sclose(dspace);
-    H5Sclose(out_mem);
-    H5Dclose(id);
+        H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset, &stride, &count, &block);
+        h5_read_timer timer(path_, h5_selection::hyperslab, count, sizeof(int));
+        timer.rows(offset, offset + count, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(id, H5T_NATIVE_INT, out_mem, dspace, H5P_DEFAULT, out.data());
 
-    if (status < 0) {
-        throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
-    }
+        H5Sclose(dspace);
+        H5Sclose(out_mem);
 
-    std::vector<int> out(rdata, rdata + count);
+        if (status < 0) {
+            throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
+        }
 
-    return out;
+        return out;
+    });
 }
 
 template <>
 auto h5_dataset::get<std::vector<double>>(const int i, const int j) {
-    hsize_t offset = i;
-    hsize_t count = j-i;
-    hsize_t stride = 1;
-    hsize_t  block = 1;
-    hsize_t dimsm = count;
-
-    double rdata[count];
-
-    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
-    hid_t dspace = H5Dget_space(id);
-
-    hid_t out_mem = H5Screate_simple(1, &dimsm, NULL);
+    return routed_read<std::vector<double>>(this, i, j, [&]() {
+        hsize_t offset = i;
+        hsize_t count = j-i;
+        hsize_t stride = 1;
+        hsize_t  block = 1;
+        hsize_t dimsm = count;
+
+        std::vector<double> out(count);
+        if (!count) {
+            return out;
+        }
 
-    H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset, &stride, &count, &block);
+        auto id = read_handle();
+        hid_t dspace = H5Dget_space(id);
 
-    auto status = H5Dread(id, H5T_NATIVE_DOUBLE, out_mem, dspace, H5P_DEFAULT, rdata);
+        hid_t out_mem = H5Screate_simple(1, &dimsm, NULL);
 
-    H5Sclose(dspace);
-    H5Sclose(out_mem);
-    H5Dclose(id);
+        H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset, &stride, &count, &block);
+        h5_read_timer timer(path_, h5_selection::hyperslab, count, sizeof(double));
+        timer.rows(offset, offset + count, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(id, H5T_NATIVE_DOUBLE, out_mem, dspace, H5P_DEFAULT, out.data());
 
-    if (status < 0) {
-        throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
-    }
+        H5Sclose(dspace);
+        H5Sclose(out_mem);
 
-    std::vector<double> out(rdata, rdata + count);
+        if (status < 0) {
+            throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
+        }
 
-    return out;
+        return out;
+    });
 }
 
 template <>
 auto h5_dataset::get<std::pair<int,int>>(const int i) {
-    const hsize_t idx_0[2] = {(hsize_t)i, (hsize_t)0};
+    return routed_read<std::pair<int,int>>(this, i, i + 1, [&]() {
+        const hsize_t idx_0[2] = {(hsize_t)i, (hsize_t)0};
 
-    // Output
-    int out_0, out_1;
+        // Output
+        int out_0, out_1;
 
-    // Output dimensions 1x1
-    hsize_t dims = 1;
-    hsize_t dim_sizes[] = {1};
+        // Output dimensions 1x1
+        hsize_t dims = 1;
+        hsize_t dim_sizes[] = {1};
 
-    // Output size
-    hsize_t num_elements = 1;
+        // Output size
+        hsize_t num_elements = 1;
 
-    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
-    hid_t dspace = H5Dget_space(id);
+        auto id = read_handle();
+        hid_t dspace = H5Dget_space(id);
 
-    H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, idx_0);
-    hid_t out_mem_0 = H5Screate_simple(dims, dim_sizes, NULL);
+        // Both elements of the pair are recorded as one read
+        h5_read_timer timer(path_, h5_selection::point, 2, sizeof(int));
+        timer.rows(i, i + 1, chunk_rows_, cache_chunks_);
+        H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, idx_0);
+        hid_t out_mem_0 = H5Screate_simple(dims, dim_sizes, NULL);
 
-    auto status0 = H5Dread(id, H5T_NATIVE_INT, out_mem_0, dspace, H5P_DEFAULT, &out_0);
+        auto status0 = H5Dread(id, H5T_NATIVE_INT, out_mem_0, dspace, H5P_DEFAULT, &out_0);
 
-    const hsize_t idx_1[2] = {(hsize_t)i, (hsize_t)1};
+        const hsize_t idx_1[2] = {(hsize_t)i, (hsize_t)1};
 
-    H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, idx_1);
-    hid_t out_mem_1 = H5Screate_simple(dims, dim_sizes, NULL);
+        H5Sselect_elements(dspace, H5S_SELECT_SET, num_elements, idx_1);
+        hid_t out_mem_1 = H5Screate_simple(dims, dim_sizes, NULL);
 
-    auto status1 = H5Dread(id, H5T_NATIVE_INT, out_mem_1, dspace, H5P_DEFAULT, &out_1);
+        auto status1 = H5Dread(id, H5T_NATIVE_INT, out_mem_1, dspace, H5P_DEFAULT, &out_1);
 
-    H5Sclose(dspace);
-    H5Sclose(out_mem_0);
-    H5Sclose(out_mem_1);
-    H5Dclose(id);
+        H5Sclose(dspace);
+        H5Sclose(out_mem_0);
+        H5Sclose(out_mem_1);
 
-    if (status0 < 0 || status1 < 0) {
-        throw sonata_dataset_exception(name_, (unsigned)i);
-    }
+        if (status0 < 0 || status1 < 0) {
+            throw sonata_dataset_exception(name_, (unsigned)i);
+        }
+
+        return std::make_pair(out_0, out_1);
+    });
+}
+template <>
+auto h5_dataset::get<std::vector<std::pair<int,int>>>(const int i, const int j) {
+    return routed_read<std::vector<std::pair<int,int>>>(this, i, j, [&]() {
+        if (columns_ != 2) {
+            throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
+        }
+        // Row-major (j-i) x 2 block, in one hyperslab
+        auto out_a = read_rows<int>(i, j);
 
-    return std::make_pair(out_0, out_1);
+        std::vector<std::pair<int, int>> out(j - i);
+        for (unsigned k = 0; k < out.size(); k++) {
+            out[k] = std::make_pair(out_a[2*k], out_a[2*k + 1]);
+        }
+        return out;
+    });
 }
+
 template <>
 auto h5_dataset::get<std::vector<int>>() {
-    int out_a[size_];
-    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
+    return routed_read<std::vector<int>>(this, 0, size_, [&]() {
+        std::vector<int> out(size_);
+        auto id = read_handle();
 
-    auto status = H5Dread(id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-            out_a);
-    H5Dclose(id);
+        h5_read_timer timer(path_, h5_selection::all, size_, sizeof(int));
+        timer.rows(0, size_, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, h5_whole_read_dxpl(id), out.data());
 
-    if (status < 0) {
-        throw sonata_dataset_exception(name_);
-    }
+        if (status < 0) {
+            throw sonata_dataset_exception(name_);
+        }
 
-    std::vector<int> out(out_a, out_a + size_);
+        return out;
+    });
+}
 
-    return out;
+template <>
+auto h5_dataset::get<std::vector<double>>() {
+    return routed_read<std::vector<double>>(this, 0, size_, [&]() {
+        std::vector<double> out(size_);
+        auto id = read_handle();
+
+        h5_read_timer timer(path_, h5_selection::all, size_, sizeof(double));
+        timer.rows(0, size_, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, h5_whole_read_dxpl(id), out.data());
+
+        if (status < 0) {
+            throw sonata_dataset_exception(name_);
+        }
+
+        return out;
+    });
 }
 
 template <>
 auto h5_dataset::get<std::vector<std::pair<int, int>>>() {
-    int out_a[size_][2];
-    auto id = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
+    return routed_read<std::vector<std::pair<int, int>>>(this, 0, size_, [&]() {
+        // Row-major size_ x 2 block
+        std::vector<int> out_a(2*size_);
+        auto id = read_handle();
 
-    auto status = H5Dread(id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, out_a);
+        h5_read_timer timer(path_, h5_selection::all, 2*size_, sizeof(int));
+        timer.rows(0, size_, chunk_rows_, cache_chunks_);
+        auto status = H5Dread(id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, h5_whole_read_dxpl(id), out_a.data());
 
-    H5Dclose(id);
 
-    if (status < 0) {
-        throw sonata_dataset_exception(name_);
+        if (status < 0) {
+            throw sonata_dataset_exception(name_);
+        }
+
+        std::vector<std::pair<int, int>> out(size_);
+        for (unsigned i = 0; i < size_; i++) {
+            out[i] = std::make_pair(out_a[2*i], out_a[2*i + 1]);
+        }
+
+        return out;
+    });
+}
+
+template <typename T>
+std::vector<T> h5_dataset::read_rows(hsize_t begin, hsize_t end) {
+    std::vector<T> out((end - begin)*columns_);
+    if (out.empty()) {
+        return out;
     }
 
-    std::vector<std::pair<int, int>> out(size_);
-    for (unsigned i = 0; i < size_; i++) {
-        out[i] = std::make_pair(out_a[i][0], out_a[i][1]);
+    auto id = read_handle();
+    hid_t dspace = H5Dget_space(id);
+
+    std::vector<hsize_t> offset(std::max(H5Sget_simple_extent_ndims(dspace), 1), 0);
+    std::vector<hsize_t> count(offset.size(), 1);
+    offset[0] = begin;
+    count[0] = end - begin;
+    if (count.size() > 1) {
+        count[1] = columns_;
     }
+    H5Sselect_hyperslab(dspace, H5S_SELECT_SET, offset.data(), NULL, count.data(), NULL);
+
+    hsize_t num_elements = out.size();
+    hid_t out_mem = H5Screate_simple(1, &num_elements, NULL);
+
+    h5_read_timer timer(path_, h5_selection::hyperslab, num_elements, sizeof(T));
+    timer.rows(begin, end, chunk_rows_, cache_chunks_);
+    auto status = H5Dread(id, h5_native_type<T>(), out_mem, dspace, H5P_DEFAULT, out.data());
+
+    H5Sclose(dspace);
+    H5Sclose(out_mem);
 
+    if (status < 0) {
+        throw sonata_dataset_exception(name_, (unsigned)begin, (unsigned)end);
+    }
     return out;
 }
 
@@ -385,26 +795,120 @@ std::shared_ptr<h5_group> h5_group::add_group(std::string name) {
     return new_group;
 }
 
+void h5_group::close() {
+    for (auto& d: datasets_) {
+        d->close();
+    }
+    for (auto& g: groups_) {
+        g->close();
+    }
+    group_h_.close();
+}
+
 template <typename T>
 void h5_group::add_dataset(std::string name, std::vector<T> dset) {
     auto new_dataset = std::make_shared<h5_dataset>(group_h_.id, name, dset);
     datasets_.emplace_back(new_dataset);
 }
 
+template <typename T>
+std::shared_ptr<h5_dataset> h5_group::add_empty_dataset(std::string name, std::vector<hsize_t> dims) {
+    auto new_dataset = std::make_shared<h5_dataset>(group_h_.id, name, h5_native_type<T>(), dims);
+    datasets_.emplace_back(new_dataset);
+    return new_dataset;
+}
+
+template <typename T>
+std::shared_ptr<h5_dataset> h5_group::add_extendible_dataset(std::string name, hsize_t chunk_size) {
+    auto new_dataset = std::make_shared<h5_dataset>(group_h_.id, name, h5_native_type<T>(), chunk_size);
+    datasets_.emplace_back(new_dataset);
+    return new_dataset;
+}
+
+std::shared_ptr<h5_dataset> h5_group::add_extendible_dataset(std::string name, hid_t type,
+                                                             std::vector<hsize_t> dims,
+                                                             std::vector<hsize_t> chunk_dims) {
+    auto new_dataset = std::make_shared<h5_dataset>(group_h_.id, name, type, dims, chunk_dims);
+    datasets_.emplace_back(new_dataset);
+    return new_dataset;
+}
+
+std::shared_ptr<h5_dataset> h5_group::add_dataset(std::string name, hid_t type,
+                                                  std::vector<hsize_t> dims,
+                                                  const h5_dataset_props& props) {
+    auto new_dataset = std::make_shared<h5_dataset>(group_h_.id, name, type, dims, props);
+    datasets_.emplace_back(new_dataset);
+    return new_dataset;
+}
+
+template <typename T>
+std::shared_ptr<h5_dataset> h5_group::add_dataset(std::string name, const T* data,
+                                                  std::vector<hsize_t> dims,
+                                                  const h5_dataset_props& props) {
+    auto new_dataset = std::make_shared<h5_dataset>(group_h_.id, name, data, dims, props);
+    datasets_.emplace_back(new_dataset);
+    return new_dataset;
+}
+
 std::string h5_group::name() {
     return name_;
 }
 
 ///h5_file methods
-h5_file::h5_file(std::string name, bool new_file):
+h5_file::file_handle::file_handle(std::string file, const h5_file_props& props, hid_t fapl): name(file) {
+    auto fcpl = H5Pcreate(H5P_FILE_CREATE);
+    if (props.page_size) {
+        // Free space is managed in pages, so that raw data and metadata don't share file blocks
+        H5Pset_file_space_strategy(fcpl, H5F_FSPACE_STRATEGY_PAGE, false, 1);
+        H5Pset_file_space_page_size(fcpl, props.page_size);
+    }
+
+    auto access = fapl == H5P_DEFAULT? H5Pcreate(H5P_FILE_ACCESS): H5Pcopy(fapl);
+    H5Pset_alignment(access, props.alignment_threshold, props.alignment);
+
+    id = H5Fcreate(file.c_str(), H5F_ACC_TRUNC, fcpl, access);
+
+    H5Pclose(access);
+    H5Pclose(fcpl);
+
+    if (id < 0) {
+        throw sonata_file_exception("Unable to create file \"{}\"", file);
+    }
+}
+
+// Input files are opened with the access of h5_input_fapl unless given one
+h5_file::h5_file(std::string name, bool new_file, hid_t fapl):
+        name_(name),
+        file_h_(name, new_file, fapl == H5P_DEFAULT && !new_file? h5_input_fapl(name): fapl),
+        top_group_(std::make_shared<h5_group>(file_h_.id, "/")) {
+    if (!new_file) {
+        h5_track_file(file_h_.id, name_);
+    }
+}
+
+h5_file::h5_file(std::string name, const h5_file_props& props, hid_t fapl):
         name_(name),
-        file_h_(name, new_file),
+        file_h_(name, props, fapl),
         top_group_(std::make_shared<h5_group>(file_h_.id, "/")) {}
 
+h5_file::~h5_file() {
+    h5_untrack_file(file_h_.id);
+}
+
 std::string h5_file::name() {
     return name_;
 }
 
+void h5_file::flush() {
+    H5Fflush(file_h_.id, H5F_SCOPE_GLOBAL);
+}
+
+void h5_file::close() {
+    h5_untrack_file(file_h_.id);
+    top_group_->close();
+    file_h_.close();
+}
+
 void print_group(std::ostream& out, const std::shared_ptr<h5_group>& group, int indent) {
     for (const auto& g: group->groups_) {
         out << std::string(indent, '\t') << g->name() << std::endl;
@@ -486,6 +990,17 @@ T h5_wrapper::get(std::string name) const {
     throw sonata_dataset_exception(name);
 }
 
+std::shared_ptr<h5_dataset> h5_wrapper::dataset(std::string name) const {
+    if (find_dataset(name) != -1) {
+        return ptr_->datasets_.at(dset_map_.at(name));
+    }
+    return nullptr;
+}
+
+const std::vector<std::shared_ptr<h5_dataset>>& h5_wrapper::datasets() const {
+    return ptr_->datasets_;
+}
+
 const h5_wrapper& h5_wrapper::operator [](unsigned i) const {
     if (i < members_.size() && i >= 0) {
         return members_.at(i);
@@ -505,6 +1020,12 @@ std::string h5_wrapper::name() const {
     return ptr_->name();
 }
 
+void h5_wrapper::close() {
+    if (ptr_) {
+        ptr_->close();
+    }
+}
+
 ///h5_record methods
 
 h5_record::h5_record(const std::vector<std::shared_ptr<h5_file>>& files) : files_(files) {
@@ -601,6 +1122,12 @@ std::vector<h5_wrapper> h5_record::populations() const {
     return populations_;
 }
 
+void h5_record::close() {
+    for (auto& f: files_) {
+        f->close();
+    }
+}
+
 std::vector<unsigned> h5_record::partitions() const {
     return partition_;
 }
@@ -618,6 +1145,37 @@ template void h5_group::add_dataset<double>(std::string, std::vector<double>);
 template void h5_group::add_dataset<std::vector<int>>(std::string, std::vector<std::vector<int>>);
 template void h5_group::add_dataset<std::vector<double>>(std::string, std::vector<std::vector<double>>);
 
+template std::shared_ptr<h5_dataset> h5_group::add_empty_dataset<int>(std::string, std::vector<hsize_t>);
+template std::shared_ptr<h5_dataset> h5_group::add_empty_dataset<double>(std::string, std::vector<hsize_t>);
+
+template std::shared_ptr<h5_dataset> h5_group::add_extendible_dataset<int>(std::string, hsize_t);
+template std::shared_ptr<h5_dataset> h5_group::add_extendible_dataset<double>(std::string, hsize_t);
+
+template std::shared_ptr<h5_dataset> h5_group::add_dataset<int>(std::string, const int*, std::vector<hsize_t>, const h5_dataset_props&);
+template std::shared_ptr<h5_dataset> h5_group::add_dataset<float>(std::string, const float*, std::vector<hsize_t>, const h5_dataset_props&);
+template std::shared_ptr<h5_dataset> h5_group::add_dataset<double>(std::string, const double*, std::vector<hsize_t>, const h5_dataset_props&);
+
+template h5_dataset::h5_dataset(hid_t, std::string, const int*, std::vector<hsize_t>, const h5_dataset_props&);
+template h5_dataset::h5_dataset(hid_t, std::string, const float*, std::vector<hsize_t>, const h5_dataset_props&);
+template h5_dataset::h5_dataset(hid_t, std::string, const double*, std::vector<hsize_t>, const h5_dataset_props&);
+
+template std::vector<int> h5_dataset::read_rows<int>(hsize_t, hsize_t);
+template std::vector<double> h5_dataset::read_rows<double>(hsize_t, hsize_t);
+
+template void h5_dataset::append<int>(const std::vector<int>&);
+template void h5_dataset::append<double>(const std::vector<double>&);
+template void h5_dataset::append<int>(const int*, hsize_t);
+template void h5_dataset::append<float>(const float*, hsize_t);
+template void h5_dataset::append<double>(const double*, hsize_t);
+template void h5_dataset::write<int>(hsize_t, const std::vector<int>&, bool);
+template void h5_dataset::write<double>(hsize_t, const std::vector<double>&, bool);
+template void h5_dataset::write<int>(hsize_t, const int*, hsize_t, bool);
+template void h5_dataset::write<float>(hsize_t, const float*, hsize_t, bool);
+template void h5_dataset::write<double>(hsize_t, const double*, hsize_t, bool);
+template void h5_dataset::write_columns<double>(hsize_t, hsize_t, const std::vector<hsize_t>&, const std::vector<double>&, bool);
+template void h5_dataset::write_columns<float>(hsize_t, hsize_t, const std::vector<hsize_t>&, const float*, bool);
+template void h5_dataset::write_columns<double>(hsize_t, hsize_t, const std::vector<hsize_t>&, const double*, bool);
+
 template int h5_wrapper::get<int>(std::string, unsigned) const;
 template double h5_wrapper::get<double>(std::string, unsigned) const;
 template std::string h5_wrapper::get<std::string>(std::string, unsigned) const;
@@ -625,7 +1183,9 @@ template std::pair<int,int> h5_wrapper::get<std::pair<int,int>>(std::string, uns
 
 template std::vector<int> h5_wrapper::get<std::vector<int>>(std::string name, unsigned i, unsigned j) const;
 template std::vector<double> h5_wrapper::get<std::vector<double>>(std::string name, unsigned i, unsigned j) const;
+template std::vector<std::pair<int,int>> h5_wrapper::get<std::vector<std::pair<int,int>>>(std::string name, unsigned i, unsigned j) const;
 
 template std::vector<int> h5_wrapper::get<std::vector<int>>(std::string) const;
+template std::vector<double> h5_wrapper::get<std::vector<double>>(std::string) const;
 template std::vector<std::pair<int,int>> h5_wrapper::get<std::vector<std::pair<int,int>>>(std::string) const;
 } // namespace sonata
\ No newline at end of file
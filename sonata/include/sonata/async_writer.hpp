@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace sonata {
+/// Class running output tasks in order on a dedicated writer thread
+/// Simulation callbacks hand over filled buffers as tasks and continue, so that the cost of
+/// writing is hidden behind the simulation. At most `max_queue_depth` tasks are queued: a
+/// callback submitting more waits until the writer thread catches up (backpressure).
+/// All hdf5 calls of the writers using an async_writer must go through it while it is in use,
+/// as hdf5 is not thread safe; `drain` before touching their files from another thread.
+class async_writer {
+public:
+    struct stats {
+        // Number of tasks run, and largest number of tasks queued at once
+        std::size_t num_tasks = 0;
+        std::size_t max_queue_depth = 0;
+
+        // Time (s) spent by callbacks waiting for a free slot in the queue
+        double wait_time = 0;
+
+        // Time (s) spent running tasks on the writer thread, and CPU time (s) of the writer thread in them
+        double write_time = 0;
+        double cpu_time = 0;
+    };
+
+    explicit async_writer(std::size_t max_queue_depth = 2);
+
+    // Runs the remaining tasks; exceptions of tasks are lost, call `drain` to receive them
+    ~async_writer();
+
+    async_writer(const async_writer&) = delete;
+    async_writer& operator=(const async_writer&) = delete;
+
+    // Queue `task`; blocks while the queue is full. The future is ready once the task has run, with its exception
+    std::future<void> submit(std::function<void()> task);
+
+    // Wait until all queued tasks are done; rethrows the first exception thrown by a task
+    void drain();
+
+    stats get_stats() const;
+
+private:
+    void run();
+
+    std::size_t max_queue_depth_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::condition_variable idle_;
+
+    std::deque<std::function<void()>> queue_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    stats stats_;
+
+    std::thread thread_;
+};
+} // namespace sonata
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <arbor/common_types.hpp>
+#include <arbor/domain_decomposition.hpp>
+#include <arbor/morph/morphology.hpp>
+
+#include <sonata/common_structs.hpp>
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+namespace sonata {
+// Properties of a cell that drive the cost of simulating it
+struct cell_features {
+    arb::cell_kind kind = arb::cell_kind::cable;
+    unsigned branches = 0;
+    double length = 0;
+    unsigned cvs = 0;
+
+    // Density mechanisms painted on the cell, counted once per section they are painted on
+    unsigned density_mechs = 0;
+
+    // Incoming edges, each a synapse on the cell
+    unsigned synapses = 0;
+};
+
+// Branches, total length and CVs under the discretisation `d` of a morphology
+void add_morphology_features(cell_features& f, const arb::morphology& morph, const discretization_info& d);
+
+/// Linear model of the cost of a cell: weighted sum of virtual cells, cable cells, CVs,
+/// density mechanisms per CV and synapses
+class cost_model {
+public:
+    static constexpr unsigned num_terms = 5;
+    using terms_type = std::array<double, num_terms>;
+
+    cost_model() = default;
+    explicit cost_model(const terms_type& weights);
+
+    // Terms of the cost of a cell, the features the weights apply to
+    static terms_type terms(const cell_features& f);
+
+    double estimate(const cell_features& f) const;
+    std::vector<double> estimate(const std::vector<cell_features>& f) const;
+
+    // Model fitted to the times measured on parts with summed terms `part_terms`:
+    // least squares, regularised towards the weights of this model scaled to the total time
+    cost_model calibrate(const std::vector<terms_type>& part_terms, const std::vector<double>& part_times) const;
+
+    const terms_type& weights() const {
+        return weights_;
+    }
+
+private:
+    // Relative costs of a virtual cell, a cable cell, a CV, a density mechanism on a CV, a synapse
+    terms_type weights_ = {0.01, 1, 0.01, 0.01, 0.005};
+};
+
+// Predicted and measured load of every rank
+struct load_report {
+    std::vector<cost_model::terms_type> terms;
+    std::vector<double> predicted;
+    std::vector<double> measured;
+
+    // Largest over mean load
+    double predicted_imbalance() const;
+    double measured_imbalance() const;
+};
+
+// Loads of the ranks, from the features of the local cells of `decomp` and `local_time` measured
+// on every rank; collective
+load_report gather_load(const std::vector<cell_features>& features,
+                        const cost_model& model,
+                        const arb::domain_decomposition& decomp,
+                        double local_time);
+#ifdef ARB_MPI_ENABLED
+load_report gather_load(const std::vector<cell_features>& features,
+                        const cost_model& model,
+                        const arb::domain_decomposition& decomp,
+                        double local_time,
+                        MPI_Comm comm);
+#endif
+
+// User and system CPU time (s) of the process, over all threads
+double process_cpu_time();
+} // namespace sonata
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arbor/cable_cell.hpp>
+#include <arbor/morph/morphology.hpp>
+
+#include <sonata/density_mech_helper.hpp>
+
+namespace sonata {
+/// Morphology, labels and decor with the painted density mechanisms and CV policy, shared by
+/// the cable cells of a node type with the same morphology and mechanism overrides
+struct cell_template {
+    arb::morphology morph;
+    arb::label_dict labels;
+    arb::decor decor;
+
+    // Names of the painted density mechanisms, and their ids in the mechanism_registry that derived them
+    std::vector<std::string> mechanism_names;
+    std::vector<unsigned> mechanisms;
+};
+
+// Key of the template of a cell of node type `type_tag` in population `pop`, with morphology file
+// `morph_file` (empty for the morphology of the node type) and density mechanisms `mechs`;
+// parameter values are written exactly, so equal keys have equal mechanisms
+std::string cell_template_key(unsigned type_tag,
+                              const std::string& pop,
+                              const std::string& morph_file,
+                              const std::unordered_map<section_kind, std::vector<arb::mechanism_desc>>& mechs);
+
+/// Templates of the cells built so far, up to `capacity` templates; not thread safe
+class cell_template_cache {
+public:
+    struct stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t size = 0;
+    };
+
+    explicit cell_template_cache(std::size_t capacity = 4096): capacity_(capacity) {}
+
+    // Template of `key`, or null if it is not in the cache
+    std::shared_ptr<const cell_template> find(const std::string& key);
+
+    // Store the template `t` of `key`, if the cache is not full; returns the template stored first for `key`,
+    // otherwise `t`
+    std::shared_ptr<const cell_template> insert(const std::string& key, cell_template t);
+
+    void clear();
+
+    const stats& statistics() const {
+        return stats_;
+    }
+
+private:
+    std::size_t capacity_;
+    std::unordered_map<std::string, std::shared_ptr<const cell_template>> templates_;
+    stats stats_;
+};
+} // namespace sonata
@@ -1,10 +1,10 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 
 #include <arbor/common_types.hpp>
 #include <arbor/cable_cell.hpp>
-#include <arbor/simple_sampler.hpp>
 
 #include <sonata/csv_lib.hpp>
 #include <sonata/hdf5_lib.hpp>
@@ -21,10 +21,45 @@ struct sim_conditions {
     double v_init;
 };
 
+// Discretisation of a cable cell into CVs
+struct discretization_info {
+    // "fixed-per-branch": `cvs_per_branch` CVs on every branch
+    // "max-extent": CVs of at most `max_extent` um, at least one per branch
+    // "explicit": CV boundaries at the locset expression `locset`, e.g. "(uniform (all) 0 9 0)"
+    std::string policy = "fixed-per-branch";
+    unsigned cvs_per_branch = 200;
+    double max_extent = 20;
+    std::string locset;
+
+    // A single CV for morphologies that only have soma segments
+    bool single_cv_soma = true;
+};
+
+// Discretisation of all cable cells, overridden per population and per node type id;
+// the overrides start from `defaults`, and node types take precedence over populations
+struct discretization_params {
+    discretization_info defaults;
+    std::unordered_map<std::string, discretization_info> populations;
+    std::unordered_map<unsigned, discretization_info> node_types;
+};
+
 struct run_params {
     double duration;
     double dt;
     double threshold;
+    discretization_params discretization;
+
+    // Targets of a cell with the same location and linear point mechanism share one synapse
+    bool coalesce_synapses = false;
+
+    // Place the synapses of a cell by mechanism, branch and position instead of edge id
+    bool sort_synapses = false;
+
+    // Relative tolerance within which values of mechanism globals share a derived mechanism; 0 for exact values
+    double global_tolerance = 0;
+
+    // Read the hdf5 rows of the local cells ahead of building them, on the I/O thread
+    bool prefetch_inputs = true;
 };
 
 struct probe_info {
@@ -35,6 +70,15 @@ struct probe_info {
     double sec_pos;
     std::string file_name;
 
+    // Sampling period and interval of the report; storage type "float" or "double"
+    double dt;
+    double start_time;
+    double end_time;
+    std::string data_type = "double";
+
+    // gzip compression level of the report data, 0 for no compression
+    unsigned deflate = 0;
+
     probe_info() {};
 
     probe_info(std::string k, std::string pop, std::vector<unsigned> ids, unsigned sid, double spos,
@@ -42,14 +86,56 @@ struct probe_info {
             kind(k), population(pop), node_ids(ids), sec_id(sid), sec_pos(spos), file_name(file) {};
 };
 
+// Sampling and storage of a report file
+struct report_info {
+    std::string file_name;
+    double dt;
+    double start_time;
+    double end_time;
+    bool single_precision;
+    unsigned deflate = 0;
+};
+
+// Electrode (location) and input (parameter) tables of a current clamp stimulus;
+// either csv files or hdf5 files (".h5"/".hdf5" extension)
 struct current_clamp_info {
-    csv_file stim_params;
-    csv_file stim_loc;
+    std::string electrode_file;
+    std::string input_file;
 };
 
 struct spike_out_info {
     std::string file_name;
     std::string sort_by;
+    // "root": spikes are gathered and written by rank 0
+    // "parallel": every rank writes its local spikes to the file (MPI-IO)
+    std::string write_mode = "root";
+};
+
+// Writing of the output files during the run
+struct output_info {
+    // Write spikes and reports on a background thread, with at most `queue_depth` blocks in flight
+    bool write_async = true;
+    unsigned queue_depth = 2;
+};
+
+// Distribution of the cells over the ranks
+struct partition_info {
+    // "default": arbor's load balancer, contiguous ranges of gids
+    // "graph": balance the cost of the cells and minimise the edges cut between ranks
+    std::string method = "default";
+
+    // Start from a spatial ordering of the cells, using the x/y/z positions of the nodes
+    bool use_positions = false;
+
+    // Rounds of refinement of the ranks of the cells, and allowed excess cost of a rank over the mean
+    unsigned iterations = 10;
+    double imbalance = 0.05;
+
+    // Cable cells per cell group; 0 for a few groups per thread
+    unsigned group_size = 0;
+
+    // Length (ms) of a pilot run calibrating the cost model before the final partition; 0 for none
+    double calibration_time = 0;
 };
 
 struct spike_in_info {
@@ -99,8 +185,6 @@ struct trace_info {
     bool is_voltage;
     arb::mlocation loc;
 
-    arb::trace_vector<double> data;
-
     trace_info() {};
 
     trace_info(bool v, arb::mlocation l) : is_voltage(v), loc(l) {};
@@ -45,8 +45,15 @@ public:
     csv_file(std::string name, char delm = ',');
     std::vector<std::vector<std::string>> get_data();
     std::string name();
+
+    // Returns index of column `name` in the header row; returns -1 if column not found
+    int column(const std::string& name) const;
 };
 
+// Typed parsing of csv fields; throw sonata_exception if the field is not a valid number
+unsigned csv_to_unsigned(const std::string& field);
+double csv_to_double(const std::string& field);
+
 ////////////////////////////////////////////////////////
 
 class csv_record {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <vector>
 #include <string>
 #include <unordered_set>
@@ -11,7 +12,12 @@
 #include <arbor/recipe.hpp>
 
 #include <sonata/sonata_exceptions.hpp>
+#include <sonata/cell_template.hpp>
 #include <sonata/common_structs.hpp>
+#include <sonata/h5_io_service.hpp>
+#include <sonata/partition.hpp>
+#include <sonata/span.hpp>
+#include <sonata/synapse_map.hpp>
 
 namespace sonata {
 
@@ -26,7 +32,8 @@ public:
     model_desc(h5_record nodes,
                h5_record edges,
                csv_node_record node_types,
-               csv_edge_record edge_types);
+               csv_edge_record edge_types,
+               discretization_params discretization = {});
 
     /// Simple queries
 
@@ -36,6 +43,9 @@ public:
 
     cell_size_type num_targets(cell_gid_type gid) const;
 
+    // Targets of the local cells sharing the synapse of another target
+    std::size_t num_coalesced_targets() const;
+
     std::vector<unsigned> pop_partitions() const;
 
     std::vector<std::string> pop_names() const;
@@ -50,8 +60,21 @@ public:
     // Queries hdf5/csv records as needed to build (with correct overrides)all needed
     // information to form a cell_connection.
     // This includes source and target locations (gid, branch id, branch position)
-    // weight/delay of the connection and point mechanism with all parameters set
-    void build_source_and_target_maps(const std::vector<arb::group_description>&);
+    // weight/delay of the connection and point mechanism with all parameters set.
+    // Targets of a cell with the same location and point mechanism share a synapse if `coalesce(mechanism)`,
+    // which must only hold for linear mechanisms. The synapses of a cell are placed in target (edge id) order,
+    // or by mechanism, branch and position with `sort_synapses_by_location`
+    void build_source_and_target_maps(const std::vector<arb::group_description>&,
+                                      const std::function<bool(const arb::mechanism_desc&)>& coalesce = {},
+                                      bool sort_synapses_by_location = false);
+
+    // Rows of the node and edge datasets and indices read to build the local cells of the last
+    // build_source_and_target_maps and their connections, sorted and coalesced
+    h5_read_plan local_read_plan() const;
+
+    // Rows of the datasets of the node and edge groups (and their dynamics_params) read to build the
+    // local cells; reads the group ids and indices of the rows of local_read_plan
+    h5_read_plan group_read_plan() const;
 
     /// Read maps
 
@@ -59,9 +82,19 @@ public:
                                  std::vector<std::pair<mlocation, arb::mechanism_desc>>& tgt) const;
 
 
+    // Morphology file of the cell in the hdf5 file; empty if the cell has the morphology of its node type
+    std::string get_morphology_file(cell_gid_type gid);
+
     // Look for morphology file in hdf5 file; if not found, use the default morphology from the node csv file
     arb::morphology get_cell_morphology(cell_gid_type gid);
 
+    // Key of the cell template of the cell, with density mechanisms `mechs` from get_density_mechs
+    std::string get_template_key(cell_gid_type gid,
+                                 const std::unordered_map<section_kind, std::vector<arb::mechanism_desc>>& mechs);
+
+    // Discretisation of the cell: the override of its node type or population, or the default
+    const discretization_info& get_discretization(cell_gid_type gid);
+
     // Get cell_kind from the node csv file
     arb::cell_kind get_cell_kind(cell_gid_type gid);
 
@@ -72,6 +105,10 @@ public:
     // Returns a map from section kind (soma, dend, etc) to a vector of mechanism_desc
     std::unordered_map<section_kind, std::vector<arb::mechanism_desc>> get_density_mechs(cell_gid_type);
 
+    // Kinds, mechanism sets, features and costs under `model`, positions (if `with_positions`) and
+    // connectivity of all cells; every rank reads a share of the cells and edges, so all ranks must call it
+    cell_graph build_cell_graph(bool with_positions, const cost_model& model = {});
+
     /// Read relevant information from the relevant hdf5 file in ranges and aggregate in convenient structs
 
     std::vector<source_type> source_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
@@ -79,41 +116,65 @@ public:
     std::vector<double> weight_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
     std::vector<double> delay_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
 
+    // Close the node files and then the edge files; with MPI-IO every rank has to call it, and the records
+    // can't be read after
+    void close_files();
+
 
 private:
     h5_record nodes_;
     h5_record edges_;
     csv_node_record node_types_;
     csv_edge_record edge_types_;
+    discretization_params discretization_;
 
     // Map from gid to vector of source_type on the cell
     std::unordered_map<cell_gid_type, std::vector<source_type>> source_maps_;
 
     // Map from gid to vector of target_type, gid on the cell
     std::unordered_map<cell_gid_type, std::vector<std::pair<target_type, unsigned>>> target_maps_;
+
+    // Map from gid to the synapses placed for the targets in target_maps_
+    std::unordered_map<cell_gid_type, synapse_map> synapse_maps_;
+    std::size_t num_coalesced_ = 0;
+
+    // Rows read for the local cells, recorded by build_source_and_target_maps for the read plans
+    struct local_rows {
+        // Node ids of the local cells, per node population
+        std::unordered_map<unsigned, std::vector<unsigned>> nodes;
+
+        // Per edge population: node ids of the local targets, their rows of target_to_source/range_to_edge_id
+        // and their edge ranges
+        std::unordered_map<unsigned, std::vector<unsigned>> targets;
+        std::unordered_map<unsigned, std::vector<std::pair<unsigned, unsigned>>> ranges;
+        std::unordered_map<unsigned, std::vector<std::pair<unsigned, unsigned>>> edges;
+    };
+    local_rows local_rows_;
 };
 
 class io_desc {
 public:
-    io_desc(h5_record nodes,
-               std::vector<spike_in_info> spikes,
-               std::vector<current_clamp_info> current_clamp,
-               std::vector<probe_info> probes);
+    // Only the population layout of `nodes` is kept; the maps are filled by build_local_maps
+    io_desc(const h5_record& nodes,
+            std::vector<spike_in_info> spikes,
+            std::vector<current_clamp_info> current_clamp,
+            std::vector<probe_info> probes);
 
     /// Fill member maps
 
-    // Queries hdf5/csv records as needed to build (with correct overrides)all needed
-    // information to form a cell_connection.
+    // Builds the spike, current clamp and probe maps, keeping only entries of gids
+    // that belong to the local cell groups
+    void build_local_maps(const std::vector<arb::group_description>&);
 
-    void build_current_clamp_map(std::vector<current_clamp_info> current);
+    void build_current_clamp_map(const std::unordered_set<cell_gid_type>& local_gids);
 
-    void build_spike_map(std::vector<spike_in_info> spikes);
+    void build_spike_map(const std::unordered_set<cell_gid_type>& local_gids);
 
-    void build_probe_map(std::vector<probe_info> probes);
+    void build_probe_map(const std::unordered_set<cell_gid_type>& local_gids);
 
     /// Read maps
 
-    std::vector<current_clamp_desc> get_current_clamps(cell_gid_type gid) const;
+    span<const current_clamp_desc> get_current_clamps(cell_gid_type gid) const;
 
     std::vector<double> get_spikes(cell_gid_type gid) const;
 
@@ -121,13 +182,61 @@ public:
 
     std::vector<trace_index_and_info> get_probes(cell_gid_type gid) const;
 
+    // Returns the probes of local gids only, grouped by output file
     std::unordered_map<std::string, std::vector<cell_member_type>> get_probe_groups() const;
 
-private:
-    h5_record nodes_;
+    // Approximate heap size in bytes of the local maps, for memory reports
+    std::size_t memory_bytes() const;
+
+    // Close the spike input files in the order of the inputs; with MPI-IO every rank has to call it, and
+    // build_local_maps can't be called after
+    void close_files();
 
-    // Map from gid to vector of current_clamp descriptors
-    std::unordered_map<cell_gid_type, std::vector<current_clamp_desc>> current_clamp_map_;
+private:
+    // Electrode locations of current clamps, one entry per electrode
+    struct clamp_electrode_table {
+        std::vector<unsigned> electrode_id;
+        std::vector<cell_gid_type> gid;
+        std::vector<unsigned> sec_id;
+        std::vector<double> seg_x;
+    };
+
+    // Input parameters of current clamps, one entry per electrode
+    struct clamp_input_table {
+        std::vector<unsigned> electrode_id;
+        std::vector<double> dur;
+        std::vector<double> amp;
+        std::vector<double> delay;
+    };
+
+    // Read electrodes of a csv/hdf5 electrode file, keeping only those placed on local gids
+    clamp_electrode_table read_clamp_electrodes(const std::string& file,
+                                                const std::unordered_set<cell_gid_type>& local_gids) const;
+
+    // Read all inputs of a csv/hdf5 input file
+    clamp_input_table read_clamp_inputs(const std::string& file) const;
+
+    // Population name and id in population of a gid
+    local_element localize(cell_gid_type gid) const;
+
+    // Global gid of a population name and id in population
+    cell_gid_type globalize(const local_element& n) const;
+
+    // Population names, partitioned sizes and map from population name to index
+    std::vector<std::string> pop_names_;
+    std::vector<unsigned> pop_parts_;
+    std::unordered_map<std::string, unsigned> pop_map_;
+
+    // Stimulus and report descriptions, consumed by build_local_maps
+    std::vector<spike_in_info> spikes_;
+    std::vector<current_clamp_info> current_clamps_;
+    std::vector<probe_info> probes_;
+
+    // Current clamps of local gids, stored contiguously per gid:
+    // the clamps of clamp_gids_[i] are clamps_[clamp_divs_[i]] to clamps_[clamp_divs_[i+1]]
+    std::vector<cell_gid_type> clamp_gids_;
+    std::vector<unsigned> clamp_divs_;
+    std::vector<current_clamp_desc> clamps_;
 
     // Map from gid to vector of time stamps of input spikes
     std::unordered_map<cell_gid_type, std::vector<double>> spike_map_;
@@ -139,4 +248,4 @@ private:
     std::unordered_map<std::string, std::vector<cell_member_type>> probe_groups_;
 
 };
-} // namespace sonata
\ No newline at end of file
+} // namespace sonata
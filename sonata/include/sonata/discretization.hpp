@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+#include <arbor/cv_policy.hpp>
+#include <arbor/morph/locset.hpp>
+#include <arbor/morph/morphology.hpp>
+
+#include <sonata/common_structs.hpp>
+
+namespace sonata {
+// Locset of an "explicit" discretisation; throws sonata_exception if `expr` does not parse
+arb::locset parse_cv_locset(const std::string& expr);
+
+// True if all segments of `morph` are tagged as soma
+bool is_soma_only(const arb::morphology& morph);
+
+// CV policy of a cell with morphology `morph`
+arb::cv_policy make_cv_policy(const discretization_info& d, const arb::morphology& morph);
+
+// Number of CVs of `morph` under `d`; exact for fixed-per-branch and max-extent, the number of
+// boundary points plus one for explicit policies
+unsigned count_cvs(const discretization_info& d, const arb::morphology& morph);
+} // namespace sonata
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <hdf5.h>
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+namespace sonata {
+// hdf5 file driver of the input files (node, edge, spike and current clamp files)
+enum class h5_driver {
+    // Every rank opens and reads the files on its own
+    sec2,
+
+    // MPI-IO: all ranks open the files together and the metadata read when opening them (superblock, groups and
+    // dataset headers) is read by one rank for all; whole datasets read in h5_collective_reads scopes are read
+    // collectively, other reads are independent
+    mpio
+};
+
+// Driver named `name` ("sec2" or "mpio"); throws sonata_exception otherwise
+h5_driver parse_h5_driver(const std::string& name);
+
+#ifdef ARB_MPI_ENABLED
+// Open the input files with `driver` over `comm` from now on; collective over `comm`. With mpio, opening an input
+// file not loaded into memory is collective: all ranks must open the same files in the same order. Returns the driver used, sec2 if hdf5
+// is built without parallel support or MPI does not provide MPI_THREAD_MULTIPLE (the inputs are read on the I/O
+// thread while the simulation thread communicates)
+h5_driver set_h5_access(h5_driver driver, MPI_Comm comm);
+
+// Access property list of an output file written by all ranks of `comm` with MPI-IO, with collective metadata
+// writes; closed by the caller. Throws sonata_exception if hdf5 is built without parallel support
+hid_t h5_mpio_fapl(MPI_Comm comm);
+#endif
+
+// Open the input files with sec2 again
+void reset_h5_access();
+
+// Driver of the input files opened from now on
+h5_driver h5_input_driver();
+
+// Node and spike input files of at most `bytes` are loaded whole into memory when they are opened (core driver), so
+// that all their reads are served from memory; every rank loads its own copy. Edge files are never loaded, each rank
+// only reads its own edges. 0 turns it off; the default is 64 MiB
+void set_h5_core_threshold(std::size_t bytes);
+
+std::size_t h5_core_threshold();
+
+// Access property list of the input file `file`: the core driver up to the threshold if `in_memory` (node and spike
+// files), otherwise that of the driver of the input files (H5P_DEFAULT with sec2), with the metadata cache set for
+// the file
+hid_t h5_input_fapl(const std::string& file, bool in_memory = false);
+
+// Caches of the input files; a value of 0 (negative for chunk_w0) is not set
+struct h5_cache_params {
+    // Chunk cache of a dataset: size, number of hash table slots and preemption weight (0 to 1) of fully read chunks
+    std::size_t chunk_bytes = 0;
+    std::size_t chunk_slots = 0;
+    double chunk_w0 = -1;
+
+    // Initial size of the metadata cache of a file
+    std::size_t metadata_bytes = 0;
+};
+
+// Parameters from "key=value" pairs separated by commas, with keys chunk_bytes, chunk_slots, chunk_w0 and
+// metadata_bytes; throws sonata_exception otherwise
+h5_cache_params parse_h5_cache(const std::string& text);
+
+// Set the values of `params` for the input files named `file` and their datasets with path `dataset` (empty: all
+// files or all datasets), over those set before for the same files and datasets. For every value the setting of the
+// most specific match applies: file and dataset, file, dataset, all. Applies to files opened from now on
+void set_h5_cache(const h5_cache_params& params, const std::string& file = "", const std::string& dataset = "");
+
+// Forget all cache settings
+void reset_h5_cache();
+
+// Caches of dataset `dataset` of input file `file`, stored in chunks of `chunk_bytes` bytes (0 if not chunked):
+// the values set with set_h5_cache, otherwise a chunk cache of at least 4 chunks and 1 MiB with 100 slots per chunk
+// (at least 521) and w0 0.75; the metadata cache is left to hdf5
+h5_cache_params h5_dataset_cache(const std::string& file, const std::string& dataset, std::size_t chunk_bytes);
+
+// Access property list of a dataset opened to read it, with the chunk cache of `cache`; closed by the caller.
+// Its header is read independently, also in files opened with collective metadata reads
+hid_t h5_read_dapl(const h5_cache_params& cache);
+
+// Transfer property list of the reads of whole datasets of `dataset`: collective in an h5_collective_reads scope
+// if its file was opened with mpio, H5P_DEFAULT otherwise
+hid_t h5_whole_read_dxpl(hid_t dataset);
+
+/// While alive, whole datasets of the input files are read collectively with mpio: all ranks sharing the files must
+/// read the same datasets in the same order
+class h5_collective_reads {
+public:
+    h5_collective_reads();
+    ~h5_collective_reads();
+
+    h5_collective_reads(const h5_collective_reads&) = delete;
+    h5_collective_reads& operator=(const h5_collective_reads&) = delete;
+};
+} // namespace sonata
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sonata/hdf5_lib.hpp>
+
+namespace sonata {
+// Rows [begin, end) of a dataset to read into memory
+struct h5_read_request {
+    std::shared_ptr<h5_dataset> dataset;
+    hsize_t begin;
+    hsize_t end;
+};
+
+/// Row ranges of datasets to be read ahead of their use
+class h5_read_plan {
+public:
+    // Add rows [begin, end) of `dataset`; datasets that are not integer or floating point are left out
+    void add(const std::shared_ptr<h5_dataset>& dataset, hsize_t begin, hsize_t end);
+
+    // Sort the requests by their position in the files (datasets by offset, then rows) and merge the
+    // ranges of a dataset that overlap or are at most `gap` rows apart
+    void coalesce(hsize_t gap = 0);
+
+    const std::vector<h5_read_request>& requests() const {
+        return requests_;
+    }
+
+private:
+    std::vector<h5_read_request> requests_;
+};
+
+/// Thread owning the reads of the hdf5 input files. While a service is active, the reads of every
+/// h5_dataset from other threads are queued and executed on its thread, and the callers wait on a future:
+/// hdf5 is not thread safe in a default build, and is only entered by one thread without a global lock.
+/// Blocks of rows prefetched from read plans are kept in memory; reads within a block are served from it,
+/// after waiting for the block if it is still queued. Only one service can be active at a time, and hdf5
+/// files must not be written while it is.
+class h5_io_service {
+public:
+    struct stats {
+        // Blocks and bytes prefetched
+        std::size_t blocks = 0;
+        std::size_t bytes = 0;
+
+        // Row reads served from a block, and those that were not
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+    };
+
+    h5_io_service();
+    ~h5_io_service();
+
+    h5_io_service(const h5_io_service&) = delete;
+    h5_io_service& operator=(const h5_io_service&) = delete;
+
+    // Run `f` on the I/O thread; the future holds its result or exception
+    template <typename F>
+    auto submit(F f) -> std::future<decltype(f())> {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+        auto result = task->get_future();
+        enqueue([task](bool) { (*task)(); });
+        return result;
+    }
+
+    // Queue the reads of the blocks of `plan`, in order; ready when all are loaded
+    std::shared_future<void> prefetch(const h5_read_plan& plan);
+
+    // Copy rows [begin, end) of `dataset`, of `columns` columns, from a prefetched block to `out`;
+    // false if no block holds them as integers (floating point)
+    bool read_cached(const h5_dataset* dataset, hsize_t begin, hsize_t end, hsize_t columns, int* out);
+    bool read_cached(const h5_dataset* dataset, hsize_t begin, hsize_t end, hsize_t columns, double* out);
+
+    bool on_io_thread() const {
+        return std::this_thread::get_id() == thread_.get_id();
+    }
+
+    stats statistics() const;
+
+    // Service the reads of h5_dataset are routed through, null if none
+    static h5_io_service* active();
+
+private:
+    // Rows [begin, end) of a dataset, row-major, as in the file
+    struct block {
+        hsize_t begin;
+        hsize_t end;
+        std::vector<int> ints;
+        std::vector<double> doubles;
+        bool loaded = false;
+        std::shared_future<void> ready;
+    };
+
+    // Queue `job`; it is called with true if the service is stopping, when prefetching is cancelled
+    void enqueue(std::function<void(bool)> job);
+    void run();
+
+    template <typename T>
+    bool copy_rows(const h5_dataset* dataset, hsize_t begin, hsize_t end, hsize_t columns, T* out);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void(bool)>> queue_;
+    bool stop_ = false;
+
+    // Blocks of every dataset, by first row
+    std::unordered_map<const h5_dataset*, std::map<hsize_t, std::shared_ptr<block>>> blocks_;
+
+    std::atomic<std::size_t> blocks_loaded_{0};
+    std::atomic<std::size_t> bytes_loaded_{0};
+    std::atomic<std::size_t> hits_{0};
+    std::atomic<std::size_t> misses_{0};
+
+    std::thread thread_;
+};
+} // namespace sonata
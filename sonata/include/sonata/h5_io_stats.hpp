@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sonata {
+// Selection of the elements read from a dataset
+enum class h5_selection {
+    all,
+    hyperslab,
+    point
+};
+
+// Reads of a dataset, identified by its path in the file
+struct h5_read_stats {
+    std::string path;
+    std::size_t reads = 0;
+    std::size_t elements = 0;
+    std::size_t bytes = 0;
+
+    // Number of reads of every selection kind, indexed by h5_selection
+    std::size_t selections[3] = {0, 0, 0};
+
+    // Cumulative time (s)
+    double time = 0;
+
+    // Chunks of the reads of a chunked dataset found in and missing from its chunk cache, estimated from the size
+    // of the cache (least recently used chunks evicted first)
+    std::size_t chunk_hits = 0;
+    std::size_t chunk_misses = 0;
+};
+
+// Metadata cache of an input file
+struct h5_file_cache_stats {
+    std::string file;
+    double metadata_hit_rate = 0;
+};
+
+// The reads of h5_dataset are only recorded when the library is built with SONATA_H5_INSTRUMENTATION,
+// and recording is enabled at run time
+bool h5_instrumentation_available();
+
+void h5_instrumentation_enable(bool enable);
+
+bool h5_instrumentation_enabled();
+
+// Recorded reads of all datasets, by decreasing time
+std::vector<h5_read_stats> h5_read_summary();
+
+// Metadata cache hit rates of the input files opened while recording, when they were closed or now if they are still
+// open; by file name. Not while reads are in flight
+std::vector<h5_file_cache_stats> h5_file_cache_summary();
+
+// Clear the recorded reads
+void h5_instrumentation_reset();
+
+// Table of the `max_rows` datasets of `summary` with most read time
+void print_h5_read_summary(std::ostream& o, const std::vector<h5_read_stats>& summary, std::size_t max_rows = 20);
+} // namespace sonata
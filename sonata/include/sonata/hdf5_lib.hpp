@@ -2,18 +2,55 @@
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <hdf5.h>
 
 namespace sonata {
+// Native hdf5 type of a C++ type
+template <typename T> hid_t h5_native_type();
+template <> inline hid_t h5_native_type<int>() { return H5T_NATIVE_INT; }
+template <> inline hid_t h5_native_type<float>() { return H5T_NATIVE_FLOAT; }
+template <> inline hid_t h5_native_type<double>() { return H5T_NATIVE_DOUBLE; }
+
+// Storage of a new dataset
+struct h5_dataset_props {
+    // Chunk dimensions; chunked datasets can be extended along their first dimension and filtered.
+    // Empty for contiguous storage
+    std::vector<hsize_t> chunk_dims;
+
+    // gzip compression level of chunked datasets, 0 for no compression
+    unsigned deflate = 0;
+
+    // Byte shuffle of chunked datasets before compression; improves compression of floating point data
+    bool shuffle = false;
+};
+
+// Layout of a new file
+struct h5_file_props {
+    // Paged file space management with pages of `page_size` bytes; 0 for the default strategy
+    hsize_t page_size = 0;
+
+    // Objects of at least `alignment_threshold` bytes start at multiples of `alignment` bytes
+    hsize_t alignment = 1;
+    hsize_t alignment_threshold = 1;
+};
+
 /// Class for reading from hdf5 datasets
-/// Datasets are opened and closed every time they are read
+/// Datasets are opened for reading on their first read and stay open, so that their chunk cache outlives the reads
 class h5_dataset {
 public:
     // Constructor from parent (hdf5 group) id and dataset name - finds size of the dataset
     h5_dataset(hid_t parent, std::string name);
 
+    ~h5_dataset();
+
+    h5_dataset(const h5_dataset&) = delete;
+    h5_dataset& operator=(const h5_dataset&) = delete;
+
     // Constructor from parent (hdf5 group) id and dataset name - creates andf writes dataset `data`
     h5_dataset(hid_t parent, std::string name, std::vector<int> data);
 
@@ -23,6 +60,66 @@ public:
 
     h5_dataset(hid_t parent, std::string name, std::vector<std::vector<double>> data);
 
+    // Constructor from parent (hdf5 group) id and dataset name - creates a dataset of dimensions `dims`
+    // stored as `props`, and writes the row-major `data` straight from the buffer
+    template <typename T>
+    h5_dataset(hid_t parent, std::string name, const T* data, std::vector<hsize_t> dims,
+               const h5_dataset_props& props = {});
+
+    // Constructor from parent (hdf5 group) id and dataset name - creates an empty dataset of `type`
+    // and dimensions `dims` stored as `props`
+    h5_dataset(hid_t parent, std::string name, hid_t type, std::vector<hsize_t> dims, const h5_dataset_props& props);
+
+    // Constructor from parent (hdf5 group) id and dataset name - creates an empty 1D dataset of `type`,
+    // chunked by `chunk_size` elements, that can be extended with `append`
+    h5_dataset(hid_t parent, std::string name, hid_t type, hsize_t chunk_size);
+
+    // Constructor from parent (hdf5 group) id and dataset name - creates a dataset of `type` and
+    // dimensions `dims`, to be filled with `write`/`write_columns`
+    h5_dataset(hid_t parent, std::string name, hid_t type, std::vector<hsize_t> dims);
+
+    // Constructor from parent (hdf5 group) id and dataset name - creates a dataset of `type` and
+    // dimensions `dims`, chunked by `chunk_dims`, that can be extended along its first dimension
+    h5_dataset(hid_t parent, std::string name, hid_t type, std::vector<hsize_t> dims, std::vector<hsize_t> chunk_dims);
+
+    // Extend a 1D dataset by the size of `data` and write `data` at its end
+    template <typename T>
+    void append(const std::vector<T>& data);
+
+    // Extend a dataset by `count` rows and write the `count` rows of the row-major `data` at its end
+    template <typename T>
+    void append(const T* data, hsize_t count);
+
+    // Set the first dimension of an extendible dataset; collective when the file is opened with MPI-IO
+    void resize(hsize_t size);
+
+    // Write `data` at `offset` of a 1D dataset; with `collective` every rank of the file
+    // has to call write, also with empty `data`
+    template <typename T>
+    void write(hsize_t offset, const std::vector<T>& data, bool collective = false);
+
+    // Write the `count` rows of the row-major `data` from row `offset`; with `collective` every rank
+    // of the file has to call write, also with `count` 0
+    template <typename T>
+    void write(hsize_t offset, const T* data, hsize_t count, bool collective = false);
+
+    // Write the block of `num_rows` rows from `row_offset` and the columns `columns` (in increasing order)
+    // of a 2D dataset from the row-major `data`; with `collective` every rank of the file has to call
+    // write_columns, also with empty `columns`
+    template <typename T>
+    void write_columns(hsize_t row_offset,
+                       hsize_t num_rows,
+                       const std::vector<hsize_t>& columns,
+                       const std::vector<T>& data,
+                       bool collective = false);
+
+    template <typename T>
+    void write_columns(hsize_t row_offset,
+                       hsize_t num_rows,
+                       const std::vector<hsize_t>& columns,
+                       const T* data,
+                       bool collective = false);
+
     // returns name of dataset
     std::string name();
 
@@ -41,15 +138,59 @@ public:
     template <typename T>
     auto get(const int i, const int j);
 
+    // Read rows [begin, end) of all columns, row-major, on the calling thread; not routed through
+    // the active h5_io_service
+    template <typename T>
+    std::vector<T> read_rows(hsize_t begin, hsize_t end);
+
+    // Number of columns of a 2D dataset, 1 otherwise
+    hsize_t columns() const {
+        return columns_;
+    }
+
+    bool is_integer() const {
+        return type_class_ == H5T_INTEGER;
+    }
+
+    bool is_float() const {
+        return type_class_ == H5T_FLOAT;
+    }
+
+    // Address of the data in the file; HADDR_UNDEF unless the dataset is stored contiguously
+    haddr_t file_offset() const {
+        return offset_;
+    }
+
+    // Close the dataset if it was opened for reading
+    void close();
+
 private:
+    // Dataset opened for reading with the chunk cache of h5_dataset_cache, on the first call
+    hid_t read_handle();
+
     // id of parent group
     hid_t parent_id_;
 
     // name of dataset
     std::string name_;
 
+    // Path of dataset in the file, the key of its read statistics
+    std::string path_;
+
     // First dimension of dataset
     size_t size_;
+
+    // Layout of a dataset opened for reading
+    hsize_t columns_ = 1;
+    H5T_class_t type_class_ = H5T_NO_CLASS;
+    haddr_t offset_ = HADDR_UNDEF;
+
+    // Rows and bytes of a chunk, 0 unless the dataset is chunked, and chunks in its chunk cache
+    hsize_t chunk_rows_ = 0;
+    std::size_t chunk_bytes_ = 0;
+    std::size_t cache_chunks_ = 0;
+
+    hid_t read_id_ = -1;
 };
 
 
@@ -66,10 +207,38 @@ public:
     // Add a new group
     std::shared_ptr<h5_group> add_group(std::string name);
 
+    // Close the datasets opened for reading and the groups of the tree, children first; the group can't be read
+    // after
+    void close();
+
     // Add a new int dataset
     template <typename T>
     void add_dataset(std::string name, std::vector<T> dset);
 
+    // Add a new dataset of dimensions `dims`, without writing it
+    template <typename T>
+    std::shared_ptr<h5_dataset> add_empty_dataset(std::string name, std::vector<hsize_t> dims);
+
+    // Add a new empty, extendible 1D dataset chunked by `chunk_size` elements
+    template <typename T>
+    std::shared_ptr<h5_dataset> add_extendible_dataset(std::string name, hsize_t chunk_size);
+
+    // Add a new dataset of `type` and dimensions `dims`, extendible along its first dimension
+    std::shared_ptr<h5_dataset> add_extendible_dataset(std::string name, hid_t type,
+                                                       std::vector<hsize_t> dims,
+                                                       std::vector<hsize_t> chunk_dims);
+
+    // Add a new empty dataset of `type` and dimensions `dims`, stored as `props`
+    std::shared_ptr<h5_dataset> add_dataset(std::string name, hid_t type,
+                                            std::vector<hsize_t> dims,
+                                            const h5_dataset_props& props);
+
+    // Add a new dataset of dimensions `dims` stored as `props`, written from the row-major `data`
+    template <typename T>
+    std::shared_ptr<h5_dataset> add_dataset(std::string name, const T* data,
+                                            std::vector<hsize_t> dims,
+                                            const h5_dataset_props& props = {});
+
     // hdf5 groups belonging to group
     std::vector<std::shared_ptr<h5_group>> groups_;
 
@@ -87,7 +256,13 @@ private:
             }
         }
         ~group_handle() {
-            H5Gclose(id);
+            close();
+        }
+        void close() {
+            if (id >= 0) {
+                H5Gclose(id);
+                id = -1;
+            }
         }
         hid_t id;
         std::string name;
@@ -109,16 +284,24 @@ class h5_file {
 private:
     // RAII to handle opening/closing files
     struct file_handle {
-        file_handle(std::string file, bool new_file = false): name(file) {
+        file_handle(std::string file, bool new_file = false, hid_t fapl = H5P_DEFAULT): name(file) {
             if (new_file) {
-                id = H5Fcreate(file.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+                id = H5Fcreate(file.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
             }
             else {
-                id = H5Fopen(file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+                id = H5Fopen(file.c_str(), H5F_ACC_RDONLY, fapl);
             }
         }
+        // Creates a new file laid out as `props`
+        file_handle(std::string file, const h5_file_props& props, hid_t fapl);
         ~file_handle() {
-            H5Fclose(id);
+            close();
+        }
+        void close() {
+            if (id >= 0) {
+                H5Fclose(id);
+                id = -1;
+            }
         }
         hid_t id;
         std::string name;
@@ -131,12 +314,25 @@ private:
     file_handle file_h_;
 
 public:
-    // Constructor from file name
-    h5_file(std::string name, bool new_file=false);
+    // Constructor from file name, with optional file access property list (e.g. for MPI-IO); existing files are
+    // opened with h5_input_fapl(name) by default
+    h5_file(std::string name, bool new_file=false, hid_t fapl=H5P_DEFAULT);
+
+    // Create a new file laid out as `props`, with optional file access property list
+    h5_file(std::string name, const h5_file_props& props, hid_t fapl=H5P_DEFAULT);
+
+    ~h5_file();
 
     // Returns file name
     std::string name();
 
+    // Flush all buffers of the file to disk
+    void flush();
+
+    // Close the tree of groups and then the file, rather than when its last object is released; with MPI-IO
+    // every rank of the file has to call it, closing its files in the same order
+    void close();
+
     // Debugging function
     void print();
 
@@ -177,6 +373,12 @@ public:
     template <typename T>
     T get(std::string name) const;
 
+    // Dataset with name `name`; null if dataset not found
+    std::shared_ptr<h5_dataset> dataset(std::string name) const;
+
+    // All datasets of the wrapped h5_group
+    const std::vector<std::shared_ptr<h5_dataset>>& datasets() const;
+
     // Returns h5_wrapper of group at index i in members_
     const h5_wrapper& operator[] (unsigned i) const;
 
@@ -186,6 +388,9 @@ public:
     // Returns name of the wrapped h5_group
     std::string name() const;
 
+    // Close the wrapped h5_group, see h5_group::close
+    void close();
+
 private:
     // Pointer to the h5_group wrapped in h5_wrapper
     std::shared_ptr<h5_group> ptr_;
@@ -240,6 +445,9 @@ public:
     // Returns all populations
     std::vector<h5_wrapper> populations() const;
 
+    // Close the files in the order they were given, see h5_file::close
+    void close();
+
     // Returns partitioned sizes of every population in the h5_record
     std::vector<unsigned> partitions() const;
 
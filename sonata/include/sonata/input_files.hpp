@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+namespace sonata {
+// Ranks reading the small text input files: the simulation, circuit and node set configs, the node and edge
+// type csv files, their dynamics_params and default morphologies, and csv stimulus files
+enum class input_read_mode {
+    // Every rank reads every file
+    all,
+
+    // Rank 0 reads the files and broadcasts their contents
+    root,
+
+    // The first rank of every node reads the files and broadcasts them to the other ranks of the node
+    node
+};
+
+// Mode named `name` ("all", "root" or "node"); throws sonata_exception otherwise
+input_read_mode parse_input_read_mode(const std::string& name);
+
+#ifdef ARB_MPI_ENABLED
+// Share the input files read from now on between the ranks of `comm` as `mode`; collective over `comm`.
+// While they are shared, read_input_file is collective: all ranks must read the same files in the same order
+void share_input_files(input_read_mode mode, MPI_Comm comm);
+#endif
+
+// Stop sharing the input files; every rank reads them again
+void unshare_input_files();
+
+// Contents of the file `name`; nothing, on all ranks sharing it, if it can not be read
+std::optional<std::string> read_input_file(const std::string& name);
+
+// Input files of this rank read from the file system and received from another rank
+struct input_file_stats {
+    std::size_t read = 0;
+    std::size_t received = 0;
+    std::size_t bytes = 0;
+};
+
+input_file_stats input_file_statistics();
+} // namespace sonata
@@ -8,6 +8,8 @@
 
 #include <nlohmann/json.hpp>
 
+#include <sonata/input_files.hpp>
+
 namespace sup {
 
 // Search a json object for an entry with a given name.
@@ -42,13 +44,12 @@ void param_from_json(std::array<T, N>& x, const char* name, nlohmann::json& j) {
     }
 }
 
+// Read through sonata::read_input_file, so collective while the input files are shared
 inline
 nlohmann::json read_json_file(const std::string& fn) {
-    std::ifstream fd(fn);
-    if (!fd.good()) throw std::runtime_error("Unable to open input file: " + fn);
-    nlohmann::json json;
-    fd >> json;
-    return json;
+    auto contents = sonata::read_input_file(fn);
+    if (!contents) throw std::runtime_error("Unable to open input file: " + fn);
+    return nlohmann::json::parse(*contents);
 }
 
 template <typename T>
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arbor/cable_cell.hpp>
+#include <arbor/common_types.hpp>
+#include <arbor/domain_decomposition.hpp>
+#include <arbor/mechcat.hpp>
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+namespace sonata {
+// Shortest decimal representation of `value` that reads back as `value`
+std::string format_global_value(double value);
+
+// Density mechanisms of the network and their instances in the cell groups
+struct mechanism_summary {
+    // Distinct density mechanisms, and those derived by setting global parameters
+    std::size_t mechanisms = 0;
+    std::size_t derived = 0;
+
+    // Number of distinct derived mechanisms of every base mechanism with derived ones
+    std::map<std::string, std::size_t> variants;
+
+    // Distinct density mechanisms on the cells of every cell group; every one is instantiated
+    // once per group
+    std::vector<std::size_t> group_instances;
+
+    std::size_t total_instances() const;
+    std::size_t max_instances() const;
+};
+
+/// Density mechanisms painted on the cable cells. Global parameters set by the dynamics params of
+/// a cell make a derived mechanism (`hh/gkbar=0.036`), named with the globals in name order and
+/// canonical values, so equal values always give the same mechanism. With a relative `tolerance`,
+/// global values are rounded to as many significant digits as keep them within the tolerance, so
+/// that nearly equal values share a mechanism. The const members can be called concurrently, the
+/// others are not thread safe.
+class mechanism_registry {
+public:
+    explicit mechanism_registry(double tolerance = 0);
+
+    // Global value `value` as used in derived mechanisms
+    double cluster(double value) const;
+
+    // `desc` with its global values as used in derived mechanisms
+    arb::mechanism_desc cluster_globals(const arb::mechanism_catalogue& cat, const arb::mechanism_desc& desc) const;
+
+    // Density mechanism painting `desc`: the derived mechanism of its globals, with its other parameters
+    arb::density derive(const arb::mechanism_catalogue& cat, const arb::mechanism_desc& desc) const;
+
+    // Id of the density mechanism `name`, registered on first use
+    unsigned intern(const std::string& name);
+
+    // Ids of the density mechanisms `names` in increasing order, registered on first use
+    std::vector<unsigned> intern(const std::vector<std::string>& names);
+
+    // Ids of the density mechanisms on cell `gid`; replaces those of an earlier call
+    void add_cell(arb::cell_gid_type gid, std::vector<unsigned> mechanisms);
+
+    // Names of the registered mechanisms, by id
+    const std::vector<std::string>& names() const {
+        return names_;
+    }
+
+    // Mechanisms of the cells of `groups` that were added
+    mechanism_summary summarise(const std::vector<arb::group_description>& groups) const;
+#ifdef ARB_MPI_ENABLED
+    // Mechanisms of the cells of `groups` over all ranks; collective
+    mechanism_summary summarise(const std::vector<arb::group_description>& groups, MPI_Comm comm) const;
+#endif
+
+    void clear();
+
+private:
+    double tolerance_;
+    int digits_;
+
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, unsigned> ids_;
+    std::unordered_map<arb::cell_gid_type, std::vector<unsigned>> cells_;
+};
+} // namespace sonata
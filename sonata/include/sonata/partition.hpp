@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <arbor/common_types.hpp>
+#include <arbor/context.hpp>
+#include <arbor/domain_decomposition.hpp>
+#include <arbor/recipe.hpp>
+
+#include <sonata/cell_cost.hpp>
+#include <sonata/common_structs.hpp>
+
+namespace sonata {
+/// Lightweight description of the whole network, for distributing the cells over the ranks
+/// The connections are undirected and merged per pair of cells: the neighbours of cell `gid` are
+/// neighbours[divs[gid]] to neighbours[divs[gid+1]], connected by weights[...] edges
+struct cell_graph {
+    std::vector<arb::cell_kind> kinds;
+
+    // Index of the set of density mechanisms of every cell; cells with the same index have
+    // the same mechanisms, possibly with different parameters
+    std::vector<unsigned> mech_sets;
+
+    // Features of every cell, and the cost of simulating it estimated from them
+    std::vector<cell_features> features;
+    std::vector<double> costs;
+
+    // Positions of the cells; empty if not all nodes have x/y/z positions
+    std::vector<std::array<double, 3>> positions;
+
+    std::vector<unsigned> divs;
+    std::vector<cell_gid_type> neighbours;
+    std::vector<unsigned> weights;
+
+    cell_size_type size() const {
+        return kinds.size();
+    }
+};
+
+// Fill the adjacency of `g` from the edges `sources[i]` - `targets[i]` with the number of edges
+// `counts[i]`; the pairs must be unique, sorted, with sources[i] < targets[i]
+void set_adjacency(cell_graph& g,
+                   const std::vector<cell_gid_type>& sources,
+                   const std::vector<cell_gid_type>& targets,
+                   const std::vector<unsigned>& counts);
+
+// Part of every cell out of `num_parts`: contiguous runs of cells in spatial or gid order,
+// refined by moving cells to the part of most of their neighbours while the cost of the
+// parts stays below (1 + imbalance) times the mean cost
+std::vector<unsigned> partition_cells(const cell_graph& g, unsigned num_parts, const partition_info& info);
+
+// Cell groups of the cells of part `part`: one kind per group, and cable cells with the same
+// mechanism set together, so that the SIMD batches of the mechanisms stay full
+std::vector<arb::group_description> make_cell_groups(const cell_graph& g,
+                                                     const std::vector<unsigned>& parts,
+                                                     unsigned part,
+                                                     unsigned group_size,
+                                                     arb::backend_kind cable_backend);
+
+// Quality of a partition: cost of the parts and edges between parts
+struct partition_stats {
+    std::vector<double> part_costs;
+    double max_cost = 0;
+    double mean_cost = 0;
+
+    // Edges between cells of different parts, and all edges
+    std::size_t cut_edges = 0;
+    std::size_t total_edges = 0;
+
+    // Cost of the most expensive part over the mean cost
+    double imbalance() const {
+        return mean_cost > 0? max_cost/mean_cost: 1;
+    }
+};
+
+partition_stats evaluate_partition(const cell_graph& g, const std::vector<unsigned>& parts, unsigned num_parts);
+
+// Decomposition of the cells of `g`, the cells of `rec`, over the ranks of `ctx`
+arb::domain_decomposition partition_network(const arb::recipe& rec,
+                                            const cell_graph& g,
+                                            const arb::context& ctx,
+                                            const partition_info& info);
+} // namespace sonata
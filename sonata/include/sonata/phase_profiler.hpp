@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <arbor/version.hpp>
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+#include <nlohmann/json.hpp>
+
+namespace sonata {
+/// Class recording the wall time and memory use of the phases of a run
+/// Every rank times its own phases; `report` reduces them over the ranks, so all ranks
+/// have to go through the same phases in the same order.
+class phase_profiler {
+public:
+    phase_profiler();
+
+#ifdef ARB_MPI_ENABLED
+    phase_profiler(MPI_Comm comm);
+#endif
+
+    // End the current phase, if any, and start phase `name`
+    void start(std::string name);
+
+    // End the current phase
+    void stop();
+
+    // Record a quantity of the local rank, e.g. the number of local cells, reported as
+    // sum, min and max over the ranks
+    void record(std::string name, double value);
+
+    // Phases and quantities of all ranks; collective
+    // Per phase: wall time (min, max and mean over ranks), resident set size at its end and
+    // peak resident set size up to its end (max over ranks, MiB)
+    nlohmann::json report() const;
+
+    // Table of the phases of `report`
+    static void print(std::ostream& o, const nlohmann::json& report);
+
+private:
+    struct phase {
+        std::string name;
+        double wall;
+        double rss;
+        double peak_rss;
+    };
+
+    struct quantity {
+        std::string name;
+        double value;
+    };
+
+    std::vector<phase> phases_;
+    std::vector<quantity> quantities_;
+
+    bool running_ = false;
+    std::string current_;
+    std::chrono::steady_clock::time_point start_;
+
+    int num_ranks_ = 1;
+
+#ifdef ARB_MPI_ENABLED
+    MPI_Comm comm_ = MPI_COMM_NULL;
+#endif
+};
+} // namespace sonata
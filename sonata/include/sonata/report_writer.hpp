@@ -0,0 +1,166 @@
+#pragma once
+
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <arbor/common_types.hpp>
+#include <arbor/sampling.hpp>
+#include <arbor/schedule.hpp>
+#include <arbor/version.hpp>
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+#include <sonata/async_writer.hpp>
+#include <sonata/common_structs.hpp>
+#include <sonata/hdf5_lib.hpp>
+
+namespace sonata {
+/// Class for streaming a SONATA compartment report
+/// Samples are written by the samplers into a block with a buffer per trace, sized for the time
+/// steps of an epoch, so that samplers of different cell groups can run concurrently and never
+/// allocate. There are two blocks: on `flush` the filled block is swapped with the other one, and
+/// its time steps are packed into row-major [time x trace] blocks appended to the chunked,
+/// extendible `reports/<pop>/data` datasets, so memory use does not grow with the length of the
+/// run. The time is stored once, as (start, stop, dt).
+/// With an async_writer, the packing and writing are done on its thread while the simulation
+/// continues, with buffers reused by every write; with several ranks this requires
+/// MPI_THREAD_MULTIPLE, otherwise blocks are written on the calling thread once the writer thread
+/// is idle, as hdf5 and MPI are then only called from one thread.
+/// Every rank writes the columns of its local traces; the mapping is built from the probes
+/// of all ranks, so the output does not depend on the number of ranks.
+/// Without parallel hdf5, the blocks are gathered and written by rank 0.
+class report_writer {
+public:
+    report_writer(report_info info, std::vector<std::string> pop_names, std::vector<unsigned> pop_parts);
+
+#ifdef ARB_MPI_ENABLED
+    report_writer(report_info info, std::vector<std::string> pop_names, std::vector<unsigned> pop_parts, MPI_Comm comm);
+#endif
+
+    ~report_writer();
+
+    // Create the report file with the mapping of the local `probes` at their locations; collective. The report
+    // is flushed at least every `epoch` (ms), the epoch length of the simulation, which sizes the buffers
+    void open(std::vector<std::pair<cell_member_type, mlocation>> probes,
+              double epoch = std::numeric_limits<double>::infinity());
+
+    // Sample times of the report
+    arb::schedule schedule() const;
+
+    // Column of a local probe in the report; columns are ordered by (gid, index)
+    unsigned column(cell_member_type probe) const;
+
+    // Record value `v` of local column `col` sampled at time `t`; throws sonata_exception if the report is not
+    // flushed within the epoch given to `open`
+    void record(unsigned col, double t, double v);
+
+    // Sampler writing the samples of local column `col` straight into its buffer
+    arb::sampler_function sampler(unsigned col);
+
+    // Write the blocks on the thread of `writer` from now on; `writer` must outlive the report
+    void set_async_writer(async_writer* writer);
+
+    // Write the buffered time steps before `t`; collective. Waits for the writes of the previous flush
+    void flush(double t);
+
+    // Write the remaining time steps and close the file; collective
+    void close();
+
+    const report_info& info() const;
+
+private:
+    // Identification and location of a trace; traces of a report are sorted by (gid, index)
+    struct trace_key {
+        cell_gid_type gid;
+        cell_lid_type index;
+        int rank;
+        unsigned branch;
+        double pos;
+    };
+
+    // Output of a population
+    struct pop_output {
+        std::shared_ptr<h5_dataset> data;
+
+        // Local columns of the population are [first_local, first_local + columns.size())
+        unsigned first_local;
+
+        // Columns of the local traces in the dataset
+        std::vector<hsize_t> columns;
+
+        // Columns of the traces of every rank, for writing gathered blocks on rank 0
+        std::vector<std::vector<hsize_t>> rank_columns;
+
+        hsize_t num_columns;
+
+        // Row-major block of the local columns, and when gathering, the counts of the ranks and on rank 0 the
+        // blocks of all ranks and the rows of all columns; sized by `open` and reused by every write
+        std::vector<double> packed;
+        std::vector<int> counts;
+        std::vector<int> displs;
+        std::vector<double> gathered;
+        std::vector<double> rows;
+        std::vector<hsize_t> all_columns;
+    };
+
+    // Samples of all local columns: element col*block_steps_ + i holds the i-th time step of the block
+    struct sample_block {
+        std::vector<double> samples;
+
+        // Ready once the block is written and cleared on the writer thread
+        std::future<void> written;
+    };
+
+    // Number of time steps sampled before time `t`
+    hsize_t steps_before(double t) const;
+
+    // Write the `num_rows` time steps of `block`, from time step `first_row`, then clear it
+    void write_blocks(std::vector<double>& block, hsize_t first_row, hsize_t num_rows);
+
+    // Write the `num_rows` time steps of `block` from `first_row` for population output `out`
+    void write_block(pop_output& out, const std::vector<double>& block, hsize_t first_row, hsize_t num_rows);
+
+    report_info info_;
+    std::vector<std::string> pop_names_;
+    std::vector<unsigned> pop_parts_;
+
+    // Total number of time steps, and number of time steps written
+    hsize_t num_steps_ = 0;
+    hsize_t written_steps_ = 0;
+
+    // Local probes in column order
+    std::vector<cell_member_type> probes_;
+
+    // Block filled by the samplers, starting at time step written_steps_, and the block of the previous flush
+    sample_block blocks_[2];
+    unsigned active_ = 0;
+
+    // Time steps held by every buffer of a block
+    hsize_t block_steps_ = 0;
+
+    std::unique_ptr<h5_file> file_;
+    std::vector<pop_output> outputs_;
+    async_writer* writer_ = nullptr;
+
+    bool open_ = false;
+
+    // Rank and number of ranks writing the report; collective_ when writing with MPI-IO, thread_multiple_ when
+    // MPI can be called from the writer thread
+    int rank_ = 0;
+    int num_ranks_ = 1;
+    bool collective_ = false;
+    bool thread_multiple_ = false;
+
+#ifdef ARB_MPI_ENABLED
+    // Duplicate of the communicator of the report, so that its collectives on the writer thread don't match
+    // those of the simulation
+    MPI_Comm comm_ = MPI_COMM_NULL;
+#endif
+};
+} // namespace sonata
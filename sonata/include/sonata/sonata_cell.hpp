@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -24,6 +25,9 @@
 #include <arborenv/concurrency.hpp>
 #include <arborenv/gpu_env.hpp>
 
+#include <sonata/cell_template.hpp>
+#include <sonata/discretization.hpp>
+#include <sonata/mechanism_registry.hpp>
 #include <sonata/sonata_io.hpp>
 #include <sonata/data_management_lib.hpp>
 #include <sonata/sonata_cell.hpp>
@@ -45,46 +49,52 @@ using namespace arborio::literals;
 namespace sonata {
 // Generate a cell.
 
-arb::density fix_my_mech (const arb::mechanism_catalogue& cat, const arb::mechanism_desc& desc) {
-    std::string name = desc.name();
-    std::unordered_map<std::string, double> params;
-    const auto& info = cat[name];
-    std::string sep = "/";
-    for (const auto& [param, value]: desc.values()) {
-        if (info.globals.count(param)) {
-            name += sep + param + "=" + std::to_string(value);
-            sep = ",";
-        }
-        else {
-            params[param] = value;
+// Labels, density mechanisms and CV policy shared by the cells of a node type; the density
+// mechanisms are derived by `registry` and registered by the caller
+cell_template make_cell_template(
+        const mechanism_registry& registry,
+        const arb::mechanism_catalogue& cat,
+        arb::morphology morph,
+        std::unordered_map<section_kind, std::vector<arb::mechanism_desc>> mechs,
+        arb::cv_policy policy) {
+    cell_template t;
+    t.morph = std::move(morph);
+
+    using arb::reg::tagged;
+    t.labels.set("soma", tagged(1));
+    t.labels.set("axon", tagged(2));
+    t.labels.set("dend", join(tagged(3), tagged(4)));
+
+    auto paint = [&](const arb::region& reg, const std::vector<arb::mechanism_desc>& section_mechs) {
+        for (const auto& mech: section_mechs) {
+            auto density = registry.derive(cat, mech);
+            t.mechanism_names.push_back(density.mech.name());
+            t.decor.paint(reg, std::move(density));
         }
-    }
-    return {name, std::move(params)};
+    };
+    paint("soma"_lab, mechs[section_kind::soma]);
+    paint("dend"_lab, mechs[section_kind::dend]);
+    paint("axon"_lab, mechs[section_kind::axon]);
+
+    std::sort(t.mechanism_names.begin(), t.mechanism_names.end());
+    t.mechanism_names.erase(std::unique(t.mechanism_names.begin(), t.mechanism_names.end()), t.mechanism_names.end());
+
+    t.decor.set_default(policy);
+    return t;
 }
 
+// Cell of template `t` with its own current clamps, detectors and synapses
 arb::cable_cell sonata_cell(
-        const arb::mechanism_catalogue& cat,
-        arb::decor dec,
-        arb::morphology morph,
-        std::unordered_map<section_kind, std::vector<arb::mechanism_desc>> mechs,
+        const cell_template& t,
+        span<const current_clamp_desc> stims,
         std::vector<std::pair<arb::mlocation, double>> detectors,
         std::vector<std::pair<arb::mlocation, arb::mechanism_desc>> synapses) {
-    arb::label_dict ld;
-    // arb::decor dec;
-
-    using arb::reg::tagged;
-    ld.set("soma", tagged(1));
-    ld.set("axon", tagged(2));
-    ld.set("dend", join(tagged(3), tagged(4)));
+    arb::decor dec = t.decor;
 
-    for (auto mech: mechs[section_kind::soma]) {
-        dec.paint("soma"_lab, fix_my_mech(cat,mech));
-    }
-    for (auto mech: mechs[section_kind::dend]) {
-        dec.paint("dend"_lab, fix_my_mech(cat,mech));
-    }
-    for (auto mech: mechs[section_kind::axon]) {
-        dec.paint("axon"_lab, fix_my_mech(cat,mech));
+    for (int i=0; i < stims.size(); i++) {
+        auto s = stims[i];
+        arb::i_clamp stim(s.delay, s.duration, s.amplitude);
+        dec.place(s.stim_loc, stim, std::string{"i_clamp"} + std::to_string(i));
     }
 
     // Add spike threshold detector at the soma.
@@ -98,10 +108,6 @@ arb::cable_cell sonata_cell(
         dec.place(synapses[i].first, arb::synapse(synapses[i].second), std::string{"synapse@"}+std::to_string(i)); //,cell_tag_type
     }
 
-    dec.set_default(arb::cv_policy_fixed_per_branch(200));
-
-    arb::cable_cell cell = arb::cable_cell(morph, dec, ld);
-
-    return cell;
+    return arb::cable_cell(t.morph, dec, t.labels);
 }
 } // namespace sonata
\ No newline at end of file
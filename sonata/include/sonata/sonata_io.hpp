@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <set>
@@ -7,7 +8,10 @@
 #include <hdf5.h>
 
 #include <sonata/json/json_params.hpp>
+#include <sonata/input_files.hpp>
+#include <sonata/h5_access.hpp>
 #include <sonata/data_management_lib.hpp>
+#include <sonata/discretization.hpp>
 
 #include <arbor/spike.hpp>
 
@@ -45,24 +49,30 @@ struct sonata_params {
     network_params network;
     sim_conditions conditions;
     run_params run;
+    partition_info partition;
     std::vector<current_clamp_info> current_clamps;
     std::vector<spike_in_info> spikes_input;
     spike_out_info spike_output;
+    output_info output;
     std::vector<probe_info> probes_info;
 
     sonata_params(network_params&& n,
                   sim_conditions&& s,
                   run_params&& r,
+                  partition_info&& part,
                   std::vector<current_clamp_info>&& clamps,
                   std::vector<spike_in_info>&& spikes,
-                  spike_out_info&& output,
+                  spike_out_info&& spike_out,
+                  output_info&& out,
                   std::vector<probe_info>&& probes):
     network(std::move(n)),
     conditions(std::move(s)),
     run(std::move(r)),
+    partition(std::move(part)),
     current_clamps(std::move(clamps)),
     spikes_input(std::move(spikes)),
-    spike_output(std::move(output)),
+    spike_output(std::move(spike_out)),
+    output(std::move(out)),
     probes_info(std::move(probes)) {}
 };
 
@@ -96,8 +106,9 @@ network_params read_network_params(nlohmann::json network_json) {
     std::vector<h5_file_handle> nodes_h5, edges_h5;
     std::vector<csv_file> nodes_csv, edges_csv;
 
+    // Node files may be loaded into memory, edge files are read in parts by each rank
     for (auto f: nodes_h5_names) {
-        nodes_h5.emplace_back(std::make_shared<h5_file>(f));
+        nodes_h5.emplace_back(std::make_shared<h5_file>(f, false, h5_input_fapl(f, true)));
     }
 
     for (auto f: edges_h5_names) {
@@ -134,6 +145,54 @@ sim_conditions read_sim_conditions(nlohmann::json json) {
     return conditions;
 }
 
+// Fields of a discretisation, on top of those of `d`
+inline
+discretization_info read_discretization_info(nlohmann::json json, discretization_info d) {
+    using sup::param_from_json;
+
+    param_from_json(d.policy, "policy", json);
+    param_from_json(d.cvs_per_branch, "cvs_per_branch", json);
+    param_from_json(d.max_extent, "max_extent", json);
+    param_from_json(d.locset, "locset", json);
+    param_from_json(d.single_cv_soma, "single_cv_soma", json);
+
+    if (d.policy == "fixed-per-branch") {
+        if (d.cvs_per_branch == 0) throw sonata_exception("discretization cvs_per_branch must be positive");
+    }
+    else if (d.policy == "max-extent") {
+        if (!(d.max_extent > 0)) throw sonata_exception("discretization max_extent must be positive");
+    }
+    else if (d.policy == "explicit") {
+        parse_cv_locset(d.locset);
+    }
+    else {
+        throw sonata_exception("discretization policy must be \"fixed-per-branch\", \"max-extent\" or \"explicit\"");
+    }
+    return d;
+}
+
+inline
+discretization_params read_discretization(nlohmann::json run_json) {
+    discretization_params discretization;
+    if (!run_json.contains("discretization")) {
+        return discretization;
+    }
+    auto json = run_json["discretization"];
+
+    discretization.defaults = read_discretization_info(json, discretization.defaults);
+    if (json.contains("populations")) {
+        for (auto& [pop, pop_json]: json["populations"].items()) {
+            discretization.populations[pop] = read_discretization_info(pop_json, discretization.defaults);
+        }
+    }
+    if (json.contains("node_types")) {
+        for (auto& [type, type_json]: json["node_types"].items()) {
+            discretization.node_types[std::stoul(type)] = read_discretization_info(type_json, discretization.defaults);
+        }
+    }
+    return discretization;
+}
+
 inline
 run_params read_run_params(nlohmann::json json) {
     if (!json.contains("run")) throw std::runtime_error("Simulation config doesn't contain require field 'run'.");
@@ -145,10 +204,72 @@ run_params read_run_params(nlohmann::json json) {
     param_from_json(run.duration, "tstop", run_json);
     param_from_json(run.dt, "dt", run_json );
     param_from_json(run.threshold, "spike_threshold", run_json );
+    param_from_json(run.coalesce_synapses, "coalesce_synapses", run_json);
+    param_from_json(run.sort_synapses, "sort_synapses", run_json);
+    param_from_json(run.global_tolerance, "global_tolerance", run_json);
+    if (run.global_tolerance < 0) {
+        throw sonata_exception("run.global_tolerance must not be negative");
+    }
+    param_from_json(run.prefetch_inputs, "prefetch_inputs", run_json);
+    run.discretization = read_discretization(run_json);
 
     return run;
 }
 
+inline
+partition_info read_partition(nlohmann::json json) {
+    using sup::param_from_json;
+
+    partition_info partition;
+    if (!json.contains("partition")) {
+        return partition;
+    }
+    auto partition_json = json["partition"];
+
+    param_from_json(partition.method, "method", partition_json);
+    param_from_json(partition.use_positions, "use_positions", partition_json);
+    param_from_json(partition.iterations, "iterations", partition_json);
+    param_from_json(partition.imbalance, "imbalance", partition_json);
+    param_from_json(partition.group_size, "group_size", partition_json);
+    param_from_json(partition.calibration_time, "calibration_time", partition_json);
+
+    if (partition.method != "default" && partition.method != "graph") {
+        throw sonata_exception("partition method must be \"default\" or \"graph\"");
+    }
+    if (partition.imbalance < 0 || partition.calibration_time < 0) {
+        throw sonata_exception("partition imbalance and calibration_time must not be negative");
+    }
+    return partition;
+}
+
+// Cache settings of the hdf5 input files from the optional "hdf5_cache" list of the simulation config, every entry
+// for all files or those of its "file" and "dataset"; SONATA_H5_CACHE sets those of all files over the entries for
+// all files
+inline
+void read_h5_cache(nlohmann::json json) {
+    using sup::param_from_json;
+
+    if (json.contains("hdf5_cache")) {
+        for (auto entry: json["hdf5_cache"]) {
+            h5_cache_params params;
+            std::string file, dataset;
+            param_from_json(file, "file", entry);
+            param_from_json(dataset, "dataset", entry);
+            param_from_json(params.chunk_bytes, "chunk_bytes", entry);
+            param_from_json(params.chunk_slots, "chunk_slots", entry);
+            param_from_json(params.chunk_w0, "chunk_w0", entry);
+            param_from_json(params.metadata_bytes, "metadata_bytes", entry);
+            if (params.chunk_w0 > 1) {
+                throw sonata_exception("hdf5_cache chunk_w0 must be between 0 and 1");
+            }
+            set_h5_cache(params, file, dataset);
+        }
+    }
+    if (auto cache = std::getenv("SONATA_H5_CACHE")) {
+        set_h5_cache(parse_h5_cache(cache));
+    }
+}
+
 inline
 std::vector<current_clamp_info> read_clamps(std::unordered_map<std::string, nlohmann::json>& stim_json) {
     using sup::param_from_json;
@@ -156,9 +277,8 @@ std::vector<current_clamp_info> read_clamps(std::unordered_map<std::string, nloh
 
     for (auto input: stim_json) {
         if (input.second["input_type"] == "current_clamp") {
-            csv_file elec_file(input.second["electrode_file"].get<std::string>());
-            csv_file input_file(input.second["input_file"].get<std::string>());
-            ret.push_back({elec_file, input_file});
+            ret.push_back({input.second["electrode_file"].get<std::string>(),
+                           input.second["input_file"].get<std::string>()});
         }
     }
     return ret;
@@ -171,7 +291,8 @@ std::vector<spike_in_info> read_spikes(std::unordered_map<std::string, nlohmann:
 
     for (auto input: spike_json) {
         if (input.second["input_type"] == "spikes") {
-            h5_wrapper rec(h5_file(input.second["input_file"].get<std::string>()).top_group_);
+            auto input_file = input.second["input_file"].get<std::string>();
+            h5_wrapper rec(h5_file(input_file, false, h5_input_fapl(input_file, true)).top_group_);
 
             std::string given_set = input.second["node_set"].get<std::string>();
             auto node_set_params = node_set_json[given_set];
@@ -184,7 +305,9 @@ std::vector<spike_in_info> read_spikes(std::unordered_map<std::string, nlohmann:
 }
 
 inline
-std::vector<probe_info> read_probes(std::unordered_map<std::string, nlohmann::json>& reports_json, const nlohmann::json& node_set_json) {
+std::vector<probe_info> read_probes(std::unordered_map<std::string, nlohmann::json>& reports_json,
+                                    const nlohmann::json& node_set_json,
+                                    const run_params& run) {
     using sup::param_from_json;
     std::vector<probe_info> ret;
 
@@ -195,6 +318,26 @@ std::vector<probe_info> read_probes(std::unordered_map<std::string, nlohmann::js
         probe.sec_id = report.second["section_id"].get<unsigned>();
         probe.sec_pos = report.second["section_pos"].get<double>();
 
+        // Sampling defaults to every time step of the whole run
+        probe.dt = run.dt;
+        probe.start_time = 0;
+        probe.end_time = run.duration;
+        param_from_json(probe.dt, "dt", report.second);
+        param_from_json(probe.start_time, "start_time", report.second);
+        param_from_json(probe.end_time, "end_time", report.second);
+        param_from_json(probe.data_type, "data_type", report.second);
+        param_from_json(probe.deflate, "deflate_level", report.second);
+
+        if (probe.dt <= 0 || probe.end_time < probe.start_time) {
+            throw sonata_exception("Invalid sampling interval of report " + report.first);
+        }
+        if (probe.data_type != "float" && probe.data_type != "double") {
+            throw sonata_exception("Report " + report.first + " data_type must be \"float\" or \"double\"");
+        }
+        if (probe.deflate > 9) {
+            throw sonata_exception("Report " + report.first + " deflate_level must be between 0 and 9");
+        }
+
         std::string given_node_set = report.second["node_set"].get<std::string>();
         auto node_set_params = node_set_json[given_node_set];
 
@@ -206,16 +349,105 @@ std::vector<probe_info> read_probes(std::unordered_map<std::string, nlohmann::js
     return ret;
 }
 
+// Report files of the probes; probes written to the same file must have the same sampling and storage
 inline
-sonata_params read_options(int argc, char** argv) {
-    if (argc>2) {
-        throw std::runtime_error("More than one command line option not permitted.");
+std::vector<report_info> report_files(const std::vector<probe_info>& probes) {
+    std::vector<report_info> ret;
+    for (const auto& p: probes) {
+        report_info info{p.file_name, p.dt, p.start_time, p.end_time, p.data_type == "float", p.deflate};
+
+        auto it = std::find_if(ret.begin(), ret.end(), [&](const report_info& r) { return r.file_name == p.file_name; });
+        if (it == ret.end()) {
+            ret.push_back(info);
+        }
+        else if (it->dt != info.dt || it->start_time != info.start_time ||
+                 it->end_time != info.end_time || it->single_precision != info.single_precision ||
+                 it->deflate != info.deflate) {
+            throw sonata_exception("Reports written to " + p.file_name + " have different sampling or data types");
+        }
     }
-    if (argc<2) {
+    return ret;
+}
+
+// Command line options: [--bench] [--profile-json <file>] [--read-inputs all|root|node] [--h5-driver sec2|mpio]
+// [--h5-core-threshold <bytes>] <simulation config>
+struct run_options {
+    std::string config_file;
+
+    // Time the phases of the run; with profile_json the timings are also written to that file
+    bool bench = false;
+    std::string profile_json;
+
+    // Ranks reading the text input files; the default can be set with SONATA_READ_INPUTS
+    input_read_mode read_inputs = input_read_mode::root;
+
+    // Driver of the hdf5 input files; the default can be set with SONATA_H5_DRIVER
+    h5_driver hdf5_driver = h5_driver::sec2;
+
+    // hdf5 input files up to this size are loaded into memory; the default can be set with SONATA_H5_CORE_THRESHOLD
+    std::size_t core_threshold = h5_core_threshold();
+};
+
+inline
+run_options parse_options(int argc, char** argv) {
+    run_options opts;
+    if (auto mode = std::getenv("SONATA_READ_INPUTS")) {
+        opts.read_inputs = parse_input_read_mode(mode);
+    }
+    if (auto driver = std::getenv("SONATA_H5_DRIVER")) {
+        opts.hdf5_driver = parse_h5_driver(driver);
+    }
+    if (auto bytes = std::getenv("SONATA_H5_CORE_THRESHOLD")) {
+        opts.core_threshold = std::stoull(bytes);
+    }
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench") {
+            opts.bench = true;
+        }
+        else if (arg == "--profile-json") {
+            if (++i == argc) {
+                throw std::runtime_error("--profile-json requires an output file.");
+            }
+            opts.bench = true;
+            opts.profile_json = argv[i];
+        }
+        else if (arg == "--read-inputs") {
+            if (++i == argc) {
+                throw std::runtime_error("--read-inputs requires a mode (all, root or node).");
+            }
+            opts.read_inputs = parse_input_read_mode(argv[i]);
+        }
+        else if (arg == "--h5-driver") {
+            if (++i == argc) {
+                throw std::runtime_error("--h5-driver requires a driver (sec2 or mpio).");
+            }
+            opts.hdf5_driver = parse_h5_driver(argv[i]);
+        }
+        else if (arg == "--h5-core-threshold") {
+            if (++i == argc) {
+                throw std::runtime_error("--h5-core-threshold requires a size in bytes.");
+            }
+            opts.core_threshold = std::stoull(argv[i]);
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("Unknown command line option " + arg + ".");
+        }
+        else if (!opts.config_file.empty()) {
+            throw std::runtime_error("More than one simulation configuration file not permitted.");
+        }
+        else {
+            opts.config_file = arg;
+        }
+    }
+    if (opts.config_file.empty()) {
         throw std::runtime_error("Simulation configuration file required.");
     }
+    return opts;
+}
 
-    std::string sim_file = argv[1];
+inline
+sonata_params read_options(const std::string& sim_file) {
     std::cout << "Loading parameters from file: " << sim_file << "\n";
     auto sim_json = sup::read_json_file(sim_file);
 
@@ -229,6 +461,12 @@ sonata_params read_options(int argc, char** argv) {
     /// Simulation Run parameters
     auto run_params = read_run_params(sim_json);
 
+    /// Distribution of the cells over the ranks
+    auto partition = read_partition(sim_json);
+
+    /// Caches of the hdf5 input files, before they are opened
+    read_h5_cache(sim_json);
+
     /// Network from the "network" field
     auto circuit_name = sup::json_get_value<std::string>(sim_json, "network");
     auto circuit_conf = sup::read_json_file(circuit_name)
@@ -250,163 +488,29 @@ sonata_params read_options(int argc, char** argv) {
     // Read output parameters
     auto output = spike_out_info{sup::json_get_value<std::string>(output_field, "spikes_file"),
                                  sup::json_get_value<std::string>(output_field, "spikes_sort_order")};
+    sup::param_from_json(output.write_mode, "spikes_write_mode", output_field);
+
+    output_info writing;
+    sup::param_from_json(writing.write_async, "write_async", output_field);
+    sup::param_from_json(writing.queue_depth, "write_queue_depth", output_field);
+    if (writing.queue_depth == 0) {
+        throw sonata_exception("write_queue_depth must be at least 1");
+    }
 
     /// Reports (probes)
     auto reports_field = sup::json_get_value<std::unordered_map<std::string, nlohmann::json>>(sim_json, "reports");
 
     // Read report(probe) parameters
-    auto probes = read_probes(reports_field, node_set_json);
+    auto probes = read_probes(reports_field, node_set_json, run_params);
 
     return {std::move(network),
             std::move(conditions),
             std::move(run_params),
+            std::move(partition),
             std::move(clamps),
             std::move(spikes),
             std::move(output),
+            std::move(writing),
             std::move(probes)};
 }
-
-inline
-void write_spikes(std::vector<arb::spike>& spikes,
-                  bool sort_by_time, std::string file_name,
-                  const std::vector<std::string>& pop_names,
-                  const std::vector<unsigned>& pop_parts) {
-
-    //Sort spikes by gid
-    std::sort(spikes.begin(), spikes.end(), [](const arb::spike& a, const arb::spike& b) -> bool
-    {
-        return a.source < b.source;
-    });
-
-    //Split by population
-    std::vector<int> spike_part = {0};
-    for (unsigned i = 1; i < pop_parts.size(); i++) {
-        auto it = std::lower_bound(spikes.begin(), spikes.end(), pop_parts[i], [](const arb::spike& a, unsigned b) -> bool
-        {
-            return a.source.gid < b;
-        });
-        spike_part.push_back(it - spikes.begin());
-    }
-
-    //If we need to sort by time, sort by partition
-    if (sort_by_time) {
-        for (unsigned i = 1; i < spike_part.size(); i++){
-            std::sort(spikes.begin() + spike_part[i-1], spikes.begin() + spike_part[i],
-                      [](const arb::spike& a, const arb::spike& b) -> bool
-                      {
-                          return a.time < b.time;
-                      });
-        }
-    }
-
-    h5_file file(file_name, true);
-    auto file_group = file.top_group_;
-
-    auto spikes_group = file_group->add_group("spikes");
-
-    for (unsigned p = 0; p < pop_names.size(); p++) {
-        if (spike_part[p+1] > spike_part[p]) {
-            auto pop_group = spikes_group->add_group(pop_names[p]);
-
-            hsize_t size = spike_part[p + 1] - spike_part[p];
-
-            std::vector<int> spike_gids;
-            std::vector<double> spike_times;
-
-            spike_gids.reserve(size);
-            spike_times.reserve(size);
-
-            for (unsigned i = spike_part[p]; i < spike_part[p + 1]; i++) {
-                spike_gids.push_back(spikes[i].source.gid - pop_parts[p]);
-                spike_times.push_back(spikes[i].time);
-            }
-
-            pop_group->add_dataset("node_ids", spike_gids);
-            pop_group->add_dataset("timestamps", spike_times);
-        }
-    }
-}
-
-inline
-void write_trace(const std::unordered_map<cell_member_type, trace_info>& trace,
-                 const std::unordered_map<std::string, std::vector<cell_member_type>>& trace_groups,
-                 const std::vector<std::string>& pop_names,
-                 const std::vector<unsigned>& pop_parts) {
-
-    for (auto t: trace_groups) {
-        std::string file_name = t.first;
-        auto traced_probes = t.second;
-
-        //Sort traced_probes by gid
-        std::sort(traced_probes.begin(), traced_probes.end(), [](const arb::cell_member_type& a, const arb::cell_member_type& b) -> bool
-        {
-            return a.gid < b.gid;
-        });
-
-        //Split by population
-        std::vector<int> trace_part = {0};
-        for (unsigned i = 1; i < pop_parts.size(); i++) {
-            auto it = std::lower_bound(traced_probes.begin(), traced_probes.end(), pop_parts[i], [](const arb::cell_member_type& a, unsigned b) -> bool
-            {
-                return a.gid < b;
-            });
-            trace_part.push_back(it - traced_probes.begin());
-        }
-
-        h5_file file(file_name, true);
-        auto file_group = file.top_group_;
-        auto reports_group = file_group->add_group("reports");
-
-        for (unsigned p = 0; p < pop_names.size(); p++) {
-            if (trace_part[p+1] > trace_part[p]) {
-
-                auto pop_group = reports_group->add_group(pop_names[p]);
-                auto map_group = pop_group->add_group("mapping");
-
-                hsize_t num_traces = trace_part[p+1] - trace_part[p];
-                hsize_t size_trace = trace.at(traced_probes.front()).data.at(0).size();
-
-                std::vector<std::vector<double>> trace_data(num_traces);
-                std::vector<double> trace_time(size_trace);
-                std::vector<int> seg_id(num_traces);
-                std::vector<double> seg_pos(num_traces);
-
-                std::vector<int> unique_gids;
-                std::vector<int> gid_parts = {0};
-
-                unsigned i;
-                for (i = trace_part[p]; i < trace_part[p+1]; i++) {
-                    auto& info = trace.at(traced_probes[i]);
-                    for (auto data: info.data.at(0)) {
-                        trace_data[i - trace_part[p]].push_back(data.v);
-                    }
-                    seg_id[i - trace_part[p]] = info.loc.branch;
-                    seg_pos[i - trace_part[p]] = info.loc.pos;
-
-                    if (i > trace_part[p]) {
-                        if (traced_probes[i].gid != traced_probes[i-1].gid) {
-                            gid_parts.push_back(i);
-                            unique_gids.push_back(traced_probes[i-1].gid - pop_parts[p]);
-                        }
-                    }
-                }
-                gid_parts.push_back(i);
-                unique_gids.push_back(traced_probes[i-1].gid - pop_parts[p]);
-
-                auto& info = trace.at(traced_probes[trace_part[p]]);
-                for (unsigned j = 0; j < info.data.at(0).size(); j++) {
-                    trace_time[j] = info.data.at(0)[j].t;
-                }
-
-                //Write values
-                pop_group->add_dataset("data", trace_data);
-                map_group->add_dataset("time", trace_time);
-                map_group->add_dataset("element_ids", seg_id);
-                map_group->add_dataset("element_pos", seg_pos);
-                map_group->add_dataset("node_ids", unique_gids);
-                map_group->add_dataset("index_pointers", gid_parts);
-            }
-        }
-    }
-}
 } // namespace sonata
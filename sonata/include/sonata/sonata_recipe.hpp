@@ -4,6 +4,8 @@
 #include <iomanip>
 #include <iostream>
 #include <any>
+#include <atomic>
+#include <limits>
 
 #include <arbor/assert_macro.hpp>
 #include <arbor/common_types.hpp>
@@ -45,11 +47,13 @@ public:
             model_desc_(params.network.nodes,
                        params.network.edges,
                        params.network.nodes_types,
-                       params.network.edges_types),
+                       params.network.edges_types,
+                       params.run.discretization),
             io_desc_(params.network.nodes,
                         params.spikes_input,
                         params.current_clamps,
                         params.probes_info),
+            mechanisms_(params.run.global_tolerance),
             run_params_(params.run),
             sim_cond_(params.conditions),
             probe_info_(params.probes_info),
@@ -66,41 +70,101 @@ public:
         return num_cells_;
     }
 
+    // Description of all cells for partitioning, with costs estimated by `model`; collective over the ranks
+    cell_graph get_cell_graph(bool with_positions, const cost_model& model = {}) const {
+        std::lock_guard<std::mutex> l(mtx_);
+        return model_desc_.build_cell_graph(with_positions, model);
+    }
+
     void build_local_maps(const arb::domain_decomposition& decomp) {
         std::lock_guard<std::mutex> l(mtx_);
-        model_desc_.build_source_and_target_maps(decomp.groups());
+        std::function<bool(const arb::mechanism_desc&)> coalesce;
+        if (run_params_.coalesce_synapses) {
+            // Targets can share a synapse if the mechanism is linear in the weight of the events
+            std::unordered_map<std::string, bool> linear;
+            coalesce = [this, linear](const arb::mechanism_desc& m) mutable {
+                auto it = linear.find(m.name());
+                if (it == linear.end()) {
+                    it = linear.emplace(m.name(), gprop.catalogue[m.name()].linear).first;
+                }
+                return it->second;
+            };
+        }
+        model_desc_.build_source_and_target_maps(decomp.groups(), coalesce, run_params_.sort_synapses);
+        io_desc_.build_local_maps(decomp.groups());
+
+        // The cells are built concurrently: from here on the hdf5 reads go through the I/O thread,
+        // which reads the rows of the local cells ahead, then those of their groups
+        io_.reset();
+        io_ = std::make_unique<h5_io_service>();
+        if (run_params_.prefetch_inputs) {
+            io_->prefetch(model_desc_.local_read_plan());
+            io_->submit([this]() { io_->prefetch(model_desc_.group_read_plan()); });
+        }
+    }
+
+    // Reads of the hdf5 inputs since build_local_maps; zero after finish_loading
+    h5_io_service::stats get_io_stats() const {
+        return io_ ? io_->statistics() : h5_io_service::stats{};
+    }
+
+    // Stop the I/O thread of the hdf5 inputs once the cells are built, before hdf5 files are written
+    void finish_loading() {
+        io_.reset();
+    }
+
+    // Close the hdf5 input files once the simulation is built, node files first, then edge and spike input files,
+    // rather than when their last handles are released; collective with MPI-IO, and no cell can be built after
+    void close_inputs() {
+        finish_loading();
+        model_desc_.close_files();
+        io_desc_.close_files();
     }
 
     arb::util::unique_any get_cell_description(cell_gid_type gid) const override {
         if (get_cell_kind(gid) == cell_kind::cable) {
             std::vector<arb::mlocation> src_locs;
             std::vector<std::pair<arb::mlocation, arb::mechanism_desc>> tgt_types;
+            span<const current_clamp_desc> stims;
 
-            std::lock_guard<std::mutex> l(mtx_);
-            auto morph = model_desc_.get_cell_morphology(gid);
+            // The inputs are read and the template built without the lock, so that the builder threads wait for
+            // their reads concurrently; the lock only guards the template cache and the mechanism registry
             auto mechs = model_desc_.get_density_mechs(gid);
+            for (auto& [section, section_mechs]: mechs) {
+                for (auto& m: section_mechs) {
+                    m = mechanisms_.cluster_globals(gprop.catalogue, m);
+                }
+            }
+            auto key = model_desc_.get_template_key(gid, mechs);
+            std::shared_ptr<const cell_template> tmpl;
+            {
+                std::lock_guard<std::mutex> l(mtx_);
+                if ((tmpl = templates_.find(key))) {
+                    mechanisms_.add_cell(gid, tmpl->mechanisms);
+                }
+            }
+            if (!tmpl) {
+                // Threads missing the same key build it concurrently, and all use the first one stored
+                auto morph = model_desc_.get_cell_morphology(gid);
+                auto policy = make_cv_policy(model_desc_.get_discretization(gid), morph);
+                auto t = make_cell_template(mechanisms_, gprop.catalogue, std::move(morph), std::move(mechs), policy);
 
+                std::lock_guard<std::mutex> l(mtx_);
+                t.mechanisms = mechanisms_.intern(t.mechanism_names);
+                tmpl = templates_.insert(key, std::move(t));
+                mechanisms_.add_cell(gid, tmpl->mechanisms);
+            }
             model_desc_.get_sources_and_targets(gid, src_locs, tgt_types);
+            stims = io_desc_.get_current_clamps(gid);
 
             std::vector<std::pair<arb::mlocation, double>> src_types;
             for (auto s: src_locs) {
                 src_types.push_back(std::make_pair(s, run_params_.threshold));
             }
 
-            auto decor = arb::decor();
-
-            auto stims = io_desc_.get_current_clamps(gid);
-            // for (auto s: stims) {
-            for (int i=0; i < stims.size(); i++) {
-                auto s = stims[i];
-                arb::i_clamp stim(s.delay, s.duration, s.amplitude);
-                decor.place(s.stim_loc, stim, std::string{"i_clamp"} + std::to_string(i));
-            }
-
-            return sonata_cell(gprop.catalogue, decor, morph, mechs, src_types, tgt_types);
+            return sonata_cell(*tmpl, stims, src_types, tgt_types);
         }
         else if (get_cell_kind(gid) == cell_kind::spike_source) {
-            std::lock_guard<std::mutex> l(mtx_);
             std::vector<double> time_sequence = io_desc_.get_spikes(gid);
             return arb::util::unique_any(arb::spike_source_cell{"detector@0",arb::explicit_schedule(time_sequence)});
         }
@@ -108,19 +172,26 @@ public:
     }
 
     cell_kind get_cell_kind(cell_gid_type gid) const override {
-        std::lock_guard<std::mutex> l(mtx_);
         return model_desc_.get_cell_kind(gid);
     }
 
     std::vector<arb::cell_connection> connections_on(cell_gid_type gid) const override {
         std::vector<arb::cell_connection> conns;
-
-        std::lock_guard<std::mutex> l(mtx_);
         model_desc_.get_connections(gid, conns);
 
+        // The connections are made concurrently by the cell groups
+        double delay = min_delay_;
+        for (const auto& c: conns) {
+            while (c.delay < delay && !min_delay_.compare_exchange_weak(delay, c.delay)) {}
+        }
         return conns;
     }
 
+    // Shortest delay of the connections of the local cells made so far (infinity without connections)
+    double get_min_delay() const {
+        return min_delay_;
+    }
+
     std::vector<arb::event_generator> event_generators(cell_gid_type gid) const override {
         std::vector<arb::event_generator> gens;
         return gens;
@@ -144,10 +215,16 @@ public:
         return probes;
     }
 
+    // Probes of the local cells, grouped by output file; only valid after build_local_maps
     std::unordered_map<std::string, std::vector<cell_member_type>> get_probe_groups() {
         return io_desc_.get_probe_groups();
     }
 
+    // Approximate size of the spike, current clamp and probe maps of the local cells, in bytes
+    std::size_t get_io_desc_bytes() const {
+        return io_desc_.memory_bytes();
+    }
+
     std::any get_global_properties(cell_kind k) const override {
         return gprop;
     }
@@ -160,10 +237,50 @@ public:
         return model_desc_.pop_names();
     }
 
+    // Incoming connections (one per target) of the cells of `groups`, from the target maps without reading the
+    // edges; only valid after build_local_maps, for local cells
+    std::size_t get_num_connections(const std::vector<arb::group_description>& groups) const {
+        std::size_t n = 0;
+        for (const auto& group: groups) {
+            for (auto gid: group.gids) {
+                n += model_desc_.num_targets(gid);
+            }
+        }
+        return n;
+    }
+
+    // Targets of the local cells sharing the synapse of another target; only valid after build_local_maps
+    std::size_t get_num_coalesced_targets() const {
+        std::lock_guard<std::mutex> l(mtx_);
+        return model_desc_.num_coalesced_targets();
+    }
+
+    // Lookups of the templates of the cable cells built so far
+    cell_template_cache::stats get_template_stats() const {
+        std::lock_guard<std::mutex> l(mtx_);
+        return templates_.statistics();
+    }
+
+    // Density mechanisms of the cells of `groups` built so far; collective with MPI
+    mechanism_summary get_mechanism_summary(const std::vector<arb::group_description>& groups) const {
+        std::lock_guard<std::mutex> l(mtx_);
+#ifdef ARB_MPI_ENABLED
+        return mechanisms_.summarise(groups, MPI_COMM_WORLD);
+#else
+        return mechanisms_.summarise(groups);
+#endif
+    }
+
 private:
+    // Guards the template cache and the non-const members of the mechanism registry; the maps of
+    // model_desc_ and io_desc_ are only read once built
     mutable std::mutex mtx_;
     mutable model_desc model_desc_;
     mutable io_desc io_desc_;
+    mutable cell_template_cache templates_;
+    mutable mechanism_registry mechanisms_;
+    std::unique_ptr<h5_io_service> io_;
+    mutable std::atomic<double> min_delay_{std::numeric_limits<double>::infinity()};
 
     run_params run_params_;
     sim_conditions sim_cond_;
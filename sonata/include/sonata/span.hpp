@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace sonata {
+/// Non-owning view of a contiguous range of elements
+/// Used to hand out stored data without copying it
+template <typename T>
+class span {
+public:
+    span() = default;
+
+    span(T* data, std::size_t size): data_(data), size_(size) {}
+
+    // Construct from any contiguous container (e.g. std::vector)
+    template <typename C, typename = decltype(std::declval<C&>().data())>
+    span(C& c): data_(c.data()), size_(c.size()) {}
+
+    T* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+
+    T& operator[](std::size_t i) const { return data_[i]; }
+    T& front() const { return data_[0]; }
+    T& back() const { return data_[size_ - 1]; }
+
+private:
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+} // namespace sonata
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <arbor/spike.hpp>
+
+namespace sonata {
+enum class spike_order {
+    none,
+    by_id,
+    by_time
+};
+
+// Spike order from the "spikes_sort_order" field of the simulation config:
+// "time"/"by_time" sorts by time, "none" keeps the order of arrival, everything else sorts by id
+spike_order spike_order_from_string(const std::string& sort_by);
+
+// Strict weak ordering of spikes by (time, gid) or by (gid, time)
+struct spike_less {
+    spike_order order;
+
+    bool operator()(const arb::spike& a, const arb::spike& b) const {
+        if (order == spike_order::by_time) {
+            return std::tie(a.time, a.source.gid) < std::tie(b.time, b.source.gid);
+        }
+        return std::tie(a.source.gid, a.time) < std::tie(b.source.gid, b.time);
+    }
+};
+
+// Sort the spikes in [first, last) in `order`, in time linear in their number
+// Large arrays are sorted with stable LSD radix sorts on the gid (a counting sort when the gids of
+// the spikes span less than 2^11 values) and on the bits of the time; small arrays with std::sort. Sorting by
+// time, spikes delivered epoch by epoch are sorted one epoch at a time.
+// With `num_threads` > 1, parts of a large array are sorted concurrently and merged pairwise.
+void sort_spikes(arb::spike* first, arb::spike* last, spike_order order, unsigned num_threads = 1);
+
+void sort_spikes(std::vector<arb::spike>& spikes, spike_order order, unsigned num_threads = 1);
+} // namespace sonata
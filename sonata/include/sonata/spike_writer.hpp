@@ -0,0 +1,149 @@
+#pragma once
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arbor/spike.hpp>
+#include <arbor/version.hpp>
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+#include <sonata/async_writer.hpp>
+#include <sonata/hdf5_lib.hpp>
+#include <sonata/spike_sort.hpp>
+
+namespace sonata {
+/// Class for streaming spikes into a SONATA spikes file
+/// Spikes are appended epoch by epoch to chunked, extendible `node_ids`/`timestamps` datasets
+/// of every population, so that memory use stays bounded on long runs.
+/// Sorting by time is done per flush (epochs are disjoint in time); sorting by id writes
+/// sorted runs to a scratch file that are merged into the output file on `close`.
+/// With an async_writer, the buffer is swapped with a second one on flush, and sorted and appended
+/// on its thread; both buffers hold `flush_size` spikes and are reused by every flush.
+class spike_writer {
+public:
+    spike_writer(std::string file_name,
+                 spike_order order,
+                 std::vector<std::string> pop_names,
+                 std::vector<unsigned> pop_parts,
+                 std::size_t flush_size = 1 << 20);
+
+    ~spike_writer();
+
+    // Buffer a batch of spikes; flushes to file when `flush_size` spikes are buffered, and before a batch that
+    // doesn't fit
+    void append(const std::vector<arb::spike>& spikes);
+
+    // Write all buffered spikes to file
+    void flush();
+
+    // Flush and finalize the output file
+    void close();
+
+    // Total number of spikes appended
+    std::size_t num_spikes() const;
+
+    // Write flushed spikes on the thread of `writer` from now on; `writer` must outlive the spike_writer
+    void set_async_writer(async_writer* writer);
+
+private:
+    // Output datasets of a population
+    struct pop_output {
+        std::shared_ptr<h5_group> group;
+        std::shared_ptr<h5_dataset> node_ids;
+        std::shared_ptr<h5_dataset> timestamps;
+
+        // Boundaries of the sorted runs (by_id order only)
+        std::vector<std::size_t> runs = {0};
+    };
+
+    // Returns the output datasets of population `p` in `parent`, creating them on first use
+    pop_output& population_output(std::vector<pop_output>& outputs, const std::shared_ptr<h5_group>& parent, unsigned p);
+
+    // Sort `spikes` according to order_ with `num_threads` threads and append them to `outputs`
+    void write_buffer(std::vector<arb::spike>& spikes,
+                      std::vector<pop_output>& outputs,
+                      const std::shared_ptr<h5_group>& parent,
+                      unsigned num_threads = 1);
+
+    // Write `spikes` as the next sorted run, or append them to the output file
+    void write_spikes(std::vector<arb::spike>& spikes);
+
+    // Merge the sorted runs of every population into the output file
+    void merge_runs();
+
+    std::string file_name_;
+    spike_order order_;
+    std::vector<std::string> pop_names_;
+    std::vector<unsigned> pop_parts_;
+    std::size_t flush_size_;
+
+    std::size_t num_spikes_ = 0;
+    bool closed_ = false;
+
+    // Spikes not yet written to file, and with an async_writer the spikes of the previous flush, written once
+    // spare_written_ is ready
+    std::vector<arb::spike> buffer_;
+    std::vector<arb::spike> spare_;
+    std::future<void> spare_written_;
+
+    // Spikes of a buffer by population, reused by every write
+    std::vector<std::vector<int>> pop_node_ids_;
+    std::vector<std::vector<double>> pop_timestamps_;
+
+    // Output file, and scratch file for the sorted runs when sorting by id
+    std::unique_ptr<h5_file> file_;
+    std::unique_ptr<h5_file> runs_file_;
+    std::shared_ptr<h5_group> spikes_group_;
+    std::shared_ptr<h5_group> runs_group_;
+
+    std::vector<pop_output> outputs_;
+    std::vector<pop_output> run_outputs_;
+
+    async_writer* writer_ = nullptr;
+};
+
+#ifdef ARB_MPI_ENABLED
+/// Class for writing the spikes of all ranks to one SONATA spikes file
+/// Every rank keeps only its local spikes. On `close`, ordered spikes are redistributed
+/// across ranks with a distributed sample sort, the offset of every rank in each population
+/// is found with an exclusive scan, and all ranks write their part collectively with
+/// parallel hdf5. Without parallel hdf5, the spikes are gathered and written by rank 0.
+class parallel_spike_writer {
+public:
+    parallel_spike_writer(std::string file_name,
+                          spike_order order,
+                          std::vector<std::string> pop_names,
+                          std::vector<unsigned> pop_parts,
+                          MPI_Comm comm);
+
+    // Buffer a batch of local spikes
+    void append(const std::vector<arb::spike>& spikes);
+
+    // Write the spikes of all ranks to file; collective
+    void close();
+
+    // Number of local spikes appended
+    std::size_t num_spikes() const;
+
+private:
+    // Redistribute and sort spikes_ so that their concatenation over ranks is ordered
+    void distributed_sort();
+
+    std::string file_name_;
+    spike_order order_;
+    std::vector<std::string> pop_names_;
+    std::vector<unsigned> pop_parts_;
+    MPI_Comm comm_;
+
+    bool closed_ = false;
+
+    // Local spikes
+    std::vector<arb::spike> spikes_;
+};
+#endif
+} // namespace sonata
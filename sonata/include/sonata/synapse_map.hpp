@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sonata/common_structs.hpp>
+
+namespace sonata {
+/// Synapses placed for the targets of a cell: target i is realised by synapse index[i], and
+/// synapse s is placed as target synapses[s]
+struct synapse_map {
+    std::vector<unsigned> synapses;
+    std::vector<unsigned> index;
+
+    // Targets realised by a synapse of another target
+    std::size_t num_coalesced() const {
+        return index.size() - synapses.size();
+    }
+};
+
+// Synapses of the targets `targets` (target and edge id): targets with the same location and
+// mechanism parameters share a synapse if `coalesce(mechanism)`, one synapse per target otherwise;
+// synapses are numbered in order of their first target
+synapse_map coalesce_targets(const std::vector<std::pair<target_type, unsigned>>& targets,
+                             const std::function<bool(const arb::mechanism_desc&)>& coalesce);
+
+// Order the synapses of `m` by mechanism, branch and position, so that the state of the
+// instances of a mechanism follows the CVs of the cell; targets keep their synapses
+void sort_synapses(synapse_map& m, const std::vector<std::pair<target_type, unsigned>>& targets);
+} // namespace sonata
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <fstream>
+#include <sstream>
+
+#include <sonata/input_files.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+#include "mpi_helper.hpp"
+
+namespace sonata {
+namespace {
+std::atomic<std::size_t> files_read{0};
+std::atomic<std::size_t> files_received{0};
+std::atomic<std::size_t> bytes_read{0};
+
+#ifdef ARB_MPI_ENABLED
+// Communicator the files are broadcast over from its rank 0, MPI_COMM_NULL if not shared
+MPI_Comm shared_comm = MPI_COMM_NULL;
+#endif
+
+std::optional<std::string> read_file(const std::string& name) {
+    std::ifstream f(name, std::ios::binary);
+    if (!f) {
+        return std::nullopt;
+    }
+    std::ostringstream contents;
+    contents << f.rdbuf();
+    if (f.bad()) {
+        return std::nullopt;
+    }
+    files_read++;
+    return contents.str();
+}
+}
+
+input_read_mode parse_input_read_mode(const std::string& name) {
+    if (name == "all") {
+        return input_read_mode::all;
+    }
+    if (name == "root") {
+        return input_read_mode::root;
+    }
+    if (name == "node") {
+        return input_read_mode::node;
+    }
+    throw sonata_exception("Unknown input read mode " + name + ", expected \"all\", \"root\" or \"node\"");
+}
+
+#ifdef ARB_MPI_ENABLED
+void share_input_files(input_read_mode mode, MPI_Comm comm) {
+    unshare_input_files();
+    if (mode == input_read_mode::root) {
+        MPI_OR_THROW(MPI_Comm_dup, comm, &shared_comm);
+    }
+    else if (mode == input_read_mode::node) {
+        MPI_OR_THROW(MPI_Comm_split_type, comm, MPI_COMM_TYPE_SHARED, rank(comm), MPI_INFO_NULL, &shared_comm);
+    }
+}
+#endif
+
+void unshare_input_files() {
+#ifdef ARB_MPI_ENABLED
+    if (shared_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&shared_comm);
+    }
+#endif
+}
+
+std::optional<std::string> read_input_file(const std::string& name) {
+#ifdef ARB_MPI_ENABLED
+    if (shared_comm != MPI_COMM_NULL && size(shared_comm) > 1) {
+        std::optional<std::string> contents;
+        bool reader = rank(shared_comm) == 0;
+        if (reader) {
+            contents = read_file(name);
+        }
+
+        // Size of the file, -1 if the reader could not read it
+        long long n = contents? (long long)contents->size(): -1;
+        MPI_OR_THROW(MPI_Bcast, &n, 1, MPI_LONG_LONG, 0, shared_comm);
+        if (n < 0) {
+            return std::nullopt;
+        }
+        if (!reader) {
+            contents = std::string(n, '\0');
+        }
+        for (long long offset = 0; offset < n; offset += INT_MAX) {
+            int count = (int)std::min<long long>(n - offset, INT_MAX);
+            MPI_OR_THROW(MPI_Bcast, &(*contents)[offset], count, MPI_CHAR, 0, shared_comm);
+        }
+        if (!reader) {
+            files_received++;
+        }
+        bytes_read += n;
+        return contents;
+    }
+#endif
+    auto contents = read_file(name);
+    if (contents) {
+        bytes_read += contents->size();
+    }
+    return contents;
+}
+
+input_file_stats input_file_statistics() {
+    input_file_stats s;
+    s.read = files_read;
+    s.received = files_received;
+    s.bytes = bytes_read;
+    return s;
+}
+} // namespace sonata
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sonata/mechanism_registry.hpp>
+
+#include "mpi_helper.hpp"
+
+namespace sonata {
+std::string format_global_value(double value) {
+    if (value == 0) {
+        return "0";
+    }
+    char buf[32];
+    int digits = 1;
+    for (; digits < 17; digits++) {
+        std::snprintf(buf, sizeof(buf), "%.*g", digits, value);
+        if (std::strtod(buf, nullptr) == value) {
+            break;
+        }
+    }
+    // Whole numbers without an exponent: 70 rather than 7e+01
+    int exponent = std::floor(std::log10(std::abs(value)));
+    std::snprintf(buf, sizeof(buf), "%.*g", exponent >= digits && exponent < 17? exponent + 1: digits, value);
+    return buf;
+}
+
+std::size_t mechanism_summary::total_instances() const {
+    std::size_t n = 0;
+    for (auto i: group_instances) {
+        n += i;
+    }
+    return n;
+}
+
+std::size_t mechanism_summary::max_instances() const {
+    return group_instances.empty()? 0: *std::max_element(group_instances.begin(), group_instances.end());
+}
+
+mechanism_registry::mechanism_registry(double tolerance): tolerance_(tolerance), digits_(17) {
+    if (tolerance_ > 0) {
+        // Rounding to d significant digits changes a value by at most 5*10^-d relative
+        digits_ = std::clamp(int(std::ceil(std::log10(0.5/tolerance_))) + 1, 1, 17);
+    }
+}
+
+double mechanism_registry::cluster(double value) const {
+    if (tolerance_ <= 0 || !std::isfinite(value)) {
+        return value;
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.*e", digits_ - 1, value);
+    return std::strtod(buf, nullptr);
+}
+
+arb::mechanism_desc mechanism_registry::cluster_globals(const arb::mechanism_catalogue& cat,
+                                                        const arb::mechanism_desc& desc) const {
+    const auto& info = cat[desc.name()];
+    arb::mechanism_desc clustered(desc.name());
+    for (const auto& [param, value]: desc.values()) {
+        clustered.set(param, info.globals.count(param)? cluster(value): value);
+    }
+    return clustered;
+}
+
+arb::density mechanism_registry::derive(const arb::mechanism_catalogue& cat, const arb::mechanism_desc& desc) const {
+    const auto& info = cat[desc.name()];
+    std::vector<std::pair<std::string, double>> globals;
+    std::unordered_map<std::string, double> params;
+    for (const auto& [param, value]: desc.values()) {
+        if (info.globals.count(param)) {
+            globals.emplace_back(param, cluster(value));
+        }
+        else {
+            params[param] = value;
+        }
+    }
+    std::sort(globals.begin(), globals.end());
+
+    std::string name = desc.name();
+    std::string sep = "/";
+    for (const auto& [param, value]: globals) {
+        name += sep + param + "=" + format_global_value(value);
+        sep = ",";
+    }
+    return {name, std::move(params)};
+}
+
+unsigned mechanism_registry::intern(const std::string& name) {
+    auto [it, inserted] = ids_.emplace(name, names_.size());
+    if (inserted) {
+        names_.push_back(name);
+    }
+    return it->second;
+}
+
+std::vector<unsigned> mechanism_registry::intern(const std::vector<std::string>& names) {
+    std::vector<unsigned> ids;
+    for (const auto& name: names) {
+        ids.push_back(intern(name));
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+void mechanism_registry::add_cell(arb::cell_gid_type gid, std::vector<unsigned> mechanisms) {
+    cells_[gid] = std::move(mechanisms);
+}
+
+// Summary of the mechanisms `names` used by the cells of groups with `group_instances` mechanisms
+static mechanism_summary make_summary(const std::set<std::string>& names, std::vector<std::size_t> group_instances) {
+    mechanism_summary s;
+    s.mechanisms = names.size();
+    for (const auto& name: names) {
+        auto sep = name.find('/');
+        if (sep != std::string::npos) {
+            s.derived++;
+            s.variants[name.substr(0, sep)]++;
+        }
+    }
+    s.group_instances = std::move(group_instances);
+    return s;
+}
+
+// Names of the mechanisms used by the cells of `groups`, and their number in every group
+static std::pair<std::set<std::string>, std::vector<std::size_t>> local_instances(
+        const std::vector<arb::group_description>& groups,
+        const std::unordered_map<arb::cell_gid_type, std::vector<unsigned>>& cells,
+        const std::vector<std::string>& names) {
+    std::set<std::string> used;
+    std::vector<std::size_t> group_instances;
+    for (const auto& group: groups) {
+        std::set<unsigned> ids;
+        for (auto gid: group.gids) {
+            auto it = cells.find(gid);
+            if (it != cells.end()) {
+                ids.insert(it->second.begin(), it->second.end());
+            }
+        }
+        for (auto id: ids) {
+            used.insert(names[id]);
+        }
+        group_instances.push_back(ids.size());
+    }
+    return {std::move(used), std::move(group_instances)};
+}
+
+mechanism_summary mechanism_registry::summarise(const std::vector<arb::group_description>& groups) const {
+    auto [used, group_instances] = local_instances(groups, cells_, names_);
+    return make_summary(used, std::move(group_instances));
+}
+
+#ifdef ARB_MPI_ENABLED
+mechanism_summary mechanism_registry::summarise(const std::vector<arb::group_description>& groups, MPI_Comm comm) const {
+    auto [used, group_instances] = local_instances(groups, cells_, names_);
+    auto all_names = gather_all(std::vector<std::string>(used.begin(), used.end()), comm);
+    return make_summary({all_names.begin(), all_names.end()}, gather_all(group_instances, comm));
+}
+#endif
+
+void mechanism_registry::clear() {
+    names_.clear();
+    ids_.clear();
+    cells_.clear();
+}
+} // namespace sonata
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
 #include <type_traits>
 #include <vector>
 #include <numeric>
+#include <string>
 
 #ifdef ARB_MPI_ENABLED
 
@@ -14,18 +17,21 @@
 while (int r_ = fn(__VA_ARGS__)) throw sonata::sonata_exception("MPI error");
 
 namespace sonata{
+inline
 int rank(MPI_Comm comm) {
     int r;
     MPI_OR_THROW(MPI_Comm_rank, comm, &r);
     return r;
 }
 
+inline
 int size(MPI_Comm comm) {
     int s;
     MPI_OR_THROW(MPI_Comm_size, comm, &s);
     return s;
 }
 
+inline
 void barrier(MPI_Comm comm) {
     MPI_OR_THROW(MPI_Barrier, comm);
 }
@@ -67,7 +73,7 @@ static_assert(std::is_same<std::size_t, unsigned long>::value ||
               "size_t is not the same as unsigned long or unsigned long long");
 
 template <typename C>
-C make_index(C const& c)
+inline C make_index(C const& c)
 {
     static_assert(
             std::is_integral<typename C::value_type>::value,
@@ -80,6 +86,17 @@ C make_index(C const& c)
     return out;
 }
 
+// Counts of a collective as the int counts and displacements of MPI; throws sonata_exception if their total
+// doesn't fit, instead of overflowing them
+inline
+std::vector<int> mpi_counts(const std::vector<unsigned long long>& counts) {
+    auto total = std::accumulate(counts.begin(), counts.end(), 0ull);
+    if (total > (unsigned long long)std::numeric_limits<int>::max()) {
+        throw sonata_exception("MPI message of " + std::to_string(total) + " elements exceeds the int counts of MPI");
+    }
+    return std::vector<int>(counts.begin(), counts.end());
+}
+
 template <typename T>
 std::vector<T> gather_all(T value, MPI_Comm comm) {
     using traits = mpi_traits<T>;
@@ -97,10 +114,7 @@ template <typename T>
 std::vector<T> gather_all(const std::vector<T>& values, MPI_Comm comm) {
 
     using traits = mpi_traits<T>;
-    auto counts = gather_all(int(values.size()), comm);
-    for (auto& c : counts) {
-        c *= traits::count();
-    }
+    auto counts = mpi_counts(gather_all((unsigned long long)values.size()*traits::count(), comm));
     auto displs = make_index(counts);
 
     std::vector<T> buffer(displs.back()/traits::count());
@@ -112,6 +126,95 @@ std::vector<T> gather_all(const std::vector<T>& values, MPI_Comm comm) {
 
     return buffer;
 }
+// Gather strings from all ranks, in rank order
+inline
+std::vector<std::string> gather_all(const std::vector<std::string>& values, MPI_Comm comm) {
+    // Strings are sent as one '\0' separated buffer
+    std::vector<char> buffer;
+    for (const auto& v: values) {
+        buffer.insert(buffer.end(), v.begin(), v.end());
+        buffer.push_back('\0');
+    }
+    auto all = gather_all(buffer, comm);
+
+    std::vector<std::string> strings;
+    auto it = all.begin();
+    while (it != all.end()) {
+        auto end = std::find(it, all.end(), '\0');
+        strings.emplace_back(it, end);
+        it = end + 1;
+    }
+    return strings;
+}
+
+// Gather `values` of every rank on rank `root`; other ranks receive an empty vector
+template <typename T>
+std::vector<T> gather(const std::vector<T>& values, int root, MPI_Comm comm) {
+    using traits = mpi_traits<T>;
+    // The sizes of all ranks are checked on all ranks, so that they all fail together
+    auto counts = mpi_counts(gather_all((unsigned long long)values.size()*traits::count(), comm));
+    int count = counts[rank(comm)];
+    auto displs = make_index(counts);
+
+    std::vector<T> buffer(rank(comm) == root? displs.back()/traits::count(): 0);
+    MPI_OR_THROW(MPI_Gatherv,
+                 const_cast<T*>(values.data()), count, traits::mpi_type(),                // send buffer
+                 buffer.data(), counts.data(), displs.data(), traits::mpi_type(), root, // receive buffer
+                 comm);
+
+    return buffer;
+}
+
+// Element-wise sum of `values` over all ranks
+template <typename T>
+std::vector<T> sum_all(const std::vector<T>& values, MPI_Comm comm) {
+    static_assert(mpi_traits<T>::is_mpi_native_type(), "sum_all only applies to native MPI types");
+    std::vector<T> buffer(values.size());
+    MPI_OR_THROW(MPI_Allreduce, values.data(), buffer.data(), values.size(), mpi_traits<T>::mpi_type(), MPI_SUM, comm);
+    return buffer;
+}
+
+// Element-wise exclusive prefix sum of `values` over ranks; zero on rank 0
+template <typename T>
+std::vector<T> exclusive_scan(const std::vector<T>& values, MPI_Comm comm) {
+    static_assert(mpi_traits<T>::is_mpi_native_type(), "exclusive_scan only applies to native MPI types");
+    std::vector<T> buffer(values.size(), T(0));
+    MPI_OR_THROW(MPI_Exscan, values.data(), buffer.data(), values.size(), mpi_traits<T>::mpi_type(), MPI_SUM, comm);
+    if (rank(comm) == 0) {
+        std::fill(buffer.begin(), buffer.end(), T(0));
+    }
+    return buffer;
+}
+
+// Send the elements of `values` in [divs[i], divs[i+1]) to rank i; returns the elements received from all ranks
+template <typename T>
+std::vector<T> all_to_all(const std::vector<T>& values, const std::vector<int>& divs, MPI_Comm comm) {
+    using traits = mpi_traits<T>;
+    int n = size(comm);
+
+    std::vector<unsigned long long> send_sizes(n), recv_sizes(n);
+    for (int i = 0; i < n; i++) {
+        send_sizes[i] = (unsigned long long)(divs[i+1] - divs[i])*traits::count();
+    }
+    MPI_OR_THROW(MPI_Alltoall, send_sizes.data(), 1, MPI_UNSIGNED_LONG_LONG, recv_sizes.data(), 1, MPI_UNSIGNED_LONG_LONG, comm);
+    // Received totals differ between ranks: all ranks check the largest, so that they all fail together
+    auto recv_total = std::accumulate(recv_sizes.begin(), recv_sizes.end(), 0ull);
+    MPI_OR_THROW(MPI_Allreduce, MPI_IN_PLACE, &recv_total, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, comm);
+    mpi_counts({recv_total});
+    auto send_counts = mpi_counts(send_sizes);
+    auto recv_counts = mpi_counts(recv_sizes);
+
+    auto send_displs = make_index(send_counts);
+    auto recv_displs = make_index(recv_counts);
+
+    std::vector<T> buffer(recv_displs.back()/traits::count());
+    MPI_OR_THROW(MPI_Alltoallv,
+                 const_cast<T*>(values.data()), send_counts.data(), send_displs.data(), traits::mpi_type(), // send buffer
+                 buffer.data(), recv_counts.data(), recv_displs.data(), traits::mpi_type(),                // receive buffer
+                 comm);
+
+    return buffer;
+}
 } // namespace sonata
 
 #endif //ARB_MPI_ENABLED
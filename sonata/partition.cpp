@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <vector>
+
+#include <arbor/context.hpp>
+#include <arbor/domain_decomposition.hpp>
+
+#include <sonata/partition.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+namespace sonata {
+namespace {
+double cell_cost(const cell_graph& g, cell_gid_type gid) {
+    return g.costs.empty()? 1.: g.costs[gid];
+}
+
+// Spread the 21 low bits of `x` to every third bit
+std::uint64_t spread_bits(std::uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffff;
+    x = (x | x << 16) & 0x1f0000ff0000ff;
+    x = (x | x << 8)  & 0x100f00f00f00f00f;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3;
+    x = (x | x << 2)  & 0x1249249249249249;
+    return x;
+}
+
+// Cells along a Z-order curve through their positions, so that nearby cells are close in the order
+std::vector<cell_gid_type> spatial_order(const std::vector<std::array<double, 3>>& positions) {
+    std::array<double, 3> lo, hi;
+    lo.fill(INFINITY);
+    hi.fill(-INFINITY);
+    for (const auto& p: positions) {
+        for (unsigned d = 0; d < 3; d++) {
+            lo[d] = std::min(lo[d], p[d]);
+            hi[d] = std::max(hi[d], p[d]);
+        }
+    }
+
+    std::vector<std::uint64_t> keys(positions.size());
+    for (unsigned i = 0; i < positions.size(); i++) {
+        std::uint64_t key = 0;
+        for (unsigned d = 0; d < 3; d++) {
+            double extent = hi[d] - lo[d];
+            std::uint64_t q = extent > 0? std::uint64_t((positions[i][d] - lo[d])/extent*0x1fffff): 0;
+            key |= spread_bits(q) << d;
+        }
+        keys[i] = key;
+    }
+
+    std::vector<cell_gid_type> order(positions.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) { return keys[a] < keys[b]; });
+    return order;
+}
+}
+
+void set_adjacency(cell_graph& g,
+                   const std::vector<cell_gid_type>& sources,
+                   const std::vector<cell_gid_type>& targets,
+                   const std::vector<unsigned>& counts) {
+    auto n = g.size();
+    g.divs.assign(n + 1, 0);
+    for (unsigned i = 0; i < sources.size(); i++) {
+        if (sources[i] >= targets[i] || targets[i] >= n) {
+            throw sonata_exception("Invalid edge between cells " + std::to_string(sources[i]) + " and " + std::to_string(targets[i]));
+        }
+        g.divs[sources[i] + 1]++;
+        g.divs[targets[i] + 1]++;
+    }
+    std::partial_sum(g.divs.begin(), g.divs.end(), g.divs.begin());
+
+    // With sorted pairs, the neighbours of every cell are filled in increasing order
+    g.neighbours.resize(g.divs.back());
+    g.weights.resize(g.divs.back());
+    auto next = g.divs;
+    for (unsigned i = 0; i < sources.size(); i++) {
+        auto s = sources[i], t = targets[i];
+        g.neighbours[next[s]] = t;
+        g.weights[next[s]++] = counts[i];
+        g.neighbours[next[t]] = s;
+        g.weights[next[t]++] = counts[i];
+    }
+}
+
+std::vector<unsigned> partition_cells(const cell_graph& g, unsigned num_parts, const partition_info& info) {
+    auto n = g.size();
+    std::vector<unsigned> parts(n, 0);
+    if (num_parts <= 1 || n == 0) {
+        return parts;
+    }
+
+    std::vector<cell_gid_type> order;
+    if (info.use_positions && g.positions.size() == n) {
+        order = spatial_order(g.positions);
+    }
+    else {
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+    }
+
+    double total = 0;
+    for (cell_gid_type gid = 0; gid < n; gid++) {
+        total += cell_cost(g, gid);
+    }
+    if (total <= 0) {
+        throw sonata_exception("Cells to partition have no cost");
+    }
+
+    // Initial parts: runs of cells of equal cost along the order
+    std::vector<double> loads(num_parts, 0);
+    std::vector<unsigned> sizes(num_parts, 0);
+    double prefix = 0;
+    for (auto gid: order) {
+        auto cost = cell_cost(g, gid);
+        auto p = std::min(num_parts - 1, unsigned((prefix + cost/2)*num_parts/total));
+        parts[gid] = p;
+        loads[p] += cost;
+        sizes[p]++;
+        prefix += cost;
+    }
+
+    if (g.divs.size() != n + 1) {
+        return parts;
+    }
+
+    // Label propagation: move every cell to the part it has most edges to, if that gains edges
+    // and the part stays within the allowed cost; parts are never emptied
+    double max_load = (1 + info.imbalance)*total/num_parts;
+    std::vector<double> edges_to(num_parts, 0);
+    std::vector<unsigned> touched;
+    for (unsigned iter = 0; iter < info.iterations; iter++) {
+        std::size_t moves = 0;
+        for (auto gid: order) {
+            auto current = parts[gid];
+            if (sizes[current] == 1) {
+                continue;
+            }
+
+            for (auto k = g.divs[gid]; k < g.divs[gid + 1]; k++) {
+                auto p = parts[g.neighbours[k]];
+                if (edges_to[p] == 0) {
+                    touched.push_back(p);
+                }
+                edges_to[p] += g.weights[k];
+            }
+
+            auto cost = cell_cost(g, gid);
+            auto best = current;
+            double best_gain = 0;
+            for (auto p: touched) {
+                double gain = edges_to[p] - edges_to[current];
+                if (p != current && gain > best_gain && loads[p] + cost <= max_load) {
+                    best = p;
+                    best_gain = gain;
+                }
+            }
+            for (auto p: touched) {
+                edges_to[p] = 0;
+            }
+            touched.clear();
+
+            if (best != current) {
+                parts[gid] = best;
+                loads[current] -= cost;
+                loads[best] += cost;
+                sizes[current]--;
+                sizes[best]++;
+                moves++;
+            }
+        }
+        if (!moves) {
+            break;
+        }
+    }
+    return parts;
+}
+
+std::vector<arb::group_description> make_cell_groups(const cell_graph& g,
+                                                     const std::vector<unsigned>& parts,
+                                                     unsigned part,
+                                                     unsigned group_size,
+                                                     arb::backend_kind cable_backend) {
+    group_size = std::max(group_size, 1u);
+
+    // Local cells of every kind, in gid order
+    std::map<arb::cell_kind, std::vector<cell_gid_type>> local;
+    for (cell_gid_type gid = 0; gid < g.size(); gid++) {
+        if (parts[gid] == part) {
+            local[g.kinds[gid]].push_back(gid);
+        }
+    }
+
+    // Split `gids` into near equal groups of at most group_size cells
+    std::vector<arb::group_description> groups;
+    auto add_groups = [&](arb::cell_kind kind, const cell_gid_type* first, std::size_t count, arb::backend_kind backend) {
+        auto num_groups = (count + group_size - 1)/group_size;
+        for (std::size_t i = 0; i < num_groups; i++) {
+            auto b = count*i/num_groups, e = count*(i + 1)/num_groups;
+            groups.emplace_back(kind, std::vector<cell_gid_type>(first + b, first + e), backend);
+        }
+    };
+
+    for (auto& [kind, gids]: local) {
+        if (kind != arb::cell_kind::cable) {
+            add_groups(kind, gids.data(), gids.size(), arb::backend_kind::multicore);
+            continue;
+        }
+
+        std::stable_sort(gids.begin(), gids.end(), [&](auto a, auto b) { return g.mech_sets[a] < g.mech_sets[b]; });
+        if (cable_backend == arb::backend_kind::gpu) {
+            groups.emplace_back(kind, gids, cable_backend);
+            continue;
+        }
+        for (std::size_t b = 0; b < gids.size();) {
+            auto e = b;
+            while (e < gids.size() && g.mech_sets[gids[e]] == g.mech_sets[gids[b]]) {
+                e++;
+            }
+            add_groups(kind, gids.data() + b, e - b, cable_backend);
+            b = e;
+        }
+    }
+    return groups;
+}
+
+partition_stats evaluate_partition(const cell_graph& g, const std::vector<unsigned>& parts, unsigned num_parts) {
+    partition_stats stats;
+    stats.part_costs.assign(num_parts, 0);
+    for (cell_gid_type gid = 0; gid < g.size(); gid++) {
+        stats.part_costs[parts[gid]] += cell_cost(g, gid);
+
+        if (g.divs.size() == g.size() + 1) {
+            for (auto k = g.divs[gid]; k < g.divs[gid + 1]; k++) {
+                if (g.neighbours[k] > gid) {
+                    stats.total_edges += g.weights[k];
+                    if (parts[g.neighbours[k]] != parts[gid]) {
+                        stats.cut_edges += g.weights[k];
+                    }
+                }
+            }
+        }
+    }
+    if (num_parts) {
+        stats.max_cost = *std::max_element(stats.part_costs.begin(), stats.part_costs.end());
+        stats.mean_cost = std::accumulate(stats.part_costs.begin(), stats.part_costs.end(), 0.)/num_parts;
+    }
+    return stats;
+}
+
+arb::domain_decomposition partition_network(const arb::recipe& rec,
+                                            const cell_graph& g,
+                                            const arb::context& ctx,
+                                            const partition_info& info) {
+    // Every rank partitions the whole network the same way, and keeps its own part
+    auto num_parts = arb::num_ranks(ctx);
+    auto part = arb::rank(ctx);
+    auto parts = partition_cells(g, num_parts, info);
+
+    // By default a few cell groups per thread, for the threads to share out
+    auto group_size = info.group_size;
+    if (!group_size) {
+        std::size_t num_cable = 0;
+        for (cell_gid_type gid = 0; gid < g.size(); gid++) {
+            num_cable += parts[gid] == part && g.kinds[gid] == arb::cell_kind::cable;
+        }
+        std::size_t num_groups = 4*arb::num_threads(ctx);
+        group_size = std::max<std::size_t>(1, (num_cable + num_groups - 1)/num_groups);
+    }
+
+    auto backend = arb::has_gpu(ctx)? arb::backend_kind::gpu: arb::backend_kind::multicore;
+    return arb::domain_decomposition(rec, ctx, make_cell_groups(g, parts, part, group_size, backend));
+}
+} // namespace sonata
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <sonata/phase_profiler.hpp>
+
+#include "mpi_helper.hpp"
+
+namespace sonata {
+constexpr double mib = 1024.*1024.;
+
+// Resident set size of the process (bytes)
+static double current_rss() {
+    long pages = 0, resident = 0;
+    if (auto f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        std::fclose(f);
+    }
+    return double(resident)*sysconf(_SC_PAGESIZE);
+}
+
+// Peak resident set size of the process (bytes)
+static double peak_rss() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return double(usage.ru_maxrss);
+#else
+    return double(usage.ru_maxrss)*1024.;
+#endif
+}
+
+phase_profiler::phase_profiler() = default;
+
+#ifdef ARB_MPI_ENABLED
+phase_profiler::phase_profiler(MPI_Comm comm):
+    num_ranks_(size(comm)),
+    comm_(comm)
+{}
+#endif
+
+void phase_profiler::start(std::string name) {
+    stop();
+    current_ = std::move(name);
+    running_ = true;
+    start_ = std::chrono::steady_clock::now();
+}
+
+void phase_profiler::stop() {
+    if (!running_) {
+        return;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    // The kernel updates the peak lazily: it may lag behind the current size
+    auto rss = current_rss();
+    phases_.push_back({current_, wall, rss, std::max(rss, peak_rss())});
+    running_ = false;
+}
+
+void phase_profiler::record(std::string name, double value) {
+    quantities_.push_back({std::move(name), value});
+}
+
+nlohmann::json phase_profiler::report() const {
+    // Values of every rank: wall, rss and peak rss of the phases, then the quantities
+    std::vector<double> local;
+    for (const auto& p: phases_) {
+        local.insert(local.end(), {p.wall, p.rss, p.peak_rss});
+    }
+    for (const auto& q: quantities_) {
+        local.push_back(q.value);
+    }
+
+    auto all = local;
+#ifdef ARB_MPI_ENABLED
+    if (num_ranks_ > 1) {
+        all = gather_all(local, comm_);
+    }
+#endif
+    auto n = local.size();
+
+    // Min, max and sum over the ranks of value `i`
+    auto reduce = [&](std::size_t i) {
+        double lo = all[i], hi = all[i], sum = 0;
+        for (int r = 0; r < num_ranks_; r++) {
+            auto v = all[r*n + i];
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+            sum += v;
+        }
+        return std::make_tuple(lo, hi, sum);
+    };
+
+    nlohmann::json phases = nlohmann::json::array();
+    double total = 0;
+    for (std::size_t p = 0; p < phases_.size(); p++) {
+        auto [wall_min, wall_max, wall_sum] = reduce(3*p);
+        auto rss_max = std::get<1>(reduce(3*p + 1));
+        auto peak_max = std::get<1>(reduce(3*p + 2));
+        total += wall_max;
+
+        phases.push_back({
+            {"name", phases_[p].name},
+            {"wall_min", wall_min},
+            {"wall_max", wall_max},
+            {"wall_mean", wall_sum/num_ranks_},
+            {"rss_max_mib", rss_max/mib},
+            {"peak_rss_max_mib", peak_max/mib}
+        });
+    }
+
+    nlohmann::json quantities = nlohmann::json::object();
+    for (std::size_t q = 0; q < quantities_.size(); q++) {
+        auto [lo, hi, sum] = reduce(3*phases_.size() + q);
+        quantities[quantities_[q].name] = {{"sum", sum}, {"min", lo}, {"max", hi}};
+    }
+
+    return {
+        {"ranks", num_ranks_},
+        {"wall_total", total},
+        {"phases", phases},
+        {"statistics", quantities}
+    };
+}
+
+void phase_profiler::print(std::ostream& o, const nlohmann::json& report) {
+    o << std::left << std::setw(20) << "phase"
+      << std::right << std::setw(12) << "wall-min" << std::setw(12) << "wall-max"
+      << std::setw(12) << "rss(MiB)" << std::setw(12) << "peak(MiB)" << "\n";
+
+    auto flags = o.flags();
+    o << std::fixed << std::setprecision(3);
+    for (const auto& p: report["phases"]) {
+        o << std::left << std::setw(20) << p["name"].get<std::string>()
+          << std::right << std::setw(12) << p["wall_min"].get<double>() << std::setw(12) << p["wall_max"].get<double>()
+          << std::setw(12) << p["rss_max_mib"].get<double>() << std::setw(12) << p["peak_rss_max_mib"].get<double>()
+          << "\n";
+    }
+    o.flags(flags);
+
+    for (const auto& [name, q]: report["statistics"].items()) {
+        o << name << ": " << q["sum"].get<double>()
+          << " (per rank " << q["min"].get<double>() << " - " << q["max"].get<double>() << ")\n";
+    }
+}
+} // namespace sonata
@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <arbor/util/any_ptr.hpp>
+
+#include <sonata/h5_access.hpp>
+#include <sonata/hdf5_lib.hpp>
+#include <sonata/report_writer.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+#include "mpi_helper.hpp"
+
+namespace sonata {
+// Number of elements per chunk of the report data datasets
+constexpr hsize_t report_chunk_size = 1 << 16;
+
+report_writer::report_writer(report_info info, std::vector<std::string> pop_names, std::vector<unsigned> pop_parts):
+    info_(std::move(info)),
+    pop_names_(std::move(pop_names)),
+    pop_parts_(std::move(pop_parts))
+{
+    // Steps at start + i*dt before end_time
+    num_steps_ = std::max(0., std::ceil((info_.end_time - info_.start_time)/info_.dt - 1e-9));
+}
+
+#ifdef ARB_MPI_ENABLED
+report_writer::report_writer(report_info info, std::vector<std::string> pop_names, std::vector<unsigned> pop_parts,
+                             MPI_Comm comm):
+    report_writer(std::move(info), std::move(pop_names), std::move(pop_parts))
+{
+    rank_ = rank(comm);
+    num_ranks_ = size(comm);
+    MPI_OR_THROW(MPI_Comm_dup, comm, &comm_);
+#ifdef H5_HAVE_PARALLEL
+    collective_ = num_ranks_ > 1;
+#endif
+    int provided;
+    MPI_Query_thread(&provided);
+    thread_multiple_ = provided == MPI_THREAD_MULTIPLE;
+}
+#endif
+
+report_writer::~report_writer() {
+    // Only the file is closed: the remaining steps are written by the collective close
+    if (writer_) {
+        try {
+            writer_->drain();
+        }
+        catch (...) {}
+    }
+    outputs_.clear();
+    file_.reset();
+#ifdef ARB_MPI_ENABLED
+    if (comm_ != MPI_COMM_NULL) {
+        MPI_Comm_free(&comm_);
+    }
+#endif
+}
+
+const report_info& report_writer::info() const {
+    return info_;
+}
+
+arb::schedule report_writer::schedule() const {
+    // Stop half a step after the last sample, so that rounding can't add or drop one
+    return arb::regular_schedule(info_.start_time, info_.dt, info_.start_time + (double(num_steps_) - 0.5)*info_.dt);
+}
+
+hsize_t report_writer::steps_before(double t) const {
+    // Time steps up to half a step before `t`: samples close to `t` may only arrive in the next epoch
+    double n = std::ceil((t - info_.start_time)/info_.dt - 0.5);
+    return std::min<hsize_t>(std::max(0., n), num_steps_);
+}
+
+unsigned report_writer::column(cell_member_type probe) const {
+    auto it = std::lower_bound(probes_.begin(), probes_.end(), probe);
+    if (it == probes_.end() || !(*it == probe)) {
+        throw sonata_exception("Probe is not recorded in report " + info_.file_name);
+    }
+    return it - probes_.begin();
+}
+
+void report_writer::record(unsigned col, double t, double v) {
+    auto step = (long long)std::llround((t - info_.start_time)/info_.dt);
+    if (step < (long long)written_steps_ || step >= (long long)num_steps_) {
+        return;
+    }
+    // Only the sampler of `col` touches its buffer
+    hsize_t row = step - written_steps_;
+    if (row >= block_steps_) {
+        throw sonata_exception("Report " + info_.file_name + " is not flushed within the epoch it was opened for");
+    }
+    blocks_[active_].samples[col*block_steps_ + row] = v;
+}
+
+void report_writer::set_async_writer(async_writer* writer) {
+    writer_ = writer;
+}
+
+arb::sampler_function report_writer::sampler(unsigned col) {
+    return [this, col](arb::probe_metadata pm, std::size_t n, const arb::sample_record* records) {
+        for (std::size_t i = 0; i < n; i++) {
+            auto value = arb::util::any_cast<const double*>(records[i].data);
+            if (!value) {
+                throw sonata_exception("Unexpected sample type in report " + info_.file_name);
+            }
+            record(col, records[i].time, *value);
+        }
+    };
+}
+
+void report_writer::open(std::vector<std::pair<cell_member_type, mlocation>> probes, double epoch) {
+    std::sort(probes.begin(), probes.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.first.gid, a.first.index) < std::tie(b.first.gid, b.first.index);
+    });
+
+    std::vector<trace_key> keys;
+    for (const auto& p: probes) {
+        probes_.push_back(p.first);
+        keys.push_back({p.first.gid, p.first.index, rank_, p.second.branch, p.second.pos});
+    }
+
+    auto key_less = [](const trace_key& a, const trace_key& b) {
+        return std::tie(a.gid, a.index) < std::tie(b.gid, b.index);
+    };
+
+    // Keys of the traces of all ranks
+    auto all_keys = keys;
+#ifdef ARB_MPI_ENABLED
+    if (num_ranks_ > 1) {
+        all_keys = gather_all(keys, comm_);
+    }
+#endif
+    std::sort(all_keys.begin(), all_keys.end(), key_less);
+
+    // With collective output all ranks open the file, otherwise only rank 0
+    if (collective_) {
+#ifdef H5_HAVE_PARALLEL
+        auto fapl = h5_mpio_fapl(comm_);
+        file_ = std::make_unique<h5_file>(info_.file_name, true, fapl);
+        H5Pclose(fapl);
+#endif
+    }
+    else if (rank_ == 0) {
+        file_ = std::make_unique<h5_file>(info_.file_name, true);
+    }
+
+    std::shared_ptr<h5_group> reports_group;
+    if (file_) {
+        reports_group = file_->top_group_->add_group("reports");
+    }
+
+    auto gid_less = [](const trace_key& a, cell_gid_type gid) { return a.gid < gid; };
+
+    unsigned local_offset = 0;
+    for (unsigned p = 0; p < pop_names_.size(); p++) {
+        auto lo = std::lower_bound(all_keys.begin(), all_keys.end(), pop_parts_[p], gid_less) - all_keys.begin();
+        auto hi = std::lower_bound(all_keys.begin(), all_keys.end(), pop_parts_[p+1], gid_less) - all_keys.begin();
+        if (lo == hi) {
+            continue;
+        }
+
+        pop_output out;
+        out.num_columns = hi - lo;
+
+        // Mapping of the population, identical on all ranks
+        std::vector<int> element_ids;
+        std::vector<double> element_pos;
+        std::vector<int> node_ids;
+        std::vector<int> index_pointers;
+        out.rank_columns.resize(num_ranks_);
+        for (auto i = lo; i < hi; i++) {
+            const auto& k = all_keys[i];
+            element_ids.push_back(k.branch);
+            element_pos.push_back(k.pos);
+            if (i == lo || k.gid != all_keys[i-1].gid) {
+                node_ids.push_back(k.gid - pop_parts_[p]);
+                index_pointers.push_back(i - lo);
+            }
+            out.rank_columns[k.rank].push_back(i - lo);
+        }
+        index_pointers.push_back(out.num_columns);
+
+        // Columns of the local traces of the population
+        out.first_local = local_offset;
+        while (local_offset < keys.size() && keys[local_offset].gid < pop_parts_[p+1]) {
+            auto col = std::lower_bound(all_keys.begin() + lo, all_keys.begin() + hi, keys[local_offset], key_less);
+            out.columns.push_back(col - all_keys.begin() - lo);
+            local_offset++;
+        }
+
+        if (file_) {
+            // Datasets are created by all ranks that opened the file; the rank of the first trace writes the mapping
+            auto pop_group = reports_group->add_group(pop_names_[p]);
+            auto map_group = pop_group->add_group("mapping");
+
+            // Chunks of whole rows when they fit; shuffled before compression, which groups the
+            // exponent bytes of the samples
+            h5_dataset_props data_props;
+            hsize_t chunk_columns = std::min(out.num_columns, report_chunk_size);
+            data_props.chunk_dims = {report_chunk_size/chunk_columns, chunk_columns};
+            data_props.deflate = info_.deflate;
+            data_props.shuffle = info_.deflate > 0;
+            out.data = pop_group->add_dataset("data",
+                                              info_.single_precision? H5T_NATIVE_FLOAT: H5T_NATIVE_DOUBLE,
+                                              {0, out.num_columns},
+                                              data_props);
+
+            auto time_set = map_group->add_empty_dataset<double>("time", {3});
+            auto element_ids_set = map_group->add_empty_dataset<int>("element_ids", {out.num_columns});
+            auto element_pos_set = map_group->add_empty_dataset<double>("element_pos", {out.num_columns});
+            auto node_ids_set = map_group->add_empty_dataset<int>("node_ids", {node_ids.size()});
+            auto index_pointers_set = map_group->add_empty_dataset<int>("index_pointers", {index_pointers.size()});
+
+            if (!collective_ || all_keys[lo].rank == rank_) {
+                time_set->write(0, std::vector<double>{info_.start_time, info_.end_time, info_.dt});
+                element_ids_set->write(0, element_ids);
+                element_pos_set->write(0, element_pos);
+                node_ids_set->write(0, node_ids);
+                index_pointers_set->write(0, index_pointers);
+            }
+        }
+        outputs_.push_back(std::move(out));
+    }
+
+    // The buffers hold the time steps sampled in an epoch and the step left over from the previous one (see
+    // steps_before), with a step for rounding, so that the samplers never allocate
+    block_steps_ = num_steps_;
+    if (std::isfinite(epoch)) {
+        block_steps_ = std::min<hsize_t>(num_steps_, std::ceil(epoch/info_.dt) + 2);
+    }
+    for (auto& block: blocks_) {
+        block.samples.assign(probes_.size()*block_steps_, 0.);
+    }
+
+    // Buffers of the writes
+    for (auto& out: outputs_) {
+        out.packed.resize(block_steps_*out.columns.size());
+#ifdef ARB_MPI_ENABLED
+        if (num_ranks_ > 1 && !collective_) {
+            // All ranks check the size of the gathered blocks, so that they all fail together
+            mpi_counts({(unsigned long long)block_steps_*out.num_columns});
+            out.counts.resize(num_ranks_);
+            out.displs.resize(num_ranks_);
+            if (rank_ == 0) {
+                out.gathered.resize(block_steps_*out.num_columns);
+                out.rows.resize(block_steps_*out.num_columns);
+                out.all_columns.resize(out.num_columns);
+                std::iota(out.all_columns.begin(), out.all_columns.end(), 0);
+            }
+        }
+#endif
+    }
+    open_ = true;
+}
+
+void report_writer::flush(double t) {
+    if (!open_) {
+        return;
+    }
+
+    // All ranks agree on the number of steps, so that they take part in the same collective writes
+    auto steps = steps_before(t);
+    if (steps <= written_steps_) {
+        return;
+    }
+    auto num_rows = steps - written_steps_;
+
+    // The block of the previous flush becomes the block of the samplers once written
+    auto& full = blocks_[active_];
+    auto& next = blocks_[1 - active_];
+    if (next.written.valid()) {
+        next.written.get();
+    }
+
+    // Steps sampled before `t` but after the written ones start the next block
+    auto sampled = std::llround((t - info_.start_time)/info_.dt) + 1;
+    auto carry_end = std::min<hsize_t>({num_steps_, written_steps_ + block_steps_, hsize_t(std::max(0ll, sampled))});
+    if (carry_end > steps) {
+        auto carry = carry_end - steps;
+        for (std::size_t col = 0; col < probes_.size(); col++) {
+            auto from = full.samples.begin() + col*block_steps_ + num_rows;
+            std::copy(from, from + carry, next.samples.begin() + col*block_steps_);
+        }
+    }
+
+    auto write = [this, &full, first_row = written_steps_, num_rows] {
+        write_blocks(full.samples, first_row, num_rows);
+    };
+    if (writer_ && (num_ranks_ == 1 || thread_multiple_)) {
+        full.written = writer_->submit(write);
+    }
+    else {
+        // hdf5 and MPI are only called from this thread: wait for the tasks of the writers sharing the writer
+        // thread
+        if (writer_) {
+            writer_->drain();
+        }
+        write();
+    }
+
+    active_ = 1 - active_;
+    written_steps_ = steps;
+}
+
+void report_writer::close() {
+    if (!open_) {
+        return;
+    }
+
+    // Write the remaining steps, and wait for the blocks in flight before closing the file on this thread
+    flush(info_.start_time + (num_steps_ + 1)*info_.dt);
+    for (auto& block: blocks_) {
+        if (block.written.valid()) {
+            block.written.get();
+        }
+    }
+    if (writer_) {
+        writer_->drain();
+        writer_ = nullptr;
+    }
+    open_ = false;
+
+    outputs_.clear();
+    file_.reset();
+}
+
+void report_writer::write_blocks(std::vector<double>& block, hsize_t first_row, hsize_t num_rows) {
+    for (auto& out: outputs_) {
+        write_block(out, block, first_row, num_rows);
+    }
+    if (file_) {
+        file_->flush();
+    }
+    // Steps not sampled are written as 0 by the next use of the block
+    std::fill(block.begin(), block.end(), 0.);
+}
+
+void report_writer::write_block(pop_output& out, const std::vector<double>& block, hsize_t first_row, hsize_t num_rows) {
+    // Row-major block of the local columns of the population
+    auto num_local = out.columns.size();
+    for (unsigned j = 0; j < num_local; j++) {
+        auto samples = block.begin() + (out.first_local + j)*block_steps_;
+        for (hsize_t i = 0; i < num_rows; i++) {
+            out.packed[i*num_local + j] = samples[i];
+        }
+    }
+
+    auto write = [&](const std::vector<hsize_t>& columns, const std::vector<double>& data) {
+        out.data->resize(first_row + num_rows);
+        out.data->write_columns(first_row, num_rows, columns, data.data(), collective_);
+    };
+
+#ifdef ARB_MPI_ENABLED
+    if (num_ranks_ > 1 && !collective_) {
+        // Serial hdf5: rank 0 writes the blocks of all ranks
+        for (int r = 0; r < num_ranks_; r++) {
+            out.counts[r] = num_rows*out.rank_columns[r].size();
+            out.displs[r] = r? out.displs[r-1] + out.counts[r-1]: 0;
+        }
+        MPI_OR_THROW(MPI_Gatherv,
+                     out.packed.data(), out.counts[rank_], MPI_DOUBLE,
+                     out.gathered.data(), out.counts.data(), out.displs.data(), MPI_DOUBLE, 0,
+                     comm_);
+        if (rank_ != 0) {
+            return;
+        }
+
+        std::size_t offset = 0;
+        for (const auto& cols: out.rank_columns) {
+            for (hsize_t i = 0; i < num_rows; i++) {
+                for (unsigned j = 0; j < cols.size(); j++) {
+                    out.rows[i*out.num_columns + cols[j]] = out.gathered[offset++];
+                }
+            }
+        }
+        write(out.all_columns, out.rows);
+        return;
+    }
+#endif
+
+    write(out.columns, out.packed);
+}
+} // namespace sonata
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arbor/spike.hpp>
+
+#include <sonata/spike_sort.hpp>
+
+namespace sonata {
+// Number of key bits sorted per radix pass; the counts of a pass stay in L1/L2 cache
+constexpr unsigned radix_bits = 11;
+
+// Arrays smaller than this are sorted with std::sort
+constexpr std::size_t radix_sort_threshold = 1 << 14;
+
+// Minimum number of spikes sorted per thread
+constexpr std::size_t parallel_sort_threshold = 1 << 16;
+
+spike_order spike_order_from_string(const std::string& sort_by) {
+    if (sort_by == "time" || sort_by == "by_time") {
+        return spike_order::by_time;
+    }
+    if (sort_by == "none") {
+        return spike_order::none;
+    }
+    return spike_order::by_id;
+}
+
+// Unsigned key with the order of the time of the spike
+static std::uint64_t time_key(const arb::spike& s) {
+    double t = s.time == 0? 0.: s.time;
+    std::uint64_t bits;
+    std::memcpy(&bits, &t, sizeof(bits));
+    return (bits >> 63)? ~bits: bits | (std::uint64_t(1) << 63);
+}
+
+static unsigned bit_width(std::uint64_t x) {
+    unsigned n = 0;
+    for (; x; x >>= 1) {
+        n++;
+    }
+    return n;
+}
+
+// Stable LSD radix sort of [first, last) on the low `key_bits` bits of key(spike);
+// passes on digits that are the same for all spikes are skipped
+template <typename Key>
+static void radix_sort(arb::spike* first, arb::spike* last, std::vector<arb::spike>& scratch,
+                       std::vector<std::size_t>& count, Key key, unsigned key_bits) {
+    const std::size_t n = last - first;
+    const std::uint64_t mask = (std::uint64_t(1) << radix_bits) - 1;
+
+    scratch.resize(n);
+    count.resize(std::size_t(1) << radix_bits);
+    arb::spike* src = first;
+    arb::spike* dst = scratch.data();
+
+    for (unsigned shift = 0; shift < key_bits; shift += radix_bits) {
+        std::fill(count.begin(), count.end(), 0);
+        for (std::size_t i = 0; i < n; i++) {
+            count[(key(src[i]) >> shift) & mask]++;
+        }
+        if (count[(key(src[0]) >> shift) & mask] == n) {
+            continue;
+        }
+
+        std::size_t offset = 0;
+        for (auto& c: count) {
+            auto k = c;
+            c = offset;
+            offset += k;
+        }
+        for (std::size_t i = 0; i < n; i++) {
+            dst[count[(key(src[i]) >> shift) & mask]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+    if (src != first) {
+        std::copy(src, src + n, first);
+    }
+}
+
+// Bounds of the blocks of [first, first + n) whose spikes are all earlier than those of the next block, as
+// the spikes of the epochs of a simulation; one block if the spikes are in no such order
+static std::vector<std::size_t> time_blocks(const arb::spike* first, std::size_t n) {
+    std::vector<double> suffix_min(n);
+    double t_min = first[n-1].time;
+    for (std::size_t i = n; i-- > 0;) {
+        suffix_min[i] = t_min = std::min(t_min, first[i].time);
+    }
+
+    std::vector<std::size_t> bounds = {0};
+    double t_max = first[0].time;
+    for (std::size_t i = 1; i < n; i++) {
+        if (t_max < suffix_min[i]) {
+            bounds.push_back(i);
+        }
+        t_max = std::max(t_max, first[i].time);
+    }
+    bounds.push_back(n);
+    return bounds;
+}
+
+// Sort [first, last) on the calling thread, small arrays with std::sort
+static void sort_block(arb::spike* first, arb::spike* last, spike_order order,
+                       std::vector<arb::spike>& scratch, std::vector<std::size_t>& count) {
+    const std::size_t n = last - first;
+    spike_less less{order};
+    if (n < radix_sort_threshold) {
+        std::sort(first, last, less);
+        return;
+    }
+    if (std::is_sorted(first, last, less)) {
+        return;
+    }
+
+    auto gids = std::minmax_element(first, last, [](const arb::spike& a, const arb::spike& b) {
+        return a.source.gid < b.source.gid;
+    });
+    auto min_gid = gids.first->source.gid;
+    auto gid_bits = bit_width(gids.second->source.gid - min_gid);
+    auto gid_key = [min_gid](const arb::spike& s) { return std::uint64_t(s.source.gid - min_gid); };
+
+    // Stable passes from the least to the most significant key
+    if (order == spike_order::by_time) {
+        radix_sort(first, last, scratch, count, gid_key, gid_bits);
+        radix_sort(first, last, scratch, count, time_key, 64);
+    }
+    else {
+        // Spikes arriving in time order only need the passes on the gid
+        auto time_less = [](const arb::spike& a, const arb::spike& b) { return a.time < b.time; };
+        if (!std::is_sorted(first, last, time_less)) {
+            radix_sort(first, last, scratch, count, time_key, 64);
+        }
+        radix_sort(first, last, scratch, count, gid_key, gid_bits);
+    }
+}
+
+// Sort [first, last) on the calling thread
+static void sort_part(arb::spike* first, arb::spike* last, spike_order order) {
+    const std::size_t n = last - first;
+    std::vector<arb::spike> scratch;
+    std::vector<std::size_t> count;
+    if (order != spike_order::by_time || n < radix_sort_threshold || std::is_sorted(first, last, spike_less{order})) {
+        sort_block(first, last, order, scratch, count);
+        return;
+    }
+
+    // Spikes delivered epoch by epoch are sorted by time by sorting every epoch, which fits in cache
+    auto bounds = time_blocks(first, n);
+    for (std::size_t i = 0; i + 1 < bounds.size(); i++) {
+        sort_block(first + bounds[i], first + bounds[i+1], order, scratch, count);
+    }
+}
+
+void sort_spikes(arb::spike* first, arb::spike* last, spike_order order, unsigned num_threads) {
+    if (order == spike_order::none) {
+        return;
+    }
+
+    const std::size_t n = last - first;
+    std::size_t num_parts = std::min<std::size_t>(std::max(num_threads, 1u), n/parallel_sort_threshold);
+    if (num_parts <= 1) {
+        sort_part(first, last, order);
+        return;
+    }
+
+    // Sort equal parts concurrently
+    std::vector<std::size_t> bounds(num_parts + 1);
+    for (std::size_t i = 0; i <= num_parts; i++) {
+        bounds[i] = i*n/num_parts;
+    }
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < num_parts; i++) {
+        threads.emplace_back(sort_part, first + bounds[i], first + bounds[i+1], order);
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+
+    // Merge pairs of sorted parts, the merges of a round concurrently, until one part is left
+    std::vector<arb::spike> buffer(n);
+    arb::spike* src = first;
+    arb::spike* dst = buffer.data();
+    spike_less less{order};
+
+    while (bounds.size() > 2) {
+        std::vector<std::size_t> next = {0};
+        threads.clear();
+        std::size_t i = 0;
+        for (; i + 2 < bounds.size(); i += 2) {
+            auto lo = bounds[i], mid = bounds[i+1], hi = bounds[i+2];
+            threads.emplace_back([=] { std::merge(src + lo, src + mid, src + mid, src + hi, dst + lo, less); });
+            next.push_back(hi);
+        }
+        if (i + 1 < bounds.size()) {
+            // Odd part out: carried over to the next round
+            std::copy(src + bounds[i], src + bounds[i+1], dst + bounds[i]);
+            next.push_back(bounds[i+1]);
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        std::swap(src, dst);
+        bounds = std::move(next);
+    }
+    if (src != first) {
+        std::copy(src, src + n, first);
+    }
+}
+
+void sort_spikes(std::vector<arb::spike>& spikes, spike_order order, unsigned num_threads) {
+    sort_spikes(spikes.data(), spikes.data() + spikes.size(), order, num_threads);
+}
+} // namespace sonata
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <cstdio>
+#include <queue>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <arbor/spike.hpp>
+
+#include <sonata/h5_access.hpp>
+#include <sonata/sonata_exceptions.hpp>
+#include <sonata/spike_writer.hpp>
+
+#include "mpi_helper.hpp"
+
+namespace sonata {
+// Number of elements per chunk of the extendible spike datasets
+constexpr hsize_t spike_chunk_size = 1 << 14;
+
+// Index of the population of `gid` in the partitioned population sizes `pop_parts`
+static unsigned population_index(const std::vector<unsigned>& pop_parts, arb::cell_gid_type gid) {
+    auto it = std::upper_bound(pop_parts.begin(), pop_parts.end(), gid);
+    if (it == pop_parts.begin() || it == pop_parts.end()) {
+        throw sonata_exception("Spike source gid out of range of node populations");
+    }
+    return it - pop_parts.begin() - 1;
+}
+
+spike_writer::spike_writer(std::string file_name,
+                           spike_order order,
+                           std::vector<std::string> pop_names,
+                           std::vector<unsigned> pop_parts,
+                           std::size_t flush_size):
+    file_name_(std::move(file_name)),
+    order_(order),
+    pop_names_(std::move(pop_names)),
+    pop_parts_(std::move(pop_parts)),
+    flush_size_(std::max<std::size_t>(flush_size, 1)),
+    outputs_(pop_names_.size()),
+    run_outputs_(pop_names_.size()),
+    pop_node_ids_(pop_names_.size()),
+    pop_timestamps_(pop_names_.size())
+{
+    buffer_.reserve(flush_size_);
+    file_ = std::make_unique<h5_file>(file_name_, true);
+    spikes_group_ = file_->top_group_->add_group("spikes");
+}
+
+spike_writer::~spike_writer() {
+    try {
+        close();
+    }
+    catch (...) {}
+}
+
+void spike_writer::append(const std::vector<arb::spike>& spikes) {
+    if (closed_) {
+        throw sonata_exception("Spikes appended to closed spike_writer");
+    }
+    num_spikes_ += spikes.size();
+
+    // Batches are kept whole, as sorting by time relies on flushes of whole epochs: flush first if the batch
+    // doesn't fit, so that the buffer only grows for batches of more than `flush_size_` spikes
+    if (buffer_.size() + spikes.size() > flush_size_) {
+        flush();
+    }
+    buffer_.insert(buffer_.end(), spikes.begin(), spikes.end());
+
+    if (buffer_.size() >= flush_size_) {
+        flush();
+    }
+}
+
+void spike_writer::flush() {
+    if (closed_ || buffer_.empty()) {
+        return;
+    }
+
+    if (writer_) {
+        // Hand the buffer over to the writer thread, once it is done with the spare one
+        if (spare_written_.valid()) {
+            spare_written_.get();
+        }
+        std::swap(buffer_, spare_);
+        spare_written_ = writer_->submit([this] { write_spikes(spare_); });
+    }
+    else {
+        write_spikes(buffer_);
+    }
+}
+
+void spike_writer::write_spikes(std::vector<arb::spike>& spikes) {
+    if (order_ == spike_order::by_id) {
+        // Every flush is a sorted run in the scratch file
+        if (!runs_file_) {
+            runs_file_ = std::make_unique<h5_file>(file_name_ + ".runs", true);
+            runs_group_ = runs_file_->top_group_->add_group("runs");
+        }
+        write_buffer(spikes, run_outputs_, runs_group_);
+        runs_file_->flush();
+    }
+    else {
+        write_buffer(spikes, outputs_, spikes_group_);
+        file_->flush();
+    }
+}
+
+void spike_writer::set_async_writer(async_writer* writer) {
+    writer_ = writer;
+    if (writer_) {
+        spare_.reserve(flush_size_);
+    }
+}
+
+void spike_writer::close() {
+    if (closed_) {
+        return;
+    }
+
+    // Wait for the buffers in flight, and finish the file on this thread
+    if (writer_) {
+        auto writer = writer_;
+        writer_ = nullptr;
+        writer->drain();
+    }
+
+    if (order_ == spike_order::by_id && !runs_file_) {
+        // All spikes fit in a single run: write it directly to the output file,
+        // sorted with all threads as the simulation is done
+        write_buffer(buffer_, outputs_, spikes_group_, std::thread::hardware_concurrency());
+    }
+    else {
+        flush();
+        if (order_ == spike_order::by_id) {
+            merge_runs();
+        }
+    }
+    closed_ = true;
+
+    outputs_.clear();
+    run_outputs_.clear();
+    spikes_group_.reset();
+    runs_group_.reset();
+    file_.reset();
+
+    if (runs_file_) {
+        runs_file_.reset();
+        std::remove((file_name_ + ".runs").c_str());
+    }
+}
+
+std::size_t spike_writer::num_spikes() const {
+    return num_spikes_;
+}
+
+spike_writer::pop_output& spike_writer::population_output(std::vector<pop_output>& outputs,
+                                                          const std::shared_ptr<h5_group>& parent,
+                                                          unsigned p) {
+    auto& out = outputs[p];
+    if (!out.group) {
+        out.group = parent->add_group(pop_names_[p]);
+        out.node_ids = out.group->add_extendible_dataset<int>("node_ids", spike_chunk_size);
+        out.timestamps = out.group->add_extendible_dataset<double>("timestamps", spike_chunk_size);
+    }
+    return out;
+}
+
+void spike_writer::write_buffer(std::vector<arb::spike>& spikes,
+                                std::vector<pop_output>& outputs,
+                                const std::shared_ptr<h5_group>& parent,
+                                unsigned num_threads) {
+    sort_spikes(spikes, order_, num_threads);
+
+    // Split by population, keeping the order within each population
+    auto& node_ids = pop_node_ids_;
+    auto& timestamps = pop_timestamps_;
+    for (unsigned p = 0; p < pop_names_.size(); p++) {
+        node_ids[p].clear();
+        timestamps[p].clear();
+    }
+
+    for (const auto& s: spikes) {
+        auto p = population_index(pop_parts_, s.source.gid);
+
+        node_ids[p].push_back(s.source.gid - pop_parts_[p]);
+        timestamps[p].push_back(s.time);
+    }
+
+    for (unsigned p = 0; p < pop_names_.size(); p++) {
+        if (node_ids[p].empty()) {
+            continue;
+        }
+        auto& out = population_output(outputs, parent, p);
+        out.node_ids->append(node_ids[p]);
+        out.timestamps->append(timestamps[p]);
+
+        if (order_ == spike_order::by_id) {
+            out.runs.push_back(out.node_ids->size());
+        }
+    }
+    spikes.clear();
+}
+
+void spike_writer::merge_runs() {
+    using entry = std::tuple<int, double, unsigned>;
+
+    for (unsigned p = 0; p < run_outputs_.size(); p++) {
+        auto& in = run_outputs_[p];
+        if (!in.group) {
+            continue;
+        }
+        auto& out = population_output(outputs_, spikes_group_, p);
+        h5_wrapper runs(in.group);
+
+        // Read the runs in blocks, so that the merge uses about as much memory as one flush
+        unsigned num_runs = in.runs.size() - 1;
+        std::size_t block = std::max<std::size_t>(1024, flush_size_ / num_runs);
+
+        struct cursor {
+            std::size_t next, end, pos = 0;
+            std::vector<int> node_ids;
+            std::vector<double> timestamps;
+        };
+        std::vector<cursor> cursors(num_runs);
+
+        auto load = [&](cursor& c) {
+            auto n = std::min(block, c.end - c.next);
+            c.node_ids = runs.get<std::vector<int>>("node_ids", c.next, c.next + n);
+            c.timestamps = runs.get<std::vector<double>>("timestamps", c.next, c.next + n);
+            c.next += n;
+            c.pos = 0;
+        };
+
+        // K-way merge of the runs with a min-heap on (node_id, time)
+        std::priority_queue<entry, std::vector<entry>, std::greater<entry>> heap;
+        for (unsigned r = 0; r < num_runs; r++) {
+            auto& c = cursors[r];
+            c.next = in.runs[r];
+            c.end = in.runs[r+1];
+            load(c);
+            heap.emplace(c.node_ids[0], c.timestamps[0], r);
+        }
+
+        std::vector<int> node_ids;
+        std::vector<double> timestamps;
+        node_ids.reserve(block);
+        timestamps.reserve(block);
+
+        while (!heap.empty()) {
+            auto [id, time, r] = heap.top();
+            heap.pop();
+
+            node_ids.push_back(id);
+            timestamps.push_back(time);
+            if (node_ids.size() == block) {
+                out.node_ids->append(node_ids);
+                out.timestamps->append(timestamps);
+                node_ids.clear();
+                timestamps.clear();
+            }
+
+            auto& c = cursors[r];
+            if (++c.pos == c.node_ids.size()) {
+                if (c.next == c.end) {
+                    continue;
+                }
+                load(c);
+            }
+            heap.emplace(c.node_ids[c.pos], c.timestamps[c.pos], r);
+        }
+        out.node_ids->append(node_ids);
+        out.timestamps->append(timestamps);
+    }
+    file_->flush();
+}
+
+#ifdef ARB_MPI_ENABLED
+parallel_spike_writer::parallel_spike_writer(std::string file_name,
+                                             spike_order order,
+                                             std::vector<std::string> pop_names,
+                                             std::vector<unsigned> pop_parts,
+                                             MPI_Comm comm):
+    file_name_(std::move(file_name)),
+    order_(order),
+    pop_names_(std::move(pop_names)),
+    pop_parts_(std::move(pop_parts)),
+    comm_(comm)
+{}
+
+void parallel_spike_writer::append(const std::vector<arb::spike>& spikes) {
+    if (closed_) {
+        throw sonata_exception("Spikes appended to closed parallel_spike_writer");
+    }
+    spikes_.insert(spikes_.end(), spikes.begin(), spikes.end());
+}
+
+std::size_t parallel_spike_writer::num_spikes() const {
+    return spikes_.size();
+}
+
+void parallel_spike_writer::distributed_sort() {
+    // Called after the simulation: sort with all threads
+    auto num_threads = std::thread::hardware_concurrency();
+    spike_less less{order_};
+    sort_spikes(spikes_, order_, num_threads);
+
+    int n = size(comm_);
+    if (n == 1) {
+        return;
+    }
+
+    // Regular samples of the local spikes give the n-1 splitters of the global key range
+    std::vector<arb::spike> samples;
+    if (!spikes_.empty()) {
+        for (int i = 1; i < n; i++) {
+            samples.push_back(spikes_[i*spikes_.size()/n]);
+        }
+    }
+    auto all_samples = gather_all(samples, comm_);
+    if (all_samples.empty()) {
+        return;
+    }
+    std::sort(all_samples.begin(), all_samples.end(), less);
+
+    // Spikes in [divs[i], divs[i+1]) go to rank i
+    std::vector<int> divs(n+1, 0);
+    for (int i = 1; i < n; i++) {
+        const auto& splitter = all_samples[i*all_samples.size()/n];
+        divs[i] = std::lower_bound(spikes_.begin(), spikes_.end(), splitter, less) - spikes_.begin();
+    }
+    divs[n] = spikes_.size();
+
+    spikes_ = all_to_all(spikes_, divs, comm_);
+    sort_spikes(spikes_, order_, num_threads);
+}
+
+void parallel_spike_writer::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    if (order_ != spike_order::none) {
+        distributed_sort();
+    }
+
+#ifdef H5_HAVE_PARALLEL
+    // Split the local spikes by population, keeping their order
+    unsigned num_pops = pop_names_.size();
+    std::vector<std::vector<int>> node_ids(num_pops);
+    std::vector<std::vector<double>> timestamps(num_pops);
+    for (const auto& s: spikes_) {
+        auto p = population_index(pop_parts_, s.source.gid);
+        node_ids[p].push_back(s.source.gid - pop_parts_[p]);
+        timestamps[p].push_back(s.time);
+    }
+    spikes_.clear();
+
+    // Offset of the local spikes in each population and population totals
+    std::vector<unsigned long long> counts(num_pops);
+    for (unsigned p = 0; p < num_pops; p++) {
+        counts[p] = node_ids[p].size();
+    }
+    auto offsets = exclusive_scan(counts, comm_);
+    auto totals = sum_all(counts, comm_);
+
+    auto fapl = h5_mpio_fapl(comm_);
+    h5_file file(file_name_, true, fapl);
+    H5Pclose(fapl);
+
+    // Group and dataset creation is collective: all ranks create the same layout
+    auto spikes_group = file.top_group_->add_group("spikes");
+    for (unsigned p = 0; p < num_pops; p++) {
+        if (!totals[p]) {
+            continue;
+        }
+        auto group = spikes_group->add_group(pop_names_[p]);
+        auto ids = group->add_extendible_dataset<int>("node_ids", spike_chunk_size);
+        auto times = group->add_extendible_dataset<double>("timestamps", spike_chunk_size);
+
+        ids->resize(totals[p]);
+        times->resize(totals[p]);
+        ids->write(offsets[p], node_ids[p], true);
+        times->write(offsets[p], timestamps[p], true);
+    }
+#else
+    // Serial hdf5: the spikes, already ordered across ranks, are written by rank 0
+    auto all_spikes = gather(spikes_, 0, comm_);
+    spikes_.clear();
+
+    if (rank(comm_) == 0) {
+        spike_writer writer(file_name_, spike_order::none, pop_names_, pop_parts_, all_spikes.size());
+        writer.append(all_spikes);
+        writer.close();
+    }
+#endif
+}
+#endif
+} // namespace sonata
@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <tuple>
+
+#include <sonata/synapse_map.hpp>
+
+namespace sonata {
+synapse_map coalesce_targets(const std::vector<std::pair<target_type, unsigned>>& targets,
+                             const std::function<bool(const arb::mechanism_desc&)>& coalesce) {
+    // Location, mechanism name and sorted parameters of a target
+    using key_type = std::tuple<cell_lid_type, double, std::string, std::vector<std::pair<std::string, double>>>;
+    std::map<key_type, unsigned> shared;
+
+    synapse_map m;
+    m.index.reserve(targets.size());
+    for (unsigned i = 0; i < targets.size(); i++) {
+        const auto& t = targets[i].first;
+        if (coalesce && coalesce(t.synapse)) {
+            std::vector<std::pair<std::string, double>> values(t.synapse.values().begin(), t.synapse.values().end());
+            std::sort(values.begin(), values.end());
+
+            auto [it, inserted] = shared.emplace(key_type{t.segment, t.position, t.synapse.name(), std::move(values)},
+                                                 m.synapses.size());
+            if (!inserted) {
+                m.index.push_back(it->second);
+                continue;
+            }
+        }
+        m.index.push_back(m.synapses.size());
+        m.synapses.push_back(i);
+    }
+    return m;
+}
+
+void sort_synapses(synapse_map& m, const std::vector<std::pair<target_type, unsigned>>& targets) {
+    auto key = [&](unsigned s) {
+        const auto& t = targets[m.synapses[s]].first;
+        return std::tie(t.synapse.name(), t.segment, t.position);
+    };
+    std::vector<unsigned> order(m.synapses.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return key(a) < key(b); });
+
+    // New number of every synapse
+    std::vector<unsigned> renumber(order.size());
+    std::vector<unsigned> synapses(order.size());
+    for (unsigned s = 0; s < order.size(); s++) {
+        renumber[order[s]] = s;
+        synapses[s] = m.synapses[order[s]];
+    }
+    m.synapses = std::move(synapses);
+    for (auto& i: m.index) {
+        i = renumber[i];
+    }
+}
+} // namespace sonata
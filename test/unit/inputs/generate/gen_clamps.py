@@ -0,0 +1,29 @@
+import h5py
+
+f0 = h5py.File("clamp_electrode.h5", "w")
+f1 = h5py.File("clamp_input.h5", "w")
+
+electrodes = f0.create_group("electrodes")
+
+# Same electrode as clamp_electrode.csv
+pop_e = electrodes.create_group("pop_e")
+pop_e.create_dataset('electrode_id', data=[0], dtype='i')
+pop_e.create_dataset('node_id', data=[0], dtype='i')
+pop_e.create_dataset('sec_id', data=[0], dtype='i')
+pop_e.create_dataset('seg_x', data=[0.5], dtype='d')
+
+# Two electrodes on the same node
+pop_i = electrodes.create_group("pop_i")
+pop_i.create_dataset('electrode_id', data=[1, 2], dtype='i')
+pop_i.create_dataset('node_id', data=[0, 0], dtype='i')
+pop_i.create_dataset('sec_id', data=[1, 1], dtype='i')
+pop_i.create_dataset('seg_x', data=[0.25, 0.25], dtype='d')
+
+inputs = f1.create_group("inputs")
+inputs.create_dataset('electrode_id', data=[2, 0, 1], dtype='i')
+inputs.create_dataset('dur', data=[20, 5, 20], dtype='d')
+inputs.create_dataset('amp', data=[-0.5, 0.4, 0.25], dtype='d')
+inputs.create_dataset('delay', data=[50, 0, 10], dtype='d')
+
+f0.close()
+f1.close()
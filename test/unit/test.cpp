@@ -4,7 +4,6 @@
 
 #ifdef ARB_MPI_ENABLED
 #include <mpi.h>
-#include <arborenv/with_mpi.hpp>
 #endif
 
 #include "../gtest.h"
@@ -13,8 +12,15 @@ int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
 
 #ifdef ARB_MPI_ENABLED
-    arbenv::with_mpi guard(argc, argv, false);
-#endif
+    // As in arbata, the output writers communicate on their writer thread
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
+    auto result = RUN_ALL_TESTS();
+    MPI_Finalize();
+    return result;
+#else
     return RUN_ALL_TESTS();
+#endif
 
 }
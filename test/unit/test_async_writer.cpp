@@ -0,0 +1,95 @@
+#include "../gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sonata/async_writer.hpp>
+
+using namespace sonata;
+
+TEST(async_writer, order) {
+    std::vector<int> done;
+    {
+        async_writer w(3);
+        for (int i = 0; i < 100; i++) {
+            w.submit([&done, i] { done.push_back(i); });
+        }
+        w.drain();
+
+        auto stats = w.get_stats();
+        EXPECT_EQ(100u, stats.num_tasks);
+        EXPECT_LE(stats.max_queue_depth, 3u);
+        EXPECT_GE(stats.max_queue_depth, 1u);
+    }
+    ASSERT_EQ(100u, done.size());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(i, done[i]);
+    }
+}
+
+TEST(async_writer, backpressure) {
+    std::atomic<bool> release{false};
+    async_writer w(1);
+
+    // The first task blocks the writer thread, the second fills the queue:
+    // the third submit waits until the writer thread is released
+    w.submit([&release] { while (!release) std::this_thread::yield(); });
+    w.submit([] {});
+    std::thread releaser([&release] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release = true;
+    });
+    w.submit([] {});
+    releaser.join();
+    w.drain();
+
+    auto stats = w.get_stats();
+    EXPECT_EQ(3u, stats.num_tasks);
+    EXPECT_EQ(1u, stats.max_queue_depth);
+    EXPECT_GT(stats.wait_time, 0.);
+    EXPECT_GT(stats.write_time, 0.);
+}
+
+TEST(async_writer, cpu_time) {
+    // A task sleeping takes time but no CPU time of the writer thread, a task spinning both
+    async_writer w;
+    w.submit([] { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+    w.drain();
+    auto stats = w.get_stats();
+    EXPECT_GE(stats.write_time, 0.05);
+    EXPECT_LT(stats.cpu_time, 0.5*stats.write_time);
+
+    w.submit([] {
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+        while (std::chrono::steady_clock::now() < end) {}
+    });
+    w.drain();
+    EXPECT_GT(w.get_stats().cpu_time, stats.cpu_time);
+}
+
+TEST(async_writer, exception) {
+    int done = 0;
+    async_writer w;
+    w.submit([] { throw std::runtime_error("write failed"); });
+    w.submit([&done] { done++; });
+    EXPECT_THROW(w.drain(), std::runtime_error);
+
+    // Tasks after a failed one still run, and the error is reported once
+    EXPECT_EQ(1, done);
+    EXPECT_NO_THROW(w.drain());
+}
+
+TEST(async_writer, future) {
+    // The future of a task is ready once it has run, and holds its exception
+    int done = 0;
+    async_writer w;
+    auto ok = w.submit([&done] { done++; });
+    auto failed = w.submit([] { throw std::runtime_error("write failed"); });
+    ok.get();
+    EXPECT_EQ(1, done);
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_THROW(w.drain(), std::runtime_error);
+}
@@ -0,0 +1,95 @@
+#include "../gtest.h"
+
+#include <numeric>
+
+#include <sonata/cell_cost.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+using namespace sonata;
+
+namespace {
+cell_features cable(unsigned cvs, unsigned mechs, unsigned synapses) {
+    cell_features f;
+    f.kind = arb::cell_kind::cable;
+    f.cvs = cvs;
+    f.density_mechs = mechs;
+    f.synapses = synapses;
+    return f;
+}
+
+double dot(const cost_model::terms_type& a, const cost_model::terms_type& b) {
+    return std::inner_product(a.begin(), a.end(), b.begin(), 0.);
+}
+}
+
+TEST(cell_cost, estimate) {
+    cell_features virt;
+    virt.kind = arb::cell_kind::spike_source;
+    virt.synapses = 3;
+
+    cost_model model({0.5, 2, 0.1, 0.01, 0.2});
+    EXPECT_EQ(cost_model::terms_type({1, 0, 0, 0, 3}), cost_model::terms(virt));
+    EXPECT_EQ(cost_model::terms_type({0, 1, 400, 1200, 10}), cost_model::terms(cable(400, 3, 10)));
+
+    EXPECT_DOUBLE_EQ(0.5 + 0.6, model.estimate(virt));
+    EXPECT_DOUBLE_EQ(2 + 40 + 12 + 2, model.estimate(cable(400, 3, 10)));
+    EXPECT_EQ(std::vector<double>({model.estimate(virt), model.estimate(cable(400, 3, 10))}),
+              model.estimate(std::vector<cell_features>{virt, cable(400, 3, 10)}));
+
+    // More CVs, mechanisms or synapses cost more
+    cost_model defaults;
+    EXPECT_LT(defaults.estimate(virt), defaults.estimate(cable(1, 0, 0)));
+    EXPECT_LT(defaults.estimate(cable(200, 2, 10)), defaults.estimate(cable(400, 2, 10)));
+    EXPECT_LT(defaults.estimate(cable(200, 2, 10)), defaults.estimate(cable(200, 3, 10)));
+    EXPECT_LT(defaults.estimate(cable(200, 2, 10)), defaults.estimate(cable(200, 2, 11)));
+}
+
+TEST(cell_cost, calibrate) {
+    // Ranks with different mixes of cells, timed with weights unlike the defaults
+    cost_model::terms_type truth = {0.001, 0.05, 0.0004, 0.0003, 0.0002};
+    std::vector<cost_model::terms_type> terms = {
+        {100, 10, 2000, 6000, 500},
+        {0, 20, 4000, 4000, 800},
+        {50, 5, 9000, 9000, 100},
+        {10, 30, 2000, 12000, 2000},
+        {0, 15, 6000, 30000, 400},
+        {200, 10, 3000, 3000, 3000},
+    };
+    std::vector<double> times;
+    for (const auto& t: terms) {
+        times.push_back(dot(t, truth));
+    }
+
+    cost_model model;
+    auto calibrated = model.calibrate(terms, times);
+
+    double error = 0, error_scaled = 0;
+    double scale = std::accumulate(times.begin(), times.end(), 0.)/
+                   std::accumulate(terms.begin(), terms.end(), 0., [&](double s, const auto& t) { return s + dot(t, model.weights()); });
+    for (unsigned r = 0; r < terms.size(); r++) {
+        error += std::abs(dot(terms[r], calibrated.weights()) - times[r])/times[r];
+        error_scaled += std::abs(scale*dot(terms[r], model.weights()) - times[r])/times[r];
+    }
+    EXPECT_LT(error, 0.5*error_scaled);
+    for (auto w: calibrated.weights()) {
+        EXPECT_GE(w, 0);
+    }
+
+    // A single part only fixes the scale of the weights
+    auto single = model.calibrate({terms[0]}, {times[0]});
+    for (unsigned k = 0; k < cost_model::num_terms; k++) {
+        EXPECT_NEAR(model.weights()[k]*times[0]/dot(terms[0], model.weights()), single.weights()[k], 1e-12);
+    }
+
+    EXPECT_THROW(model.calibrate(terms, {1.}), sonata_exception);
+}
+
+TEST(cell_cost, imbalance) {
+    load_report load;
+    load.predicted = {1, 2, 3};
+    load.measured = {2, 2, 2};
+    EXPECT_DOUBLE_EQ(1.5, load.predicted_imbalance());
+    EXPECT_DOUBLE_EQ(1, load.measured_imbalance());
+
+    EXPECT_DOUBLE_EQ(1, load_report().measured_imbalance());
+}
@@ -0,0 +1,59 @@
+#include "../gtest.h"
+
+#include <sonata/cell_template.hpp>
+
+using namespace sonata;
+
+namespace {
+std::unordered_map<section_kind, std::vector<arb::mechanism_desc>> pas_hh(double g_pas, double gnabar) {
+    auto pas = arb::mechanism_desc("pas").set("g", g_pas).set("e", -70);
+    auto hh = arb::mechanism_desc("hh").set("gnabar", gnabar);
+    return {{section_kind::soma, {pas, hh}}, {section_kind::dend, {pas}}};
+}
+}
+
+TEST(cell_template, key) {
+    auto key = cell_template_key(100, "pop_e", "", pas_hh(0.001, 0.12));
+
+    EXPECT_EQ(key, cell_template_key(100, "pop_e", "", pas_hh(0.001, 0.12)));
+    EXPECT_NE(key, cell_template_key(101, "pop_e", "", pas_hh(0.001, 0.12)));
+    EXPECT_NE(key, cell_template_key(100, "pop_i", "", pas_hh(0.001, 0.12)));
+    EXPECT_NE(key, cell_template_key(100, "pop_e", "cell.swc", pas_hh(0.001, 0.12)));
+    EXPECT_NE(key, cell_template_key(100, "pop_e", "", pas_hh(0.001, 0.13)));
+
+    // Values are compared exactly
+    EXPECT_NE(key, cell_template_key(100, "pop_e", "", pas_hh(0.001 + 1e-16, 0.12)));
+
+    // The section of a mechanism matters
+    auto pas = arb::mechanism_desc("pas").set("g", 0.001);
+    EXPECT_NE(cell_template_key(100, "pop_e", "", {{section_kind::soma, {pas}}}),
+              cell_template_key(100, "pop_e", "", {{section_kind::dend, {pas}}}));
+}
+
+TEST(cell_template, cache) {
+    cell_template_cache cache(2);
+    EXPECT_EQ(nullptr, cache.find("a"));
+
+    auto a = cache.insert("a", {});
+    EXPECT_EQ(a, cache.find("a"));
+    EXPECT_EQ(a, cache.find("a"));
+
+    cache.insert("b", {});
+    EXPECT_NE(nullptr, cache.find("b"));
+
+    // A template built concurrently for a stored key is dropped for the stored one
+    EXPECT_EQ(a, cache.insert("a", {}));
+
+    // Full: "c" is built but not kept
+    EXPECT_NE(nullptr, cache.insert("c", {}));
+    EXPECT_EQ(nullptr, cache.find("c"));
+
+    auto stats = cache.statistics();
+    EXPECT_EQ(3u, stats.hits);
+    EXPECT_EQ(2u, stats.misses);
+    EXPECT_EQ(2u, stats.size);
+
+    cache.clear();
+    EXPECT_EQ(0u, cache.statistics().size);
+    EXPECT_EQ(nullptr, cache.find("a"));
+}
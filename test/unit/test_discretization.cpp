@@ -0,0 +1,80 @@
+#include "../gtest.h"
+
+#include <arbor/morph/morphology.hpp>
+#include <arbor/morph/segment_tree.hpp>
+
+#include <sonata/discretization.hpp>
+#include <sonata/sonata_exceptions.hpp>
+#include <sonata/sonata_io.hpp>
+
+using namespace sonata;
+
+namespace {
+// Soma of 20 um, optionally with a dendrite of 100 um forking into two branches of 50 um
+arb::morphology make_morph(bool with_dend) {
+    arb::segment_tree tree;
+    auto soma = tree.append(arb::mnpos, {0, 0, 0, 10}, {0, 0, 20, 10}, 1);
+    if (with_dend) {
+        auto dend = tree.append(soma, {0, 0, 20, 1}, {0, 0, 120, 1}, 3);
+        tree.append(dend, {0, 0, 120, 1}, {0, 50, 120, 1}, 3);
+        tree.append(dend, {0, 0, 120, 1}, {0, -50, 120, 1}, 3);
+    }
+    return arb::morphology(tree);
+}
+}
+
+TEST(discretization, count_cvs) {
+    auto soma = make_morph(false);
+    auto cell = make_morph(true);
+    EXPECT_TRUE(is_soma_only(soma));
+    EXPECT_FALSE(is_soma_only(cell));
+
+    discretization_info d;
+    EXPECT_EQ(1, count_cvs(d, soma));
+    EXPECT_EQ(3*200, count_cvs(d, cell));
+
+    d.cvs_per_branch = 5;
+    d.single_cv_soma = false;
+    EXPECT_EQ(5, count_cvs(d, soma));
+    EXPECT_EQ(15, count_cvs(d, cell));
+
+    // Branches of 120, 50 and 50 um
+    d.policy = "max-extent";
+    d.max_extent = 20;
+    EXPECT_EQ(1, count_cvs(d, soma));
+    EXPECT_EQ(6 + 3 + 3, count_cvs(d, cell));
+
+    d.policy = "explicit";
+    d.locset = "(on-branches 0.5)";
+    EXPECT_EQ(4, count_cvs(d, cell));
+}
+
+TEST(discretization, read) {
+    auto run = nlohmann::json::parse(R"json({
+        "discretization": {
+            "policy": "max-extent",
+            "max_extent": 10,
+            "populations": {"pop_i": {"policy": "fixed-per-branch"}},
+            "node_types": {"100": {"policy": "explicit", "locset": "(terminal)", "single_cv_soma": false}}
+        }
+    })json");
+    auto d = read_discretization(run);
+    EXPECT_EQ("max-extent", d.defaults.policy);
+    EXPECT_EQ(10, d.defaults.max_extent);
+    EXPECT_TRUE(d.defaults.single_cv_soma);
+
+    // Overrides start from the defaults
+    EXPECT_EQ("fixed-per-branch", d.populations.at("pop_i").policy);
+    EXPECT_EQ(10, d.populations.at("pop_i").max_extent);
+    EXPECT_EQ("explicit", d.node_types.at(100).policy);
+    EXPECT_EQ("(terminal)", d.node_types.at(100).locset);
+    EXPECT_FALSE(d.node_types.at(100).single_cv_soma);
+
+    auto none = read_discretization(nlohmann::json::parse("{}"));
+    EXPECT_EQ("fixed-per-branch", none.defaults.policy);
+    EXPECT_EQ(200, none.defaults.cvs_per_branch);
+
+    EXPECT_THROW(read_discretization(nlohmann::json::parse(R"json({"discretization": {"policy": "single"}})json")), sonata_exception);
+    EXPECT_THROW(read_discretization(nlohmann::json::parse(R"json({"discretization": {"max_extent": 0, "policy": "max-extent"}})json")), sonata_exception);
+    EXPECT_THROW(read_discretization(nlohmann::json::parse(R"json({"discretization": {"policy": "explicit", "locset": "(on-branches"}})json")), sonata_exception);
+}
@@ -0,0 +1,275 @@
+#include "../gtest.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sonata/h5_access.hpp>
+#include <sonata/hdf5_lib.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+#include "mpi_helper.hpp"
+
+using namespace sonata;
+
+TEST(h5_access, driver) {
+    EXPECT_EQ(h5_driver::sec2, parse_h5_driver("sec2"));
+    EXPECT_EQ(h5_driver::mpio, parse_h5_driver("mpio"));
+    EXPECT_THROW(parse_h5_driver("core"), sonata_exception);
+}
+
+TEST(h5_access, sec2) {
+    reset_h5_access();
+    EXPECT_EQ(h5_driver::sec2, h5_input_driver());
+
+    std::vector<int> ids = {4, 5, 6};
+    h5_file("test_h5_sec2.h5", true).top_group_->add_dataset("ids", ids);
+
+    auto threshold = h5_core_threshold();
+    set_h5_core_threshold(0);
+    EXPECT_EQ(H5P_DEFAULT, h5_input_fapl("test_h5_sec2.h5"));
+    {
+        h5_file f("test_h5_sec2.h5");
+        h5_wrapper w(f.top_group_);
+        h5_collective_reads collective;
+        EXPECT_EQ(ids, w.get<std::vector<int>>("ids"));
+    }
+    set_h5_core_threshold(threshold);
+    std::remove("test_h5_sec2.h5");
+}
+
+TEST(h5_access, core) {
+    std::vector<int> ids(1000);
+    for (unsigned i = 0; i < ids.size(); i++) {
+        ids[i] = 3*i;
+    }
+    h5_file("test_h5_core.h5", true).top_group_->add_dataset("ids", ids);
+
+    // Small node and spike files are loaded into memory; larger ones, missing ones and the others (edge files) are
+    // left to the driver
+    auto threshold = h5_core_threshold();
+    set_h5_core_threshold(1 << 20);
+    auto fapl = h5_input_fapl("test_h5_core.h5", true);
+    ASSERT_NE(H5P_DEFAULT, fapl);
+    EXPECT_EQ(H5FD_CORE, H5Pget_driver(fapl));
+    EXPECT_EQ(H5P_DEFAULT, h5_input_fapl("test_h5_core.h5"));
+    EXPECT_EQ(H5P_DEFAULT, h5_input_fapl("test_h5_missing.h5", true));
+    {
+        h5_file f("test_h5_core.h5", false, fapl);
+        h5_wrapper w(f.top_group_);
+        EXPECT_EQ(ids, w.get<std::vector<int>>("ids"));
+        EXPECT_EQ(300, w.get<int>("ids", 100));
+        EXPECT_EQ(std::vector<int>({30, 33}), w.get<std::vector<int>>("ids", 10, 12));
+    }
+
+    set_h5_core_threshold(100);
+    EXPECT_EQ(H5P_DEFAULT, h5_input_fapl("test_h5_core.h5", true));
+    set_h5_core_threshold(threshold);
+
+    // The list is released with the access and made again on use
+    reset_h5_access();
+    EXPECT_EQ(H5FD_CORE, H5Pget_driver(h5_input_fapl("test_h5_core.h5", true)));
+    std::remove("test_h5_core.h5");
+}
+
+TEST(h5_access, cache) {
+    auto c = parse_h5_cache("chunk_bytes=4096,chunk_slots=101,chunk_w0=0.5,metadata_bytes=2097152");
+    EXPECT_EQ(4096u, c.chunk_bytes);
+    EXPECT_EQ(101u, c.chunk_slots);
+    EXPECT_EQ(0.5, c.chunk_w0);
+    EXPECT_EQ(2097152u, c.metadata_bytes);
+    EXPECT_THROW(parse_h5_cache("chunk_size=1"), sonata_exception);
+    EXPECT_THROW(parse_h5_cache("chunk_bytes=many"), sonata_exception);
+    EXPECT_THROW(parse_h5_cache("chunk_w0=2"), sonata_exception);
+
+    // Defaults sized from the chunks: 4 chunks, at least 1 MiB, 100 slots per chunk, at least 521
+    reset_h5_cache();
+    auto d = h5_dataset_cache("a.h5", "/x", 1 << 20);
+    EXPECT_EQ(4u << 20, d.chunk_bytes);
+    EXPECT_EQ(521u, d.chunk_slots);
+    EXPECT_EQ(0.75, d.chunk_w0);
+    EXPECT_EQ(0u, d.metadata_bytes);
+    d = h5_dataset_cache("a.h5", "/x", 1024);
+    EXPECT_EQ(1u << 20, d.chunk_bytes);
+    EXPECT_EQ(102407u, d.chunk_slots);
+    EXPECT_EQ(0u, h5_dataset_cache("a.h5", "/x", 0).chunk_bytes);
+
+    // The most specific setting of every value applies
+    h5_cache_params all, file, dataset, both;
+    all.chunk_bytes = 1000;
+    all.chunk_slots = 11;
+    file.chunk_bytes = 2000;
+    file.metadata_bytes = 1 << 21;
+    dataset.chunk_slots = 13;
+    dataset.chunk_bytes = 3000;
+    both.chunk_w0 = 0.25;
+    set_h5_cache(all);
+    set_h5_cache(file, "a.h5");
+    set_h5_cache(dataset, "", "/x");
+    set_h5_cache(both, "a.h5", "/x");
+
+    d = h5_dataset_cache("a.h5", "/x", 100);
+    EXPECT_EQ(2000u, d.chunk_bytes);
+    EXPECT_EQ(13u, d.chunk_slots);
+    EXPECT_EQ(0.25, d.chunk_w0);
+    EXPECT_EQ(2u << 20, d.metadata_bytes);
+
+    d = h5_dataset_cache("b.h5", "/x", 100);
+    EXPECT_EQ(3000u, d.chunk_bytes);
+    EXPECT_EQ(13u, d.chunk_slots);
+    EXPECT_EQ(0.75, d.chunk_w0);
+
+    d = h5_dataset_cache("b.h5", "/y", 100);
+    EXPECT_EQ(1000u, d.chunk_bytes);
+    EXPECT_EQ(11u, d.chunk_slots);
+
+    // The chunk cache is set on the access property list of the reads
+    auto dapl = h5_read_dapl(d);
+    std::size_t slots, bytes;
+    double w0;
+    H5Pget_chunk_cache(dapl, &slots, &bytes, &w0);
+    EXPECT_EQ(11u, slots);
+    EXPECT_EQ(1000u, bytes);
+    EXPECT_EQ(0.75, w0);
+    H5Pclose(dapl);
+
+    // The metadata cache of a file with a setting starts at its size
+    std::vector<int> ids = {1, 2, 3};
+    h5_file("test_h5_cache.h5", true).top_group_->add_dataset("ids", ids);
+    auto threshold = h5_core_threshold();
+    set_h5_core_threshold(0);
+    EXPECT_EQ(H5P_DEFAULT, h5_input_fapl("test_h5_cache.h5"));
+    set_h5_cache(file, "test_h5_cache.h5");
+    auto fapl = h5_input_fapl("test_h5_cache.h5");
+    ASSERT_NE(H5P_DEFAULT, fapl);
+    H5AC_cache_config_t config;
+    config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+    H5Pget_mdc_config(fapl, &config);
+    EXPECT_TRUE(config.set_initial_size);
+    EXPECT_EQ(2u << 20, config.initial_size);
+    {
+        h5_file f("test_h5_cache.h5");
+        EXPECT_EQ(ids, h5_wrapper(f.top_group_).get<std::vector<int>>("ids"));
+    }
+
+    reset_h5_cache();
+    EXPECT_EQ(H5P_DEFAULT, h5_input_fapl("test_h5_cache.h5"));
+    set_h5_core_threshold(threshold);
+    std::remove("test_h5_cache.h5");
+}
+
+TEST(h5_access, close) {
+    std::vector<int> ids = {1, 2, 3};
+    h5_file("test_h5_close.h5", true).top_group_->add_group("nodes")->add_group("pop")->add_dataset("ids", ids);
+
+    auto open_files = H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_FILE);
+    auto open_datasets = H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_DATASET);
+    {
+        auto f = std::make_shared<h5_file>("test_h5_close.h5");
+        h5_record record({f});
+        EXPECT_EQ(ids, record[0].get<std::vector<int>>("ids"));
+        EXPECT_EQ(open_files + 1, H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_FILE));
+        EXPECT_EQ(open_datasets + 1, H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_DATASET));
+
+        // The dataset opened for reading, the groups and the file are closed while the record still holds them
+        record.close();
+        EXPECT_EQ(open_files, H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_FILE));
+        EXPECT_EQ(open_datasets, H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_DATASET));
+        record.close();
+    }
+    EXPECT_EQ(open_files, H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_FILE));
+    std::remove("test_h5_close.h5");
+}
+
+#ifdef ARB_MPI_ENABLED
+TEST(h5_access, distributed) {
+    int rank = sonata::rank(MPI_COMM_WORLD);
+    int num_ranks = sonata::size(MPI_COMM_WORLD);
+
+    std::vector<int> ids(100);
+    for (unsigned i = 0; i < ids.size(); i++) {
+        ids[i] = 2*i;
+    }
+    if (rank == 0) {
+        h5_file f("test_h5_access.h5", true);
+        f.top_group_->add_group("pop")->add_dataset("ids", ids);
+    }
+    sonata::barrier(MPI_COMM_WORLD);
+
+    // Falls back to sec2 without parallel hdf5 or MPI_THREAD_MULTIPLE; the reads are the same. The file is not
+    // loaded into memory, so that it is opened with the driver
+    auto driver = set_h5_access(h5_driver::mpio, MPI_COMM_WORLD);
+    EXPECT_EQ(driver, h5_input_driver());
+    auto threshold = h5_core_threshold();
+    set_h5_core_threshold(0);
+    if (driver == h5_driver::sec2) {
+        EXPECT_EQ(H5P_DEFAULT, h5_input_fapl("test_h5_access.h5"));
+    }
+    {
+        h5_file f("test_h5_access.h5");
+        h5_wrapper pop(h5_wrapper(f.top_group_)[0]);
+        {
+            h5_collective_reads collective;
+            EXPECT_EQ(ids, pop.get<std::vector<int>>("ids"));
+        }
+
+        // Independent reads of different rows on every rank
+        EXPECT_EQ(2*(rank % 100), pop.get<int>("ids", rank % 100));
+        EXPECT_EQ(std::vector<int>({2*num_ranks, 2*num_ranks + 2}), pop.get<std::vector<int>>("ids", num_ranks, num_ranks + 2));
+    }
+    set_h5_core_threshold(threshold);
+    reset_h5_access();
+    EXPECT_EQ(h5_driver::sec2, h5_input_driver());
+
+    sonata::barrier(MPI_COMM_WORLD);
+    if (rank == 0) {
+        std::remove("test_h5_access.h5");
+    }
+}
+
+#ifdef H5_HAVE_PARALLEL
+TEST(h5_access, distributed_close) {
+    int rank = sonata::rank(MPI_COMM_WORLD);
+    int num_ranks = sonata::size(MPI_COMM_WORLD);
+
+    std::vector<int> ids = {1, 2, 3};
+    std::vector<std::string> names = {"test_h5_close_a.h5", "test_h5_close_b.h5"};
+    if (rank == 0) {
+        for (unsigned i = 0; i < names.size(); i++) {
+            h5_file(names[i], true).top_group_->add_group("nodes")->add_group("pop_" + std::to_string(i))->add_dataset("ids", ids);
+        }
+    }
+    sonata::barrier(MPI_COMM_WORLD);
+
+    // Every rank reads another one of the files, so that the datasets opened for reading differ between the
+    // ranks; the files are then closed collectively in the same order, and a collective open of an output file
+    // completes on all ranks
+    if (set_h5_access(h5_driver::mpio, MPI_COMM_WORLD) == h5_driver::mpio) {
+        auto threshold = h5_core_threshold();
+        set_h5_core_threshold(0);
+        std::vector<std::shared_ptr<h5_file>> files;
+        for (const auto& name: names) {
+            files.push_back(std::make_shared<h5_file>(name));
+        }
+        h5_record record(files);
+        EXPECT_EQ(ids, record[rank % 2].get<std::vector<int>>("ids", 0, 3));
+        record.close();
+
+        auto fapl = h5_mpio_fapl(MPI_COMM_WORLD);
+        h5_file("test_h5_close_out.h5", true, fapl).top_group_->add_group("ranks_" + std::to_string(num_ranks));
+        H5Pclose(fapl);
+        set_h5_core_threshold(threshold);
+    }
+    reset_h5_access();
+
+    sonata::barrier(MPI_COMM_WORLD);
+    if (rank == 0) {
+        for (const auto& name: names) {
+            std::remove(name.c_str());
+        }
+        std::remove("test_h5_close_out.h5");
+    }
+}
+#endif
+#endif
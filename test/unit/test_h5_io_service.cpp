@@ -0,0 +1,119 @@
+#include "../gtest.h"
+
+#include <cstdio>
+#include <thread>
+
+#include <sonata/h5_io_service.hpp>
+#include <sonata/hdf5_lib.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+using namespace sonata;
+
+namespace {
+// File with int datasets "ids" (i) and "pairs" ((2i, 2i+1)), and double dataset "weights" (i/2) of `n` rows
+void write_inputs(const std::string& name, unsigned n) {
+    std::vector<int> ids(n);
+    std::vector<double> weights(n);
+    std::vector<std::vector<int>> pairs(n, std::vector<int>(2));
+    for (unsigned i = 0; i < n; i++) {
+        ids[i] = i;
+        weights[i] = i*0.5;
+        pairs[i] = {int(2*i), int(2*i + 1)};
+    }
+    h5_file f(name, true);
+    f.top_group_->add_dataset("ids", ids);
+    f.top_group_->add_dataset("weights", weights);
+    f.top_group_->add_dataset("pairs", pairs);
+}
+}
+
+TEST(h5_io_service, plan) {
+    write_inputs("test_io_plan.h5", 100);
+    {
+        h5_file f("test_io_plan.h5");
+        h5_wrapper w(f.top_group_);
+        auto ids = w.dataset("ids");
+        auto weights = w.dataset("weights");
+        EXPECT_EQ(nullptr, w.dataset("missing"));
+
+        h5_read_plan plan;
+        plan.add(ids, 50, 60);
+        plan.add(ids, 0, 10);
+        plan.add(ids, 12, 20);
+        plan.add(weights, 5, 6);
+        plan.add(ids, 30, 30);
+        plan.add(nullptr, 0, 10);
+        EXPECT_EQ(4u, plan.requests().size());
+
+        auto coalesced = plan;
+        coalesced.coalesce();
+        ASSERT_EQ(4u, coalesced.requests().size());
+
+        coalesced = plan;
+        coalesced.coalesce(2);
+        ASSERT_EQ(3u, coalesced.requests().size());
+        for (const auto& r: coalesced.requests()) {
+            if (r.dataset == ids && r.begin == 0) {
+                EXPECT_EQ(20u, r.end);
+            }
+        }
+    }
+    std::remove("test_io_plan.h5");
+}
+
+TEST(h5_io_service, submit) {
+    h5_io_service io;
+    EXPECT_EQ(&io, h5_io_service::active());
+    EXPECT_THROW(h5_io_service(), sonata_exception);
+
+    EXPECT_FALSE(io.on_io_thread());
+    EXPECT_TRUE(io.submit([&]() { return io.on_io_thread(); }).get());
+    EXPECT_EQ(42, io.submit([]() { return 42; }).get());
+
+    auto failed = io.submit([]() -> int { throw sonata_exception("failed"); });
+    EXPECT_THROW(failed.get(), sonata_exception);
+}
+
+TEST(h5_io_service, prefetch) {
+    write_inputs("test_io_prefetch.h5", 1000);
+    {
+        h5_file f("test_io_prefetch.h5");
+        h5_wrapper w(f.top_group_);
+
+        h5_io_service io;
+        h5_read_plan plan;
+        plan.add(w.dataset("ids"), 100, 200);
+        plan.add(w.dataset("weights"), 0, 1000);
+        plan.add(w.dataset("pairs"), 10, 20);
+        io.prefetch(plan).wait();
+
+        auto s = io.statistics();
+        EXPECT_EQ(3u, s.blocks);
+        EXPECT_EQ(100*sizeof(int) + 1000*sizeof(double) + 20*sizeof(int), s.bytes);
+
+        // Reads within the blocks are served from them, concurrently
+        std::vector<std::thread> readers;
+        for (unsigned t = 0; t < 4; t++) {
+            readers.emplace_back([&w, t]() {
+                for (unsigned i = 0; i < 10; i++) {
+                    EXPECT_EQ(int(100 + 10*t + i), w.get<int>("ids", 100 + 10*t + i));
+                }
+            });
+        }
+        for (auto& r: readers) {
+            r.join();
+        }
+        EXPECT_EQ(std::vector<int>({150, 151, 152}), (w.get<std::vector<int>>("ids", 150, 153)));
+        EXPECT_EQ(12.5, w.get<double>("weights", 25));
+        EXPECT_EQ(std::make_pair(30, 31), (w.get<std::pair<int,int>>("pairs", 15)));
+        EXPECT_EQ(43u, io.statistics().hits);
+
+        // Reads outside the blocks go to the file, through the I/O thread
+        EXPECT_EQ(std::vector<int>({199, 200, 201}), (w.get<std::vector<int>>("ids", 199, 202)));
+        EXPECT_EQ(5, w.get<int>("ids", 5));
+        EXPECT_EQ(std::make_pair(0, 1), (w.get<std::pair<int,int>>("pairs", 0)));
+        EXPECT_EQ(3u, io.statistics().misses);
+    }
+    EXPECT_EQ(nullptr, h5_io_service::active());
+    std::remove("test_io_prefetch.h5");
+}
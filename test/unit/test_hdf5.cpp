@@ -1,7 +1,13 @@
 #include "../gtest.h"
 
+#include <cstdio>
+#include <sstream>
+#include <unordered_map>
+
 #include <arbor/cable_cell.hpp>
 
+#include <sonata/h5_access.hpp>
+#include <sonata/h5_io_stats.hpp>
 #include <sonata/hdf5_lib.hpp>
 #include <sonata/sonata_exceptions.hpp>
 
@@ -168,3 +174,233 @@ TEST(hdf5_record, verify_edges) {
     EXPECT_EQ(2, r["pop_e_i"].get<int>("source_node_id", 1));
     EXPECT_EQ(0, r["pop_e_i"].get<int>("target_node_id", 1));
 }
+
+TEST(hdf5_dataset, write_rows) {
+    // Larger than the default stack
+    std::vector<std::vector<double>> rows(2000, std::vector<double>(600));
+    for (unsigned i = 0; i < rows.size(); i++) {
+        for (unsigned j = 0; j < rows[i].size(); j++) {
+            rows[i][j] = i*1000. + j;
+        }
+    }
+    {
+        h5_file f("test_write.h5", true);
+        f.top_group_->add_dataset("rows", rows);
+        EXPECT_THROW(f.top_group_->add_dataset("ragged", std::vector<std::vector<int>>{{1, 2}, {3}}), sonata_exception);
+    }
+
+    auto f = H5Fopen("test_write.h5", H5F_ACC_RDONLY, H5P_DEFAULT);
+    auto d = H5Dopen(f, "rows", H5P_DEFAULT);
+    std::vector<double> data(2000*600);
+    H5Dread(d, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data());
+    H5Dclose(d);
+    H5Fclose(f);
+
+    EXPECT_EQ(0., data[0]);
+    EXPECT_EQ(1999*1000. + 599, data.back());
+    EXPECT_EQ(5*1000. + 7, data[5*600 + 7]);
+
+    std::remove("test_write.h5");
+}
+
+TEST(hdf5_dataset, props) {
+    h5_file_props file_props;
+    file_props.page_size = 1 << 16;
+    file_props.alignment = 4096;
+    file_props.alignment_threshold = 1024;
+
+    h5_dataset_props props;
+    props.chunk_dims = {16, 8};
+    props.deflate = 4;
+    props.shuffle = true;
+
+    std::vector<float> block(10*8);
+    for (unsigned i = 0; i < block.size(); i++) {
+        block[i] = i*0.5f;
+    }
+    {
+        h5_file f("test_props.h5", file_props);
+        auto d = f.top_group_->add_dataset("data", H5T_NATIVE_FLOAT, {0, 8}, props);
+
+        // Rows appended from a contiguous buffer, in two parts
+        d->append(block.data(), 4);
+        d->append(block.data() + 4*8, 6);
+        EXPECT_EQ(10, d->size());
+
+        auto contiguous = f.top_group_->add_dataset("contiguous", block.data(), {10, 8});
+        EXPECT_EQ(10, contiguous->size());
+    }
+
+    auto f = H5Fopen("test_props.h5", H5F_ACC_RDONLY, H5P_DEFAULT);
+
+    auto fcpl = H5Fget_create_plist(f);
+    H5F_fspace_strategy_t strategy;
+    hbool_t persist;
+    hsize_t threshold, page_size;
+    H5Pget_file_space_strategy(fcpl, &strategy, &persist, &threshold);
+    H5Pget_file_space_page_size(fcpl, &page_size);
+    H5Pclose(fcpl);
+    EXPECT_EQ(H5F_FSPACE_STRATEGY_PAGE, strategy);
+    EXPECT_EQ(hsize_t(1 << 16), page_size);
+
+    for (std::string name: {"data", "contiguous"}) {
+        auto d = H5Dopen(f, name.c_str(), H5P_DEFAULT);
+        std::vector<float> data(block.size());
+        H5Dread(d, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data());
+        EXPECT_EQ(block, data) << name;
+
+        auto dcpl = H5Dget_create_plist(d);
+        if (name == "data") {
+            EXPECT_EQ(H5D_CHUNKED, H5Pget_layout(dcpl));
+            EXPECT_EQ(2, H5Pget_nfilters(dcpl));
+        }
+        else {
+            EXPECT_EQ(H5D_CONTIGUOUS, H5Pget_layout(dcpl));
+            EXPECT_EQ(0, H5Pget_nfilters(dcpl));
+        }
+        H5Pclose(dcpl);
+        H5Dclose(d);
+    }
+    H5Fclose(f);
+
+    std::remove("test_props.h5");
+}
+
+TEST(hdf5_dataset, read_stats) {
+    // Nothing is recorded in builds without SONATA_H5_INSTRUMENTATION
+    if (!h5_instrumentation_available()) {
+        h5_instrumentation_enable(true);
+        EXPECT_FALSE(h5_instrumentation_enabled());
+        return;
+    }
+
+    std::vector<int> ids(100);
+    std::vector<double> weights(100);
+    std::vector<std::vector<int>> pairs(50, std::vector<int>(2));
+    for (unsigned i = 0; i < ids.size(); i++) {
+        ids[i] = i;
+        weights[i] = i*0.5;
+        pairs[i/2][i%2] = i;
+    }
+    {
+        h5_file f("test_read_stats.h5", true);
+        auto g = f.top_group_->add_group("edges");
+        g->add_dataset("ids", ids);
+        g->add_dataset("weights", weights);
+        g->add_dataset("pairs", pairs);
+    }
+
+    h5_file f("test_read_stats.h5");
+    h5_wrapper w(f.top_group_);
+    const auto& g = w["edges"];
+
+    // Reads while disabled are not recorded
+    h5_instrumentation_reset();
+    h5_instrumentation_enable(false);
+    EXPECT_EQ(ids, g.get<std::vector<int>>("ids"));
+    EXPECT_TRUE(h5_read_summary().empty());
+
+    h5_instrumentation_enable(true);
+    for (unsigned i = 0; i < 10; i++) {
+        EXPECT_EQ(int(i), g.get<int>("ids", i));
+    }
+    EXPECT_EQ(std::vector<int>(ids.begin() + 10, ids.begin() + 30), (g.get<std::vector<int>>("ids", 10, 30)));
+    EXPECT_EQ(weights, g.get<std::vector<double>>("weights"));
+    EXPECT_EQ(std::make_pair(6, 7), (g.get<std::pair<int,int>>("pairs", 3)));
+    EXPECT_EQ(std::make_pair(98, 99), (g.get<std::vector<std::pair<int,int>>>("pairs").back()));
+    EXPECT_EQ((std::vector<std::pair<int,int>>{{6, 7}, {8, 9}}), (g.get<std::vector<std::pair<int,int>>>("pairs", 3, 5)));
+    h5_instrumentation_enable(false);
+
+    auto summary = h5_read_summary();
+    ASSERT_EQ(3u, summary.size());
+    for (unsigned i = 1; i < summary.size(); i++) {
+        EXPECT_GE(summary[i-1].time, summary[i].time);
+    }
+
+    std::unordered_map<std::string, h5_read_stats> stats;
+    for (const auto& s: summary) {
+        stats[s.path] = s;
+    }
+    ASSERT_EQ(1u, stats.count("/edges/ids"));
+    ASSERT_EQ(1u, stats.count("/edges/weights"));
+    ASSERT_EQ(1u, stats.count("/edges/pairs"));
+
+    const auto& s_ids = stats["/edges/ids"];
+    EXPECT_EQ(11u, s_ids.reads);
+    EXPECT_EQ(30u, s_ids.elements);
+    EXPECT_EQ(30*sizeof(int), s_ids.bytes);
+    EXPECT_EQ(0u, s_ids.selections[(int)h5_selection::all]);
+    EXPECT_EQ(1u, s_ids.selections[(int)h5_selection::hyperslab]);
+    EXPECT_EQ(10u, s_ids.selections[(int)h5_selection::point]);
+
+    const auto& s_weights = stats["/edges/weights"];
+    EXPECT_EQ(1u, s_weights.reads);
+    EXPECT_EQ(100*sizeof(double), s_weights.bytes);
+    EXPECT_EQ(1u, s_weights.selections[(int)h5_selection::all]);
+
+    const auto& s_pairs = stats["/edges/pairs"];
+    EXPECT_EQ(3u, s_pairs.reads);
+    EXPECT_EQ(106u, s_pairs.elements);
+    EXPECT_EQ(1u, s_pairs.selections[(int)h5_selection::all]);
+    EXPECT_EQ(1u, s_pairs.selections[(int)h5_selection::hyperslab]);
+    EXPECT_EQ(1u, s_pairs.selections[(int)h5_selection::point]);
+
+    std::ostringstream table;
+    print_h5_read_summary(table, summary, 2);
+    EXPECT_NE(std::string::npos, table.str().find(summary[0].path));
+    EXPECT_EQ(std::string::npos, table.str().find(summary[2].path));
+
+    h5_instrumentation_reset();
+    EXPECT_TRUE(h5_read_summary().empty());
+
+    std::remove("test_read_stats.h5");
+}
+
+TEST(hdf5_dataset, cache_stats) {
+    if (!h5_instrumentation_available()) {
+        return;
+    }
+
+    // 100 rows in compressed chunks of 10 rows, read with a chunk cache of 2 chunks
+    std::vector<int> ids(100);
+    for (unsigned i = 0; i < ids.size(); i++) {
+        ids[i] = i;
+    }
+    {
+        h5_dataset_props props;
+        props.chunk_dims = {10};
+        props.deflate = 1;
+        h5_file("test_cache_stats.h5", true).top_group_->add_dataset("ids", ids.data(), {ids.size()}, props);
+    }
+    h5_cache_params cache;
+    cache.chunk_bytes = 2*10*sizeof(int);
+    set_h5_cache(cache, "test_cache_stats.h5", "/ids");
+
+    h5_instrumentation_reset();
+    h5_instrumentation_enable(true);
+    {
+        h5_file f("test_cache_stats.h5");
+        h5_wrapper w(f.top_group_);
+        for (int i: {0, 1, 15, 2, 25, 16}) {
+            EXPECT_EQ(i, w.get<int>("ids", i));
+        }
+        EXPECT_EQ(1u, h5_file_cache_summary().size());
+    }
+    h5_instrumentation_enable(false);
+
+    auto summary = h5_read_summary();
+    ASSERT_EQ(1u, summary.size());
+    EXPECT_EQ(2u, summary[0].chunk_hits);
+    EXPECT_EQ(4u, summary[0].chunk_misses);
+
+    // The hit rate of a closed file is kept
+    auto files = h5_file_cache_summary();
+    ASSERT_EQ(1u, files.size());
+    EXPECT_EQ("test_cache_stats.h5", files[0].file);
+    EXPECT_GE(files[0].metadata_hit_rate, 0.);
+    EXPECT_LE(files[0].metadata_hit_rate, 1.);
+
+    h5_instrumentation_reset();
+    reset_h5_cache();
+    std::remove("test_cache_stats.h5");
+}
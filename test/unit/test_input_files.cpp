@@ -0,0 +1,68 @@
+#include "../gtest.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include <sonata/input_files.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+#include "mpi_helper.hpp"
+
+using namespace sonata;
+
+TEST(input_files, mode) {
+    EXPECT_EQ(input_read_mode::all, parse_input_read_mode("all"));
+    EXPECT_EQ(input_read_mode::root, parse_input_read_mode("root"));
+    EXPECT_EQ(input_read_mode::node, parse_input_read_mode("node"));
+    EXPECT_THROW(parse_input_read_mode("rank"), sonata_exception);
+}
+
+TEST(input_files, read) {
+    std::string contents("type,pop\n1,a\n\0binary", 20);
+    std::ofstream("test_input_file.txt", std::ios::binary) << contents;
+
+    auto before = input_file_statistics();
+    EXPECT_EQ(contents, read_input_file("test_input_file.txt"));
+    EXPECT_FALSE(read_input_file("test_input_missing.txt"));
+
+    auto after = input_file_statistics();
+    EXPECT_EQ(before.read + 1, after.read);
+    EXPECT_EQ(before.received, after.received);
+    EXPECT_EQ(before.bytes + contents.size(), after.bytes);
+
+    std::remove("test_input_file.txt");
+}
+
+#ifdef ARB_MPI_ENABLED
+TEST(input_files, distributed) {
+    int rank = sonata::rank(MPI_COMM_WORLD);
+    int num_ranks = sonata::size(MPI_COMM_WORLD);
+
+    // Only rank 0 reads the file, the others receive its contents
+    std::string contents(100000, 'x');
+    if (rank == 0) {
+        std::ofstream("test_input_shared.txt") << contents;
+    }
+    sonata::barrier(MPI_COMM_WORLD);
+
+    share_input_files(input_read_mode::root, MPI_COMM_WORLD);
+    auto before = input_file_statistics();
+    EXPECT_EQ(contents, read_input_file("test_input_shared.txt"));
+    EXPECT_FALSE(read_input_file("test_input_missing.txt"));
+    auto after = input_file_statistics();
+    unshare_input_files();
+
+    EXPECT_EQ(before.read + (rank == 0), after.read);
+    EXPECT_EQ(before.received + (rank != 0 && num_ranks > 1), after.received);
+
+    // One rank per node reads the file
+    share_input_files(input_read_mode::node, MPI_COMM_WORLD);
+    EXPECT_EQ(contents, read_input_file("test_input_shared.txt"));
+    unshare_input_files();
+
+    sonata::barrier(MPI_COMM_WORLD);
+    if (rank == 0) {
+        std::remove("test_input_shared.txt");
+    }
+}
+#endif
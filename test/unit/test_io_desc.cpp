@@ -21,7 +21,7 @@
 
 using namespace sonata;
 
-io_desc simple_input() {
+io_desc simple_input(bool h5_clamps = false) {
     std::string datadir{DATADIR};
 
     auto nodes0 = datadir + "/nodes_0.h5";
@@ -42,13 +42,11 @@ io_desc simple_input() {
 
     std::vector<spike_in_info> spike_vec = {{spike_gp0, "pop_e"}, {spike_gp1, "pop_i"}};
 
-    auto clamp_input = datadir + "/clamp_input.csv";
-    auto clamp_electrode = datadir + "/clamp_electrode.csv";
+    std::string clamp_ext = h5_clamps ? ".h5" : ".csv";
+    auto clamp_input = datadir + "/clamp_input" + clamp_ext;
+    auto clamp_electrode = datadir + "/clamp_electrode" + clamp_ext;
 
-    csv_file clamp_in(clamp_input);
-    csv_file clamp_elec(clamp_electrode);
-
-    std::vector<current_clamp_info> clamp_vec = {{clamp_elec, clamp_in}};
+    std::vector<current_clamp_info> clamp_vec = {{clamp_electrode, clamp_input}};
 
     std::vector<probe_info> probe_vec;
     probe_vec.emplace_back("v", "pop_e", std::vector<unsigned>{0,2}, 0, 0.5, "file0");
@@ -61,8 +59,17 @@ io_desc simple_input() {
     return std::move(in);
 }
 
+io_desc simple_input_all_local(bool h5_clamps = false) {
+    auto in = simple_input(h5_clamps);
+
+    auto decomp = arb::group_description(arb::cell_kind::cable, {0,1,2,3,4,5}, arb::backend_kind::multicore);
+    in.build_local_maps({decomp});
+
+    return std::move(in);
+}
+
 TEST(io_desc, spikes) {
-    auto in = simple_input();
+    auto in = simple_input_all_local();
 
     for (unsigned i = 0; i < 4; i++) {
         auto spikes = in.get_spikes(i);
@@ -89,7 +96,7 @@ TEST(io_desc, spikes) {
 }
 
 TEST(io_desc, clamps) {
-    auto in = simple_input();
+    auto in = simple_input_all_local();
 
     auto clamps = in.get_current_clamps(0);
     auto loc = arb::mlocation{0,0.5};
@@ -99,11 +106,45 @@ TEST(io_desc, clamps) {
     EXPECT_EQ(0, clamps.front().delay);
     EXPECT_EQ(0.4, clamps.front().amplitude);
     EXPECT_EQ(5, clamps.front().duration);
+
+    for (unsigned i = 1; i < 6; i++) {
+        EXPECT_TRUE(in.get_current_clamps(i).empty());
+    }
+}
+
+TEST(io_desc, clamps_h5) {
+    auto in = simple_input_all_local(true);
+
+    auto clamps = in.get_current_clamps(0);
+    auto loc = arb::mlocation{0,0.5};
+
+    EXPECT_EQ(1, clamps.size());
+    EXPECT_EQ(loc, clamps.front().stim_loc);
+    EXPECT_EQ(0, clamps.front().delay);
+    EXPECT_EQ(0.4, clamps.front().amplitude);
+    EXPECT_EQ(5, clamps.front().duration);
+
+    clamps = in.get_current_clamps(4);
+    loc = arb::mlocation{1,0.25};
+
+    EXPECT_EQ(2, clamps.size());
+    EXPECT_EQ(loc, clamps[0].stim_loc);
+    EXPECT_EQ(10, clamps[0].delay);
+    EXPECT_EQ(0.25, clamps[0].amplitude);
+    EXPECT_EQ(20, clamps[0].duration);
+    EXPECT_EQ(loc, clamps[1].stim_loc);
+    EXPECT_EQ(50, clamps[1].delay);
+    EXPECT_EQ(-0.5, clamps[1].amplitude);
+    EXPECT_EQ(20, clamps[1].duration);
+
+    for (unsigned i: {1, 2, 3, 5}) {
+        EXPECT_TRUE(in.get_current_clamps(i).empty());
+    }
 }
 
 
 TEST(io_desc, probes) {
-    auto in = simple_input();
+    auto in = simple_input_all_local();
 
     EXPECT_EQ(2, in.get_probes(0).size());
     EXPECT_EQ(0, in.get_probes(1).size());
@@ -149,4 +190,49 @@ TEST(io_desc, probes) {
     p = in.get_probes(4);
     loc = arb::mlocation{0,0.3};
     EXPECT_EQ(loc, p.front().info.loc);
-}
\ No newline at end of file
+}
+
+TEST(io_desc, local_maps) {
+    auto in = simple_input();
+
+    // Nothing is loaded before the local maps are built
+    EXPECT_TRUE(in.get_spikes(0).empty());
+    EXPECT_TRUE(in.get_current_clamps(0).empty());
+    EXPECT_TRUE(in.get_probes(0).empty());
+    EXPECT_TRUE(in.get_probe_groups().empty());
+
+    auto decomp_0 = arb::group_description(arb::cell_kind::cable, {2,3}, arb::backend_kind::multicore);
+    auto decomp_1 = arb::group_description(arb::cell_kind::spike_source, {5}, arb::backend_kind::multicore);
+    in.build_local_maps({decomp_0, decomp_1});
+
+    // Non-local gids keep no entries
+    EXPECT_TRUE(in.get_spikes(0).empty());
+    EXPECT_TRUE(in.get_spikes(4).empty());
+    EXPECT_TRUE(in.get_current_clamps(0).empty());
+    EXPECT_TRUE(in.get_probes(0).empty());
+    EXPECT_TRUE(in.get_probes(4).empty());
+
+    EXPECT_EQ(5, in.get_spikes(2).size());
+    EXPECT_EQ(5, in.get_spikes(3).size());
+
+    EXPECT_EQ(1, in.get_probes(2).size());
+    EXPECT_EQ(1, in.get_probes(3).size());
+    EXPECT_EQ(1, in.get_probes(5).size());
+
+    auto probe_gps = in.get_probe_groups();
+    EXPECT_EQ(2, probe_gps.size());
+    EXPECT_EQ(2, probe_gps.at("file0").size());
+    EXPECT_EQ(1, probe_gps.at("file1").size());
+
+    EXPECT_EQ(cell_member_type({2, 0}), probe_gps.at("file0")[0]);
+    EXPECT_EQ(cell_member_type({5, 0}), probe_gps.at("file0")[1]);
+    EXPECT_EQ(cell_member_type({3, 0}), probe_gps.at("file1")[0]);
+
+    // The maps only grow with the local cells
+    auto local_bytes = in.memory_bytes();
+    EXPECT_LT(0u, local_bytes);
+    auto all = simple_input_all_local();
+    EXPECT_LT(local_bytes, all.memory_bytes());
+    in.build_local_maps({});
+    EXPECT_GT(local_bytes, in.memory_bytes());
+}
@@ -0,0 +1,106 @@
+#include "../gtest.h"
+
+#include <sonata/mechanism_registry.hpp>
+
+using namespace sonata;
+
+namespace {
+// Catalogue with mechanism "kca" of global "gamma" and "decay", and parameter "gbar"
+arb::mechanism_catalogue make_catalogue() {
+    arb::mechanism_info info;
+    info.globals["gamma"] = {};
+    info.globals["decay"] = {};
+    info.parameters["gbar"] = {};
+
+    arb::mechanism_catalogue cat;
+    cat.add("kca", info);
+    cat.add("pas", arb::mechanism_info{});
+    return cat;
+}
+}
+
+TEST(mechanism_registry, format) {
+    EXPECT_EQ("0", format_global_value(0));
+    EXPECT_EQ("0", format_global_value(-0.0));
+    EXPECT_EQ("0.036", format_global_value(0.036));
+    EXPECT_EQ("-70", format_global_value(-70));
+    EXPECT_EQ("1e-07", format_global_value(1e-7));
+    EXPECT_EQ("10000000000", format_global_value(1e10));
+    EXPECT_EQ(1.0/3, std::stod(format_global_value(1.0/3)));
+}
+
+TEST(mechanism_registry, derive) {
+    auto cat = make_catalogue();
+    mechanism_registry registry;
+
+    auto d = registry.derive(cat, arb::mechanism_desc("kca").set("gbar", 0.1).set("gamma", 0.05).set("decay", 80));
+    EXPECT_EQ("kca/decay=80,gamma=0.05", d.mech.name());
+    EXPECT_EQ(1u, d.mech.values().size());
+    EXPECT_EQ(0.1, d.mech.values().at("gbar"));
+
+    EXPECT_EQ("kca", registry.derive(cat, arb::mechanism_desc("kca").set("gbar", 0.2)).mech.name());
+    EXPECT_EQ("pas", registry.derive(cat, arb::mechanism_desc("pas").set("e", -70)).mech.name());
+
+    // Exact values without a tolerance
+    EXPECT_NE(d.mech.name(),
+              registry.derive(cat, arb::mechanism_desc("kca").set("gamma", 0.05 + 1e-9).set("decay", 80)).mech.name());
+}
+
+TEST(mechanism_registry, tolerance) {
+    auto cat = make_catalogue();
+    mechanism_registry registry(1e-3);
+
+    for (double v: {0.05, 0.0500001, 123.456, -7e-9}) {
+        EXPECT_NEAR(v, registry.cluster(v), 1e-3*std::abs(v));
+        EXPECT_EQ(registry.cluster(v), registry.cluster(registry.cluster(v)));
+    }
+    EXPECT_EQ(registry.cluster(0.05), registry.cluster(0.0500001));
+    EXPECT_NE(registry.cluster(0.05), registry.cluster(0.051));
+
+    auto a = registry.derive(cat, arb::mechanism_desc("kca").set("gamma", 0.05).set("gbar", 0.1));
+    auto b = registry.derive(cat, arb::mechanism_desc("kca").set("gamma", 0.0500001).set("gbar", 0.1000001));
+    EXPECT_EQ("kca/gamma=0.05", a.mech.name());
+    EXPECT_EQ(a.mech.name(), b.mech.name());
+
+    // Parameters other than globals are not clustered
+    EXPECT_EQ(0.1000001, b.mech.values().at("gbar"));
+    EXPECT_EQ(0.1000001, registry.cluster_globals(cat, arb::mechanism_desc("kca").set("gbar", 0.1000001)).values().at("gbar"));
+    EXPECT_EQ(0.05, registry.cluster_globals(cat, arb::mechanism_desc("kca").set("gamma", 0.0500001)).values().at("gamma"));
+}
+
+TEST(mechanism_registry, summary) {
+    mechanism_registry registry;
+    auto pas = registry.intern("pas");
+    auto kca_a = registry.intern("kca/gamma=0.05");
+    auto kca_b = registry.intern("kca/gamma=0.06");
+    EXPECT_EQ(pas, registry.intern("pas"));
+    EXPECT_EQ((std::vector<unsigned>{pas, kca_b}), registry.intern(std::vector<std::string>{"kca/gamma=0.06", "pas"}));
+    EXPECT_EQ(3u, registry.names().size());
+
+    registry.add_cell(0, {pas, kca_a});
+    registry.add_cell(1, {pas, kca_b});
+    registry.add_cell(2, {pas, kca_a});
+    registry.add_cell(3, {kca_b});
+    registry.add_cell(3, {pas});
+
+    std::vector<arb::group_description> groups = {
+        {arb::cell_kind::cable, {0, 1}, arb::backend_kind::multicore},
+        {arb::cell_kind::cable, {2, 3}, arb::backend_kind::multicore},
+        {arb::cell_kind::spike_source, {4}, arb::backend_kind::multicore}};
+
+    auto s = registry.summarise(groups);
+    EXPECT_EQ(3u, s.mechanisms);
+    EXPECT_EQ(2u, s.derived);
+    EXPECT_EQ((std::map<std::string, std::size_t>{{"kca", 2}}), s.variants);
+    EXPECT_EQ((std::vector<std::size_t>{3, 2, 0}), s.group_instances);
+    EXPECT_EQ(5u, s.total_instances());
+    EXPECT_EQ(3u, s.max_instances());
+
+    // Mechanisms only used by cells outside the groups are not counted
+    s = registry.summarise({groups[1]});
+    EXPECT_EQ(2u, s.mechanisms);
+    EXPECT_EQ(1u, s.derived);
+
+    registry.clear();
+    EXPECT_EQ(0u, registry.summarise(groups).total_instances());
+}
@@ -1,5 +1,7 @@
 #include "../gtest.h"
 
+#include <algorithm>
+
 #include <arbor/cable_cell.hpp>
 
 #include <sonata/hdf5_lib.hpp>
@@ -20,7 +22,7 @@
 
 using namespace sonata;
 
-model_desc simple_network() {
+model_desc simple_network(discretization_params discretization = {}) {
     std::string datadir{DATADIR};
 
     auto nodes0 = datadir + "/nodes_0.h5";
@@ -54,7 +56,7 @@ model_desc simple_network() {
     auto nf = csv_file(nodes3);
     auto n_base = csv_node_record({nf});
 
-    model_desc md(nodes, edges, n_base, e_base);
+    model_desc md(nodes, edges, n_base, e_base, discretization);
 
     return std::move(md);
 }
@@ -225,6 +227,14 @@ TEST(model_desc, connections) {
     EXPECT_NEAR(0.04,conns[1].weight,1e-5);
     EXPECT_NEAR(0.3,conns[1].delay,1e-5);
 
+    // The targets of the cells are at different locations: nothing to coalesce
+    md.build_source_and_target_maps({decomp}, [](const arb::mechanism_desc&) { return true; });
+    EXPECT_EQ(0u, md.num_coalesced_targets());
+    conns.clear();
+    md.get_connections(4, conns);
+    EXPECT_EQ(2, conns.size());
+    EXPECT_EQ("synapse@"+arb::cell_tag_type{"1"},conns[1].target.tag);
+
 }
 
 /*TEST(model_desc, morphologies) {
@@ -254,6 +264,24 @@ TEST(model_desc, cell_kinds) {
     EXPECT_EQ(arb::cell_kind::spike_source, kind);
 }
 
+TEST(model_desc, discretization) {
+    discretization_params discretization;
+    discretization.defaults.policy = "max-extent";
+    discretization.populations["pop_i"].cvs_per_branch = 10;
+    discretization.node_types[100].policy = "explicit";
+    discretization.node_types[100].locset = "(terminal)";
+
+    auto md = simple_network(discretization);
+    for (unsigned i = 0; i < 4; i++) {
+        EXPECT_EQ("explicit", md.get_discretization(i).policy);
+    }
+    EXPECT_EQ("fixed-per-branch", md.get_discretization(4).policy);
+    EXPECT_EQ(10, md.get_discretization(4).cvs_per_branch);
+    EXPECT_EQ("max-extent", md.get_discretization(5).policy);
+
+    EXPECT_EQ("fixed-per-branch", simple_network().get_discretization(0).policy);
+}
+
 TEST(model_desc, density_mechs) {
     auto md = simple_network();
 
@@ -304,3 +332,35 @@ TEST(model_desc, density_mechs) {
     auto mechs_per_sec = md.get_density_mechs(5);
     EXPECT_EQ(0, mechs_per_sec.size());
 }
+
+// Graph of simple_network: edges 0->4, 2->4, 4->1, 1->3, 5->0 and 5->2
+static void check_cell_graph() {
+    auto md = simple_network();
+    auto g = md.build_cell_graph(false);
+
+    ASSERT_EQ(6u, g.size());
+    std::vector<std::vector<cell_gid_type>> expected = {{4, 5}, {3, 4}, {4, 5}, {1}, {0, 1, 2}, {0, 2}};
+    for (cell_gid_type gid = 0; gid < 6; gid++) {
+        std::vector<cell_gid_type> neighbours(g.neighbours.begin() + g.divs[gid], g.neighbours.begin() + g.divs[gid + 1]);
+        std::sort(neighbours.begin(), neighbours.end());
+        EXPECT_EQ(expected[gid], neighbours) << gid;
+    }
+    EXPECT_EQ(std::vector<unsigned>(g.neighbours.size(), 1), g.weights);
+
+    std::vector<unsigned> synapses;
+    for (const auto& f: g.features) {
+        synapses.push_back(f.synapses);
+    }
+    EXPECT_EQ(std::vector<unsigned>({1, 1, 1, 1, 2, 0}), synapses);
+}
+
+TEST(model_desc, cell_graph) {
+    check_cell_graph();
+}
+
+#ifdef ARB_MPI_ENABLED
+// Run with mpirun: every rank reads the index rows of a share of the nodes
+TEST(model_desc, cell_graph_distributed) {
+    check_cell_graph();
+}
+#endif
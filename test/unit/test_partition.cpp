@@ -0,0 +1,149 @@
+#include "../gtest.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include <sonata/partition.hpp>
+#include <sonata/sonata_exceptions.hpp>
+
+using namespace sonata;
+
+namespace {
+// `num_clusters` fully connected clusters of `cluster_size` cable cells, in a ring
+// with one edge between consecutive clusters; the gids of the clusters are interleaved
+cell_graph make_clusters(unsigned num_clusters, unsigned cluster_size) {
+    cell_graph g;
+    unsigned n = num_clusters*cluster_size;
+    g.kinds.assign(n, arb::cell_kind::cable);
+    g.mech_sets.assign(n, 0);
+    g.costs.assign(n, 1);
+
+    auto gid = [&](unsigned cluster, unsigned i) { return i*num_clusters + cluster; };
+
+    std::vector<std::pair<cell_gid_type, cell_gid_type>> edges;
+    for (unsigned c = 0; c < num_clusters; c++) {
+        for (unsigned i = 0; i < cluster_size; i++) {
+            for (unsigned j = i + 1; j < cluster_size; j++) {
+                edges.push_back(std::minmax(gid(c, i), gid(c, j)));
+            }
+        }
+        edges.push_back(std::minmax(gid(c, 0), gid((c + 1)%num_clusters, 1)));
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<cell_gid_type> sources, targets;
+    for (auto e: edges) {
+        sources.push_back(e.first);
+        targets.push_back(e.second);
+    }
+    set_adjacency(g, sources, targets, std::vector<unsigned>(edges.size(), 1));
+    return g;
+}
+}
+
+TEST(partition, adjacency) {
+    cell_graph g;
+    g.kinds.assign(4, arb::cell_kind::cable);
+    set_adjacency(g, {0, 0, 1}, {1, 3, 3}, {2, 1, 5});
+
+    EXPECT_EQ(std::vector<unsigned>({0, 2, 4, 4, 6}), g.divs);
+    EXPECT_EQ(std::vector<cell_gid_type>({1, 3, 0, 3, 0, 1}), g.neighbours);
+    EXPECT_EQ(std::vector<unsigned>({2, 1, 2, 5, 1, 5}), g.weights);
+
+    EXPECT_THROW(set_adjacency(g, {1}, {1}, {1}), sonata_exception);
+    EXPECT_THROW(set_adjacency(g, {1}, {4}, {1}), sonata_exception);
+}
+
+TEST(partition, clusters) {
+    // Every part ends up with whole clusters: only the ring edges are cut
+    auto g = make_clusters(4, 10);
+    partition_info info;
+    info.method = "graph";
+    info.iterations = 20;
+    info.imbalance = 0.1;
+
+    auto parts = partition_cells(g, 4, info);
+    auto stats = evaluate_partition(g, parts, 4);
+
+    EXPECT_EQ(4u*45 + 4, stats.total_edges);
+    EXPECT_EQ(4u, stats.cut_edges);
+    EXPECT_LE(stats.imbalance(), 1.1);
+
+    // Contiguous gid ranges cut the interleaved clusters
+    info.iterations = 0;
+    auto ranges = evaluate_partition(g, partition_cells(g, 4, info), 4);
+    EXPECT_GT(ranges.cut_edges, stats.cut_edges);
+    EXPECT_EQ(1., ranges.imbalance());
+}
+
+TEST(partition, balance) {
+    // The cost limit holds with uneven costs, and parts are never emptied
+    auto g = make_clusters(3, 8);
+    for (unsigned gid = 0; gid < g.size(); gid++) {
+        g.costs[gid] = gid%3 == 0? 5: 0.5;
+    }
+    partition_info info;
+    info.imbalance = 0.2;
+
+    for (unsigned num_parts: {1u, 2u, 3u, 5u}) {
+        auto parts = partition_cells(g, num_parts, info);
+        auto stats = evaluate_partition(g, parts, num_parts);
+        double total = std::accumulate(g.costs.begin(), g.costs.end(), 0.);
+        EXPECT_NEAR(total/num_parts, stats.mean_cost, 1e-12);
+        for (auto c: stats.part_costs) {
+            EXPECT_GT(c, 0);
+        }
+        if (num_parts > 1) {
+            EXPECT_LE(stats.max_cost, (1 + info.imbalance)*total/num_parts + 5);
+        }
+    }
+}
+
+TEST(partition, positions) {
+    // Without edges, the parts follow the positions of the cells rather than their gids
+    cell_graph g;
+    unsigned n = 16;
+    g.kinds.assign(n, arb::cell_kind::cable);
+    g.mech_sets.assign(n, 0);
+    for (unsigned gid = 0; gid < n; gid++) {
+        g.positions.push_back({(gid%2? 100.: 0.) + gid*0.1, 0., 0.});
+    }
+    set_adjacency(g, {}, {}, {});
+
+    partition_info info;
+    info.use_positions = true;
+    auto parts = partition_cells(g, 2, info);
+    for (unsigned gid = 0; gid < n; gid++) {
+        EXPECT_EQ(parts[gid], parts[gid%2]) << gid;
+    }
+    EXPECT_NE(parts[0], parts[1]);
+
+    info.use_positions = false;
+    parts = partition_cells(g, 2, info);
+    EXPECT_EQ(0u, parts[0]);
+    EXPECT_EQ(1u, parts[n-1]);
+}
+
+TEST(partition, cell_groups) {
+    cell_graph g;
+    g.kinds = {arb::cell_kind::cable, arb::cell_kind::spike_source, arb::cell_kind::cable, arb::cell_kind::cable,
+               arb::cell_kind::cable, arb::cell_kind::spike_source, arb::cell_kind::cable, arb::cell_kind::cable};
+    g.mech_sets = {0, 0, 1, 0, 1, 0, 1, 0};
+    std::vector<unsigned> parts = {0, 0, 0, 0, 0, 0, 0, 1};
+
+    // Groups never mix mechanism sets or kinds
+    auto groups = make_cell_groups(g, parts, 0, 2, arb::backend_kind::multicore);
+    ASSERT_EQ(4u, groups.size());
+    EXPECT_EQ(std::vector<cell_gid_type>({0, 3}), groups[0].gids);
+    EXPECT_EQ(std::vector<cell_gid_type>({2}), groups[1].gids);
+    EXPECT_EQ(std::vector<cell_gid_type>({4, 6}), groups[2].gids);
+    EXPECT_EQ(std::vector<cell_gid_type>({1, 5}), groups[3].gids);
+    EXPECT_EQ(arb::cell_kind::spike_source, groups[3].kind);
+
+    // All cable cells in one group on gpu
+    groups = make_cell_groups(g, parts, 0, 2, arb::backend_kind::gpu);
+    ASSERT_EQ(2u, groups.size());
+    EXPECT_EQ(std::vector<cell_gid_type>({0, 3, 2, 4, 6}), groups[0].gids);
+    EXPECT_EQ(arb::backend_kind::gpu, groups[0].backend);
+    EXPECT_EQ(arb::backend_kind::multicore, groups[1].backend);
+}
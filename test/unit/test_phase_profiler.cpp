@@ -0,0 +1,70 @@
+#include "../gtest.h"
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <arbor/version.hpp>
+
+#include <sonata/phase_profiler.hpp>
+
+#include "mpi_helper.hpp"
+
+using namespace sonata;
+
+TEST(phase_profiler, phases) {
+    phase_profiler p;
+    p.start("sleep");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    p.start("alloc");
+    std::vector<char> block(64 << 20, 1);
+    p.stop();
+    p.stop();
+    p.record("cells", 12);
+
+    auto report = p.report();
+    ASSERT_EQ(2u, report["phases"].size());
+    EXPECT_EQ(1, report["ranks"].get<int>());
+
+    const auto& sleep = report["phases"][0];
+    EXPECT_EQ("sleep", sleep["name"].get<std::string>());
+    EXPECT_GE(sleep["wall_max"].get<double>(), 0.02);
+    EXPECT_EQ(sleep["wall_min"].get<double>(), sleep["wall_max"].get<double>());
+
+    // The block is resident at the end of the phase
+    const auto& alloc = report["phases"][1];
+    EXPECT_GE(alloc["rss_max_mib"].get<double>(), 64.);
+    EXPECT_GE(alloc["peak_rss_max_mib"].get<double>(), alloc["rss_max_mib"].get<double>());
+    EXPECT_GE(report["wall_total"].get<double>(), sleep["wall_max"].get<double>());
+
+    EXPECT_EQ(12., report["statistics"]["cells"]["sum"].get<double>());
+
+    std::ostringstream table;
+    phase_profiler::print(table, report);
+    EXPECT_NE(std::string::npos, table.str().find("alloc"));
+}
+
+#ifdef ARB_MPI_ENABLED
+TEST(phase_profiler, distributed) {
+    int rank = sonata::rank(MPI_COMM_WORLD);
+    int num_ranks = sonata::size(MPI_COMM_WORLD);
+
+    // Rank r spends about r*10 ms in the phase
+    phase_profiler p(MPI_COMM_WORLD);
+    p.start("work");
+    std::this_thread::sleep_for(std::chrono::milliseconds(10*rank));
+    p.stop();
+    p.record("cells", rank + 1);
+
+    auto report = p.report();
+    EXPECT_EQ(num_ranks, report["ranks"].get<int>());
+    EXPECT_GE(report["phases"][0]["wall_max"].get<double>(), 0.01*(num_ranks - 1));
+    EXPECT_LE(report["phases"][0]["wall_min"].get<double>(), report["phases"][0]["wall_mean"].get<double>());
+
+    const auto& cells = report["statistics"]["cells"];
+    EXPECT_EQ(num_ranks*(num_ranks + 1)/2., cells["sum"].get<double>());
+    EXPECT_EQ(1., cells["min"].get<double>());
+    EXPECT_EQ(double(num_ranks), cells["max"].get<double>());
+}
+#endif
@@ -0,0 +1,326 @@
+#include "../gtest.h"
+
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+
+#include <arbor/sampling.hpp>
+#include <arbor/util/any_ptr.hpp>
+#include <arbor/version.hpp>
+
+#include <sonata/async_writer.hpp>
+#include <sonata/hdf5_lib.hpp>
+#include <sonata/report_writer.hpp>
+#include <sonata/sonata_exceptions.hpp>
+#include <sonata/spike_writer.hpp>
+
+#include "mpi_helper.hpp"
+
+using namespace sonata;
+
+namespace {
+// Probes of two populations: pop_a with gids 0-9, pop_b with gids 10-14
+// 2 probes on every third cell
+std::vector<std::pair<cell_member_type, mlocation>> make_probes() {
+    std::vector<std::pair<cell_member_type, mlocation>> probes;
+    for (cell_gid_type gid = 0; gid < 15; gid += 3) {
+        for (cell_lid_type idx = 0; idx < 2; idx++) {
+            probes.push_back({{gid, idx}, mlocation{idx, 0.25 + 0.5*idx}});
+        }
+    }
+    return probes;
+}
+
+double sample_value(cell_member_type probe, unsigned step) {
+    return probe.gid*100. + probe.index*10. + step*0.5;
+}
+
+// Report sampled every 0.1 ms between 0.5 and 2 ms: 15 time steps
+report_info make_info(const std::string& file, bool single_precision = false) {
+    return {file, 0.1, 0.5, 2.0, single_precision};
+}
+
+// Sample `probes` epoch by epoch through the samplers of the report, as during a simulation;
+// `epoch(t0, t1)` is called after every epoch, before the report is flushed. The longest epoch is 1.18 ms
+void run(report_writer& w, const std::vector<std::pair<cell_member_type, mlocation>>& probes,
+         async_writer* writer = nullptr, const std::function<void(double, double)>& epoch = {},
+         double epoch_length = std::numeric_limits<double>::infinity()) {
+    w.open(probes, epoch_length);
+    w.set_async_writer(writer);
+    const auto& info = w.info();
+
+    std::vector<arb::sampler_function> samplers;
+    for (const auto& p: probes) {
+        samplers.push_back(w.sampler(w.column(p.first)));
+    }
+
+    double t0 = 0;
+    for (double t1: {0.7, 1.3, 1.32, 2.5}) {
+        for (unsigned i = 0; i < probes.size(); i++) {
+            const auto& probe = probes[i].first;
+
+            std::vector<double> values;
+            std::vector<arb::sample_record> records;
+            for (unsigned step = 0; step < 15; step++) {
+                double t = info.start_time + step*info.dt;
+                if (t < t0 || t >= t1) continue;
+                values.push_back(sample_value(probe, step));
+                records.push_back({t, arb::util::any_ptr()});
+            }
+            for (unsigned j = 0; j < records.size(); j++) {
+                records[j].data = (const double*)&values[j];
+            }
+            samplers[i](arb::probe_metadata{probe, 0, 0, {}}, records.size(), records.data());
+        }
+        if (epoch) {
+            epoch(t0, t1);
+        }
+        w.flush(t1);
+        t0 = t1;
+    }
+    w.close();
+}
+
+// Raw content of a dataset, in its stored type
+std::vector<char> read_bytes(const std::string& file, const std::string& path) {
+    auto f = H5Fopen(file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    auto d = H5Dopen(f, path.c_str(), H5P_DEFAULT);
+    auto type = H5Dget_type(d);
+    auto space = H5Dget_space(d);
+
+    std::vector<char> bytes(H5Sget_simple_extent_npoints(space)*H5Tget_size(type));
+    H5Dread(d, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, bytes.data());
+
+    H5Sclose(space);
+    H5Tclose(type);
+    H5Dclose(d);
+    H5Fclose(f);
+    return bytes;
+}
+
+template <typename T>
+std::vector<T> read_values(const std::string& file, const std::string& path) {
+    auto bytes = read_bytes(file, path);
+    std::vector<T> values(bytes.size()/sizeof(T));
+    std::copy(bytes.begin(), bytes.end(), (char*)values.data());
+    return values;
+}
+
+const std::vector<std::string> report_datasets = {
+    "data",
+    "mapping/time",
+    "mapping/element_ids",
+    "mapping/element_pos",
+    "mapping/node_ids",
+    "mapping/index_pointers"
+};
+}
+
+TEST(report_writer, serial) {
+    report_writer w(make_info("test_report.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+    run(w, make_probes());
+
+    // pop_a: gids 0, 3, 6, 9
+    EXPECT_EQ(std::vector<int>({0, 3, 6, 9}), read_values<int>("test_report.h5", "reports/pop_a/mapping/node_ids"));
+    EXPECT_EQ(std::vector<int>({0, 2, 4, 6, 8}), read_values<int>("test_report.h5", "reports/pop_a/mapping/index_pointers"));
+    EXPECT_EQ(std::vector<int>({0, 1, 0, 1, 0, 1, 0, 1}), read_values<int>("test_report.h5", "reports/pop_a/mapping/element_ids"));
+
+    // pop_b: gid 12 (2 in population)
+    EXPECT_EQ(std::vector<int>({2}), read_values<int>("test_report.h5", "reports/pop_b/mapping/node_ids"));
+    EXPECT_EQ(std::vector<int>({0, 2}), read_values<int>("test_report.h5", "reports/pop_b/mapping/index_pointers"));
+    EXPECT_EQ(std::vector<double>({0.25, 0.75}), read_values<double>("test_report.h5", "reports/pop_b/mapping/element_pos"));
+
+    // Time as (start, stop, dt)
+    EXPECT_EQ(std::vector<double>({0.5, 2.0, 0.1}), read_values<double>("test_report.h5", "reports/pop_a/mapping/time"));
+
+    // One row per time step, one column per trace sorted by (gid, index)
+    auto data = read_values<double>("test_report.h5", "reports/pop_b/data");
+    ASSERT_EQ(30u, data.size());
+    for (unsigned step = 0; step < 15; step++) {
+        EXPECT_EQ(sample_value({12, 0}, step), data[step*2]);
+        EXPECT_EQ(sample_value({12, 1}, step), data[step*2 + 1]);
+    }
+    auto data_a = read_values<double>("test_report.h5", "reports/pop_a/data");
+    ASSERT_EQ(120u, data_a.size());
+    EXPECT_EQ(sample_value({9, 1}, 14), data_a.back());
+
+    std::remove("test_report.h5");
+}
+
+TEST(report_writer, single_precision) {
+    report_writer w(make_info("test_report.h5", true), {"pop_a", "pop_b"}, {0, 10, 15});
+    run(w, make_probes());
+
+    auto data = read_values<float>("test_report.h5", "reports/pop_b/data");
+    ASSERT_EQ(30u, data.size());
+    EXPECT_EQ(float(sample_value({12, 1}, 14)), data.back());
+
+    std::remove("test_report.h5");
+}
+
+TEST(report_writer, compressed) {
+    auto info = make_info("test_report_compressed.h5");
+    info.deflate = 6;
+    report_writer compressed(info, {"pop_a", "pop_b"}, {0, 10, 15});
+    run(compressed, make_probes());
+
+    report_writer serial(make_info("test_report.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+    run(serial, make_probes());
+
+    for (std::string pop: {"pop_a", "pop_b"}) {
+        auto path = "reports/" + pop + "/data";
+        EXPECT_EQ(read_bytes("test_report.h5", path), read_bytes("test_report_compressed.h5", path)) << path;
+    }
+
+    std::remove("test_report.h5");
+    std::remove("test_report_compressed.h5");
+}
+
+TEST(report_writer, epoch_buffers) {
+    // Buffers holding the steps of the longest epoch give the same report as buffers holding all of them
+    report_writer epoch(make_info("test_report_epoch.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+    run(epoch, make_probes(), nullptr, {}, 1.18);
+
+    report_writer serial(make_info("test_report.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+    run(serial, make_probes());
+
+    for (std::string pop: {"pop_a", "pop_b"}) {
+        auto path = "reports/" + pop + "/data";
+        EXPECT_EQ(read_bytes("test_report.h5", path), read_bytes("test_report_epoch.h5", path)) << path;
+    }
+
+    // Epochs longer than the report was opened for fail instead of growing the buffers
+    {
+        report_writer short_epoch(make_info("test_report_short.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+        EXPECT_THROW(run(short_epoch, make_probes(), nullptr, {}, 0.3), sonata_exception);
+    }
+
+    std::remove("test_report.h5");
+    std::remove("test_report_epoch.h5");
+    std::remove("test_report_short.h5");
+}
+
+TEST(report_writer, async) {
+    // The report written on the writer thread is identical to the report written synchronously
+    async_writer writer(1);
+    report_writer async(make_info("test_report_async.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+    run(async, make_probes(), &writer);
+
+    report_writer serial(make_info("test_report.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+    run(serial, make_probes());
+
+    for (std::string pop: {"pop_a", "pop_b"}) {
+        for (const auto& d: report_datasets) {
+            auto path = "reports/" + pop + "/" + d;
+            EXPECT_EQ(read_bytes("test_report.h5", path), read_bytes("test_report_async.h5", path)) << path;
+        }
+    }
+    EXPECT_GT(writer.get_stats().num_tasks, 0u);
+
+    std::remove("test_report.h5");
+    std::remove("test_report_async.h5");
+}
+
+#ifdef ARB_MPI_ENABLED
+// Run with mpirun: the report written by all ranks, each with the traces of the cells it owns,
+// is identical to the report written by a single rank with all traces
+TEST(report_writer, distributed) {
+    int rank = sonata::rank(MPI_COMM_WORLD);
+    int num_ranks = sonata::size(MPI_COMM_WORLD);
+
+    auto probes = make_probes();
+
+    std::vector<std::pair<cell_member_type, mlocation>> local_probes;
+    for (const auto& p: probes) {
+        if (int(p.first.gid/3) % num_ranks == rank) {
+            local_probes.push_back(p);
+        }
+    }
+    // With MPI_THREAD_MULTIPLE the blocks are packed, gathered and written on the writer thread
+    async_writer writer;
+    report_writer distributed(make_info("test_report_distributed.h5"), {"pop_a", "pop_b"}, {0, 10, 15}, MPI_COMM_WORLD);
+    run(distributed, local_probes, &writer);
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided == MPI_THREAD_MULTIPLE) {
+        EXPECT_GT(writer.get_stats().num_tasks, 0u);
+    }
+
+    if (rank == 0) {
+        report_writer serial(make_info("test_report_serial.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+        run(serial, probes);
+
+        for (std::string pop: {"pop_a", "pop_b"}) {
+            for (const auto& d: report_datasets) {
+                auto path = "reports/" + pop + "/" + d;
+                EXPECT_EQ(read_bytes("test_report_serial.h5", path), read_bytes("test_report_distributed.h5", path)) << path;
+            }
+        }
+        std::remove("test_report_serial.h5");
+        std::remove("test_report_distributed.h5");
+    }
+    sonata::barrier(MPI_COMM_WORLD);
+}
+
+// Run with mpirun: a report written by all ranks (collectively with parallel hdf5) while rank 0 streams spikes
+// on the same writer thread, as in arbata; hdf5 must only be entered from one thread at a time
+TEST(report_writer, distributed_with_spikes) {
+    int rank = sonata::rank(MPI_COMM_WORLD);
+    int num_ranks = sonata::size(MPI_COMM_WORLD);
+
+    auto probes = make_probes();
+    std::vector<std::pair<cell_member_type, mlocation>> local_probes;
+    for (const auto& p: probes) {
+        if (int(p.first.gid/3) % num_ranks == rank) {
+            local_probes.push_back(p);
+        }
+    }
+
+    async_writer writer(1);
+    std::unique_ptr<spike_writer> spikes;
+    if (rank == 0) {
+        // Every batch of spikes is written on the writer thread
+        spikes = std::make_unique<spike_writer>("test_report_spikes.h5", spike_order::by_time,
+                                                std::vector<std::string>{"pop_a", "pop_b"},
+                                                std::vector<unsigned>{0, 10, 15}, 1);
+        spikes->set_async_writer(&writer);
+    }
+
+    report_writer distributed(make_info("test_report_distributed.h5"), {"pop_a", "pop_b"}, {0, 10, 15}, MPI_COMM_WORLD);
+    run(distributed, local_probes, &writer, [&](double t0, double t1) {
+        if (spikes) {
+            std::vector<arb::spike> batch;
+            for (cell_gid_type gid = 0; gid < 15; gid++) {
+                arb::spike s;
+                s.source = {gid, 0};
+                s.time = t0 + (t1 - t0)*gid/15.;
+                batch.push_back(s);
+            }
+            spikes->append(batch);
+        }
+    });
+
+    if (rank == 0) {
+        writer.drain();
+        spikes->close();
+        EXPECT_EQ(60u, spikes->num_spikes());
+
+        report_writer serial(make_info("test_report_serial.h5"), {"pop_a", "pop_b"}, {0, 10, 15});
+        run(serial, probes);
+        for (std::string pop: {"pop_a", "pop_b"}) {
+            for (const auto& d: report_datasets) {
+                auto path = "reports/" + pop + "/" + d;
+                EXPECT_EQ(read_bytes("test_report_serial.h5", path), read_bytes("test_report_distributed.h5", path)) << path;
+            }
+        }
+        EXPECT_EQ(60u, read_values<double>("test_report_spikes.h5", "spikes/pop_a/timestamps").size() +
+                       read_values<double>("test_report_spikes.h5", "spikes/pop_b/timestamps").size());
+
+        std::remove("test_report_serial.h5");
+        std::remove("test_report_distributed.h5");
+        std::remove("test_report_spikes.h5");
+    }
+    sonata::barrier(MPI_COMM_WORLD);
+}
+#endif
@@ -0,0 +1,115 @@
+#include "../gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <arbor/spike.hpp>
+
+#include <sonata/spike_sort.hpp>
+
+using namespace sonata;
+
+namespace {
+// Spikes arriving epoch by epoch, in time order within an epoch; many equal times
+std::vector<arb::spike> make_spikes(std::size_t n, unsigned num_gids, unsigned first_gid = 0) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<unsigned> gid(first_gid, first_gid + num_gids - 1);
+    std::uniform_int_distribution<unsigned> step(0, 400);
+
+    std::vector<arb::spike> spikes(n);
+    std::size_t epoch_size = 1000;
+    for (std::size_t i = 0; i < n; i++) {
+        spikes[i].source = {gid(gen), 0};
+        spikes[i].time = (i/epoch_size)*10. + step(gen)*0.025;
+    }
+    for (std::size_t i = 0; i < n; i += epoch_size) {
+        auto last = spikes.begin() + std::min(n, i + epoch_size);
+        std::sort(spikes.begin() + i, last, [](const auto& a, const auto& b) { return a.time < b.time; });
+    }
+    return spikes;
+}
+
+bool same_spikes(const std::vector<arb::spike>& a, const std::vector<arb::spike>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto& x, const auto& y) {
+        return x.source.gid == y.source.gid && x.time == y.time;
+    });
+}
+
+void expect_sorted(std::vector<arb::spike> spikes, spike_order order, unsigned num_threads) {
+    auto expected = spikes;
+    std::sort(expected.begin(), expected.end(), spike_less{order});
+
+    sort_spikes(spikes, order, num_threads);
+    EXPECT_TRUE(same_spikes(expected, spikes));
+}
+}
+
+TEST(spike_sort, order_none) {
+    auto spikes = make_spikes(1000, 10);
+    auto expected = spikes;
+    sort_spikes(spikes, spike_order::none);
+    EXPECT_TRUE(same_spikes(expected, spikes));
+}
+
+TEST(spike_sort, small) {
+    for (auto order: {spike_order::by_id, spike_order::by_time}) {
+        expect_sorted({}, order, 1);
+        expect_sorted(make_spikes(1, 3), order, 1);
+        expect_sorted(make_spikes(1000, 37), order, 1);
+    }
+}
+
+TEST(spike_sort, radix) {
+    for (auto order: {spike_order::by_id, spike_order::by_time}) {
+        // Counting sort on the gids
+        expect_sorted(make_spikes(100000, 1000), order, 1);
+        expect_sorted(make_spikes(100000, 1, 1234567), order, 1);
+        // Gids spanning more than one radix digit
+        expect_sorted(make_spikes(100000, 1u << 20, 1000), order, 1);
+    }
+}
+
+TEST(spike_sort, epochs) {
+    // Epochs in time order, unsorted within an epoch; the last spikes of an epoch have the time of the first
+    // ones of the next, so that those epochs are sorted together
+    for (std::size_t epoch_size: {100, 1000, 50000}) {
+        auto spikes = make_spikes(200000, 1000);
+        std::mt19937 gen(7);
+        for (std::size_t i = 0; i < spikes.size(); i += epoch_size) {
+            std::shuffle(spikes.begin() + i, spikes.begin() + std::min(spikes.size(), i + epoch_size), gen);
+        }
+        expect_sorted(spikes, spike_order::by_time, 1);
+        expect_sorted(spikes, spike_order::by_time, 3);
+        expect_sorted(spikes, spike_order::by_id, 1);
+    }
+}
+
+TEST(spike_sort, negative_times) {
+    auto spikes = make_spikes(50000, 100);
+    for (auto& s: spikes) {
+        s.time -= 100.;
+    }
+    spikes[7].time = -0.;
+    spikes[8].time = 0.;
+    expect_sorted(spikes, spike_order::by_time, 1);
+    expect_sorted(spikes, spike_order::by_id, 1);
+}
+
+TEST(spike_sort, parallel) {
+    for (auto order: {spike_order::by_id, spike_order::by_time}) {
+        for (unsigned num_threads: {2, 3, 4, 7}) {
+            expect_sorted(make_spikes(500000, 5000), order, num_threads);
+        }
+    }
+}
+
+TEST(spike_sort, range) {
+    // Sorting part of an array leaves the rest untouched
+    auto spikes = make_spikes(100000, 100);
+    auto expected = spikes;
+    std::sort(expected.begin() + 1000, expected.begin() + 90000, spike_less{spike_order::by_time});
+
+    sort_spikes(spikes.data() + 1000, spikes.data() + 90000, spike_order::by_time, 2);
+    EXPECT_TRUE(same_spikes(expected, spikes));
+}
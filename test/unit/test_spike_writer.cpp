@@ -0,0 +1,166 @@
+#include "../gtest.h"
+
+#include <cstdio>
+
+#include <arbor/spike.hpp>
+#include <arbor/version.hpp>
+
+#include <sonata/hdf5_lib.hpp>
+#include <sonata/spike_writer.hpp>
+
+#include "mpi_helper.hpp"
+
+using namespace sonata;
+
+namespace {
+// Spikes of two populations: pop_a with gids 0-9, pop_b with gids 10-14
+std::vector<std::vector<arb::spike>> spike_epochs() {
+    std::vector<std::vector<arb::spike>> epochs;
+    for (unsigned e = 0; e < 10; e++) {
+        std::vector<arb::spike> epoch;
+        for (unsigned i = 0; i < 5; i++) {
+            arb::spike s;
+            s.source = {(e*7 + i*11) % 15, 0};
+            s.time = e + ((i*3 + e) % 5)*0.1;
+            epoch.push_back(s);
+        }
+        epochs.push_back(epoch);
+    }
+    return epochs;
+}
+
+struct written_spikes {
+    std::vector<int> node_ids;
+    std::vector<double> timestamps;
+};
+
+written_spikes read_population(const std::string& file, const std::string& pop) {
+    h5_file f(file);
+    h5_wrapper top(f.top_group_);
+    const auto& p = top["spikes"][pop];
+    auto n = p.dataset_size("timestamps");
+    return {p.get<std::vector<int>>("node_ids"), p.get<std::vector<double>>("timestamps", 0, n)};
+}
+
+void write(spike_order order, std::size_t flush_size, async_writer* writer = nullptr,
+           const std::string& file = "test_spikes.h5") {
+    spike_writer w(file, order, {"pop_a", "pop_b"}, {0, 10, 15}, flush_size);
+    w.set_async_writer(writer);
+    for (const auto& epoch: spike_epochs()) {
+        w.append(epoch);
+    }
+    EXPECT_EQ(50u, w.num_spikes());
+    w.close();
+}
+}
+
+TEST(spike_writer, order_from_string) {
+    EXPECT_EQ(spike_order::by_time, spike_order_from_string("time"));
+    EXPECT_EQ(spike_order::by_time, spike_order_from_string("by_time"));
+    EXPECT_EQ(spike_order::by_id, spike_order_from_string("by_id"));
+    EXPECT_EQ(spike_order::by_id, spike_order_from_string("id"));
+    EXPECT_EQ(spike_order::none, spike_order_from_string("none"));
+}
+
+TEST(spike_writer, by_time) {
+    for (std::size_t flush_size: {1, 7, 1000}) {
+        write(spike_order::by_time, flush_size);
+
+        auto a = read_population("test_spikes.h5", "pop_a");
+        auto b = read_population("test_spikes.h5", "pop_b");
+        EXPECT_EQ(50u, a.node_ids.size() + b.node_ids.size());
+        EXPECT_TRUE(std::is_sorted(a.timestamps.begin(), a.timestamps.end()));
+        EXPECT_TRUE(std::is_sorted(b.timestamps.begin(), b.timestamps.end()));
+        for (auto id: b.node_ids) {
+            EXPECT_LT(id, 5);
+        }
+    }
+    std::remove("test_spikes.h5");
+}
+
+TEST(spike_writer, by_id) {
+    for (std::size_t flush_size: {1, 7, 1000}) {
+        write(spike_order::by_id, flush_size);
+
+        for (std::string pop: {"pop_a", "pop_b"}) {
+            auto s = read_population("test_spikes.h5", pop);
+            std::vector<std::pair<int, double>> spikes;
+            for (unsigned i = 0; i < s.node_ids.size(); i++) {
+                spikes.emplace_back(s.node_ids[i], s.timestamps[i]);
+            }
+            EXPECT_TRUE(std::is_sorted(spikes.begin(), spikes.end()));
+        }
+
+        // The scratch file of the sorted runs is removed
+        EXPECT_EQ(nullptr, std::fopen("test_spikes.h5.runs", "r"));
+    }
+    std::remove("test_spikes.h5");
+}
+
+TEST(spike_writer, async) {
+    // Spikes written on the writer thread are identical to spikes written synchronously
+    async_writer writer(1);
+    for (auto order: {spike_order::none, spike_order::by_id, spike_order::by_time}) {
+        for (std::size_t flush_size: {1, 7, 1000}) {
+            write(order, flush_size, &writer, "test_spikes_async.h5");
+            write(order, flush_size);
+
+            for (std::string pop: {"pop_a", "pop_b"}) {
+                auto expected = read_population("test_spikes.h5", pop);
+                auto s = read_population("test_spikes_async.h5", pop);
+                EXPECT_EQ(expected.node_ids, s.node_ids);
+                EXPECT_EQ(expected.timestamps, s.timestamps);
+            }
+        }
+    }
+    EXPECT_GT(writer.get_stats().num_tasks, 0u);
+
+    std::remove("test_spikes.h5");
+    std::remove("test_spikes_async.h5");
+}
+
+#ifdef ARB_MPI_ENABLED
+TEST(spike_writer, distributed) {
+    int rank = sonata::rank(MPI_COMM_WORLD);
+    int num_ranks = sonata::size(MPI_COMM_WORLD);
+
+    for (auto order: {spike_order::by_id, spike_order::by_time}) {
+        // Every rank appends the spikes of the gids it owns
+        parallel_spike_writer w("test_parallel_spikes.h5", order, {"pop_a", "pop_b"}, {0, 10, 15}, MPI_COMM_WORLD);
+        for (const auto& epoch: spike_epochs()) {
+            std::vector<arb::spike> local;
+            for (const auto& s: epoch) {
+                if (int(s.source.gid) % num_ranks == rank) {
+                    local.push_back(s);
+                }
+            }
+            w.append(local);
+        }
+        w.close();
+        sonata::barrier(MPI_COMM_WORLD);
+
+        std::size_t total = 0;
+        for (std::string pop: {"pop_a", "pop_b"}) {
+            auto s = read_population("test_parallel_spikes.h5", pop);
+            std::vector<std::pair<int, double>> by_id;
+            std::vector<std::pair<double, int>> by_time;
+            for (unsigned i = 0; i < s.node_ids.size(); i++) {
+                by_id.emplace_back(s.node_ids[i], s.timestamps[i]);
+                by_time.emplace_back(s.timestamps[i], s.node_ids[i]);
+            }
+            if (order == spike_order::by_id) {
+                EXPECT_TRUE(std::is_sorted(by_id.begin(), by_id.end()));
+            }
+            else {
+                EXPECT_TRUE(std::is_sorted(by_time.begin(), by_time.end()));
+            }
+            total += s.node_ids.size();
+        }
+        EXPECT_EQ(50u, total);
+        sonata::barrier(MPI_COMM_WORLD);
+    }
+    if (rank == 0) {
+        std::remove("test_parallel_spikes.h5");
+    }
+}
+#endif
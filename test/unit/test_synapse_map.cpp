@@ -0,0 +1,67 @@
+#include "../gtest.h"
+
+#include <sonata/synapse_map.hpp>
+
+using namespace sonata;
+
+namespace {
+std::pair<target_type, unsigned> target(cell_lid_type branch, double pos, arb::mechanism_desc m, unsigned edge) {
+    return {target_type(branch, pos, std::move(m)), edge};
+}
+}
+
+TEST(synapse_map, coalesce) {
+    auto expsyn = arb::mechanism_desc("expsyn").set("tau", 2).set("e", 0);
+    auto expsyn_slow = arb::mechanism_desc("expsyn").set("tau", 5).set("e", 0);
+    auto exp2syn = arb::mechanism_desc("exp2syn").set("tau1", 0.5).set("tau2", 2);
+
+    std::vector<std::pair<target_type, unsigned>> targets = {
+        target(0, 0.5, expsyn, 10),
+        target(0, 0.5, expsyn, 11),      // same as 0
+        target(0, 0.5, expsyn_slow, 12), // other parameters
+        target(1, 0.5, expsyn, 13),      // other location
+        target(0, 0.5, exp2syn, 14),
+        target(0, 0.5, exp2syn, 15),     // not coalesced
+        target(0, 0.5, expsyn, 16),      // same as 0
+    };
+
+    auto linear = [](const arb::mechanism_desc& m) { return m.name() == "expsyn"; };
+    auto m = coalesce_targets(targets, linear);
+    EXPECT_EQ(std::vector<unsigned>({0, 2, 3, 4, 5}), m.synapses);
+    EXPECT_EQ(std::vector<unsigned>({0, 0, 1, 2, 3, 4, 0}), m.index);
+    EXPECT_EQ(2u, m.num_coalesced());
+
+    // Without coalescing every target has its own synapse
+    auto none = coalesce_targets(targets, {});
+    EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3, 4, 5, 6}), none.synapses);
+    EXPECT_EQ(none.synapses, none.index);
+    EXPECT_EQ(0u, none.num_coalesced());
+}
+
+TEST(synapse_map, sort) {
+    auto expsyn = arb::mechanism_desc("expsyn").set("tau", 2);
+    auto exp2syn = arb::mechanism_desc("exp2syn").set("tau1", 0.5);
+
+    std::vector<std::pair<target_type, unsigned>> targets = {
+        target(2, 0.1, expsyn, 10),
+        target(0, 0.9, exp2syn, 11),
+        target(0, 0.5, expsyn, 12),
+        target(2, 0.1, expsyn, 13),
+        target(0, 0.2, expsyn, 14),
+    };
+    auto m = coalesce_targets(targets, [](const arb::mechanism_desc& m) { return m.name() == "expsyn"; });
+    EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 0, 3}), m.index);
+
+    // exp2syn first, then expsyn by branch and position
+    sort_synapses(m, targets);
+    EXPECT_EQ(std::vector<unsigned>({1, 4, 2, 0}), m.synapses);
+    EXPECT_EQ(std::vector<unsigned>({3, 0, 2, 3, 1}), m.index);
+
+    // Every target still has a synapse at its own location
+    for (unsigned i = 0; i < targets.size(); i++) {
+        const auto& t = targets[m.synapses[m.index[i]]].first;
+        EXPECT_EQ(targets[i].first.segment, t.segment);
+        EXPECT_EQ(targets[i].first.position, t.position);
+        EXPECT_EQ(targets[i].first.synapse.name(), t.synapse.name());
+    }
+}